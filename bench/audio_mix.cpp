@@ -0,0 +1,123 @@
+// Times the audio mixing kernels, checking the SIMD ones against scalar, then plays a synthetic many-track
+// timeline through the audio engine into a null output in real time and prints its metrics.
+//
+// usage: bench_audio_mix [tracks] [seconds] [block frames] [output.wav]
+
+#include "audio_engine.h"
+#include "audio_output.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t SAMPLE_RATE = 48000;
+
+/// A sine per resource, at 44.1 kHz for odd resources and 48 kHz for even ones, so half the tracks resample.
+class SineDecoder : public AudioDecoder {
+public:
+	uint32_t sampleRate(uint32_t resource) override { return resource % 2 ? 44100 : 48000; }
+
+	size_t decode(uint32_t resource, int64_t firstFrame, float* out, size_t frames) override {
+		const double frequency = 110.0 * (1 + resource % 12);
+		const double rate = sampleRate(resource);
+		for (size_t i = 0; i < frames; i++) {
+			const float value = 0.05f * static_cast<float>(std::sin(6.283185307 * frequency * double(firstFrame + int64_t(i)) / rate));
+			out[2 * i] = value;
+			out[2 * i + 1] = value;
+		}
+		return frames;
+	}
+};
+
+template<typename F>
+double millisecondsPer(size_t runs, F&& f) {
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < runs; i++) f();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / double(runs);
+}
+
+bool benchKernels() {
+	constexpr size_t FRAMES = 1 << 16;
+	constexpr size_t RUNS = 200;
+	std::vector<float> in(2 * (FRAMES + 2));
+	for (size_t i = 0; i < in.size(); i++) in[i] = static_cast<float>(std::sin(0.001 * double(i)));
+	const GainRamp ramp = {0.5f, 0.7f, 1e-6f, -2e-6f};
+	const double step = 44100.0 / 48000.0;
+
+	std::vector<const AudioMixKernels*> levels = {&scalarAudioMixKernels()};
+	if (simdAudioMixKernels()) levels.push_back(simdAudioMixKernels());
+
+	std::vector<std::vector<float>> mixed, resampled;
+	std::cout << "kernels, " << FRAMES << " stereo frames:\n";
+	for (const AudioMixKernels* kernels : levels) {
+		std::vector<float> out(2 * FRAMES, 0.0f);
+		const double mix_ms = millisecondsPer(RUNS, [&]() { kernels->mix(out.data(), in.data(), FRAMES, ramp); });
+		mixed.push_back(out);
+
+		std::fill(out.begin(), out.end(), 0.0f);
+		const double resample_ms =
+			millisecondsPer(RUNS, [&]() { kernels->mixResampled(out.data(), in.data(), 0.25, step, FRAMES, ramp); });
+		resampled.push_back(out);
+
+		std::cout << "  " << kernels->name << ":\tmix " << mix_ms << " ms, resample+mix " << resample_ms << " ms\n";
+	}
+
+	for (size_t i = 1; i < levels.size(); i++) {
+		if (mixed[i] != mixed[0] || resampled[i] != resampled[0]) {
+			std::cout << levels[i]->name << " does not match scalar!\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const size_t track_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32;
+	const double seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 3.0;
+	const size_t block_frames = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 256;
+	const char* wav_path = argc > 4 ? argv[4] : nullptr;
+
+	if (!benchKernels()) return EXIT_FAILURE;
+
+	// Every track cuts between two resources every couple of seconds, at 30 fps
+	Project project;
+	for (size_t i = 0; i < 2 * track_count; i++) project.resources.push_back({"r" + std::to_string(i), "r.wav"});
+	for (size_t t = 0; t < track_count; t++) {
+		Track track{"audio-" + std::to_string(t), TrackKind::Audio, {}, {}, true};
+		for (int64_t frame = 0, cut = 0; frame < 30 * 600; frame += 45 + int64_t(t) * 7, cut++) {
+			track.segments.push_back({uint32_t(2 * t + cut % 2), frame, frame / 2, Segment::UNTIL_NEXT});
+		}
+		project.tracks.push_back(std::move(track));
+	}
+	const Timeline timeline(project);
+
+	SineDecoder decoder;
+	std::unique_ptr<AudioOutput> output;
+	if (wav_path) output = std::make_unique<WavFileAudioOutput>(wav_path, SAMPLE_RATE, block_frames);
+	else output = std::make_unique<NullAudioOutput>(SAMPLE_RATE, block_frames);
+
+	AudioEngine engine(timeline, decoder, *output);
+	for (size_t t = 0; t < track_count; t++) engine.setTrackGain(t, 1.0f, t % 2 ? -0.5f : 0.5f);
+
+	std::cout << track_count << " tracks, " << block_frames << "-frame blocks at " << SAMPLE_RATE << " Hz, playing "
+	          << seconds << " s with a seek halfway\n";
+	engine.seek(0);
+	engine.play();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds / 2));
+	engine.seek(30 * 60);
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds / 2));
+	engine.pause();
+
+	engine.metrics().print(std::cout);
+	std::cout << "playhead at frame " << engine.playheadFrame() << "\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+// Composites 1080p frames from several layers on the CPU with every available set of blend kernels, in both
+// pixel formats, checking each against the scalar result. Before that, it blends every pairing of special half values
+// (zeros, subnormals, infinities and NaNs with assorted signs and payloads) and checks that every set of kernels
+// writes the same bits as the scalar ones.
+//
+// usage: bench_composite [layer count] [thread count] [frame count]
+
+#include "compositor.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t WIDTH = 1920;
+constexpr uint32_t HEIGHT = 1080;
+
+/// Random colors; alpha is mostly opaque or clear with some soft edges, like real layers.
+std::vector<uint8_t> makeLayer(PixelFormat format, std::mt19937& rng) {
+	std::vector<uint8_t> pixels(size_t(WIDTH) * HEIGHT * bytesPerPixel(format));
+	for (size_t p = 0; p < size_t(WIDTH) * HEIGHT; p++) {
+		const uint32_t r = rng();
+		const uint32_t alpha = (r >> 24) < 96 ? 255 : (r >> 24) < 160 ? 0 : (r >> 16) & 0xff;
+		const uint32_t channels[4] = {r & 0xff, (r >> 8) & 0xff, (r >> 16) & 0xff, alpha};
+		for (int c = 0; c < 4; c++) {
+			if (format == PixelFormat::Rgba8) {
+				pixels[p * 4 + c] = static_cast<uint8_t>(channels[c]);
+			} else {
+				const uint16_t half = floatToHalf(channels[c] / 255.0f);
+				std::memcpy(&pixels[p * 8 + c * 2], &half, sizeof(half));
+			}
+		}
+	}
+	return pixels;
+}
+
+/// Blend every combination of special values as source color, source alpha, destination color and destination
+/// alpha with each set of kernels. Returns whether they all wrote exactly what the scalar kernels did.
+bool specialValuesMatch() {
+	const uint16_t values[] = {0x0000, 0x8000, 0x0001, 0x83ff, 0x3800, 0x3c00, 0xbc00, 0x7bff,
+	                           0x7c00, 0xfc00, 0x7e00, 0xfe00, 0x7d00, 0x7e01, 0xffff, 0x7c01};
+	std::vector<uint16_t> src, dst;
+	for (uint16_t sc : values) {
+		for (uint16_t sa : values) {
+			for (uint16_t dc : values) {
+				for (uint16_t da : values) {
+					src.insert(src.end(), {sc, dc, sa, sa});
+					dst.insert(dst.end(), {dc, sc, da, da});
+				}
+			}
+		}
+	}
+	const size_t count = src.size() / 4;
+
+	bool match = true;
+	for (float opacity : {1.0f, 0.5f}) {
+		for (size_t mode = 0; mode < BLEND_MODE_COUNT; mode++) {
+			std::vector<uint16_t> reference = dst;
+			scalarBlendKernels().rgba16f[mode](reference.data(), src.data(), count, opacity);
+			for (SimdLevel level : {SimdLevel::Sse2, SimdLevel::Avx2, SimdLevel::Neon}) {
+				const BlendKernels* kernels = Compositor::kernelsFor(level);
+				if (!kernels) continue;
+				std::vector<uint16_t> result = dst;
+				kernels->rgba16f[mode](result.data(), src.data(), count, opacity);
+				size_t differing = 0;
+				for (size_t i = 0; i < result.size(); i++) differing += result[i] != reference[i];
+				if (differing > 0) {
+					std::cout << "rgba16f " << kernels->name << ", blend mode " << mode << ", opacity " << opacity
+					          << ": MISMATCH on special values: " << differing << " values\n";
+					match = false;
+				}
+			}
+		}
+	}
+	return match;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const size_t layer_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8;
+	const size_t thread_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+	const size_t frame_count = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 20;
+
+	std::unique_ptr<ThreadPool> pool;
+	if (thread_count != 1) pool = std::make_unique<ThreadPool>(thread_count);
+	std::cout << "layers: " << layer_count << " at " << WIDTH << "x" << HEIGHT << ", "
+	          << (pool ? pool->size() + 1 : 1) << " threads, best kernels: "
+	          << Compositor::kernelsFor(Compositor::bestSimdLevel())->name << "\n";
+
+	bool mismatch = !specialValuesMatch();
+	for (PixelFormat format : {PixelFormat::Rgba8, PixelFormat::Rgba16f}) {
+		std::mt19937 rng(42);
+		const size_t stride = WIDTH * bytesPerPixel(format);
+		const std::vector<uint8_t> background = makeLayer(format, rng);
+		std::vector<std::vector<uint8_t>> layer_pixels;
+		std::vector<CompositeLayer> layers;
+		for (size_t i = 0; i < layer_count; i++) {
+			layer_pixels.push_back(makeLayer(format, rng));
+			layers.push_back({layer_pixels.back().data(), stride, static_cast<BlendMode>(i % BLEND_MODE_COUNT), i % 4 == 3 ? 0.5f : 1.0f});
+		}
+
+		std::vector<uint8_t> reference;
+		for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2, SimdLevel::Neon}) {
+			if (!Compositor::kernelsFor(level)) continue;
+			Compositor compositor(pool.get(), level);
+
+			std::vector<uint8_t> target;
+			auto start = std::chrono::steady_clock::now();
+			for (size_t f = 0; f < frame_count; f++) {
+				target = background;
+				compositor.composite({target.data(), WIDTH, HEIGHT, stride, format}, layers);
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			std::cout << (format == PixelFormat::Rgba8 ? "rgba8   " : "rgba16f ") << compositor.kernelName() << ":\t"
+			          << std::chrono::duration<double, std::milli>(end - start).count() / static_cast<double>(frame_count)
+			          << " ms/frame";
+			if (reference.empty()) {
+				reference = target;
+			} else {
+				const ImageDifference difference = Compositor::compare({target.data(), WIDTH, HEIGHT, stride, format},
+				                                                       {reference.data(), WIDTH, HEIGHT, stride, format});
+				if (difference.differingValues > 0) {
+					std::cout << "  MISMATCH: " << difference.differingValues << " values, up to " << difference.maxDifference;
+					mismatch = true;
+				}
+			}
+			std::cout << "\n";
+		}
+	}
+	return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,524 @@
+// Runs every compute effect kernel (compute_effects.h) on the GPU and compares its output with a reference computed
+// on the CPU: NV12 and I420 conversion with both matrices and ranges, bilinear and Lanczos resizing up and down,
+// and 3D LUT grading at full and half strength. It runs headless, and the kernels are compiled by the pipeline
+// registry as they are in the app.
+//
+// Exits with a failure if any channel of any output is further than a few 8-bit steps from its reference. The
+// slack covers the GPU's sub-texel filtering precision and its float rounding.
+//
+// usage: bench_compute_effects
+
+#include "compute_effects.h"
+#include "gpu_memory.h"
+#include "shaders.h"
+#include "thread_pool.h"
+#include "vulkan_driver.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int TOLERANCE = 3; // In 8-bit steps
+const VkExtent2D FRAME = {64, 48};
+const uint32_t LUT_SIZE = 17;
+
+using Pixels = std::vector<uint8_t>;
+
+/// An image in device memory, with what the kernels need to know of it.
+struct TestImage {
+	EffectImage effect;
+	GpuAllocation memory;
+	uint32_t depth = 1;
+	uint32_t texelSize = 4;
+};
+
+uint32_t texelSize(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_R8_UNORM: return 1;
+	case VK_FORMAT_R8G8_UNORM: return 2;
+	default: return 4;
+	}
+}
+
+/// Creates images, fills them and reads them back, with one-off submissions on a single queue.
+class Harness {
+public:
+	Harness(VulkanDriver& driver, GpuMemory& memory)
+		: m_device(driver.device()), m_queue(driver.graphicsQueue()), m_memory(memory) {
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		pool_info.queueFamilyIndex = driver.queueFamilies().graphicsFamily.value();
+
+		if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
+
+	~Harness() {
+		vkQueueWaitIdle(m_queue);
+		for (auto& image : m_images) {
+			vkDestroyImageView(m_device, image->effect.view, nullptr);
+			vkDestroyImage(m_device, image->effect.image, nullptr);
+			m_memory.free(image->memory);
+		}
+		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	}
+
+	Harness(const Harness&) = delete;
+	Harness& operator=(const Harness&) = delete;
+
+	/// A `width`×`height`(×`depth`) image in VK_IMAGE_LAYOUT_GENERAL, holding `pixels` (tightly packed texels)
+	/// unless they are empty. 3D images are sampled; 2D images can also be storage images.
+	const TestImage& image(VkFormat format, uint32_t width, uint32_t height, const Pixels& pixels = {}, uint32_t depth = 1) {
+		auto image = std::make_unique<TestImage>();
+		image->effect.extent = {width, height};
+		image->depth = depth;
+		image->texelSize = texelSize(format);
+
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+		image_info.format = format;
+		image_info.extent = {width, height, depth};
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if (format == VK_FORMAT_R8G8B8A8_UNORM && depth == 1) image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_device, &image_info, nullptr, &image->effect.image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create image!");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(m_device, image->effect.image, &requirements);
+		image->memory = m_memory.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceLayout::Optimal);
+		vkBindImageMemory(m_device, image->effect.image, image->memory.memory, image->memory.offset);
+
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = image->effect.image;
+		view_info.viewType = depth > 1 ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = format;
+		view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+		if (vkCreateImageView(m_device, &view_info, nullptr, &image->effect.view) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create image view!");
+		}
+
+		m_images.push_back(std::move(image));
+		const TestImage& result = *m_images.back();
+		if (!pixels.empty()) upload(result, pixels);
+		return result;
+	}
+
+	/// The contents of `image` once `after` is done.
+	Pixels read(const TestImage& image, const TimelineWait& after) {
+		Staging staging(*this, byteSize(image));
+
+		submit([&](VkCommandBuffer cmd) {
+			VkBufferImageCopy region = copyRegion(image);
+			vkCmdCopyImageToBuffer(cmd, image.effect.image, VK_IMAGE_LAYOUT_GENERAL, staging.buffer, 1, &region);
+
+			VkBufferMemoryBarrier to_host{};
+			to_host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			to_host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			to_host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			to_host.buffer = staging.buffer;
+			to_host.offset = 0;
+			to_host.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			                     0, nullptr, 1, &to_host, 0, nullptr);
+		}, after);
+
+		const auto* bytes = static_cast<const uint8_t*>(staging.memory.mapped);
+		return Pixels(bytes, bytes + byteSize(image));
+	}
+
+private:
+	/// A host visible buffer for copies, released when it goes out of scope.
+	struct Staging {
+		Harness& harness;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		GpuAllocation memory;
+
+		Staging(Harness& h, VkDeviceSize size) : harness(h) {
+			VkBufferCreateInfo buffer_info{};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.size = size;
+			buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if (vkCreateBuffer(harness.m_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create staging buffer!");
+			}
+
+			VkMemoryRequirements requirements;
+			vkGetBufferMemoryRequirements(harness.m_device, buffer, &requirements);
+			memory = harness.m_memory.allocate(requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			                                   ResourceLayout::Linear);
+			vkBindBufferMemory(harness.m_device, buffer, memory.memory, memory.offset);
+		}
+
+		~Staging() {
+			vkDestroyBuffer(harness.m_device, buffer, nullptr);
+			harness.m_memory.free(memory);
+		}
+	};
+
+	VkDevice m_device;
+	VkQueue m_queue;
+	GpuMemory& m_memory;
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	std::vector<std::unique_ptr<TestImage>> m_images;
+
+	static VkDeviceSize byteSize(const TestImage& image) {
+		return VkDeviceSize(image.effect.extent.width) * image.effect.extent.height * image.depth * image.texelSize;
+	}
+
+	static VkBufferImageCopy copyRegion(const TestImage& image) {
+		VkBufferImageCopy region{};
+		region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		region.imageExtent = {image.effect.extent.width, image.effect.extent.height, image.depth};
+		return region;
+	}
+
+	/// Fill `image` with `pixels` and leave it in GENERAL, readable by the kernels.
+	void upload(const TestImage& image, const Pixels& pixels) {
+		if (pixels.size() != byteSize(image)) throw std::runtime_error("pixels do not match the image's size!");
+		Staging staging(*this, pixels.size());
+		std::memcpy(staging.memory.mapped, pixels.data(), pixels.size());
+
+		submit([&](VkCommandBuffer cmd) {
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image.effect.image;
+			barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			                     0, nullptr, 0, nullptr, 1, &barrier);
+
+			VkBufferImageCopy region = copyRegion(image);
+			vkCmdCopyBufferToImage(cmd, staging.buffer, image.effect.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			// Later submissions on this queue dispatch the kernels reading it
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			                     0, nullptr, 0, nullptr, 1, &barrier);
+		});
+	}
+
+	/// Record a command buffer with `record`, submit it after `wait` and block until the queue is idle.
+	void submit(const std::function<void(VkCommandBuffer)>& record, const TimelineWait& wait = {}) {
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = m_commandPool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(m_device, &alloc_info, &cmd) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffer!");
+		}
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(cmd, &begin_info);
+		record(cmd);
+		if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+
+		VkTimelineSemaphoreSubmitInfo timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_info.waitSemaphoreValueCount = 1;
+		timeline_info.pWaitSemaphoreValues = &wait.value;
+
+		VkSubmitInfo submit_info{};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		if (wait.value != 0) {
+			submit_info.pNext = &timeline_info;
+			submit_info.waitSemaphoreCount = 1;
+			submit_info.pWaitSemaphores = &wait.semaphore;
+			submit_info.pWaitDstStageMask = &wait.stages;
+		}
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &cmd;
+
+		if (vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit!");
+		}
+		vkQueueWaitIdle(m_queue);
+		vkFreeCommandBuffers(m_device, m_commandPool, 1, &cmd);
+	}
+};
+
+/// Deterministic noise, so a failure can be reproduced.
+Pixels noise(size_t size, uint32_t seed) {
+	Pixels pixels(size);
+	uint32_t state = seed * 2654435761u + 1;
+	for (auto& p : pixels) {
+		state = state * 1664525u + 1013904223u;
+		p = static_cast<uint8_t>(state >> 24);
+	}
+	return pixels;
+}
+
+uint8_t toUnorm(float value) {
+	return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+/// As yuv_to_rgba.comp. `u` and `v` are indexed by chroma texel, with `stride` bytes between a texel's U and the
+/// next texel's.
+Pixels referenceYuv(const Pixels& luma, const uint8_t* u, const uint8_t* v, size_t stride, YuvMatrix matrix, YuvRange range) {
+	const std::array<float, 16> m = ComputeEffects::yuvToRgbMatrix(matrix, range);
+	const uint32_t chroma_width = (FRAME.width + 1) / 2;
+	Pixels rgba(size_t(FRAME.width) * FRAME.height * 4);
+	for (uint32_t y = 0; y < FRAME.height; y++) {
+		for (uint32_t x = 0; x < FRAME.width; x++) {
+			const size_t c = (size_t(y / 2) * chroma_width + x / 2) * stride;
+			const float yuv[4] = {luma[size_t(y) * FRAME.width + x] / 255.0f, u[c] / 255.0f, v[c] / 255.0f, 1.0f};
+			uint8_t* out = &rgba[(size_t(y) * FRAME.width + x) * 4];
+			for (int i = 0; i < 3; i++) {
+				out[i] = toUnorm(m[i] * yuv[0] + m[4 + i] * yuv[1] + m[8 + i] * yuv[2] + m[12 + i] * yuv[3]);
+			}
+			out[3] = 255;
+		}
+	}
+	return rgba;
+}
+
+float texel(const Pixels& image, uint32_t width, uint32_t height, int x, int y, int channel) {
+	x = std::clamp(x, 0, int(width) - 1);
+	y = std::clamp(y, 0, int(height) - 1);
+	return image[(size_t(y) * width + x) * 4 + channel] / 255.0f;
+}
+
+float lanczos(float x) {
+	const float PI = 3.14159265359f, LOBES = 3.0f;
+	if (std::abs(x) < 1e-5f) return 1.0f;
+	if (std::abs(x) >= LOBES) return 0.0f;
+	const float px = PI * x;
+	return LOBES * std::sin(px) * std::sin(px / LOBES) / (px * px);
+}
+
+/// As resize.comp: the sampler's bilinear filter with clamped edges, or Lanczos-3 widened when shrinking.
+Pixels referenceResize(const Pixels& source, VkExtent2D size, ResizeFilter filter) {
+	const uint32_t sw = FRAME.width, sh = FRAME.height;
+	Pixels out(size_t(size.width) * size.height * 4);
+	const float scale_x = float(sw) / size.width, scale_y = float(sh) / size.height;
+
+	for (uint32_t y = 0; y < size.height; y++) {
+		for (uint32_t x = 0; x < size.width; x++) {
+			float color[4] = {};
+			if (filter == ResizeFilter::Bilinear) {
+				const float fx = (x + 0.5f) / size.width * sw - 0.5f, fy = (y + 0.5f) / size.height * sh - 0.5f;
+				const int x0 = int(std::floor(fx)), y0 = int(std::floor(fy));
+				const float ax = fx - x0, ay = fy - y0;
+				for (int c = 0; c < 4; c++) {
+					const float top = texel(source, sw, sh, x0, y0, c) * (1 - ax) + texel(source, sw, sh, x0 + 1, y0, c) * ax;
+					const float bottom = texel(source, sw, sh, x0, y0 + 1, c) * (1 - ax) + texel(source, sw, sh, x0 + 1, y0 + 1, c) * ax;
+					color[c] = top * (1 - ay) + bottom * ay;
+				}
+			} else {
+				const float filter_x = std::clamp(scale_x, 1.0f, 4.0f), filter_y = std::clamp(scale_y, 1.0f, 4.0f);
+				const float cx = (x + 0.5f) * scale_x - 0.5f, cy = (y + 0.5f) * scale_y - 0.5f;
+				const int bx = int(std::floor(cx)), by = int(std::floor(cy));
+				const int rx = int(std::ceil(3.0f * filter_x)), ry = int(std::ceil(3.0f * filter_y));
+				float weight_sum = 0.0f;
+				for (int dy = 1 - ry; dy <= ry; dy++) {
+					const float wy = lanczos((float(by + dy) - cy) / filter_y);
+					if (wy == 0.0f) continue;
+					for (int dx = 1 - rx; dx <= rx; dx++) {
+						const float w = wy * lanczos((float(bx + dx) - cx) / filter_x);
+						for (int c = 0; c < 4; c++) color[c] += texel(source, sw, sh, bx + dx, by + dy, c) * w;
+						weight_sum += w;
+					}
+				}
+				for (float& c : color) c /= weight_sum;
+			}
+			for (int c = 0; c < 4; c++) out[(size_t(y) * size.width + x) * 4 + c] = toUnorm(color[c]);
+		}
+	}
+	return out;
+}
+
+/// As apply_lut.comp: a trilinear lookup between the table's entries, blended with the original by `strength`.
+Pixels referenceLut(const Pixels& source, const Pixels& lut, float strength) {
+	const uint32_t n = LUT_SIZE;
+	auto entry = [&](uint32_t r, uint32_t g, uint32_t b, int c) {
+		return lut[((size_t(b) * n + g) * n + r) * 4 + c] / 255.0f;
+	};
+
+	Pixels out(source.size());
+	for (size_t p = 0; p < source.size(); p += 4) {
+		float position[3], fraction[3];
+		uint32_t base[3];
+		for (int c = 0; c < 3; c++) {
+			position[c] = source[p + c] / 255.0f * (n - 1);
+			base[c] = std::min(uint32_t(position[c]), n - 2);
+			fraction[c] = position[c] - base[c];
+		}
+		for (int c = 0; c < 3; c++) {
+			float graded = 0.0f;
+			for (int corner = 0; corner < 8; corner++) {
+				const uint32_t dr = corner & 1, dg = (corner >> 1) & 1, db = corner >> 2;
+				const float w = (dr ? fraction[0] : 1 - fraction[0]) * (dg ? fraction[1] : 1 - fraction[1]) *
+				                (db ? fraction[2] : 1 - fraction[2]);
+				graded += w * entry(base[0] + dr, base[1] + dg, base[2] + db, c);
+			}
+			const float original = source[p + c] / 255.0f;
+			out[p + c] = toUnorm(original + (graded - original) * strength);
+		}
+		out[p + 3] = source[p + 3];
+	}
+	return out;
+}
+
+/// Print how far `gpu` is from `reference`; false if further than the tolerance.
+bool compare(const std::string& name, const Pixels& gpu, const Pixels& reference) {
+	int max_error = 0;
+	for (size_t i = 0; i < gpu.size(); i++) max_error = std::max(max_error, std::abs(int(gpu[i]) - int(reference[i])));
+	const bool pass = gpu.size() == reference.size() && max_error <= TOLERANCE;
+	std::cout << name << ":\tmax error " << max_error << (pass ? "" : "  FAILED") << "\n";
+	return pass;
+}
+
+const char* matrixName(YuvMatrix matrix) { return matrix == YuvMatrix::Bt709 ? "bt709" : "bt601"; }
+const char* rangeName(YuvRange range) { return range == YuvRange::Full ? "full" : "limited"; }
+
+bool runChecks(VulkanDriver& driver, GpuMemory& memory, ComputeEffects& effects) {
+	Harness harness(driver, memory);
+	bool pass = true;
+
+	// Every check runs one kernel on its own and reads the output back once the effects' submission is done
+	auto run = [&](const TestImage& output, const std::function<void()>& dispatch) {
+		effects.beginFrame(0);
+		dispatch();
+		return harness.read(output, effects.submit({}, VK_PIPELINE_STAGE_TRANSFER_BIT));
+	};
+
+	const uint32_t cw = (FRAME.width + 1) / 2, ch = (FRAME.height + 1) / 2;
+	const Pixels luma_pixels = noise(size_t(FRAME.width) * FRAME.height, 1);
+	const Pixels uv_pixels = noise(size_t(cw) * ch * 2, 2);
+	const Pixels u_pixels = noise(size_t(cw) * ch, 3);
+	const Pixels v_pixels = noise(size_t(cw) * ch, 4);
+	const TestImage& luma = harness.image(VK_FORMAT_R8_UNORM, FRAME.width, FRAME.height, luma_pixels);
+	const TestImage& uv = harness.image(VK_FORMAT_R8G8_UNORM, cw, ch, uv_pixels);
+	const TestImage& u = harness.image(VK_FORMAT_R8_UNORM, cw, ch, u_pixels);
+	const TestImage& v = harness.image(VK_FORMAT_R8_UNORM, cw, ch, v_pixels);
+	const TestImage& rgba = harness.image(VK_FORMAT_R8G8B8A8_UNORM, FRAME.width, FRAME.height);
+
+	for (YuvMatrix matrix : {YuvMatrix::Bt601, YuvMatrix::Bt709}) {
+		for (YuvRange range : {YuvRange::Limited, YuvRange::Full}) {
+			const std::string variant = std::string(matrixName(matrix)) + " " + rangeName(range);
+
+			Pixels gpu = run(rgba, [&]() { effects.convertNv12(luma.effect, uv.effect, rgba.effect, matrix, range); });
+			pass &= compare("nv12 " + variant, gpu, referenceYuv(luma_pixels, &uv_pixels[0], &uv_pixels[1], 2, matrix, range));
+
+			gpu = run(rgba, [&]() { effects.convertI420(luma.effect, u.effect, v.effect, rgba.effect, matrix, range); });
+			pass &= compare("i420 " + variant, gpu, referenceYuv(luma_pixels, u_pixels.data(), v_pixels.data(), 1, matrix, range));
+		}
+	}
+
+	const Pixels source_pixels = noise(size_t(FRAME.width) * FRAME.height * 4, 5);
+	const TestImage& source = harness.image(VK_FORMAT_R8G8B8A8_UNORM, FRAME.width, FRAME.height, source_pixels);
+
+	for (VkExtent2D size : {VkExtent2D{96, 80}, VkExtent2D{37, 29}}) {
+		const TestImage& resized = harness.image(VK_FORMAT_R8G8B8A8_UNORM, size.width, size.height);
+		for (ResizeFilter filter : {ResizeFilter::Bilinear, ResizeFilter::Lanczos}) {
+			const std::string name = std::string(filter == ResizeFilter::Lanczos ? "lanczos " : "bilinear ") +
+			                         std::to_string(size.width) + "x" + std::to_string(size.height);
+			Pixels gpu = run(resized, [&]() { effects.resize(source.effect, resized.effect, filter); });
+			pass &= compare(name, gpu, referenceResize(source_pixels, size, filter));
+		}
+	}
+
+	// A smooth but far from identity grade, so interpolation errors show
+	Pixels lut_pixels(size_t(LUT_SIZE) * LUT_SIZE * LUT_SIZE * 4);
+	for (uint32_t b = 0; b < LUT_SIZE; b++) {
+		for (uint32_t g = 0; g < LUT_SIZE; g++) {
+			for (uint32_t r = 0; r < LUT_SIZE; r++) {
+				const float fr = r / float(LUT_SIZE - 1), fg = g / float(LUT_SIZE - 1), fb = b / float(LUT_SIZE - 1);
+				uint8_t* entry = &lut_pixels[((size_t(b) * LUT_SIZE + g) * LUT_SIZE + r) * 4];
+				entry[0] = toUnorm(1.0f - fr);
+				entry[1] = toUnorm(fg * fg);
+				entry[2] = toUnorm(0.5f * (fr + fb));
+				entry[3] = 255;
+			}
+		}
+	}
+	const TestImage& lut = harness.image(VK_FORMAT_R8G8B8A8_UNORM, LUT_SIZE, LUT_SIZE, lut_pixels, LUT_SIZE);
+
+	for (float strength : {1.0f, 0.5f}) {
+		Pixels gpu = run(rgba, [&]() { effects.applyLut(source.effect, lut.effect, rgba.effect, strength); });
+		pass &= compare(strength == 1.0f ? "lut full strength" : "lut half strength", gpu, referenceLut(source_pixels, lut_pixels, strength));
+	}
+	return pass;
+}
+
+} // namespace
+
+int main() {
+	try {
+		VulkanDriver driver(nullptr);
+		driver.init();
+
+		bool pass;
+		{
+			VkPhysicalDeviceMemoryProperties memory_properties;
+			vkGetPhysicalDeviceMemoryProperties(driver.physicalDevice(), &memory_properties);
+			VulkanMemorySource memory_source(driver.device());
+			GpuMemory memory(memory_properties, memory_source);
+
+			ThreadPool threads;
+			PipelineRegistry pipelines(driver.device(), VK_NULL_HANDLE, threads);
+
+			ComputeEffects::Shaders shaders;
+			shaders.yuvToRgba = embeddedShader(YUV_TO_RGBA_COMP_SPV);
+			shaders.resize = embeddedShader(RESIZE_COMP_SPV);
+			shaders.applyLut = embeddedShader(APPLY_LUT_COMP_SPV);
+			// On the graphics queue, like the images, so none of them need sharing between families
+			ComputeEffects effects(driver.device(), pipelines, driver.queueFamilies().graphicsFamily.value(),
+			                       driver.graphicsQueue(), nullptr, 1, shaders);
+
+			pass = runChecks(driver, memory, effects);
+		}
+		driver.cleanup();
+
+		if (!pass) {
+			std::cout << "a kernel does not match its reference!\n";
+			return EXIT_FAILURE;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+// Exports a synthetic three-track timeline with the CPU renderer on 1, 2, 4, ... worker threads, showing how
+// export throughput scales, and checks that the frames arrive in order.
+//
+// usage: bench_export [frames] [decode microseconds] [chunk frames]
+
+#include "export_engine.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t WIDTH = 1280;
+constexpr uint32_t HEIGHT = 720;
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const int64_t frames = argc > 1 ? std::strtoll(argv[1], nullptr, 10) : 960;
+	const auto decode_time = std::chrono::microseconds(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 3000);
+	const int64_t chunk_frames = argc > 3 ? std::strtoll(argv[3], nullptr, 10) : 48;
+
+	// A background clip under cuts of irregular length, and a title overlay that comes and goes
+	Project project;
+	project.resources.push_back({"background", "background.mp4"});
+	project.resources.push_back({"cuts", "cuts.mp4"});
+	project.resources.push_back({"title", "title.mp4"});
+	project.tracks.push_back({"background", TrackKind::Video, {{0, 0, 0, frames}}, {}, true});
+	project.tracks.push_back({"cuts", TrackKind::Video, {}, {}, true});
+	for (int64_t frame = 0, length = 17; frame < frames; frame += length, length = 17 + (length * 7) % 90) {
+		project.tracks.back().segments.push_back({1, frame, frame * 3, length});
+	}
+	project.tracks.push_back({"title", TrackKind::Video, {}, {}, true});
+	for (int64_t frame = 30; frame < frames; frame += 300) project.tracks.back().segments.push_back({2, frame, 0, 120});
+	const Timeline timeline(project);
+
+	// Stands in for a real decoder: the frame costs `decode_time`, and the overlays are half transparent
+	FrameDecoder decoder = [decode_time](const FrameKey& key) {
+		DecodedFrame frame;
+		frame.width = key.resource == 2 ? WIDTH / 2 : WIDTH; // The title is scaled up
+		frame.height = key.resource == 2 ? HEIGHT / 2 : HEIGHT;
+		frame.stride = size_t(frame.width) * 4;
+		frame.pixels.resize(frame.stride * frame.height);
+		for (size_t i = 0; i < frame.pixels.size(); i += 4) {
+			frame.pixels[i] = static_cast<uint8_t>(key.frame + i);
+			frame.pixels[i + 1] = static_cast<uint8_t>(key.resource * 80);
+			frame.pixels[i + 2] = static_cast<uint8_t>(i >> 12);
+			frame.pixels[i + 3] = key.resource == 0 ? 255 : 128;
+		}
+		std::this_thread::sleep_for(decode_time);
+		return frame;
+	};
+
+	std::cout << "export: " << frames << " frames at " << WIDTH << "x" << HEIGHT << ", decode " << decode_time.count()
+	          << " us, chunks of ~" << chunk_frames << " frames\n";
+
+	const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	double single = 0;
+	for (size_t workers = 1;; workers *= 2) {
+		workers = std::min(workers, hardware);
+		ExportSettings settings;
+		settings.workers = workers;
+		settings.chunkFrames = chunk_frames;
+
+		int64_t expected = 0;
+		const ExportStats stats = exportTimeline(
+			timeline, settings,
+			[&](size_t) { return std::make_unique<CpuExportRenderer>(timeline, decoder, WIDTH, HEIGHT); },
+			[&](int64_t frame, const DecodedFrame&) {
+				if (frame != expected++) throw std::runtime_error("frames reached the sink out of order!");
+			});
+		if (workers == 1) single = stats.framesPerSecond();
+
+		std::cout << workers << " workers:\t" << stats.framesPerSecond() << " fps (" << stats.framesPerSecond() / single
+		          << "x), " << stats.chunks << " chunks, " << stats.steals << " stolen\n";
+		if (workers == hardware) break;
+	}
+	return EXIT_SUCCESS;
+}
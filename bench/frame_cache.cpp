@@ -0,0 +1,77 @@
+// Scrubs back and forth over a clip with a synthetic decoder, showing what the frame cache and the prefetcher
+// save: the time the playhead spends waiting for frames, and the hit rate.
+//
+// usage: bench_frame_cache [budget MiB] [scrub steps] [decode microseconds]
+
+#include "frame_cache.h"
+#include "thread_pool.h"
+#include "timeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t WIDTH = 960;
+constexpr uint32_t HEIGHT = 540;
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const size_t budget = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 512) << 20;
+	const size_t steps = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 3000;
+	const auto decode_time = std::chrono::microseconds(argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2000);
+
+	// One 1200-frame clip on one track, scrubbed over its middle
+	Project project;
+	project.resources.push_back({"clip", "clip.mp4"});
+	project.tracks.push_back({"video-track", TrackKind::Video, {{0, 0, 0, 1200}}, {}, true});
+	const Timeline timeline(project);
+
+	// Stands in for a real decoder: the frame costs `decode_time` and writes every pixel
+	FrameDecoder decoder = [decode_time](const FrameKey& key) {
+		DecodedFrame frame;
+		frame.width = WIDTH;
+		frame.height = HEIGHT;
+		frame.stride = WIDTH * 4;
+		frame.pixels.assign(frame.stride * HEIGHT, static_cast<uint8_t>(key.frame));
+		std::this_thread::sleep_for(decode_time);
+		return frame;
+	};
+
+	ThreadPool pool(2);
+	std::cout << "frames: " << WIDTH << "x" << HEIGHT << " rgba8, decode " << decode_time.count() << " us, budget "
+	          << (budget >> 20) << " MiB\n";
+
+	for (const char* mode : {"no cache", "cache", "cache + prefetch"}) {
+		const bool caching = mode[0] != 'n';
+		const bool prefetching = mode[std::strlen(mode) - 1] == 'h';
+		FrameCache cache(decoder, caching ? budget : 0, pool);
+		PlayheadPrefetcher prefetcher(cache, timeline);
+
+		// Scrubbing: runs of a few frames per step in one direction, with the playhead at editing speed
+		std::mt19937 rng(7);
+		int64_t playhead = 600;
+		int64_t direction = 1;
+		std::chrono::duration<double, std::milli> waited{0};
+		for (size_t i = 0; i < steps; i++) {
+			if (rng() % 60 == 0) direction = -direction;
+			playhead = std::clamp<int64_t>(playhead + direction * (1 + rng() % 2), 300, 900);
+			if (prefetching) prefetcher.update(playhead);
+
+			auto start = std::chrono::steady_clock::now();
+			FrameCache::Handle frame = cache.get({0, playhead});
+			waited += std::chrono::steady_clock::now() - start;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Drawing the frame
+		}
+
+		std::cout << mode << ":\t" << waited.count() / static_cast<double>(steps) << " ms waiting per frame\n  ";
+		cache.stats().print(std::cout);
+	}
+	return EXIT_SUCCESS;
+}
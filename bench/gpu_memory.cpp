@@ -0,0 +1,301 @@
+// Exercises the device memory sub-allocators without a GPU: GpuMemory gets its blocks from a mock DeviceMemorySource
+// that hands out fake handles backed by host memory. It checks buddy splitting, merging and reuse, the frame ring's
+// wrapping and release(), and GpuMemory's pool growth, dedicated allocations, block release and fragmentation
+// statistics, then times allocating and freeing a mix of sizes.
+//
+// Exits with a failure if any check fails. Needs the Vulkan loader to link, but no device.
+//
+// usage: bench_gpu_memory [operations]
+
+#include "gpu_memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(condition)                                                                  \
+	do {                                                                                  \
+		if (!(condition)) {                                                               \
+			std::cout << "check failed, line " << __LINE__ << ": " #condition "\n";       \
+			g_failures++;                                                                 \
+		}                                                                                 \
+	} while (false)
+
+/// Hands out numbered fake handles, backed by host memory when they are to be mapped, and refuses blocks past
+/// `budget` bytes in total, like a device running out of memory.
+class MockMemorySource : public DeviceMemorySource {
+public:
+	explicit MockMemorySource(VkDeviceSize budget = UINT64_MAX) : m_budget(budget) {}
+
+	bool allocate(uint32_t, VkDeviceSize size, bool hostVisible, DeviceBlock& block) override {
+		if (m_allocatedBytes + size > m_budget) return false;
+		m_nextHandle++;
+		block.memory = (VkDeviceMemory)(uintptr_t) m_nextHandle; // Never dereferenced
+		Live& live = m_live[m_nextHandle];
+		live.size = size;
+		if (hostVisible) live.bytes.reset(new char[size]);
+		block.mapped = live.bytes.get();
+		m_allocatedBytes += size;
+		m_allocations++;
+		return true;
+	}
+
+	void free(const DeviceBlock& block) override {
+		auto it = m_live.find((uint64_t)(uintptr_t) block.memory);
+		if (it == m_live.end()) throw std::logic_error("freed a block that was not allocated");
+		m_allocatedBytes -= it->second.size;
+		m_live.erase(it);
+	}
+
+	size_t liveBlocks() const { return m_live.size(); }
+	VkDeviceSize allocatedBytes() const { return m_allocatedBytes; }
+	uint64_t allocations() const { return m_allocations; }
+
+private:
+	struct Live {
+		VkDeviceSize size = 0;
+		std::unique_ptr<char[]> bytes;
+	};
+
+	VkDeviceSize m_budget;
+	VkDeviceSize m_allocatedBytes = 0;
+	uint64_t m_allocations = 0;
+	uint64_t m_nextHandle = 0;
+	std::map<uint64_t, Live> m_live;
+};
+
+constexpr VkDeviceSize KIB = 1024;
+constexpr VkDeviceSize MIB = 1024 * KIB;
+
+/// A device with a large device local heap, a host visible heap, and a small BAR heap that gets smaller blocks.
+VkPhysicalDeviceMemoryProperties mockProperties() {
+	VkPhysicalDeviceMemoryProperties properties{};
+	properties.memoryHeapCount = 3;
+	properties.memoryHeaps[0] = {1024 * MIB, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+	properties.memoryHeaps[1] = {256 * MIB, 0};
+	properties.memoryHeaps[2] = {256 * KIB, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+	properties.memoryTypeCount = 3;
+	properties.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+	properties.memoryTypes[1] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1};
+	properties.memoryTypes[2] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 2};
+	return properties;
+}
+
+VkMemoryRequirements requirements(VkDeviceSize size, uint32_t typeBits, VkDeviceSize alignment = 256) {
+	return {size, alignment, typeBits};
+}
+
+void checkBuddy() {
+	BuddyAllocator buddy(1024, 64);
+	const uint64_t a = buddy.allocate(64), b = buddy.allocate(64), c = buddy.allocate(100), d = buddy.allocate(512);
+	CHECK(a == 0 && b == 64); // Split down from the whole range, lowest halves first
+	CHECK(c == 128 && buddy.blockSize(100) == 128);
+	CHECK(d == 512);
+	CHECK(buddy.freeBytes() == 256 && buddy.largestFree() == 256);
+	CHECK(buddy.allocate(512) == BuddyAllocator::INVALID);
+	CHECK(buddy.allocate(2048) == BuddyAllocator::INVALID);
+
+	buddy.free(a);
+	buddy.free(b); // Merges with a into 128 bytes at 0
+	CHECK(buddy.largestFree() == 256);
+	CHECK(buddy.allocate(128) == 0); // The merged block is reused
+	buddy.free(0);
+	buddy.free(c);
+	buddy.free(d);
+	CHECK(buddy.empty() && buddy.largestFree() == 1024); // Everything merged back into one block
+
+	// Random allocations never overlap, are aligned to their block size, and all merge back when freed
+	BuddyAllocator random_buddy(1 << 20, 256);
+	std::mt19937 rng(7);
+	std::map<uint64_t, uint64_t> live; // Offset to block size
+	for (int i = 0; i < 20000; i++) {
+		if (live.empty() || rng() % 3 != 0) {
+			const uint64_t size = 1 + rng() % 16384;
+			const uint64_t offset = random_buddy.allocate(size);
+			if (offset == BuddyAllocator::INVALID) continue;
+			const uint64_t block = random_buddy.blockSize(size);
+			CHECK(offset % block == 0);
+			auto next = live.lower_bound(offset);
+			CHECK(next == live.end() || next->first >= offset + block);
+			CHECK(next == live.begin() || std::prev(next)->first + std::prev(next)->second <= offset);
+			live[offset] = block;
+		} else {
+			auto it = std::next(live.begin(), static_cast<long>(rng() % live.size()));
+			random_buddy.free(it->first);
+			live.erase(it);
+		}
+	}
+	for (const auto& [offset, size] : live) random_buddy.free(offset);
+	CHECK(random_buddy.empty() && random_buddy.largestFree() == random_buddy.capacity());
+}
+
+void checkFrameRing() {
+	FrameRing ring(1024, 2);
+	ring.beginFrame(0);
+	CHECK(ring.allocate(400) == 0);
+	CHECK(ring.allocate(300, 256) == 512); // Aligned up
+	ring.beginFrame(1);
+	CHECK(ring.allocate(400) == FrameRing::INVALID); // Would wrap onto what frame 0 still uses
+	CHECK(ring.allocate(200) == 816); // Still fits before the end
+	ring.beginFrame(0); // Frame 0 finished: its bytes are released
+	CHECK(ring.allocate(400) == 0); // Wrapped to the start rather than split at the end
+	CHECK(ring.usedBytes() == 1024 + 400 - 812); // Including the skipped end
+
+	// Released by position rather than frame slot
+	FrameRing timeline_ring(1024);
+	CHECK(timeline_ring.allocate(600) == 0);
+	const uint64_t mark = timeline_ring.position();
+	CHECK(timeline_ring.allocate(600) == FrameRing::INVALID);
+	timeline_ring.release(mark);
+	CHECK(timeline_ring.allocate(600) == 0);
+	timeline_ring.release(mark - 1); // Releasing an older position does nothing
+	CHECK(timeline_ring.allocate(500) == FrameRing::INVALID);
+	CHECK(timeline_ring.allocate(2048) == FrameRing::INVALID);
+}
+
+void checkGpuMemory() {
+	const VkPhysicalDeviceMemoryProperties properties = mockProperties();
+	MockMemorySource source;
+	{
+		GpuMemory memory(properties, source, MIB);
+		CHECK(memory.blockSize(0) == MIB && memory.blockSize(2) == 32 * KIB);
+
+		// Sixteen 64 KiB allocations fill one block, the seventeenth grows the pool
+		std::vector<GpuAllocation> allocations;
+		for (int i = 0; i < 16; i++) allocations.push_back(memory.allocate(requirements(64 * KIB, 1u << 0), 0, ResourceLayout::Optimal));
+		CHECK(memory.heapStats(0).blockCount == 1 && source.liveBlocks() == 1);
+		allocations.push_back(memory.allocate(requirements(64 * KIB, 1u << 0), 0, ResourceLayout::Optimal));
+		CHECK(memory.heapStats(0).blockCount == 2 && source.liveBlocks() == 2);
+		CHECK(allocations.back().memory != allocations.front().memory && allocations.back().offset == 0);
+
+		// An emptied block goes back to the source while the pool has another
+		memory.free(allocations.back());
+		allocations.pop_back();
+		CHECK(memory.heapStats(0).blockCount == 1 && source.liveBlocks() == 1);
+
+		// Freeing every other allocation leaves 512 KiB free but no more than 64 KiB in one piece
+		for (size_t i = 0; i < allocations.size(); i += 2) memory.free(allocations[i]);
+		HeapStats stats = memory.heapStats(0);
+		CHECK(stats.allocationCount == 8 && stats.usedBytes == 512 * KIB && stats.largestFree == 64 * KIB);
+		CHECK(stats.fragmentation() > 0.874 && stats.fragmentation() < 0.876); // 1 - 64 / 512
+		const GpuAllocation spill = memory.allocate(requirements(128 * KIB, 1u << 0), 0, ResourceLayout::Optimal);
+		CHECK(spill.memory != allocations[0].memory && memory.heapStats(0).blockCount == 2);
+
+		// Once the rest is freed the first block goes back to the source, and the last block is kept when it empties
+		for (size_t i = 1; i < allocations.size(); i += 2) memory.free(allocations[i]);
+		stats = memory.heapStats(0);
+		CHECK(stats.blockCount == 1 && stats.allocationCount == 1 && stats.largestFree == 512 * KIB);
+		memory.free(spill);
+		stats = memory.heapStats(0);
+		CHECK(stats.blockCount == 1 && stats.largestFree == MIB && stats.fragmentation() == 0.0 && source.liveBlocks() == 1);
+
+		// Requests above half a block get a block of their own, of exactly their size
+		const uint64_t before = source.allocations();
+		const GpuAllocation large = memory.allocate(requirements(600 * KIB, 1u << 0), 0, ResourceLayout::Optimal);
+		CHECK(large.block == GpuAllocation::DEDICATED && large.offset == 0);
+		CHECK(source.allocations() == before + 1 && memory.heapStats(0).dedicatedCount == 1);
+		CHECK(memory.heapStats(0).blockBytes == MIB + 600 * KIB);
+		memory.free(large);
+		CHECK(memory.heapStats(0).dedicatedCount == 0 && source.liveBlocks() == 1);
+
+		// Linear resources get a pool of their own, which keeps its block when emptied
+		const GpuAllocation buffer = memory.allocate(requirements(4 * KIB, 1u << 0), 0, ResourceLayout::Linear);
+		CHECK(memory.heapStats(0).blockCount == 2 && source.liveBlocks() == 2);
+		memory.free(buffer);
+		CHECK(memory.heapStats(0).blockCount == 2);
+
+		// Host visible allocations are mapped at their offset and do not overlap
+		std::vector<GpuAllocation> mapped;
+		for (int i = 0; i < 24; i++) {
+			mapped.push_back(memory.allocate(requirements(KIB * (1 + i * 7 % 60), 1u << 1), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, ResourceLayout::Linear));
+			CHECK(mapped.back().mapped != nullptr && mapped.back().memoryType == 1);
+			std::memset(mapped.back().mapped, i, mapped.back().size);
+		}
+		for (size_t i = 0; i < mapped.size(); i++) {
+			const auto* bytes = static_cast<const unsigned char*>(mapped[i].mapped);
+			CHECK(std::all_of(bytes, bytes + mapped[i].size, [&](unsigned char b) { return b == i; }));
+			memory.free(mapped[i]);
+		}
+
+		// The first type with the required properties is picked, among those the resource allows
+		const GpuAllocation bar = memory.allocate(requirements(4 * KIB, 0b111), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		                                          ResourceLayout::Linear);
+		CHECK(bar.memoryType == 2 && memory.heapStats(2).blockBytes == 32 * KIB);
+		memory.free(bar);
+
+		bool threw = false;
+		try {
+			memory.allocate(requirements(4 * KIB, 1u << 0), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, ResourceLayout::Linear);
+		} catch (const std::runtime_error&) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+	CHECK(source.liveBlocks() == 0); // Everything went back to the source
+
+	// A device out of memory makes allocate() throw, without losing track of anything
+	MockMemorySource small_source(MIB);
+	{
+		GpuMemory memory(properties, small_source, MIB);
+		const GpuAllocation first = memory.allocate(requirements(512 * KIB, 1u << 0), 0, ResourceLayout::Optimal);
+		bool threw = false;
+		try {
+			memory.allocate(requirements(4 * KIB, 1u << 0), 0, ResourceLayout::Linear);
+		} catch (const std::runtime_error&) {
+			threw = true;
+		}
+		CHECK(threw && memory.heapStats(0).allocationCount == 1);
+		memory.free(first);
+	}
+	CHECK(small_source.liveBlocks() == 0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const size_t operations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+	checkBuddy();
+	checkFrameRing();
+	checkGpuMemory();
+	if (g_failures > 0) {
+		std::cout << g_failures << " checks failed!\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "all checks passed\n";
+
+	// A churn of image-sized and buffer-sized allocations, about half of them live at any time
+	MockMemorySource source;
+	GpuMemory memory(mockProperties(), source);
+	std::mt19937 rng(42);
+	std::vector<GpuAllocation> live;
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < operations; i++) {
+		if (live.size() < 512 && (live.empty() || rng() % 2 == 0)) {
+			const VkDeviceSize size = rng() % 8 == 0 ? (1 + rng() % 16) * MIB : (1 + rng() % 256) * KIB;
+			live.push_back(memory.allocate(requirements(size, 1u << 0), 0, rng() % 2 ? ResourceLayout::Optimal : ResourceLayout::Linear));
+		} else {
+			const size_t index = rng() % live.size();
+			memory.free(live[index]);
+			live[index] = live.back();
+			live.pop_back();
+		}
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << operations << " allocations and frees: " << ms << " ms (" << ms * 1e6 / double(operations) << " ns each)\n";
+	memory.print(std::cout);
+	for (const GpuAllocation& allocation : live) memory.free(allocation);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+// Builds the 2D geometry of a busy synthetic timeline, frame after frame while it scrolls, and reports how long
+// building and writing out a frame takes and how many draw calls it comes to. For comparison it also counts the
+// draws that submitting the same shapes in painter's order, with a draw per change of texture, would need. Then it
+// holds the timeline still while only the playhead moves, and reports how much of the window damage tracking finds
+// changed and what hashing the tiles costs, and rasterizes those frames with the software driver, whole and only
+// where damaged.
+//
+// usage: bench_gui_batch [tracks] [clips per track] [frames]
+
+#include "damage_tracker.h"
+#include "gui_batch.h"
+#include "software_driver.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr float WIDTH = 1920;
+constexpr float HEIGHT = 1080;
+constexpr uint32_t THUMBNAIL_TEXTURES = 8; // Thumbnail atlases, one per source clip, as the renderer would register them
+
+/// A 7×12 monospaced font of solid blocks for ASCII, packed into the atlas like a real one would be.
+GuiFont makeFont(GuiAtlas& atlas) {
+	GuiFont font;
+	font.lineHeight = 14;
+	const std::vector<uint8_t> mask(7 * 12, 200);
+	for (uint32_t c = 32; c < 127; c++) {
+		GuiGlyph glyph;
+		glyph.advance = 8;
+		if (c != ' ') {
+			if (!atlas.addMask(7, 12, mask.data(), 7, glyph.uv)) {
+				std::cerr << "atlas is full!\n";
+				std::exit(EXIT_FAILURE);
+			}
+			glyph.offsetY = -10;
+			glyph.width = 7;
+			glyph.height = 12;
+		}
+		font.add(c, glyph);
+	}
+	return font;
+}
+
+/// Counts the draw calls of drawing shapes in the order they are issued, one per change of texture.
+struct PainterOrder {
+	uint32_t texture = UINT32_MAX;
+	size_t draws = 0;
+
+	void use(uint32_t t) {
+		if (t != texture) draws++;
+		texture = t;
+	}
+};
+
+/// Lay out one frame of the timeline, scrolled `scroll` pixels to the right, with the playhead at `playhead`.
+void buildTimeline(GuiBatch& batch, const GuiFont& font, uint32_t tracks, uint32_t clips, float scroll, float playhead,
+                   PainterOrder& painter) {
+	const float ruler_height = 24;
+	const float track_height = (HEIGHT - ruler_height) / float(tracks);
+	const float clip_width = 90;
+	char label[32];
+
+	batch.reset(WIDTH, HEIGHT);
+
+	// Ruler: ticks and timecodes
+	batch.setLayer(0);
+	batch.rect({0, 0, WIDTH, ruler_height}, guiColor(40, 40, 44));
+	painter.use(GuiBatch::ATLAS);
+	for (float x = -std::fmod(scroll, 10.0f); x < WIDTH; x += 10) {
+		const bool major = int((x + scroll) / 10 + 0.5f) % 10 == 0;
+		batch.rect({x, major ? 8.0f : 16.0f, 1, major ? 16.0f : 8.0f}, guiColor(150, 150, 150));
+		if (major) {
+			std::snprintf(label, sizeof(label), "%02d:%02d", int(x + scroll) / 600, int(x + scroll) / 10 % 60);
+			batch.setLayer(2);
+			batch.text(font, x + 3, 12, label, guiColor(220, 220, 220));
+			batch.setLayer(0);
+		}
+	}
+
+	// Tracks: clip bodies, thumbnails, names and trim handles, clipped to the track area
+	batch.pushClip({0, ruler_height, WIDTH, HEIGHT - ruler_height});
+	for (uint32_t t = 0; t < tracks; t++) {
+		const float y = ruler_height + float(t) * track_height;
+		for (uint32_t c = 0; c < clips; c++) {
+			const GuiRect body = {float(c) * (clip_width + 4) + float(t % 7) * 13 - scroll, y + 1, clip_width, track_height - 2};
+			if (body.x + body.width < 0 || body.x > WIDTH) continue; // The timeline would only look up visible clips
+			const uint32_t texture = 1 + (t * clips + c) % THUMBNAIL_TEXTURES;
+
+			batch.setLayer(0);
+			batch.roundedRect(body, 4, guiColor(60, 90, 140));
+			painter.use(GuiBatch::ATLAS);
+
+			batch.setLayer(1);
+			batch.image({body.x + 2, body.y + 2, track_height * 16 / 9, body.height - 4}, texture, {0, float(c % 16) / 16, 1, 1.0f / 16});
+			painter.use(texture);
+
+			batch.setLayer(2);
+			std::snprintf(label, sizeof(label), "clip %u.%u", t, c);
+			batch.text(font, body.x + 4, body.y + 12, label, guiColor(255, 255, 255));
+			batch.rect({body.x, body.y, 3, body.height}, guiColor(240, 200, 60));
+			batch.rect({body.x + body.width - 3, body.y, 3, body.height}, guiColor(240, 200, 60));
+			painter.use(GuiBatch::ATLAS);
+		}
+	}
+	batch.popClip();
+
+	// Playhead
+	batch.setLayer(3);
+	batch.setBlend(GuiBlend::Additive);
+	batch.rect({playhead, 0, 2, HEIGHT}, guiColor(255, 60, 60, 200));
+	painter.use(GuiBatch::ATLAS);
+	batch.setBlend(GuiBlend::Alpha);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const uint32_t tracks = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 32;
+	const uint32_t clips = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 200;
+	const uint32_t frames = argc > 3 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 500;
+
+	GuiAtlas atlas;
+	const GuiFont font = makeFont(atlas);
+	GuiBatch batch(atlas);
+	std::vector<GuiVertex> vertices; // Stands in for the renderer's mapped vertex buffer
+
+	double build_ms = 0, write_ms = 0;
+	size_t quads = 0, draws = 0, painter_draws = 0;
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		PainterOrder painter;
+		const auto start = std::chrono::steady_clock::now();
+		buildTimeline(batch, font, tracks, clips, float(frame) * 7, WIDTH / 2, painter);
+		const auto built = std::chrono::steady_clock::now();
+
+		if (vertices.size() < batch.vertexCount()) vertices.resize(batch.vertexCount());
+		const std::vector<GuiDraw>& result = batch.build(vertices.data());
+		const auto written = std::chrono::steady_clock::now();
+
+		size_t drawn = 0;
+		for (const GuiDraw& draw : result) drawn += draw.quadCount;
+		if (drawn != batch.quadCount()) {
+			std::cout << "draws cover " << drawn << " of " << batch.quadCount() << " quads!\n";
+			return EXIT_FAILURE;
+		}
+
+		build_ms += std::chrono::duration<double, std::milli>(built - start).count();
+		write_ms += std::chrono::duration<double, std::milli>(written - built).count();
+		quads += batch.quadCount();
+		draws += result.size();
+		painter_draws += painter.draws;
+	}
+
+	std::cout << tracks << " tracks of " << clips << " clips, " << frames << " frames at " << WIDTH << "x" << HEIGHT << ":\n"
+	          << "  " << quads / frames << " visible quads and " << draws / frames << " draw calls per frame ("
+	          << painter_draws / frames << " in painter's order)\n"
+	          << "  build " << build_ms / frames << " ms, write out " << write_ms / frames << " ms per frame ("
+	          << (build_ms + write_ms) * 1e6 / double(quads) << " ns per quad)\n";
+
+	// Playback with the view held still: only the playhead moves, a pixel a frame
+	SoftwareDriver raster(static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT));
+	raster.init();
+	for (uint32_t t = 0; t < THUMBNAIL_TEXTURES; t++) {
+		std::vector<uint8_t> thumbnails(64 * 64 * 4, uint8_t(40 + 20 * t));
+		raster.addTexture(64, 64, thumbnails.data(), 64 * 4);
+	}
+	const float background[4] = {0.1f, 0.1f, 0.1f, 1.0f};
+	std::vector<DriverRect> scissors;
+	double full_raster_ms = 0, damaged_raster_ms = 0;
+
+	DamageTracker damage;
+	damage.reset(uint32_t(WIDTH), uint32_t(HEIGHT), 3);
+	std::vector<uint64_t> tiles;
+	double hash_ms = 0;
+	int64_t damaged = 0;
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		PainterOrder painter;
+		buildTimeline(batch, font, tracks, clips, 0, WIDTH / 4 + float(frame), painter);
+		const auto start = std::chrono::steady_clock::now();
+		batch.hashTiles(DamageTracker::TILE_SIZE, damage.tileColumns(), damage.tileRows(), tiles);
+		damage.addTiles(tiles);
+		const std::vector<DamageRect>& rects = damage.takeFrame(frame % 3);
+		const auto hashed = std::chrono::steady_clock::now();
+		hash_ms += std::chrono::duration<double, std::milli>(hashed - start).count();
+
+		if (vertices.size() < batch.vertexCount()) vertices.resize(batch.vertexCount());
+		const std::vector<GuiDraw>& draws = batch.build(vertices.data());
+		raster.updateAtlas(atlas);
+		scissors.clear();
+		for (const DamageRect& rect : rects) {
+			scissors.push_back({rect.x0, rect.y0, uint32_t(rect.x1 - rect.x0), uint32_t(rect.y1 - rect.y0)});
+		}
+		SoftwareCommands commands = raster.commands(vertices.data());
+		commands.clear(scissors, background);
+		drawGui(commands, draws, scissors);
+		const double raster_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hashed).count();
+
+		// The first frame of each image draws it whole
+		if (frame >= 3) {
+			for (const DamageRect& rect : rects) damaged += rect.area();
+			damaged_raster_ms += raster_ms;
+		} else {
+			full_raster_ms += raster_ms;
+		}
+	}
+	const uint32_t counted = frames > 3 ? frames - 3 : 1;
+	std::cout << "  playhead only: " << 100.0 * double(damaged) / counted / (double(WIDTH) * HEIGHT)
+	          << "% of the window redrawn, hash and diff " << hash_ms / frames << " ms per frame\n"
+	          << "  software raster: " << full_raster_ms / std::min(frames, 3u) << " ms per whole frame, "
+	          << damaged_raster_ms / counted << " ms per damaged frame\n";
+	raster.cleanup();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+// Builds waveform and thumbnail sidecars for synthetic media of very different lengths, then times drawing a
+// 1920-pixel-wide waveform over each whole clip and over one second of it. The cost should not grow with length.
+//
+// usage: bench_overview [longest clip minutes]
+
+#include "audio_engine.h"
+#include "overview_cache.h"
+#include "resource_registry.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t SAMPLE_RATE = 48000;
+constexpr size_t COLUMNS = 1920;
+
+/// A swelling sine per resource, as many frames long as `lengths` says.
+class SineDecoder : public AudioDecoder {
+public:
+	std::vector<int64_t> lengths;
+
+	uint32_t sampleRate(uint32_t) override { return SAMPLE_RATE; }
+
+	size_t decode(uint32_t resource, int64_t firstFrame, float* out, size_t frames) override {
+		const int64_t available = std::max<int64_t>(0, std::min<int64_t>(int64_t(frames), lengths[resource] - firstFrame));
+		for (int64_t i = 0; i < available; i++) {
+			const double t = double(firstFrame + i) / SAMPLE_RATE;
+			const float envelope = static_cast<float>(0.5 + 0.4 * std::sin(t * 0.5));
+			out[2 * i] = envelope * static_cast<float>(std::sin(t * 2764.6));
+			out[2 * i + 1] = 0.5f * out[2 * i];
+		}
+		return size_t(available);
+	}
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const int64_t longest_minutes = argc > 1 ? std::strtoll(argv[1], nullptr, 10) : 60;
+
+	// Media files only need distinct contents, for their content hashes; the decoders make up what is in them
+	const fs::path directory = fs::temp_directory_path() / "viper_bench_overview";
+	fs::remove_all(directory);
+	fs::create_directories(directory);
+	Project project;
+	project.path = (directory / "bench.viper").string();
+	SineDecoder audio;
+	for (int64_t minutes : {int64_t(1), longest_minutes}) {
+		const std::string name = "audio_" + std::to_string(minutes) + "min.wav";
+		std::ofstream(directory / name) << name;
+		project.resources.push_back({name, name});
+		audio.lengths.push_back(minutes * 60 * SAMPLE_RATE);
+	}
+	project.tracks.push_back({"audio", TrackKind::Audio, {{0, 0, 0, Segment::UNTIL_NEXT}, {1, 3600, 0, Segment::UNTIL_NEXT}}, {}, true});
+
+	// A 640x360 video of 9000 frames, as a y4m header so the registry learns its size and length
+	const int64_t video_frames = 9000;
+	{
+		std::ofstream video(directory / "video.y4m", std::ios::binary);
+		video << "YUV4MPEG2 W640 H360 F30:1 C420jpeg\n";
+		video.seekp(static_cast<std::streamoff>(video_frames * (6 + 640 * 360 * 3 / 2) - 1), std::ios::cur);
+		video.put('\0');
+	}
+	project.resources.push_back({"video", "video.y4m"});
+	audio.lengths.push_back(0);
+	project.tracks.push_back({"video", TrackKind::Video, {{2, 0, 0, Segment::UNTIL_NEXT}}, {}, true});
+	FrameDecoder video = [](const FrameKey& key) {
+		DecodedFrame frame;
+		frame.width = 640;
+		frame.height = 360;
+		frame.stride = 640 * 4;
+		frame.pixels.assign(frame.stride * frame.height, static_cast<uint8_t>(key.frame));
+		return frame;
+	};
+
+	ThreadPool pool(2);
+	ResourceRegistry registry(pool, "");
+	registry.open(project);
+	registry.waitSettled();
+
+	const auto build_start = std::chrono::steady_clock::now();
+	{
+		OverviewCache cache(video, audio, (directory / "overviews").string());
+		cache.update(registry, project);
+		while (cache.pending() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		std::cout << "sidecars built in "
+		          << std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count() << " s\n";
+
+		std::vector<Peak> columns(2 * COLUMNS);
+		for (uint32_t resource = 0; resource < 2; resource++) {
+			const std::shared_ptr<const WaveformPeaks> waveform = cache.waveform(resource);
+			if (!waveform) {
+				std::cout << "waveform " << resource << " failed to build!\n";
+				return EXIT_FAILURE;
+			}
+
+			auto time = [&](int64_t first, int64_t end) {
+				constexpr int RUNS = 1000;
+				const auto start = std::chrono::steady_clock::now();
+				for (int i = 0; i < RUNS; i++) waveform->columns(first, end, COLUMNS, columns.data());
+				return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / RUNS;
+			};
+			const int64_t frames = waveform->frameCount();
+			std::cout << project.resources[resource].id << ": " << waveform->levelCount() << " levels, whole clip "
+			          << time(0, frames) << " us (level " << waveform->levelFor(double(frames) / COLUMNS) << "), one second "
+			          << time(frames / 2, frames / 2 + SAMPLE_RATE) << " us (level "
+			          << waveform->levelFor(double(SAMPLE_RATE) / COLUMNS) << ")\n";
+		}
+
+		const std::shared_ptr<const ThumbnailStrip> thumbnails = cache.thumbnails(2);
+		if (!thumbnails) {
+			std::cout << "thumbnails failed to build!\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << "thumbnails: " << thumbnails->width() << "x" << thumbnails->height() << ", " << thumbnails->levelCount()
+		          << " levels, " << thumbnails->thumbnailCount(0) << " at level 0\n";
+	}
+
+	std::error_code ec;
+	fs::remove_all(directory, ec);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// Plays back at the common timeline frame rates on a simulated display, paced by the present scheduler the way the
+// main loop paces the preview, and reports how many frames were drawn and dropped, how late they were queued, and how
+// many refreshes the display repeated a frame for beyond its share of the timeline. Drawing takes a set time with some
+// jitter, and presentation is FIFO, so a frame queued behind others waits for the refreshes before it. Time is
+// simulated, so a minute of playback takes milliseconds and every run is the same.
+//
+// For comparison it also reports how many frames drawing at every refresh, as mailbox presentation invites, would
+// draw for the same playback.
+//
+// Exits with a failure if any frame was dropped or repeated, so it can hold playback to being smooth.
+//
+// usage: bench_present_pacing [refresh Hz] [draw ms] [seconds]
+
+#include "present_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+
+namespace {
+
+using Clock = PresentScheduler::Clock;
+
+constexpr uint32_t SWAP_CHAIN_IMAGES = 3; // As paced presentation asks for on most surfaces
+
+Clock::duration seconds(double value) {
+	return std::chrono::ceil<Clock::duration>(std::chrono::duration<double>(value));
+}
+
+struct Rate {
+	uint32_t numerator;
+	uint32_t denominator;
+};
+
+/// Play `duration` seconds at `rate` on a `refreshHz` display, drawing a frame in about `drawMs`. Returns the
+/// scheduler, with its statistics, and counts in `repeats` the refreshes a frame stayed on the display for beyond
+/// its share of the timeline.
+PresentScheduler play(Rate rate, double refreshHz, double drawMs, double duration, uint64_t& repeats) {
+	const Clock::time_point start{};
+	const Clock::duration refresh = seconds(1.0 / refreshHz);
+	PresentScheduler scheduler;
+	scheduler.setFrameRate(rate.numerator, rate.denominator, start);
+	scheduler.play(start);
+
+	std::deque<Clock::time_point> queued; // When each frame queued for presentation will be shown
+	Clock::time_point last_shown{};
+	int64_t last_frame = -1;
+	repeats = 0;
+	Clock::time_point now = start;
+	uint32_t jitter = 12345; // Of drawing, from a fixed seed
+	while (now < start + seconds(duration)) {
+		now += seconds(scheduler.secondsUntilDue(now, 1.0));
+		if (!scheduler.frameDue(now)) continue;
+		const int64_t frame = scheduler.frameAt(now);
+
+		// Acquiring an image blocks while every other image is queued
+		while (!queued.empty() && queued.front() <= now) queued.pop_front();
+		if (queued.size() >= SWAP_CHAIN_IMAGES - 1) {
+			now = queued.front();
+			queued.pop_front();
+		}
+
+		jitter = jitter * 1664525u + 1013904223u;
+		now += seconds(drawMs * (0.75 + 0.5 * double(jitter >> 8) / double(1u << 24)) / 1000.0);
+		scheduler.presented(frame, now);
+
+		// Shown at the first refresh after it was queued that is not taken by a frame before it
+		Clock::time_point shown = start + refresh * ((now - start) / refresh + 1);
+		if (!queued.empty()) shown = std::max(shown, queued.back() + refresh);
+		queued.push_back(shown);
+
+		// The previous frame may stay up for as many refreshes as the timeline gives it, rounded up (2 and 3 in turn for
+		// 24 fps on 60 Hz); any more are repeats
+		if (last_frame >= 0) {
+			const int64_t held = (shown - last_shown) / refresh;
+			const int64_t share = (scheduler.dueTime(frame) - scheduler.dueTime(last_frame) + refresh - Clock::duration(1)) / refresh;
+			repeats += uint64_t(std::max<int64_t>(held - share, 0));
+		}
+		last_shown = shown;
+		last_frame = frame;
+	}
+	return scheduler;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const double refresh_hz = argc > 1 ? std::atof(argv[1]) : 60.0;
+	const double draw_ms = argc > 2 ? std::atof(argv[2]) : 8.0;
+	const double duration = argc > 3 ? std::atof(argv[3]) : 60.0;
+	if (refresh_hz <= 0.0 || draw_ms < 0.0 || duration <= 0.0) {
+		std::cerr << "usage: " << argv[0] << " [refresh Hz] [draw ms] [seconds]\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << duration << " s of playback on a " << refresh_hz << " Hz display, drawing in about " << draw_ms << " ms\n";
+	const Rate rates[] = {{24000, 1001}, {24, 1}, {25, 1}, {30000, 1001}, {30, 1}, {50, 1}, {60, 1}};
+	bool smooth = true;
+	for (const Rate& rate : rates) {
+		uint64_t repeats = 0;
+		const PresentScheduler scheduler = play(rate, refresh_hz, draw_ms, duration, repeats);
+		const PresentScheduler::Stats& stats = scheduler.stats();
+		std::cout << "\n";
+		scheduler.print(std::cout);
+		std::cout << "refreshes repeated: " << repeats << "\n";
+		std::cout << "frames drawn: " << stats.presented << ", drawing every refresh: " << uint64_t(std::ceil(duration * refresh_hz)) << "\n";
+
+		// Faster content than the display cannot be shown whole, whatever the pacing
+		if (scheduler.frameRate() <= refresh_hz && (stats.dropped > 0 || repeats > 0)) smooth = false;
+	}
+
+	if (!smooth) {
+		std::cout << "playback dropped or repeated frames!\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+// Measures how long it takes to load a large synthetic ".viper" project.
+//
+// usage: bench_project_parse [segment count] [track count]
+
+#include "project.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/// Write a project with `segmentCount` segments spread evenly over `trackCount` video tracks.
+static void writeSyntheticProject(const std::string& path, size_t segmentCount, size_t trackCount) {
+	std::ofstream file(path, std::ios::binary);
+	file << "[Settings]\ntitle=\"Synthetic Project\"\nframerate=30\n\n[Resources]\n";
+
+	const size_t resource_count = 512;
+	for (size_t i = 0; i < resource_count; i++) {
+		file << "clip" << i << "=Resource(\"media/clip" << i << ".mp4\")\n";
+	}
+
+	file << "\n[Tracks]\n";
+	const size_t per_track = segmentCount / trackCount;
+	for (size_t t = 0; t < trackCount; t++) {
+		file << "video-track-" << t << "=[\n";
+		for (size_t s = 0; s < per_track; s++) {
+			file << "    VideoSegment(clip" << (s * 7 + t) % resource_count << ", " << s * 48 << ", " << (s % 97) * 12 << ", 48),\n";
+		}
+		file << "]\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	const size_t segment_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 300000;
+	const size_t track_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+	if (track_count < 1) {
+		std::cerr << "usage: " << argv[0] << " [segment count] [track count]\n";
+		return EXIT_FAILURE;
+	}
+	const std::string path = "bench_project_parse.viper";
+
+	writeSyntheticProject(path, segment_count, track_count);
+
+	std::ifstream size_probe(path, std::ios::ate | std::ios::binary);
+	const double megabytes = static_cast<double>(size_probe.tellg()) / (1024.0 * 1024.0);
+
+	const int iterations = 10;
+	double best_ms = 1e30, total_ms = 0.0;
+	size_t parsed_segments = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		auto start = std::chrono::steady_clock::now();
+		Project project = loadProject(path);
+		auto end = std::chrono::steady_clock::now();
+
+		parsed_segments = 0;
+		for (const auto& track : project.tracks) parsed_segments += track.segments.size();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		best_ms = ms < best_ms ? ms : best_ms;
+		total_ms += ms;
+	}
+
+	if (!getenv("KEEP")) std::remove(path.c_str());
+
+	std::cout << "segments: " << parsed_segments << " (" << megabytes << " MiB)\n";
+	std::cout << "best:     " << best_ms << " ms (" << megabytes / (best_ms / 1000.0) << " MiB/s)\n";
+	std::cout << "mean:     " << total_ms / iterations << " ms\n";
+	return EXIT_SUCCESS;
+}
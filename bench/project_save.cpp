@@ -0,0 +1,159 @@
+// Checks that incremental saves write back what was edited, then measures how long saving a large synthetic project
+// takes when one track changed, incrementally and in full.
+//
+// The checks save edited projects over their files and load them again: tracks reordered in a file without a final
+// newline, a dirty track between clean ones, and a track added after them. Exits with a failure if a reloaded project
+// differs from what was saved.
+//
+// usage: bench_project_save [segment count] [track count]
+
+#include "project.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+
+namespace {
+
+void writeFile(const std::string& path, const std::string& text) {
+	std::ofstream file(path, std::ios::binary);
+	file << text;
+}
+
+bool sameSegments(const std::vector<Segment>& a, const std::vector<Segment>& b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Segment& x, const Segment& y) {
+		return x.resource == y.resource && x.trackFrame == y.trackFrame && x.clipFrame == y.clipFrame && x.length == y.length;
+	});
+}
+
+/// Whether `a` and `b` hold the same settings, resources and tracks, in the same order.
+bool sameProject(const Project& a, const Project& b) {
+	auto same_setting = [](const Setting& x, const Setting& y) { return x.key == y.key && x.value == y.value; };
+	auto same_resource = [](const Resource& x, const Resource& y) { return x.id == y.id && x.path == y.path; };
+	auto same_track = [](const Track& x, const Track& y) { return x.name == y.name && x.kind == y.kind && sameSegments(x.segments, y.segments); };
+	return std::equal(a.settings.begin(), a.settings.end(), b.settings.begin(), b.settings.end(), same_setting)
+		&& std::equal(a.resources.begin(), a.resources.end(), b.resources.begin(), b.resources.end(), same_resource)
+		&& std::equal(a.tracks.begin(), a.tracks.end(), b.tracks.begin(), b.tracks.end(), same_track);
+}
+
+/// Load `text` from `path`, apply `edit`, save it over the file and load it again. Returns whether that gave back
+/// the edited project, twice over: swapping the first and last tracks and saving again, from the layout the first
+/// save left, must give them back too.
+template<typename Edit>
+bool roundTrip(const char* name, const std::string& path, const std::string& text, Edit edit) {
+	writeFile(path, text);
+	bool ok = false;
+	try {
+		Project project = loadProject(path);
+		edit(project);
+		saveProject(project);
+		Project reloaded = loadProject(path);
+		ok = sameProject(project, reloaded);
+
+		if (ok && !reloaded.tracks.empty()) { // Incrementally again, from the layout saving gave
+			std::swap(project.tracks.front(), project.tracks.back());
+			saveProject(project);
+			ok = sameProject(project, loadProject(path));
+		}
+	} catch (const std::exception& e) {
+		std::cout << name << ": " << e.what() << "\n";
+		ok = false;
+	}
+	std::cout << name << ": " << (ok ? "ok" : "FAILED") << "\n";
+	std::remove(path.c_str());
+	return ok;
+}
+
+/// Write a project with `segmentCount` segments spread evenly over `trackCount` video tracks.
+std::string syntheticProject(size_t segmentCount, size_t trackCount) {
+	std::string text = "[Settings]\ntitle=\"Synthetic Project\"\nframerate=30\n\n[Resources]\n";
+	const size_t resource_count = 512;
+	for (size_t i = 0; i < resource_count; i++) {
+		text += "clip" + std::to_string(i) + "=Resource(\"media/clip" + std::to_string(i) + ".mp4\")\n";
+	}
+
+	text += "\n[Tracks]\n";
+	const size_t per_track = segmentCount / trackCount;
+	for (size_t t = 0; t < trackCount; t++) {
+		text += "video-track-" + std::to_string(t) + "=[\n";
+		for (size_t s = 0; s < per_track; s++) {
+			text += "    VideoSegment(clip" + std::to_string((s * 7 + t) % resource_count) + ", " + std::to_string(s * 48) + ", "
+			        + std::to_string((s % 97) * 12) + ", 48),\n";
+		}
+		text += "]\n";
+	}
+	return text;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const size_t segment_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 300000;
+	const size_t track_count = argc > 2 ? std::max<size_t>(std::strtoull(argv[2], nullptr, 10), 1) : 8;
+	const std::string path = "bench_project_save.viper";
+
+	const std::string small = "# A project\n[Settings]\ntitle=\"Small\"\n\n[Resources]\nid1=Resource(\"a.mp4\")\nid2=Resource(\"b.wav\")\n\n"
+	                          "[Tracks]\nA=[\n    VideoSegment(id1, 0, 0),\n]\n# Between tracks\nB=[\n    AudioSegment(id2, 0, 0, 120),\n]\n"
+	                          "C=[\n    VideoSegment(id1, 10, 5),\n]";
+	bool ok = true;
+	ok &= roundTrip("reorder, no final newline", path, small, [](Project& project) {
+		std::swap(project.tracks[0], project.tracks[2]);
+	});
+	ok &= roundTrip("dirty track between clean ones", path, small, [](Project& project) {
+		project.tracks[1].segments[0].clipFrame = 24;
+		project.tracks[1].dirty = true;
+	});
+	ok &= roundTrip("track added, no final newline", path, small, [](Project& project) {
+		Track track;
+		track.name = "D";
+		track.kind = TrackKind::Video;
+		track.segments.push_back({0, 100, 0, Segment::UNTIL_NEXT});
+		project.tracks.push_back(track);
+	});
+	ok &= roundTrip("settings edited", path, small + "\n", [](Project& project) {
+		project.settings[0].value = "Renamed";
+		project.settingsDirty = true;
+	});
+	if (!ok) {
+		std::cout << "incremental saves lost edits!\n";
+		return EXIT_FAILURE;
+	}
+
+	// One track of a large project edited, saved over itself (incrementally) and elsewhere (in full)
+	const std::string copy_path = "bench_project_save_full.viper";
+	writeFile(path, syntheticProject(segment_count, track_count));
+	Project project = loadProject(path);
+	const int iterations = 10;
+	double incremental_ms = 1e30, full_ms = 1e30;
+	for (int i = 0; i < iterations; i++) {
+		Track& track = project.tracks[static_cast<size_t>(i) % project.tracks.size()];
+		if (!track.segments.empty()) track.segments[0].clipFrame++;
+		track.dirty = true;
+
+		auto start = std::chrono::steady_clock::now();
+		saveProject(project);
+		incremental_ms = std::min(incremental_ms, millisecondsSince(start));
+
+		Project copy = project;
+		start = std::chrono::steady_clock::now();
+		saveProject(copy, copy_path);
+		full_ms = std::min(full_ms, millisecondsSince(start));
+	}
+	std::remove(path.c_str());
+	std::remove(copy_path.c_str());
+
+	std::cout << "one of " << project.tracks.size() << " tracks edited, best of " << iterations << ":\n";
+	std::cout << "incremental: " << incremental_ms << " ms\n";
+	std::cout << "full:        " << full_ms << " ms\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Times initializing the Vulkan driver, the bulk of Viper's startup, step by step: creating the instance, picking
+// a physical device and creating the logical device. It runs headless so it needs no display. Cold runs start without
+// a cached device choice, warm runs with one, as every start after the first does. The first run of the process also
+// pays for loading the driver's libraries, so it is reported on its own.
+//
+// Exits with a failure if the median warm start takes longer than the budget, so it can hold startup to one.
+//
+// usage: bench_startup [runs] [budget ms]
+
+#include "vulkan_driver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Run {
+	VulkanInitTimes steps;
+	double total; // Including destroying the device and instance
+};
+
+Run initDriver(const std::string& cachePath) {
+	const auto start = std::chrono::steady_clock::now();
+	VulkanDriver driver(nullptr, cachePath);
+	driver.init();
+	const VulkanInitTimes steps = driver.initTimes();
+	driver.cleanup();
+	return {steps, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+}
+
+double median(std::vector<double> values) {
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+/// One line of the median of each step over `runs`.
+void printRuns(const char* label, const std::vector<Run>& runs) {
+	std::vector<double> instance, device_pick, device, total;
+	for (const Run& run : runs) {
+		instance.push_back(run.steps.instance);
+		device_pick.push_back(run.steps.physicalDevice);
+		device.push_back(run.steps.device);
+		total.push_back(run.total);
+	}
+	std::cout << label << " (median of " << runs.size() << "):\tinstance " << median(instance) << " ms, pick device "
+	          << median(device_pick) << " ms, create device " << median(device) << " ms, total " << median(total) << " ms\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const int runs = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+	const double budget = argc > 2 ? std::atof(argv[2]) : 250.0;
+	const std::string cache_path = (fs::temp_directory_path() / "viper_bench_device.bin").string();
+
+	try {
+		fs::remove(cache_path);
+		const Run first = initDriver(cache_path);
+		std::cout << "first in process:\tinstance " << first.steps.instance << " ms, pick device " << first.steps.physicalDevice
+		          << " ms, create device " << first.steps.device << " ms, total " << first.total << " ms\n";
+
+		std::vector<Run> cold, warm;
+		for (int i = 0; i < runs; i++) {
+			fs::remove(cache_path);
+			cold.push_back(initDriver(cache_path));
+		}
+		for (int i = 0; i < runs; i++) {
+			warm.push_back(initDriver(cache_path));
+			if (!warm.back().steps.cachedDevice) {
+				std::cout << "the cached device was not used!\n";
+				return EXIT_FAILURE;
+			}
+		}
+		fs::remove(cache_path);
+
+		printRuns("cold", cold);
+		printRuns("warm", warm);
+
+		std::vector<double> warm_totals;
+		for (const Run& run : warm) warm_totals.push_back(run.total);
+		if (median(warm_totals) > budget) {
+			std::cout << "over the startup budget of " << budget << " ms!\n";
+			return EXIT_FAILURE;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+// Measures "what is active at frame N" queries over a large timeline, both while scrubbing back and forth
+// and when jumping to random frames.
+//
+// usage: bench_timeline_scrub [segment count] [track count]
+
+#include "timeline.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int argc, char** argv) {
+	const size_t segment_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+	const size_t track_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16;
+
+	// Clips of 1-10 seconds at 30 fps; every fourth one overlaps its successor, like a crossfade would
+	std::mt19937_64 rng(42);
+	Project project;
+	project.resources.push_back({"clip", "clip.mp4"});
+	int64_t timeline_length = 0;
+	for (size_t t = 0; t < track_count; t++) {
+		Track track{"video-track-" + std::to_string(t), TrackKind::Video, {}, {}, true};
+		int64_t frame = static_cast<int64_t>(rng() % 300);
+		for (size_t s = 0; s < segment_count / track_count; s++) {
+			const int64_t length = 30 + static_cast<int64_t>(rng() % 270);
+			track.segments.push_back({0, frame, static_cast<int64_t>(rng() % 1000), length});
+			frame += s % 4 == 0 ? length - 15 : length;
+		}
+		timeline_length = std::max(timeline_length, frame);
+		project.tracks.push_back(std::move(track));
+	}
+
+	auto build_start = std::chrono::steady_clock::now();
+	Timeline timeline(project);
+	auto build_end = std::chrono::steady_clock::now();
+
+	std::vector<ActiveSegment> active;
+	active.reserve(track_count * 2);
+	size_t hits = 0;
+
+	// Scrubbing: the playhead sweeps back and forth over a window, a few frames per step
+	const size_t scrub_queries = 2000000;
+	int64_t playhead = timeline_length / 2;
+	int64_t direction = 3;
+	auto scrub_start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < scrub_queries; i++) {
+		timeline.activeAt(playhead, active);
+		hits += active.size();
+		playhead += direction;
+		if (i % 5000 == 0) direction = -direction;
+	}
+	auto scrub_end = std::chrono::steady_clock::now();
+
+	// Random seeks across the whole timeline
+	const size_t seek_queries = 1000000;
+	std::vector<int64_t> frames(seek_queries);
+	for (auto& f : frames) f = static_cast<int64_t>(rng() % static_cast<uint64_t>(timeline_length));
+	auto seek_start = std::chrono::steady_clock::now();
+	for (int64_t f : frames) {
+		timeline.activeAt(f, active);
+		hits += active.size();
+	}
+	auto seek_end = std::chrono::steady_clock::now();
+
+	auto ns_per = [](auto start, auto end, size_t count) {
+		return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(count);
+	};
+
+	std::cout << "segments: " << segment_count << " on " << track_count << " tracks, " << timeline_length << " frames\n";
+	std::cout << "build:    " << std::chrono::duration<double, std::milli>(build_end - build_start).count() << " ms\n";
+	std::cout << "scrub:    " << ns_per(scrub_start, scrub_end, scrub_queries) << " ns/query\n";
+	std::cout << "seek:     " << ns_per(seek_start, seek_end, seek_queries) << " ns/query\n";
+	std::cout << "hits:     " << hits << "\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+# Writes the SPIR-V module SPIRV out as the C++ header HEADER, declaring SYMBOL as a constexpr array of its words.
+# SOURCE names the shader it was compiled from. Run in script mode (cmake -P) by viper_embed_shaders().
+
+file(READ "${SPIRV}" hex HEX)
+string(LENGTH "${hex}" hex_length)
+math(EXPR partial_word "${hex_length} % 8")
+if(hex_length EQUAL 0 OR NOT partial_word EQUAL 0)
+    message(FATAL_ERROR "${SPIRV} is not a SPIR-V module")
+endif()
+
+# glslc writes little-endian words; turn every four bytes into one, eight to a line
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " words "${hex}")
+if(NOT words MATCHES "^0x07230203, ")
+    message(FATAL_ERROR "${SPIRV} is not a little-endian SPIR-V module")
+endif()
+string(REPEAT "0x[0-9a-f]+, " 8 line)
+string(REGEX REPLACE "(${line})" "\\1\n\t" words "${words}")
+string(REPLACE " \n" "\n" words "${words}")
+string(REGEX REPLACE ",[ \t\n]*$" "," words "${words}")
+
+file(WRITE "${HEADER}" "// Generated from ${SOURCE} by ViperEmbedSpirv.cmake. Do not edit.\n\n"
+                       "#pragma once\n\n"
+                       "#include <cstdint>\n\n"
+                       "inline constexpr uint32_t ${SYMBOL}[] = {\n\t${words}\n};\n")
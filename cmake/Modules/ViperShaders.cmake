@@ -0,0 +1,49 @@
+# Compiles GLSL shaders to SPIR-V with glslc and embeds each one in a generated header as a constexpr array, so the
+# binary carries its shaders and never reads them from disk.
+#
+#   viper_embed_shaders(<target> <shader>...)
+#
+# shaders/foo.comp becomes generated/shaders/foo_comp.h in the build directory, declaring FOO_COMP_SPV: the SPIR-V
+# words as a uint32_t array. The target gets generated/ on its include path, and is rebuilt when a shader changes.
+# Targets in the same directory can embed the same shaders; each is compiled once.
+
+find_program(GLSLC_EXECUTABLE glslc HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin")
+set(VIPER_EMBED_SPIRV_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/ViperEmbedSpirv.cmake")
+
+function(viper_embed_shaders target)
+    if(NOT GLSLC_EXECUTABLE)
+        message(FATAL_ERROR "glslc was not found. It comes with the Vulkan SDK; or set GLSLC_EXECUTABLE.")
+    endif()
+
+    set(generated_dir "${CMAKE_CURRENT_BINARY_DIR}/generated")
+    file(MAKE_DIRECTORY "${generated_dir}/shaders")
+
+    set(headers)
+    foreach(shader ${ARGN})
+        get_filename_component(shader_path "${shader}" ABSOLUTE)
+        get_filename_component(shader_name "${shader}" NAME)
+        string(REPLACE "." "_" stem "${shader_name}")
+        string(TOUPPER "${stem}_SPV" symbol)
+        set(spirv "${generated_dir}/shaders/${stem}.spv")
+        set(header "${generated_dir}/shaders/${stem}.h")
+
+        # A second rule for the same output would be an error
+        get_property(embedded DIRECTORY PROPERTY VIPER_EMBEDDED_SHADERS)
+        if(NOT header IN_LIST embedded)
+            add_custom_command(
+                OUTPUT "${header}"
+                COMMAND "${GLSLC_EXECUTABLE}" -O --target-env=vulkan1.2 -o "${spirv}" "${shader_path}"
+                COMMAND "${CMAKE_COMMAND}" -DSPIRV=${spirv} -DHEADER=${header} -DSYMBOL=${symbol} -DSOURCE=${shader}
+                        -P "${VIPER_EMBED_SPIRV_SCRIPT}"
+                DEPENDS "${shader_path}" "${VIPER_EMBED_SPIRV_SCRIPT}"
+                COMMENT "Compiling ${shader_name} to SPIR-V"
+                VERBATIM
+            )
+            set_property(DIRECTORY APPEND PROPERTY VIPER_EMBEDDED_SHADERS "${header}")
+        endif()
+        list(APPEND headers "${header}")
+    endforeach()
+
+    target_sources(${target} PRIVATE ${headers})
+    target_include_directories(${target} PRIVATE "${generated_dir}")
+endfunction()
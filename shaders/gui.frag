@@ -0,0 +1,23 @@
+#version 450
+
+// Shades a GUI quad: the texture times the vertex color, with rounded corners cut out by their signed distance.
+
+layout(location = 0) in vec2 fragUv;
+layout(location = 1) in vec2 fragLocal;
+layout(location = 2) flat in vec2 fragHalfSize;
+layout(location = 3) flat in float fragRadius;
+layout(location = 4) in vec4 fragColor;
+
+layout(binding = 0) uniform sampler2D atlas;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 color = fragColor * texture(atlas, fragUv);
+    if (fragRadius > 0.0) {
+        vec2 corner = abs(fragLocal) - (fragHalfSize - fragRadius);
+        float distance = length(max(corner, 0.0)) + min(max(corner.x, corner.y), 0.0) - fragRadius;
+        color.a *= clamp(0.5 - distance, 0.0, 1.0); // Anti-aliased over about one pixel
+    }
+    outColor = color;
+}
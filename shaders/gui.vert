@@ -0,0 +1,29 @@
+#version 450
+
+// Places the GUI's pixel-space quads on screen and passes everything else through to the fragment shader.
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec2 local;
+layout(location = 3) in vec2 halfSize;
+layout(location = 4) in float radius;
+layout(location = 5) in vec4 color;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec2 fragLocal;
+layout(location = 2) flat out vec2 fragHalfSize;
+layout(location = 3) flat out float fragRadius;
+layout(location = 4) out vec4 fragColor;
+
+layout(push_constant) uniform Params {
+    vec2 scale; // 2 / target size
+} params;
+
+void main() {
+    gl_Position = vec4(position * params.scale - 1.0, 0.0, 1.0); // Vulkan's y points down, like the GUI's
+    fragUv = uv;
+    fragLocal = local;
+    fragHalfSize = halfSize;
+    fragRadius = radius;
+    fragColor = color;
+}
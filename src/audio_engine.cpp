@@ -0,0 +1,295 @@
+#include "audio_engine.h"
+
+#include "audio_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+static_assert(std::atomic<int64_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free,
+              "the mixer relies on lock-free atomics");
+
+namespace {
+
+constexpr int64_t OPEN_END = std::numeric_limits<int64_t>::max();
+constexpr uint32_t UNKNOWN_RATE = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+void AudioMetrics::print(std::ostream& out) const {
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	out << "audio: " << blocks << " blocks of " << blockMs << "ms, mix mean=" << mixMeanMs << "ms max=" << mixMaxMs
+	    << "ms (load " << std::setprecision(1) << 100.0 * load() << "%)"
+	    << " underruns=" << underruns << " preroll=" << prerollBlocks << " decode errors=" << decodeErrors
+	    << " latency=" << latencyMs << "ms\n";
+	out.flags(flags);
+}
+
+AudioEngine::AudioEngine(const Timeline& timeline, AudioDecoder& decoder, AudioOutput& output, AudioSettings settings)
+	: m_decoder(decoder), m_output(output), m_settings(settings), m_kernels(bestAudioMixKernels()),
+	  m_sampleRate(output.sampleRate()) {
+	if (settings.frameRateNumerator == 0 || settings.frameRateDenominator == 0) {
+		throw std::runtime_error("audio engine needs the timeline's frame rate!");
+	}
+
+	// Enough packets for the buffer at 1:1 rates, and a few more for the one being mixed and rounding
+	const size_t ring_packets = static_cast<size_t>(settings.bufferSeconds * m_sampleRate / PACKET_FRAMES) + 3;
+	for (size_t t = 0; t < timeline.tracks().size(); t++) {
+		const TrackTimeline& timeline_track = timeline.tracks()[t];
+		if (timeline_track.kind() != TrackKind::Audio) continue;
+
+		auto track = std::make_unique<Track>(t, ring_packets);
+		for (size_t i = 0; i < timeline_track.size(); i++) {
+			Span span;
+			span.start = framesAtRate(timeline_track.starts()[i], m_sampleRate);
+			span.end = timeline_track.ends()[i] == OPEN_END ? OPEN_END : framesAtRate(timeline_track.ends()[i], m_sampleRate);
+			if (i + 1 < timeline_track.size()) span.end = std::min(span.end, framesAtRate(timeline_track.starts()[i + 1], m_sampleRate));
+			span.resource = timeline_track.resources()[i];
+			span.clipFrame = timeline_track.clipFrames()[i];
+			if (span.end > span.start) track->spans.push_back(span);
+		}
+		m_tracks.push_back(std::move(track));
+	}
+
+	m_feeder = std::thread([this]() { feederLoop(); });
+	m_output.start([this](float* out, size_t frames) { render(out, frames); });
+}
+
+AudioEngine::~AudioEngine() {
+	m_output.stop();
+	{
+		std::lock_guard<std::mutex> lock(m_feedMutex);
+		m_stopping = true;
+	}
+	m_feedWake.notify_all();
+	m_feeder.join();
+}
+
+void AudioEngine::seek(int64_t frame) {
+	m_seekPosition.store(framesAtRate(frame, m_sampleRate), std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(m_feedMutex);
+		m_generation.fetch_add(1, std::memory_order_release);
+	}
+	m_feedWake.notify_all();
+}
+
+int64_t AudioEngine::playheadFrame() const {
+	const int64_t position = m_playhead.load(std::memory_order_relaxed);
+	return position * m_settings.frameRateNumerator / (int64_t(m_sampleRate) * m_settings.frameRateDenominator);
+}
+
+void AudioEngine::setTrackGain(size_t track, float gain, float pan) {
+	for (auto& candidate : m_tracks) {
+		if (candidate->timelineTrack != track) continue;
+		candidate->gain.store(gain, std::memory_order_relaxed);
+		candidate->pan.store(std::clamp(pan, -1.0f, 1.0f), std::memory_order_relaxed);
+		return;
+	}
+	throw std::runtime_error("not an audio track!");
+}
+
+AudioMetrics AudioEngine::metrics() const {
+	AudioMetrics metrics;
+	metrics.blocks = m_blocks;
+	metrics.underruns = m_underruns;
+	metrics.prerollBlocks = m_prerollBlocks;
+	metrics.decodeErrors = m_decodeErrors;
+	metrics.mixMeanMs = metrics.blocks ? double(m_mixNanoseconds) / double(metrics.blocks) / 1e6 : 0.0;
+	metrics.mixMaxMs = double(m_mixMaxNanoseconds) / 1e6;
+	metrics.blockMs = 1e3 * double(m_output.blockFrames()) / m_sampleRate;
+	metrics.latencyMs = 1e3 * m_output.latencySeconds();
+	return metrics;
+}
+
+void AudioEngine::resetMetrics() {
+	m_blocks = 0;
+	m_underruns = 0;
+	m_prerollBlocks = 0;
+	m_decodeErrors = 0;
+	m_mixNanoseconds = 0;
+	m_mixMaxNanoseconds = 0;
+}
+
+int64_t AudioEngine::framesAtRate(int64_t timelineFrame, uint32_t rate) const {
+	return timelineFrame * int64_t(rate) * m_settings.frameRateDenominator / m_settings.frameRateNumerator;
+}
+
+uint32_t AudioEngine::sourceRate(uint32_t resource) {
+	if (resource >= m_sourceRates.size()) m_sourceRates.resize(resource + 1, UNKNOWN_RATE);
+	if (m_sourceRates[resource] == UNKNOWN_RATE) m_sourceRates[resource] = m_decoder.sampleRate(resource);
+	return m_sourceRates[resource];
+}
+
+void AudioEngine::feederLoop() {
+	const int64_t buffer_frames = static_cast<int64_t>(m_settings.bufferSeconds * m_sampleRate);
+	const auto idle_wait = std::chrono::duration<double>(m_settings.bufferSeconds / 8);
+
+	for (;;) {
+		const uint64_t generation = m_generation.load(std::memory_order_acquire);
+		const int64_t horizon = std::max(m_playhead.load(std::memory_order_relaxed), m_seekPosition.load(std::memory_order_relaxed))
+		                        + buffer_frames;
+
+		bool progress = false;
+		for (auto& track : m_tracks) progress |= feed(*track, generation, horizon);
+
+		std::unique_lock<std::mutex> lock(m_feedMutex);
+		if (!progress) { // Full or far enough ahead: the mixer frees a packet every few milliseconds
+			m_feedWake.wait_for(lock, idle_wait, [&]() { return m_stopping || m_generation.load() != generation; });
+		}
+		if (m_stopping) return;
+	}
+}
+
+bool AudioEngine::feed(Track& track, uint64_t generation, int64_t horizon) {
+	if (track.feedGeneration != generation) {
+		track.feedGeneration = generation;
+		track.feedPosition = m_seekPosition.load(std::memory_order_relaxed);
+		track.bufferedUntil.store(track.feedPosition, std::memory_order_relaxed);
+		track.bufferedGeneration.store(generation, std::memory_order_release);
+	}
+
+	bool progress = false;
+	while (track.feedPosition < horizon && m_generation.load(std::memory_order_relaxed) == generation) {
+		const int64_t position = track.feedPosition;
+		auto after = std::upper_bound(track.spans.begin(), track.spans.end(), position,
+		                              [](int64_t frame, const Span& span) { return frame < span.start; });
+
+		// Between segments, or on one without audio: nothing to decode, but the mixer needs to know it is silence
+		const Span* span = after != track.spans.begin() && position < (after - 1)->end ? &*(after - 1) : nullptr;
+		const uint32_t rate = span ? sourceRate(span->resource) : 0;
+		if (rate == 0) {
+			const int64_t silent_until = span ? span->end : after != track.spans.end() ? after->start : OPEN_END;
+			track.feedPosition = std::min(silent_until, horizon);
+			track.bufferedUntil.store(track.feedPosition, std::memory_order_release);
+			progress = true;
+			continue;
+		}
+
+		Packet* packet = track.ring.back();
+		if (!packet) break;
+
+		// Where the source is at this output frame, split into the first source frame to decode and a fraction.
+		// The packet carries as many output frames as it has source frames for, interpolation included.
+		const double step = double(rate) / m_sampleRate;
+		const double source = double(framesAtRate(span->clipFrame, rate)) + double(position - span->start) * step;
+		const double first = std::floor(source);
+		const double phase = source - first;
+		const int64_t frames = std::min<int64_t>(static_cast<int64_t>((PACKET_FRAMES - 1 - phase) / step) + 1, span->end - position);
+		const size_t needed = static_cast<size_t>(phase + double(frames - 1) * step) + 2;
+
+		size_t decoded = 0;
+		try {
+			decoded = std::min(needed, m_decoder.decode(span->resource, static_cast<int64_t>(first), packet->samples, needed));
+		} catch (const std::exception&) {
+			m_decodeErrors++;
+		}
+		std::fill(packet->samples + 2 * decoded, packet->samples + 2 * needed, 0.0f); // Past the end of the source
+
+		packet->generation = generation;
+		packet->start = position;
+		packet->end = position + frames;
+		packet->position = phase;
+		packet->step = step;
+		track.ring.push();
+
+		track.feedPosition = packet->end;
+		track.bufferedUntil.store(track.feedPosition, std::memory_order_release);
+		progress = true;
+	}
+	return progress;
+}
+
+void AudioEngine::render(float* out, size_t frames) {
+	const auto start_time = std::chrono::steady_clock::now();
+	std::fill(out, out + 2 * frames, 0.0f);
+
+	const uint64_t generation = m_generation.load(std::memory_order_acquire);
+	if (generation != m_mixGeneration) {
+		m_mixGeneration = generation;
+		m_mixPosition = m_seekPosition.load(std::memory_order_relaxed);
+		m_playhead.store(m_mixPosition, std::memory_order_relaxed);
+		m_primed = false;
+	}
+
+	// After a seek, drop what was buffered for the old position and wait for a block from every track at the new one.
+	// Packets from a newer generation are kept: they are for a seek made since `generation` was read.
+	if (!m_primed) {
+		m_primed = true;
+		for (auto& track : m_tracks) {
+			for (Packet* packet = track->ring.front(); packet && packet->generation < generation; packet = track->ring.front()) {
+				track->ring.pop();
+			}
+			m_primed = m_primed && track->bufferedGeneration.load(std::memory_order_acquire) == generation
+			           && track->bufferedUntil.load(std::memory_order_acquire) >= m_mixPosition + int64_t(frames);
+		}
+	}
+
+	if (m_playing.load(std::memory_order_relaxed)) {
+		if (m_primed) {
+			const float master = m_masterGain.load(std::memory_order_relaxed);
+			for (auto& track : m_tracks) {
+				if (!mixTrack(*track, out, m_mixPosition, frames, master)) m_underruns.fetch_add(1, std::memory_order_relaxed);
+			}
+			m_mixPosition += int64_t(frames);
+			m_playhead.store(m_mixPosition, std::memory_order_relaxed);
+		} else {
+			m_prerollBlocks.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	const uint64_t elapsed = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+	m_blocks.fetch_add(1, std::memory_order_relaxed);
+	m_mixNanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+	if (elapsed > m_mixMaxNanoseconds.load(std::memory_order_relaxed)) m_mixMaxNanoseconds.store(elapsed, std::memory_order_relaxed);
+}
+
+bool AudioEngine::mixTrack(Track& track, float* out, int64_t start, size_t frames, float master) {
+	const int64_t end = start + int64_t(frames);
+
+	// Constant-power pan, scaled so the centre keeps the gain on both channels
+	const float gain = track.gain.load(std::memory_order_relaxed) * master;
+	const float angle = (track.pan.load(std::memory_order_relaxed) + 1.0f) * 0.785398163f;
+	const float left = gain * 1.41421356f * std::cos(angle);
+	const float right = gain * 1.41421356f * std::sin(angle);
+	const GainRamp ramp = {track.left, track.right, (left - track.left) / float(frames), (right - track.right) / float(frames)};
+	track.left = left;
+	track.right = right;
+
+	// Read before looking at the ring: once the decoder has published a position, its packets up to there are
+	// visible too, so an empty ring then means silence rather than a decoder running late
+	const bool buffered = track.bufferedGeneration.load(std::memory_order_acquire) == m_mixGeneration
+	                      && track.bufferedUntil.load(std::memory_order_acquire) >= end;
+
+	int64_t cursor = start;
+	while (cursor < end) {
+		Packet* packet = track.ring.front();
+		if (!packet) return buffered;
+		if (packet->generation > m_mixGeneration) return true; // For a seek the next block picks up; never refilled if dropped
+		if (packet->generation < m_mixGeneration || packet->end <= cursor) { // Stale
+			track.ring.pop();
+			continue;
+		}
+		if (packet->start >= end) break;
+
+		const int64_t from = std::max(cursor, packet->start);
+		const int64_t to = std::min(end, packet->end);
+		const size_t offset = size_t(from - start);
+		const double position = packet->position + double(from - packet->start) * packet->step;
+		if (packet->step == 1.0 && position == std::floor(position)) {
+			m_kernels.mix(out + 2 * offset, packet->samples + 2 * size_t(position), size_t(to - from), ramp.from(offset));
+		} else {
+			m_kernels.mixResampled(out + 2 * offset, packet->samples, position, packet->step, size_t(to - from), ramp.from(offset));
+		}
+
+		cursor = to;
+		if (packet->end > end) break; // The rest plays in the next block
+		track.ring.pop();
+	}
+	return true;
+}
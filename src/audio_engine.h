@@ -0,0 +1,172 @@
+#pragma once
+
+#include "audio_mix.h"
+#include "spsc_ring.h"
+#include "timeline.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+class AudioOutput;
+
+/// Decodes a resource's audio as interleaved stereo float at the resource's own sample rate. Only ever called
+/// from the engine's decoder thread.
+class AudioDecoder {
+public:
+	virtual ~AudioDecoder() = default;
+	/// The resource's sample rate; 0 if it has no audio.
+	virtual uint32_t sampleRate(uint32_t resource) = 0;
+	/// Decode `frames` stereo frames starting at `firstFrame` into `out`. Returns the number decoded, which is
+	/// smaller than asked at the end of the resource.
+	virtual size_t decode(uint32_t resource, int64_t firstFrame, float* out, size_t frames) = 0;
+};
+
+struct AudioSettings {
+	uint32_t frameRateNumerator = 30; // Timeline frames per second, which segment positions are in
+	uint32_t frameRateDenominator = 1;
+	double bufferSeconds = 0.5;       // Decoded ahead of the playhead, per track
+};
+
+struct AudioMetrics {
+	uint64_t blocks = 0;         // Blocks the output asked for
+	uint64_t underruns = 0;      // Track blocks that had to be played silent because the decoder was behind
+	uint64_t prerollBlocks = 0;  // Silent blocks after a seek, waiting for the decoders to fill the buffers
+	uint64_t decodeErrors = 0;   // Packets played silent because the decoder threw
+	double mixMeanMs = 0.0;      // Time the callback took
+	double mixMaxMs = 0.0;
+	double blockMs = 0.0;        // The time one block plays for: the callback's budget
+	double latencyMs = 0.0;      // From mixing a block to hearing it
+
+	double load() const { return blockMs > 0.0 ? mixMeanMs / blockMs : 0.0; }
+	void print(std::ostream& out) const;
+};
+
+/// Plays a timeline's audio tracks.
+///
+/// A decoder thread reads each track ahead of the playhead, cut into packets at the sources' own sample rates,
+/// and hands them to the mixer through one lock-free ring per track. The mixer runs in the output's real-time
+/// callback and never locks, allocates or waits: it resamples each packet to the output rate, applies the track's
+/// gain and pan, and adds it into the output block, all in one SIMD pass per packet. A track whose ring runs dry
+/// plays silence for the block and counts an underrun.
+///
+/// Seeking bumps a generation number; the mixer drops packets from older generations and plays silence until
+/// every track has buffered a block at the new position. Segments are placed in timeline frames (see
+/// AudioSettings), and start at their clip frame's time in the source.
+class AudioEngine {
+public:
+	/// `timeline`, `decoder` and `output` must outlive the engine. Starts the output, paused at frame 0.
+	AudioEngine(const Timeline& timeline, AudioDecoder& decoder, AudioOutput& output, AudioSettings settings = {});
+	/// Stops the output.
+	~AudioEngine();
+
+	AudioEngine(const AudioEngine&) = delete;
+	AudioEngine& operator=(const AudioEngine&) = delete;
+
+	void play() { m_playing = true; }
+	void pause() { m_playing = false; }
+	bool playing() const { return m_playing; }
+
+	/// Continue playback from timeline frame `frame`.
+	void seek(int64_t frame);
+	/// The timeline frame being mixed.
+	int64_t playheadFrame() const;
+
+	/// `track` indexes Timeline::tracks(). `gain` is linear; `pan` goes from -1 (left) to 1 (right) at constant
+	/// power, with both channels at `gain` in the centre. Both take effect smoothly over the next block.
+	void setTrackGain(size_t track, float gain, float pan = 0.0f);
+	void setMasterGain(float gain) { m_masterGain = gain; }
+
+	AudioMetrics metrics() const;
+	void resetMetrics();
+
+	/// Frames of audio a packet carries, plus one from the next packet for interpolating across the seam.
+	static constexpr size_t PACKET_FRAMES = 1024;
+
+private:
+	struct Packet {
+		uint64_t generation;
+		int64_t start;      // Output frame the packet starts at
+		int64_t end;        // Exclusive
+		double position;    // Source frame within `samples` that output frame `start` reads
+		double step;        // Source frames per output frame
+		float samples[2 * (PACKET_FRAMES + 1)];
+	};
+
+	/// A segment in output frames.
+	struct Span {
+		int64_t start;
+		int64_t end;            // Cut short where the track's next segment starts
+		uint32_t resource;
+		int64_t clipFrame;
+	};
+
+	struct Track {
+		size_t timelineTrack;
+		std::vector<Span> spans;
+		SpscRing<Packet> ring;
+		std::atomic<float> gain{1.0f};
+		std::atomic<float> pan{0.0f};
+
+		// The decoder's side. `bufferedUntil` is published for the generation in `bufferedGeneration`.
+		int64_t feedPosition = 0;
+		uint64_t feedGeneration = 0;
+		std::atomic<int64_t> bufferedUntil{0};
+		std::atomic<uint64_t> bufferedGeneration{0};
+
+		// The mixer's side: the gains it ended the last block on
+		float left = 0.0f;
+		float right = 0.0f;
+
+		Track(size_t timelineTrack, size_t ringPackets) : timelineTrack(timelineTrack), ring(ringPackets) {}
+	};
+
+	AudioDecoder& m_decoder;
+	AudioOutput& m_output;
+	AudioSettings m_settings;
+	const AudioMixKernels& m_kernels;
+	uint32_t m_sampleRate;
+	std::vector<std::unique_ptr<Track>> m_tracks;
+	std::vector<uint32_t> m_sourceRates; // By resource, looked up on the decoder thread
+
+	std::atomic<bool> m_playing{false};
+	std::atomic<float> m_masterGain{1.0f};
+	std::atomic<uint64_t> m_generation{1};
+	std::atomic<int64_t> m_seekPosition{0}; // Output frame to play from in the current generation
+	std::atomic<int64_t> m_playhead{0};     // Output frame the mixer is at
+
+	// The mixer's own state
+	uint64_t m_mixGeneration = 0;
+	int64_t m_mixPosition = 0;
+	bool m_primed = false;
+
+	std::atomic<uint64_t> m_blocks{0};
+	std::atomic<uint64_t> m_underruns{0};
+	std::atomic<uint64_t> m_prerollBlocks{0};
+	std::atomic<uint64_t> m_decodeErrors{0};
+	std::atomic<uint64_t> m_mixNanoseconds{0};
+	std::atomic<uint64_t> m_mixMaxNanoseconds{0};
+
+	std::mutex m_feedMutex; // Only for sleeping; the mixer never takes it
+	std::condition_variable m_feedWake;
+	bool m_stopping = false;
+	std::thread m_feeder;
+
+	/// Timeline frame `timelineFrame` as a frame at sample rate `rate`.
+	int64_t framesAtRate(int64_t timelineFrame, uint32_t rate) const;
+	uint32_t sourceRate(uint32_t resource);
+
+	void feederLoop();
+	/// Decode ahead on `track` until its ring is full or it is `horizon` ahead. Returns whether it made progress.
+	bool feed(Track& track, uint64_t generation, int64_t horizon);
+
+	void render(float* out, size_t frames);
+	/// Add the track's audio for output frames [start, start + frames) to `out`. Returns false on an underrun.
+	bool mixTrack(Track& track, float* out, int64_t start, size_t frames, float master);
+};
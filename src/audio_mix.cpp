@@ -0,0 +1,176 @@
+#include "audio_mix.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VIPER_AUDIO_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define VIPER_AUDIO_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// The scalar kernels work on a range of frames [first, end) so the SIMD kernels can finish their odd last frame
+// with them and still compute its gain exactly as the scalar kernel would.
+
+void mixRange(float* out, const float* in, size_t first, size_t end, const GainRamp& ramp) {
+	for (size_t k = first; k < end; k++) {
+		const float left = ramp.left + static_cast<float>(k) * ramp.leftStep;
+		const float right = ramp.right + static_cast<float>(k) * ramp.rightStep;
+		out[2 * k] = out[2 * k] + in[2 * k] * left;
+		out[2 * k + 1] = out[2 * k + 1] + in[2 * k + 1] * right;
+	}
+}
+
+void mixResampledRange(float* out, const float* in, double position, double step, size_t first, size_t end,
+                       const GainRamp& ramp) {
+	for (size_t k = first; k < end; k++) {
+		const double source = position + static_cast<double>(k) * step;
+		const size_t i = static_cast<size_t>(source);
+		const float t = static_cast<float>(source - static_cast<double>(i));
+		const float* a = in + 2 * i;
+		const float left = ramp.left + static_cast<float>(k) * ramp.leftStep;
+		const float right = ramp.right + static_cast<float>(k) * ramp.rightStep;
+		out[2 * k] = out[2 * k] + (a[0] + t * (a[2] - a[0])) * left;
+		out[2 * k + 1] = out[2 * k + 1] + (a[1] + t * (a[3] - a[1])) * right;
+	}
+}
+
+void mixScalar(float* out, const float* in, size_t frames, const GainRamp& ramp) {
+	mixRange(out, in, 0, frames, ramp);
+}
+
+void mixResampledScalar(float* out, const float* in, double position, double step, size_t frames, const GainRamp& ramp) {
+	mixResampledRange(out, in, position, step, 0, frames, ramp);
+}
+
+// The SIMD kernels do two stereo frames per 128-bit register: lanes L0 R0 L1 R1. Resampling reads each output
+// frame's two neighbouring source frames with one unaligned load, as they are adjacent, and deinterleaves the pair
+// of loads into the "before" and "after" frames.
+
+#if defined(VIPER_AUDIO_SSE2)
+
+void mixSse2(float* out, const float* in, size_t frames, const GainRamp& ramp) {
+	const __m128 start = _mm_setr_ps(ramp.left, ramp.right, ramp.left, ramp.right);
+	const __m128 step = _mm_setr_ps(ramp.leftStep, ramp.rightStep, ramp.leftStep, ramp.rightStep);
+	__m128 k = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for (; i + 2 <= frames; i += 2) {
+		const __m128 gain = _mm_add_ps(start, _mm_mul_ps(k, step));
+		const __m128 mixed = _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(_mm_loadu_ps(in + 2 * i), gain));
+		_mm_storeu_ps(out + 2 * i, mixed);
+		k = _mm_add_ps(k, two);
+	}
+	mixRange(out, in, i, frames, ramp);
+}
+
+void mixResampledSse2(float* out, const float* in, double position, double step, size_t frames, const GainRamp& ramp) {
+	const __m128 start = _mm_setr_ps(ramp.left, ramp.right, ramp.left, ramp.right);
+	const __m128 gain_step = _mm_setr_ps(ramp.leftStep, ramp.rightStep, ramp.leftStep, ramp.rightStep);
+	__m128 k = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for (; i + 2 <= frames; i += 2) {
+		const double source0 = position + static_cast<double>(i) * step;
+		const double source1 = position + static_cast<double>(i + 1) * step;
+		const size_t i0 = static_cast<size_t>(source0);
+		const size_t i1 = static_cast<size_t>(source1);
+		const float t0 = static_cast<float>(source0 - static_cast<double>(i0));
+		const float t1 = static_cast<float>(source1 - static_cast<double>(i1));
+
+		const __m128 pair0 = _mm_loadu_ps(in + 2 * i0);
+		const __m128 pair1 = _mm_loadu_ps(in + 2 * i1);
+		const __m128 before = _mm_shuffle_ps(pair0, pair1, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m128 after = _mm_shuffle_ps(pair0, pair1, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m128 t = _mm_setr_ps(t0, t0, t1, t1);
+		const __m128 sample = _mm_add_ps(before, _mm_mul_ps(t, _mm_sub_ps(after, before)));
+
+		const __m128 gain = _mm_add_ps(start, _mm_mul_ps(k, gain_step));
+		_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(sample, gain)));
+		k = _mm_add_ps(k, two);
+	}
+	mixResampledRange(out, in, position, step, i, frames, ramp);
+}
+
+#elif defined(VIPER_AUDIO_NEON)
+
+// vmlaq_f32 may be fused on ARM64, so multiplies and adds stay separate to match the scalar kernels
+
+void mixNeon(float* out, const float* in, size_t frames, const GainRamp& ramp) {
+	const float start_values[4] = {ramp.left, ramp.right, ramp.left, ramp.right};
+	const float step_values[4] = {ramp.leftStep, ramp.rightStep, ramp.leftStep, ramp.rightStep};
+	const float k_values[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+	const float32x4_t start = vld1q_f32(start_values);
+	const float32x4_t step = vld1q_f32(step_values);
+	float32x4_t k = vld1q_f32(k_values);
+	const float32x4_t two = vdupq_n_f32(2.0f);
+
+	size_t i = 0;
+	for (; i + 2 <= frames; i += 2) {
+		const float32x4_t gain = vaddq_f32(start, vmulq_f32(k, step));
+		vst1q_f32(out + 2 * i, vaddq_f32(vld1q_f32(out + 2 * i), vmulq_f32(vld1q_f32(in + 2 * i), gain)));
+		k = vaddq_f32(k, two);
+	}
+	mixRange(out, in, i, frames, ramp);
+}
+
+void mixResampledNeon(float* out, const float* in, double position, double step, size_t frames, const GainRamp& ramp) {
+	const float start_values[4] = {ramp.left, ramp.right, ramp.left, ramp.right};
+	const float step_values[4] = {ramp.leftStep, ramp.rightStep, ramp.leftStep, ramp.rightStep};
+	const float k_values[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+	const float32x4_t start = vld1q_f32(start_values);
+	const float32x4_t gain_step = vld1q_f32(step_values);
+	float32x4_t k = vld1q_f32(k_values);
+	const float32x4_t two = vdupq_n_f32(2.0f);
+
+	size_t i = 0;
+	for (; i + 2 <= frames; i += 2) {
+		const double source0 = position + static_cast<double>(i) * step;
+		const double source1 = position + static_cast<double>(i + 1) * step;
+		const size_t i0 = static_cast<size_t>(source0);
+		const size_t i1 = static_cast<size_t>(source1);
+		const float t0 = static_cast<float>(source0 - static_cast<double>(i0));
+		const float t1 = static_cast<float>(source1 - static_cast<double>(i1));
+
+		const float32x4_t pair0 = vld1q_f32(in + 2 * i0);
+		const float32x4_t pair1 = vld1q_f32(in + 2 * i1);
+		const float32x4_t before = vcombine_f32(vget_low_f32(pair0), vget_low_f32(pair1));
+		const float32x4_t after = vcombine_f32(vget_high_f32(pair0), vget_high_f32(pair1));
+		const float32x4_t t = vcombine_f32(vdup_n_f32(t0), vdup_n_f32(t1));
+		const float32x4_t sample = vaddq_f32(before, vmulq_f32(t, vsubq_f32(after, before)));
+
+		const float32x4_t gain = vaddq_f32(start, vmulq_f32(k, gain_step));
+		vst1q_f32(out + 2 * i, vaddq_f32(vld1q_f32(out + 2 * i), vmulq_f32(sample, gain)));
+		k = vaddq_f32(k, two);
+	}
+	mixResampledRange(out, in, position, step, i, frames, ramp);
+}
+
+#endif
+
+} // namespace
+
+const AudioMixKernels& scalarAudioMixKernels() {
+	static const AudioMixKernels kernels = {"scalar", mixScalar, mixResampledScalar};
+	return kernels;
+}
+
+const AudioMixKernels* simdAudioMixKernels() {
+#if defined(VIPER_AUDIO_SSE2)
+	static const AudioMixKernels kernels = {"sse2", mixSse2, mixResampledSse2};
+	return &kernels;
+#elif defined(VIPER_AUDIO_NEON)
+	static const AudioMixKernels kernels = {"neon", mixNeon, mixResampledNeon};
+	return &kernels;
+#else
+	return nullptr;
+#endif
+}
+
+const AudioMixKernels& bestAudioMixKernels() {
+	const AudioMixKernels* simd = simdAudioMixKernels();
+	return simd ? *simd : scalarAudioMixKernels();
+}
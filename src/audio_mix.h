@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+/// Per-channel gain moving linearly across a block, so gain and pan changes do not click: frame k of the block is
+/// scaled by left + k * leftStep on the left channel, and likewise on the right.
+struct GainRamp {
+	float left;
+	float right;
+	float leftStep = 0.0f;
+	float rightStep = 0.0f;
+
+	/// The ramp from where this one is at frame `offset`.
+	GainRamp from(size_t offset) const {
+		const float k = static_cast<float>(offset);
+		return {left + k * leftStep, right + k * rightStep, leftStep, rightStep};
+	}
+};
+
+/// Add `frames` interleaved stereo frames of `in`, scaled by `ramp`, onto `out`.
+using MixStereoFn = void (*)(float* out, const float* in, size_t frames, const GainRamp& ramp);
+
+/// Like MixStereoFn, but read `in` at source frame position + k * step for output frame k, interpolating linearly
+/// between neighbouring source frames. `in` must hold floor(position + (frames - 1) * step) + 2 frames.
+using MixResampledFn = void (*)(float* out, const float* in, double position, double step, size_t frames, const GainRamp& ramp);
+
+/// One implementation of the mixing kernels. All of them produce bit-identical results: they evaluate the same
+/// float expressions in the same order, without fused multiply-adds.
+struct AudioMixKernels {
+	const char* name;
+	MixStereoFn mix;
+	MixResampledFn mixResampled;
+};
+
+const AudioMixKernels& scalarAudioMixKernels();
+/// SSE2 on x86, NEON on ARM64; null elsewhere. Both are part of the baseline instruction set, so no CPU check.
+const AudioMixKernels* simdAudioMixKernels();
+/// The SIMD kernels where there are some, scalar otherwise.
+const AudioMixKernels& bestAudioMixKernels();
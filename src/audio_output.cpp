@@ -0,0 +1,100 @@
+#include "audio_output.h"
+
+#include <chrono>
+#include <stdexcept>
+
+ThreadedAudioOutput::ThreadedAudioOutput(uint32_t sampleRate, size_t blockFrames, bool realtime)
+	: m_sampleRate(sampleRate), m_blockFrames(blockFrames ? blockFrames : 1), m_realtime(realtime), m_block(2 * m_blockFrames) {
+	if (sampleRate == 0) throw std::runtime_error("audio output needs a sample rate!");
+}
+
+ThreadedAudioOutput::~ThreadedAudioOutput() {
+	stop();
+}
+
+void ThreadedAudioOutput::start(Callback callback) {
+	ThreadedAudioOutput::stop(); // Not the derived stop(), which may finish the output for good
+	m_running = true;
+	m_thread = std::thread([this, callback = std::move(callback)]() {
+		using Clock = std::chrono::steady_clock;
+		const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(latencySeconds()));
+		auto deadline = Clock::now() + period;
+
+		while (m_running.load(std::memory_order_relaxed)) {
+			callback(m_block.data(), m_blockFrames);
+			consume(m_block.data(), m_blockFrames);
+			if (!m_realtime) continue;
+
+			// A sound card would have played silence for the blocks we are late for; start counting afresh
+			const auto now = Clock::now();
+			if (now > deadline) {
+				m_lateBlocks++;
+				deadline = now;
+			}
+			std::this_thread::sleep_until(deadline);
+			deadline += period;
+		}
+	});
+}
+
+void ThreadedAudioOutput::stop() {
+	m_running = false;
+	if (m_thread.joinable()) m_thread.join();
+}
+
+namespace {
+
+void writeLittleEndian(std::ofstream& file, uint32_t value, int bytes) {
+	char data[4];
+	for (int i = 0; i < bytes; i++) data[i] = static_cast<char>(value >> (8 * i));
+	file.write(data, bytes);
+}
+
+constexpr uint32_t WAV_HEADER_SIZE = 44;
+
+} // namespace
+
+WavFileAudioOutput::WavFileAudioOutput(const std::string& path, uint32_t sampleRate, size_t blockFrames, bool realtime)
+	: ThreadedAudioOutput(sampleRate, blockFrames, realtime), m_file(path, std::ios::binary | std::ios::trunc) {
+	if (!m_file.is_open()) throw std::runtime_error("failed to create '" + path + "'!");
+
+	// The two sizes are filled in by stop()
+	m_file.write("RIFF", 4);
+	writeLittleEndian(m_file, 0, 4);
+	m_file.write("WAVEfmt ", 8);
+	writeLittleEndian(m_file, 16, 4);
+	writeLittleEndian(m_file, 3, 2); // WAVE_FORMAT_IEEE_FLOAT
+	writeLittleEndian(m_file, 2, 2);
+	writeLittleEndian(m_file, sampleRate, 4);
+	writeLittleEndian(m_file, sampleRate * 2 * sizeof(float), 4);
+	writeLittleEndian(m_file, 2 * sizeof(float), 2);
+	writeLittleEndian(m_file, 32, 2);
+	m_file.write("data", 4);
+	writeLittleEndian(m_file, 0, 4);
+}
+
+WavFileAudioOutput::~WavFileAudioOutput() {
+	try {
+		stop();
+	} catch (...) { // Destructors must not throw; call stop() to hear about write errors
+	}
+}
+
+void WavFileAudioOutput::stop() {
+	ThreadedAudioOutput::stop();
+	if (!m_file.is_open()) return;
+
+	const uint64_t data_size = m_frames * 2 * sizeof(float);
+	m_file.seekp(4);
+	writeLittleEndian(m_file, static_cast<uint32_t>(WAV_HEADER_SIZE - 8 + data_size), 4);
+	m_file.seekp(40);
+	writeLittleEndian(m_file, static_cast<uint32_t>(data_size), 4);
+	m_file.close();
+	if (m_file.fail()) throw std::runtime_error("failed to write wav file!");
+}
+
+void WavFileAudioOutput::consume(const float* block, size_t frames) {
+	// Samples are written in the host's byte order, which is little-endian everywhere we build
+	m_file.write(reinterpret_cast<const char*>(block), static_cast<std::streamsize>(frames * 2 * sizeof(float)));
+	m_frames += frames;
+}
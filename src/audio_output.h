@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Where mixed audio goes: interleaved stereo float frames, pulled a block at a time by the output's own thread.
+class AudioOutput {
+public:
+	/// Fill `out` with `frames` interleaved stereo frames. Runs on the output's real-time thread, so it must not
+	/// block, lock or allocate.
+	using Callback = std::function<void(float* out, size_t frames)>;
+
+	virtual ~AudioOutput() = default;
+
+	virtual uint32_t sampleRate() const = 0;
+	virtual size_t blockFrames() const = 0;
+	/// Time from a block being mixed to it being heard.
+	virtual double latencySeconds() const = 0;
+
+	/// Start calling `callback`. Not called again once stop() returns.
+	virtual void start(Callback callback) = 0;
+	virtual void stop() = 0;
+};
+
+/// An output without a device, for tests, benchmarks and headless runs: a thread of its own pulls blocks, either
+/// paced like a sound card or as fast as the callback allows, and passes them to consume().
+class ThreadedAudioOutput : public AudioOutput {
+public:
+	ThreadedAudioOutput(uint32_t sampleRate, size_t blockFrames, bool realtime);
+	/// Derived classes must call stop() in their destructor, while consume() still works.
+	~ThreadedAudioOutput() override;
+
+	uint32_t sampleRate() const override { return m_sampleRate; }
+	size_t blockFrames() const override { return m_blockFrames; }
+	double latencySeconds() const override { return double(m_blockFrames) / m_sampleRate; }
+
+	void start(Callback callback) override;
+	void stop() override;
+
+	/// Blocks a paced output was too late for (the callback, or the thread, took longer than a block).
+	uint64_t lateBlocks() const { return m_lateBlocks; }
+
+protected:
+	/// Called on the output thread with each block after the callback filled it.
+	virtual void consume(const float* block, size_t frames) = 0;
+
+private:
+	uint32_t m_sampleRate;
+	size_t m_blockFrames;
+	bool m_realtime;
+	std::vector<float> m_block;
+	std::thread m_thread;
+	std::atomic<bool> m_running{false};
+	std::atomic<uint64_t> m_lateBlocks{0};
+};
+
+/// Discards the audio.
+class NullAudioOutput : public ThreadedAudioOutput {
+public:
+	NullAudioOutput(uint32_t sampleRate = 48000, size_t blockFrames = 256, bool realtime = true)
+		: ThreadedAudioOutput(sampleRate, blockFrames, realtime) {}
+	~NullAudioOutput() override { stop(); }
+
+protected:
+	void consume(const float*, size_t) override {}
+};
+
+/// Records the audio to a 32-bit float stereo WAV file, which is complete once stop() returns. Unpaced, it records
+/// as fast as the callback goes, which only sounds right if the callback's sources keep up.
+class WavFileAudioOutput : public ThreadedAudioOutput {
+public:
+	WavFileAudioOutput(const std::string& path, uint32_t sampleRate = 48000, size_t blockFrames = 256, bool realtime = true);
+	~WavFileAudioOutput() override;
+
+	void stop() override;
+
+protected:
+	void consume(const float* block, size_t frames) override;
+
+private:
+	std::ofstream m_file;
+	uint64_t m_frames = 0;
+};
@@ -0,0 +1,122 @@
+#include "blend_kernels.h"
+
+// Built with AVX2 and F16C code generation enabled (see CMakeLists.txt); only called after the CPU is checked.
+#if defined(__AVX2__) && (defined(__F16C__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+// RGBA8 blends eight pixels at a time in 16-bit lanes, RGBA16F four at a time as floats. Both unpack within
+// 128-bit lanes, which the packs and stores undo, so pixels never cross lanes.
+
+namespace {
+
+inline __m256i div255(__m256i x) {
+	const __m256i t = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+/// Blend four widened pixels.
+template<BlendMode Mode>
+inline __m256i blendPixels(__m256i d, __m256i s, __m256i opacity) {
+	const __m256i full = _mm256_set1_epi16(255);
+	const __m256i alpha_lanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+	const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	const __m256i sa = div255(_mm256_mullo_epi16(a, opacity));
+	const __m256i inverse = _mm256_sub_epi16(full, sa);
+	const __m256i alpha = _mm256_add_epi16(sa, div255(_mm256_mullo_epi16(d, inverse)));
+
+	__m256i color;
+	if (Mode == BlendMode::AlphaOver) {
+		color = div255(_mm256_add_epi16(_mm256_mullo_epi16(s, sa), _mm256_mullo_epi16(d, inverse)));
+	} else if (Mode == BlendMode::Additive) {
+		color = _mm256_min_epi16(_mm256_add_epi16(d, div255(_mm256_mullo_epi16(s, sa))), full);
+	} else {
+		color = div255(_mm256_mullo_epi16(d, _mm256_add_epi16(div255(_mm256_mullo_epi16(s, sa)), inverse)));
+	}
+	return _mm256_blendv_epi8(color, alpha, alpha_lanes);
+}
+
+template<BlendMode Mode>
+void blendRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opacity16 = _mm256_set1_epi16(static_cast<short>(opacity));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+		const __m256i low = blendPixels<Mode>(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), opacity16);
+		const __m256i high = blendPixels<Mode>(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), opacity16);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(low, high));
+	}
+	scalarBlendKernels().rgba8[static_cast<size_t>(Mode)](dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+/// Blend two pixels, one per 128-bit lane.
+template<BlendMode Mode>
+inline __m256 blendPixels(__m256 d, __m256 s, __m256 opacity) {
+	const __m256 sa = _mm256_mul_ps(_mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3)), opacity);
+	const __m256 inverse = _mm256_sub_ps(_mm256_set1_ps(1.0f), sa);
+	const __m256 kept = _mm256_mul_ps(d, inverse);
+	const __m256 alpha = _mm256_add_ps(sa, kept);
+
+	const __m256 weighted = _mm256_mul_ps(s, sa);
+	__m256 color;
+	if (Mode == BlendMode::AlphaOver) {
+		color = _mm256_add_ps(weighted, kept);
+	} else if (Mode == BlendMode::Additive) {
+		color = _mm256_add_ps(d, weighted);
+	} else {
+		color = _mm256_mul_ps(d, _mm256_add_ps(inverse, weighted));
+	}
+	return _mm256_blend_ps(color, alpha, 0x88);
+}
+
+/// `v` with NaN lanes replaced by the canonical NaN, before conversion to half.
+inline __m256 canonicalNan(__m256 v) {
+	const __m256 nan = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(FLOAT_NAN_BITS)));
+	return _mm256_blendv_ps(v, nan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+}
+
+template<BlendMode Mode>
+void blendRgba16f(uint16_t* dst, const uint16_t* src, size_t count, float opacity) {
+	const __m256 opacity_ps = _mm256_set1_ps(opacity);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+		__m256 low = blendPixels<Mode>(_mm256_cvtph_ps(_mm256_castsi256_si128(d)),
+		                               _mm256_cvtph_ps(_mm256_castsi256_si128(s)), opacity_ps);
+		__m256 high = blendPixels<Mode>(_mm256_cvtph_ps(_mm256_extracti128_si256(d, 1)),
+		                                _mm256_cvtph_ps(_mm256_extracti128_si256(s, 1)), opacity_ps);
+		if (_mm256_movemask_ps(_mm256_cmp_ps(low, high, _CMP_UNORD_Q)) != 0) { // Rare, so only then canonicalized
+			low = canonicalNan(low);
+			high = canonicalNan(high);
+		}
+		const __m256i result = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvtps_ph(low, _MM_FROUND_TO_NEAREST_INT)),
+		                                               _mm256_cvtps_ph(high, _MM_FROUND_TO_NEAREST_INT), 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), result);
+	}
+	scalarBlendKernels().rgba16f[static_cast<size_t>(Mode)](dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+} // namespace
+
+const BlendKernels* avx2BlendKernels() {
+	static const BlendKernels kernels = {
+		"avx2",
+		{blendRgba8<BlendMode::AlphaOver>, blendRgba8<BlendMode::Additive>, blendRgba8<BlendMode::Multiply>},
+		{blendRgba16f<BlendMode::AlphaOver>, blendRgba16f<BlendMode::Additive>, blendRgba16f<BlendMode::Multiply>},
+	};
+	return &kernels;
+}
+
+#else
+
+const BlendKernels* avx2BlendKernels() {
+	return nullptr;
+}
+
+#endif
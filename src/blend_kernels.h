@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// How a layer combines with what is below it. Colors are straight (not premultiplied) alpha; with source color s,
+/// destination color d and effective source alpha sa (layer alpha times opacity):
+///   AlphaOver  d = s * sa + d * (1 - sa)       (the graphics pipeline's SRC_ALPHA / ONE_MINUS_SRC_ALPHA)
+///   Additive   d = d + s * sa                  (clamped to 1 for RGBA8)
+///   Multiply   d = d * (1 - sa + s * sa)
+/// and in every mode the alpha channel becomes sa + da * (1 - sa).
+enum class BlendMode { AlphaOver, Additive, Multiply };
+constexpr size_t BLEND_MODE_COUNT = 3;
+
+/// Blend `count` pixels of `src` onto `dst`. RGBA8 opacity is 0..255.
+using BlendRgba8Fn = void (*)(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity);
+using BlendRgba16fFn = void (*)(uint16_t* dst, const uint16_t* src, size_t count, float opacity);
+
+/// One implementation of every blend. All of them produce bit-identical results: RGBA8 uses exactly rounded integer
+/// arithmetic, and RGBA16F evaluates the formulas above in float, in the same order, without fused multiply-adds.
+/// Which NaN an operation on NaNs gives differs between instruction sets, so RGBA16F writes every NaN as HALF_NAN.
+struct BlendKernels {
+	const char* name;
+	BlendRgba8Fn rgba8[BLEND_MODE_COUNT];
+	BlendRgba16fFn rgba16f[BLEND_MODE_COUNT];
+};
+
+const BlendKernels& scalarBlendKernels();
+
+// Null where the instruction set is not compiled in. The caller checks that the CPU supports it.
+const BlendKernels* sse2BlendKernels();
+const BlendKernels* avx2BlendKernels(); // AVX2 and F16C
+const BlendKernels* neonBlendKernels();
+
+/// x / 255 rounded to nearest, exactly, for x <= 255 * 255.
+inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/// IEEE half to float, exactly, matching the hardware conversions.
+inline float halfToFloat(uint16_t h) {
+	const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1f;
+	const uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0) {
+		float magnitude = static_cast<float>(mantissa) * (1.0f / 16777216.0f); // Subnormal: mantissa * 2^-24
+		std::memcpy(&bits, &magnitude, sizeof(bits));
+		bits |= sign;
+	} else if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13); // Infinity or NaN, which comes out quiet as in hardware
+		if (mantissa != 0) bits |= 0x00400000;
+	} else {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+/// Float to IEEE half, rounding to nearest even like the hardware conversions (F16C, NEON) do.
+inline uint16_t floatToHalf(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	if (magnitude >= 0x7f800000) { // Infinity stays infinity; NaNs stay NaNs, quieted, keeping the top payload bits
+		return static_cast<uint16_t>(sign | (magnitude > 0x7f800000 ? 0x7e00 | ((magnitude >> 13) & 0x3ff) : 0x7c00));
+	}
+	if (magnitude >= 0x477ff000) return static_cast<uint16_t>(sign | 0x7c00); // Rounds up to infinity
+	if (magnitude < 0x38800000) {
+		// Result is subnormal (or zero): adding 0.5 lines the half's mantissa up with the float's and lets the FPU round
+		float shifted;
+		std::memcpy(&shifted, &magnitude, sizeof(shifted));
+		shifted += 0.5f;
+		uint32_t shifted_bits;
+		std::memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+		return static_cast<uint16_t>(sign | (shifted_bits - 0x3f000000));
+	}
+
+	const uint32_t mantissa_odd = (magnitude >> 13) & 1;
+	magnitude += 0xc8000fff + mantissa_odd; // Rebias the exponent by -112 and round to nearest even
+	return static_cast<uint16_t>(sign | (magnitude >> 13));
+}
+
+/// The NaN that RGBA16F blends write for any NaN result, whatever its sign and payload.
+constexpr uint16_t HALF_NAN = 0x7e00;
+constexpr uint32_t FLOAT_NAN_BITS = 0x7fc00000; // Converts to HALF_NAN
+
+/// A blended value as a half, with NaNs made HALF_NAN.
+inline uint16_t blendedToHalf(float f) {
+	return f != f ? HALF_NAN : floatToHalf(f);
+}
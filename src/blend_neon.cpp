@@ -0,0 +1,106 @@
+#include "blend_kernels.h"
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+
+#include <arm_neon.h>
+
+// The structured loads split pixels into one register per channel, so alpha needs no shuffling: RGBA8 blends
+// eight pixels at a time in 16-bit lanes, RGBA16F four at a time as floats.
+
+namespace {
+
+inline uint16x8_t div255(uint16x8_t x) {
+	const uint16x8_t t = vaddq_u16(x, vdupq_n_u16(128));
+	return vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+template<BlendMode Mode>
+void blendRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	const uint16x8_t full = vdupq_n_u16(255);
+	const uint16x8_t opacity16 = vdupq_n_u16(static_cast<uint16_t>(opacity));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const uint8x8x4_t s = vld4_u8(src + i * 4);
+		uint8x8x4_t d = vld4_u8(dst + i * 4);
+
+		const uint16x8_t sa = div255(vmulq_u16(vmovl_u8(s.val[3]), opacity16));
+		const uint16x8_t inverse = vsubq_u16(full, sa);
+		for (int c = 0; c < 3; c++) {
+			const uint16x8_t sc = vmovl_u8(s.val[c]);
+			const uint16x8_t dc = vmovl_u8(d.val[c]);
+			uint16x8_t color;
+			if (Mode == BlendMode::AlphaOver) {
+				color = div255(vaddq_u16(vmulq_u16(sc, sa), vmulq_u16(dc, inverse)));
+			} else if (Mode == BlendMode::Additive) {
+				color = vminq_u16(vaddq_u16(dc, div255(vmulq_u16(sc, sa))), full);
+			} else {
+				color = div255(vmulq_u16(dc, vaddq_u16(div255(vmulq_u16(sc, sa)), inverse)));
+			}
+			d.val[c] = vmovn_u16(color);
+		}
+		d.val[3] = vmovn_u16(vaddq_u16(sa, div255(vmulq_u16(vmovl_u8(d.val[3]), inverse))));
+		vst4_u8(dst + i * 4, d);
+	}
+	scalarBlendKernels().rgba8[static_cast<size_t>(Mode)](dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+inline float32x4_t toFloat(uint16x4_t h) {
+	return vcvt_f32_f16(vreinterpret_f16_u16(h));
+}
+
+/// Converts NaNs to the canonical NaN, as blend results must be.
+inline uint16x4_t toHalf(float32x4_t f) {
+	const float32x4_t nan = vreinterpretq_f32_u32(vdupq_n_u32(FLOAT_NAN_BITS));
+	return vreinterpret_u16_f16(vcvt_f16_f32(vbslq_f32(vceqq_f32(f, f), f, nan)));
+}
+
+template<BlendMode Mode>
+void blendRgba16f(uint16_t* dst, const uint16_t* src, size_t count, float opacity) {
+	const float32x4_t one = vdupq_n_f32(1.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const uint16x4x4_t s = vld4_u16(src + i * 4);
+		uint16x4x4_t d = vld4_u16(dst + i * 4);
+
+		const float32x4_t sa = vmulq_n_f32(toFloat(s.val[3]), opacity);
+		const float32x4_t inverse = vsubq_f32(one, sa);
+		for (int c = 0; c < 3; c++) {
+			const float32x4_t sc = toFloat(s.val[c]);
+			const float32x4_t dc = toFloat(d.val[c]);
+			const float32x4_t weighted = vmulq_f32(sc, sa);
+			float32x4_t color;
+			if (Mode == BlendMode::AlphaOver) {
+				color = vaddq_f32(weighted, vmulq_f32(dc, inverse));
+			} else if (Mode == BlendMode::Additive) {
+				color = vaddq_f32(dc, weighted);
+			} else {
+				color = vmulq_f32(dc, vaddq_f32(inverse, weighted));
+			}
+			d.val[c] = toHalf(color);
+		}
+		d.val[3] = toHalf(vaddq_f32(sa, vmulq_f32(toFloat(d.val[3]), inverse)));
+		vst4_u16(dst + i * 4, d);
+	}
+	scalarBlendKernels().rgba16f[static_cast<size_t>(Mode)](dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+} // namespace
+
+const BlendKernels* neonBlendKernels() {
+	static const BlendKernels kernels = {
+		"neon",
+		{blendRgba8<BlendMode::AlphaOver>, blendRgba8<BlendMode::Additive>, blendRgba8<BlendMode::Multiply>},
+		{blendRgba16f<BlendMode::AlphaOver>, blendRgba16f<BlendMode::Additive>, blendRgba16f<BlendMode::Multiply>},
+	};
+	return &kernels;
+}
+
+#else
+
+const BlendKernels* neonBlendKernels() {
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "blend_kernels.h"
+
+#include <algorithm>
+
+// The reference implementation. The SIMD kernels handle the pixels left over after their last full vector with
+// these, so they must stay bit-identical to them.
+
+namespace {
+
+void overRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	for (size_t i = 0; i < count; i++, dst += 4, src += 4) {
+		const uint32_t sa = div255(src[3] * opacity);
+		for (int c = 0; c < 3; c++) dst[c] = static_cast<uint8_t>(div255(src[c] * sa + dst[c] * (255 - sa)));
+		dst[3] = static_cast<uint8_t>(sa + div255(dst[3] * (255 - sa)));
+	}
+}
+
+void additiveRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	for (size_t i = 0; i < count; i++, dst += 4, src += 4) {
+		const uint32_t sa = div255(src[3] * opacity);
+		for (int c = 0; c < 3; c++) dst[c] = static_cast<uint8_t>(std::min(255u, dst[c] + div255(src[c] * sa)));
+		dst[3] = static_cast<uint8_t>(sa + div255(dst[3] * (255 - sa)));
+	}
+}
+
+void multiplyRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	for (size_t i = 0; i < count; i++, dst += 4, src += 4) {
+		const uint32_t sa = div255(src[3] * opacity);
+		for (int c = 0; c < 3; c++) dst[c] = static_cast<uint8_t>(div255(dst[c] * (div255(src[c] * sa) + 255 - sa)));
+		dst[3] = static_cast<uint8_t>(sa + div255(dst[3] * (255 - sa)));
+	}
+}
+
+template<BlendMode Mode>
+void blendRgba16f(uint16_t* dst, const uint16_t* src, size_t count, float opacity) {
+	for (size_t i = 0; i < count; i++, dst += 4, src += 4) {
+		const float sa = halfToFloat(src[3]) * opacity;
+		const float inverse = 1.0f - sa;
+		for (int c = 0; c < 3; c++) {
+			const float s = halfToFloat(src[c]);
+			const float d = halfToFloat(dst[c]);
+			float result;
+			if (Mode == BlendMode::AlphaOver) {
+				const float weighted = s * sa;
+				const float kept = d * inverse;
+				result = weighted + kept;
+			} else if (Mode == BlendMode::Additive) {
+				const float weighted = s * sa;
+				result = d + weighted;
+			} else {
+				const float weighted = s * sa;
+				const float factor = inverse + weighted;
+				result = d * factor;
+			}
+			dst[c] = blendedToHalf(result);
+		}
+		const float kept = halfToFloat(dst[3]) * inverse;
+		dst[3] = blendedToHalf(sa + kept);
+	}
+}
+
+const BlendKernels KERNELS = {
+	"scalar",
+	{overRgba8, additiveRgba8, multiplyRgba8},
+	{blendRgba16f<BlendMode::AlphaOver>, blendRgba16f<BlendMode::Additive>, blendRgba16f<BlendMode::Multiply>},
+};
+
+} // namespace
+
+const BlendKernels& scalarBlendKernels() {
+	return KERNELS;
+}
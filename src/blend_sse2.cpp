@@ -0,0 +1,72 @@
+#include "blend_kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+// RGBA8 blends four pixels at a time in 16-bit lanes. SSE2 has no half conversions, so RGBA16F uses the scalar
+// kernels.
+
+namespace {
+
+inline __m128i div255(__m128i x) {
+	const __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/// Blend two widened pixels.
+template<BlendMode Mode>
+inline __m128i blendPixels(__m128i d, __m128i s, __m128i opacity) {
+	const __m128i full = _mm_set1_epi16(255);
+	const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+	const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	const __m128i sa = div255(_mm_mullo_epi16(a, opacity));
+	const __m128i inverse = _mm_sub_epi16(full, sa);
+	const __m128i alpha = _mm_add_epi16(sa, div255(_mm_mullo_epi16(d, inverse)));
+
+	__m128i color;
+	if (Mode == BlendMode::AlphaOver) {
+		color = div255(_mm_add_epi16(_mm_mullo_epi16(s, sa), _mm_mullo_epi16(d, inverse)));
+	} else if (Mode == BlendMode::Additive) {
+		color = _mm_min_epi16(_mm_add_epi16(d, div255(_mm_mullo_epi16(s, sa))), full);
+	} else {
+		color = div255(_mm_mullo_epi16(d, _mm_add_epi16(div255(_mm_mullo_epi16(s, sa)), inverse)));
+	}
+	return _mm_or_si128(_mm_and_si128(alpha_lanes, alpha), _mm_andnot_si128(alpha_lanes, color));
+}
+
+template<BlendMode Mode>
+void blendRgba8(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opacity16 = _mm_set1_epi16(static_cast<short>(opacity));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+		const __m128i low = blendPixels<Mode>(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), opacity16);
+		const __m128i high = blendPixels<Mode>(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), opacity16);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(low, high));
+	}
+	scalarBlendKernels().rgba8[static_cast<size_t>(Mode)](dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+} // namespace
+
+const BlendKernels* sse2BlendKernels() {
+	static const BlendKernels kernels = {
+		"sse2",
+		{blendRgba8<BlendMode::AlphaOver>, blendRgba8<BlendMode::Additive>, blendRgba8<BlendMode::Multiply>},
+		{scalarBlendKernels().rgba16f[0], scalarBlendKernels().rgba16f[1], scalarBlendKernels().rgba16f[2]},
+	};
+	return &kernels;
+}
+
+#else
+
+const BlendKernels* sse2BlendKernels() {
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/// A blocking queue with a fixed capacity, for handing work between the stages of a pipeline. A full queue
+/// blocks its producer, so a fast stage cannot run ahead of a slow one and pile up memory.
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity ? capacity : 1) {}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/// Wait for room and append `item`. Returns false, dropping the item, if the queue is closed.
+	bool push(T item) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed) return false;
+		m_items.push_back(std::move(item));
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	/// Wait for an item and move it to `item`. Returns false once the queue is closed and drained.
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+		if (m_items.empty()) return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	/// No more pushes: producers are released and consumers drain what is left. With `discard`, what is left is
+	/// dropped too, for abandoning a pipeline.
+	void close(bool discard = false) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		if (discard) m_items.clear();
+		m_notFull.notify_all();
+		m_notEmpty.notify_all();
+	}
+
+private:
+	const size_t m_capacity;
+	std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+	std::deque<T> m_items;
+	bool m_closed = false;
+};
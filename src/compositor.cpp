@@ -0,0 +1,184 @@
+#include "compositor.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VIPER_X86 1
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef VIPER_X86
+/// AVX2 and F16C, with the OS saving the YMM registers.
+bool cpuSupportsAvx2() {
+	unsigned int leaf1[4] = {};
+	unsigned int leaf7[4] = {};
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) return false;
+	__cpuid(regs, 1);
+	for (int i = 0; i < 4; i++) leaf1[i] = static_cast<unsigned int>(regs[i]);
+	__cpuidex(regs, 7, 0);
+	for (int i = 0; i < 4; i++) leaf7[i] = static_cast<unsigned int>(regs[i]);
+#else
+	if (__get_cpuid_max(0, nullptr) < 7) return false;
+	__cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+	__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+
+	const unsigned int osxsave = 1u << 27, avx = 1u << 28, f16c = 1u << 29;
+	if ((leaf1[2] & (osxsave | avx | f16c)) != (osxsave | avx | f16c)) return false;
+	if ((leaf7[1] & (1u << 5)) == 0) return false; // AVX2
+
+#if defined(_MSC_VER)
+	const unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xcr0_low, xcr0_high;
+	__asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	const unsigned long long xcr0 = xcr0_low;
+#endif
+	return (xcr0 & 0x6) == 0x6; // XMM and YMM state
+}
+#endif
+
+} // namespace
+
+Compositor::Compositor(ThreadPool* pool, SimdLevel level)
+	: m_pool(pool), m_level(level), m_kernels(kernelsFor(level)) {
+	if (!m_kernels) {
+		m_level = SimdLevel::Scalar;
+		m_kernels = &scalarBlendKernels();
+	}
+}
+
+SimdLevel Compositor::bestSimdLevel() {
+	static const SimdLevel best = [] {
+		for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Neon, SimdLevel::Sse2}) {
+			if (kernelsFor(level)) return level;
+		}
+		return SimdLevel::Scalar;
+	}();
+	return best;
+}
+
+const BlendKernels* Compositor::kernelsFor(SimdLevel level) {
+	switch (level) {
+	case SimdLevel::Scalar:
+		return &scalarBlendKernels();
+	case SimdLevel::Sse2:
+		return sse2BlendKernels(); // Compiled in only where every CPU has it
+	case SimdLevel::Avx2: {
+#ifdef VIPER_X86
+		static const bool supported = cpuSupportsAvx2();
+		return supported ? avx2BlendKernels() : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+	case SimdLevel::Neon:
+		return neonBlendKernels(); // Part of every AArch64 CPU
+	}
+	return nullptr;
+}
+
+void Compositor::composite(const CpuImage& target, const std::vector<CompositeLayer>& layers) const {
+	if (target.width == 0 || target.height == 0 || layers.empty()) return;
+
+	const size_t row_bytes = target.width * bytesPerPixel(target.format);
+	const uint32_t band_rows = static_cast<uint32_t>(std::max<size_t>(1, BAND_BYTES / row_bytes));
+	const uint32_t band_count = (target.height + band_rows - 1) / band_rows;
+
+	const bool parallel = m_pool && m_pool->size() > 0 && band_count > 1 && ThreadPool::workerIndex() == ThreadPool::NOT_A_WORKER;
+	if (!parallel) {
+		compositeRows(target, layers, 0, target.height);
+		return;
+	}
+
+	// Bands are claimed from a shared counter, so a thread slowed down by something else just takes fewer of them
+	std::atomic<uint32_t> next_band{0};
+	auto work = [&]() {
+		for (uint32_t band = next_band++; band < band_count; band = next_band++) {
+			const uint32_t first = band * band_rows;
+			compositeRows(target, layers, first, std::min(target.height, first + band_rows));
+		}
+	};
+
+	const size_t helper_count = std::min<size_t>(m_pool->size(), band_count - 1);
+	std::vector<std::future<void>> helpers;
+	helpers.reserve(helper_count);
+	for (size_t i = 0; i < helper_count; i++) helpers.push_back(m_pool->submit(work));
+	work();
+	for (auto& helper : helpers) helper.get();
+}
+
+void Compositor::compositeRows(const CpuImage& target, const std::vector<CompositeLayer>& layers, uint32_t first, uint32_t end) const {
+	auto* target_bytes = static_cast<uint8_t*>(target.pixels);
+
+	for (const CompositeLayer& layer : layers) {
+		const float opacity = std::clamp(layer.opacity, 0.0f, 1.0f);
+		if (opacity == 0.0f) continue;
+		const size_t mode = static_cast<size_t>(layer.mode);
+		const auto* layer_bytes = static_cast<const uint8_t*>(layer.pixels);
+
+		if (target.format == PixelFormat::Rgba8) {
+			const BlendRgba8Fn blend = m_kernels->rgba8[mode];
+			const uint32_t opacity8 = static_cast<uint32_t>(std::lround(opacity * 255.0f));
+			for (uint32_t y = first; y < end; y++) {
+				blend(target_bytes + y * target.stride, layer_bytes + y * layer.stride, target.width, opacity8);
+			}
+		} else {
+			const BlendRgba16fFn blend = m_kernels->rgba16f[mode];
+			for (uint32_t y = first; y < end; y++) {
+				blend(reinterpret_cast<uint16_t*>(target_bytes + y * target.stride),
+				      reinterpret_cast<const uint16_t*>(layer_bytes + y * layer.stride), target.width, opacity);
+			}
+		}
+	}
+}
+
+ImageDifference Compositor::compare(const CpuImage& a, const CpuImage& b) {
+	if (a.width != b.width || a.height != b.height || a.format != b.format) {
+		throw std::runtime_error("images to compare differ in size or format!");
+	}
+
+	ImageDifference difference;
+	const size_t values = size_t(a.width) * 4;
+	for (uint32_t y = 0; y < a.height; y++) {
+		const auto* row_a = static_cast<const uint8_t*>(a.pixels) + y * a.stride;
+		const auto* row_b = static_cast<const uint8_t*>(b.pixels) + y * b.stride;
+
+		for (size_t i = 0; i < values; i++) {
+			double delta;
+			if (a.format == PixelFormat::Rgba8) {
+				delta = std::abs(int(row_a[i]) - int(row_b[i]));
+			} else {
+				uint16_t half_a, half_b;
+				std::memcpy(&half_a, row_a + i * 2, sizeof(half_a));
+				std::memcpy(&half_b, row_b + i * 2, sizeof(half_b));
+				if (half_a == half_b) continue;
+				delta = std::abs(double(halfToFloat(half_a)) - double(halfToFloat(half_b)));
+				if (std::isnan(delta)) delta = std::numeric_limits<double>::infinity(); // NaN against anything else
+			}
+			if (delta > 0) {
+				difference.differingValues++;
+				difference.maxDifference = std::max(difference.maxDifference, delta);
+			}
+		}
+	}
+	return difference;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "blend_kernels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+enum class PixelFormat {
+	Rgba8,   // 8 bits per channel, unsigned normalized
+	Rgba16f, // IEEE half per channel, as VK_FORMAT_R16G16B16A16_SFLOAT
+};
+
+constexpr size_t bytesPerPixel(PixelFormat format) {
+	return format == PixelFormat::Rgba8 ? 4 : 8;
+}
+
+/// A frame in CPU memory. Rows are `stride` bytes apart.
+struct CpuImage {
+	void* pixels;
+	uint32_t width;
+	uint32_t height;
+	size_t stride;
+	PixelFormat format;
+};
+
+/// A layer to blend onto the target. It has the target's size and format.
+struct CompositeLayer {
+	const void* pixels;
+	size_t stride;
+	BlendMode mode = BlendMode::AlphaOver;
+	float opacity = 1.0f; // 0..1, scales the layer's alpha
+};
+
+enum class SimdLevel { Scalar, Sse2, Avx2, Neon };
+
+struct ImageDifference {
+	double maxDifference = 0; // Largest per-channel difference, in 0..255 units for RGBA8 and float for RGBA16F
+	size_t differingValues = 0;
+};
+
+/// Composites layers on the CPU: the fallback when there is no usable GPU (such as exporting on a headless
+/// machine) and the reference that GPU compositing is checked against.
+///
+/// The blend kernels are picked once, for the best instruction set both compiled in and supported by the CPU;
+/// every level gives bit-identical output, so results do not depend on the machine. Frames are split into bands
+/// of rows small enough to stay in cache while all layers are blended onto them, and the bands are spread over
+/// the thread pool, if there is one.
+class Compositor {
+public:
+	/// `level` falls back to scalar if it is not available here.
+	explicit Compositor(ThreadPool* pool = nullptr, SimdLevel level = bestSimdLevel());
+
+	/// Blend `layers` onto `target` in order, bottom first; `target` holds the background. Called from a worker of
+	/// a thread pool, this runs on the calling thread alone.
+	void composite(const CpuImage& target, const std::vector<CompositeLayer>& layers) const;
+
+	SimdLevel simdLevel() const { return m_level; }
+	const char* kernelName() const { return m_kernels->name; }
+
+	/// The best level compiled in and supported by this CPU.
+	static SimdLevel bestSimdLevel();
+	/// Kernels for `level`, or null if they are not available here.
+	static const BlendKernels* kernelsFor(SimdLevel level);
+
+	/// Compare two images of the same size and format, such as a GPU readback against the CPU result.
+	static ImageDifference compare(const CpuImage& a, const CpuImage& b);
+
+private:
+	static constexpr size_t BAND_BYTES = size_t(128) << 10; // Target bytes per band
+
+	ThreadPool* m_pool;
+	SimdLevel m_level;
+	const BlendKernels* m_kernels;
+
+	void compositeRows(const CpuImage& target, const std::vector<CompositeLayer>& layers, uint32_t first, uint32_t end) const;
+};
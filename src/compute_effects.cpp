@@ -0,0 +1,366 @@
+#include "compute_effects.h"
+
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t SETS_PER_POOL = 64;
+
+uint32_t groupCount(uint32_t size) {
+	return (size + ComputeEffects::GROUP_SIZE - 1) / ComputeEffects::GROUP_SIZE;
+}
+
+} // namespace
+
+ComputeEffects::ComputeEffects(VkDevice device, PipelineRegistry& pipelines, uint32_t queueFamily, VkQueue queue,
+                               std::mutex* queueMutex, uint32_t framesInFlight, const Shaders& shaders)
+	: m_device(device), m_queue(queue), m_queueMutex(queueMutex), m_frames(framesInFlight) {
+	VkSemaphoreTypeCreateInfo type_info{};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphore_info{};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+
+	if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_timeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create compute timeline semaphore!");
+	}
+
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_LINEAR;
+	sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.maxLod = 0.0f;
+
+	if (vkCreateSampler(m_device, &sampler_info, nullptr, &m_linearSampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create effect sampler!");
+	}
+
+	const VkDescriptorType storage = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	const VkDescriptorType sampled = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	const uint32_t matrix_size = 16 * sizeof(float);
+	std::array<PipelineRegistry::Key, KERNEL_COUNT> keys;
+	keys[NV12_TO_RGBA] = createKernel(NV12_TO_RGBA, pipelines, shaders.yuvToRgba, {sampled, sampled, sampled, storage}, matrix_size, {VK_FALSE});
+	keys[I420_TO_RGBA] = createKernel(I420_TO_RGBA, pipelines, shaders.yuvToRgba, {sampled, sampled, sampled, storage}, matrix_size, {VK_TRUE});
+	keys[RESIZE_BILINEAR] = createKernel(RESIZE_BILINEAR, pipelines, shaders.resize, {sampled, storage}, 0, {VK_FALSE});
+	keys[RESIZE_LANCZOS] = createKernel(RESIZE_LANCZOS, pipelines, shaders.resize, {sampled, storage}, 0, {VK_TRUE});
+	keys[APPLY_LUT] = createKernel(APPLY_LUT, pipelines, shaders.applyLut, {storage, sampled, storage}, sizeof(float));
+	// Every kernel was requested before waiting on any, so they compile in parallel
+	for (size_t i = 0; i < KERNEL_COUNT; i++) m_kernels[i].pipeline = pipelines.get(keys[i]);
+
+	for (auto& frame : m_frames) {
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		pool_info.queueFamilyIndex = queueFamily;
+
+		if (vkCreateCommandPool(m_device, &pool_info, nullptr, &frame.commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute command pool!");
+		}
+
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = frame.commandPool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_device, &alloc_info, &frame.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate compute command buffer!");
+		}
+
+		frame.descriptorPools.push_back(createDescriptorPool());
+	}
+}
+
+ComputeEffects::~ComputeEffects() {
+	VkSemaphoreWaitInfo wait_info{};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &m_timeline;
+	wait_info.pValues = &m_lastValue;
+	vkWaitSemaphores(m_device, &wait_info, UINT64_MAX);
+
+	for (auto& frame : m_frames) {
+		vkDestroyCommandPool(m_device, frame.commandPool, nullptr);
+		for (auto pool : frame.descriptorPools) vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	for (auto& kernel : m_kernels) {
+		vkDestroyPipelineLayout(m_device, kernel.layout, nullptr);
+		vkDestroyDescriptorSetLayout(m_device, kernel.setLayout, nullptr);
+	}
+	vkDestroySampler(m_device, m_linearSampler, nullptr);
+	vkDestroySemaphore(m_device, m_timeline, nullptr);
+}
+
+PipelineRegistry::Key ComputeEffects::createKernel(Kernel kernel, PipelineRegistry& pipelines, const ShaderCode& code,
+                                                   const std::vector<VkDescriptorType>& bindings, uint32_t pushConstantSize,
+                                                   const std::vector<uint32_t>& constants) {
+	KernelPipeline& k = m_kernels[kernel];
+	k.bindings = bindings;
+
+	std::vector<VkDescriptorSetLayoutBinding> layout_bindings(bindings.size());
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		layout_bindings[i].binding = i;
+		layout_bindings[i].descriptorType = bindings[i];
+		layout_bindings[i].descriptorCount = 1;
+		layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_layout_info{};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+	set_layout_info.pBindings = layout_bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &set_layout_info, nullptr, &k.setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create effect descriptor set layout!");
+	}
+
+	VkPushConstantRange push_constants{};
+	push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constants.offset = 0;
+	push_constants.size = pushConstantSize;
+
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &k.setLayout;
+	layout_info.pushConstantRangeCount = pushConstantSize ? 1 : 0;
+	layout_info.pPushConstantRanges = &push_constants;
+
+	if (vkCreatePipelineLayout(m_device, &layout_info, nullptr, &k.layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create effect pipeline layout!");
+	}
+
+	ComputePipelineDesc desc;
+	desc.shader = code;
+	desc.layout = k.layout;
+	desc.constants = constants;
+	return pipelines.request(desc);
+}
+
+VkDescriptorPool ComputeEffects::createDescriptorPool() {
+	VkDescriptorPoolSize pool_sizes[2] = { // The most any kernel's set has of each
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, SETS_PER_POOL * 2},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SETS_PER_POOL * 3},
+	};
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = SETS_PER_POOL;
+	pool_info.poolSizeCount = 2;
+	pool_info.pPoolSizes = pool_sizes;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create effect descriptor pool!");
+	}
+	return pool;
+}
+
+VkDescriptorSet ComputeEffects::allocateSet(Kernel kernel) {
+	FrameSlot& frame = m_frames[m_currentSlot];
+
+	for (;;) {
+		VkDescriptorSetAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = frame.descriptorPools[frame.currentPool];
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &m_kernels[kernel].setLayout;
+
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(m_device, &alloc_info, &set);
+		if (result == VK_SUCCESS) return set;
+		if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+			throw std::runtime_error("failed to allocate effect descriptor set!");
+		}
+
+		// This pool is full; move on to the next one, creating it the first time a frame needs it
+		frame.currentPool++;
+		if (frame.currentPool == frame.descriptorPools.size()) frame.descriptorPools.push_back(createDescriptorPool());
+	}
+}
+
+void ComputeEffects::beginFrame(uint32_t slot) {
+	m_currentSlot = slot;
+	FrameSlot& frame = m_frames[slot];
+	vkResetCommandPool(m_device, frame.commandPool, 0);
+	for (size_t i = 0; i <= frame.currentPool; i++) vkResetDescriptorPool(m_device, frame.descriptorPools[i], 0);
+	frame.currentPool = 0;
+	frame.recording = false;
+}
+
+VkCommandBuffer ComputeEffects::commandBuffer() {
+	FrameSlot& frame = m_frames[m_currentSlot];
+	if (!frame.recording) { // Frames without effects never begin theirs, and submit() skips them
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(frame.commandBuffer, &begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording compute command buffer!");
+		}
+		frame.recording = true;
+	}
+	return frame.commandBuffer;
+}
+
+void ComputeEffects::dispatch(Kernel kernel, std::initializer_list<const EffectImage*> inputs, const EffectImage& output,
+                              const void* pushConstants, uint32_t pushConstantSize) {
+	VkCommandBuffer cmd = commandBuffer();
+	const KernelPipeline& k = m_kernels[kernel];
+	VkDescriptorSet set = allocateSet(kernel);
+
+	// One write per binding: the inputs in order, then the output. Sampled bindings get the linear sampler.
+	std::array<VkDescriptorImageInfo, 4> image_infos{};
+	std::array<VkWriteDescriptorSet, 4> writes{};
+	uint32_t binding = 0;
+	auto add_binding = [&](const EffectImage& image, VkDescriptorType type) {
+		image_infos[binding].sampler = type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? m_linearSampler : VK_NULL_HANDLE;
+		image_infos[binding].imageView = image.view;
+		image_infos[binding].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[binding].dstSet = set;
+		writes[binding].dstBinding = binding;
+		writes[binding].descriptorCount = 1;
+		writes[binding].descriptorType = type;
+		writes[binding].pImageInfo = &image_infos[binding];
+		binding++;
+	};
+
+	for (const EffectImage* input : inputs) add_binding(*input, k.bindings[binding]);
+	add_binding(output, k.bindings[binding]);
+	vkUpdateDescriptorSets(m_device, binding, writes.data(), 0, nullptr);
+
+	// The output's old contents are discarded; wait only for earlier dispatches that may still read it
+	VkImageMemoryBarrier to_general{};
+	to_general.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	to_general.srcAccessMask = 0;
+	to_general.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	to_general.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	to_general.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	to_general.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	to_general.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	to_general.image = output.image;
+	to_general.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+	                     0, nullptr, 0, nullptr, 1, &to_general);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, k.pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, k.layout, 0, 1, &set, 0, nullptr);
+	if (pushConstantSize) {
+		vkCmdPushConstants(cmd, k.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pushConstants);
+	}
+	vkCmdDispatch(cmd, groupCount(output.extent.width), groupCount(output.extent.height), 1);
+
+	// Chained effects (convert, then resize, then grade) read what the previous dispatch wrote
+	VkMemoryBarrier written{};
+	written.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	written.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	written.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+	                     1, &written, 0, nullptr, 0, nullptr);
+}
+
+void ComputeEffects::convertNv12(const EffectImage& luma, const EffectImage& chroma, const EffectImage& output,
+                                 YuvMatrix matrix, YuvRange range) {
+	const std::array<float, 16> yuv_to_rgb = yuvToRgbMatrix(matrix, range);
+	// The planar variant's V plane binding is still in the set layout, so it is given the chroma plane, unread
+	dispatch(NV12_TO_RGBA, {&luma, &chroma, &chroma}, output, yuv_to_rgb.data(), sizeof(yuv_to_rgb));
+}
+
+void ComputeEffects::convertI420(const EffectImage& luma, const EffectImage& u, const EffectImage& v, const EffectImage& output,
+                                 YuvMatrix matrix, YuvRange range) {
+	const std::array<float, 16> yuv_to_rgb = yuvToRgbMatrix(matrix, range);
+	dispatch(I420_TO_RGBA, {&luma, &u, &v}, output, yuv_to_rgb.data(), sizeof(yuv_to_rgb));
+}
+
+void ComputeEffects::resize(const EffectImage& source, const EffectImage& output, ResizeFilter filter) {
+	dispatch(filter == ResizeFilter::Lanczos ? RESIZE_LANCZOS : RESIZE_BILINEAR, {&source}, output, nullptr, 0);
+}
+
+void ComputeEffects::applyLut(const EffectImage& source, const EffectImage& lut, const EffectImage& output, float strength) {
+	dispatch(APPLY_LUT, {&source, &lut}, output, &strength, sizeof(strength));
+}
+
+TimelineWait ComputeEffects::submit(std::initializer_list<TimelineWait> inputs, VkPipelineStageFlags stages) {
+	FrameSlot& frame = m_frames[m_currentSlot];
+	if (!frame.recording) return {}; // Nothing to do this frame
+
+	if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record compute command buffer!");
+	}
+	frame.recording = false;
+
+	std::vector<VkSemaphore> wait_semaphores;
+	std::vector<uint64_t> wait_values;
+	std::vector<VkPipelineStageFlags> wait_stages;
+	for (const TimelineWait& input : inputs) {
+		if (input.value == 0) continue;
+		wait_semaphores.push_back(input.semaphore);
+		wait_values.push_back(input.value);
+		wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	const uint64_t value = ++m_lastValue;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info{};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+	timeline_info.pWaitSemaphoreValues = wait_values.data();
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &value;
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+	submit_info.pWaitSemaphores = wait_semaphores.data();
+	submit_info.pWaitDstStageMask = wait_stages.data();
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &frame.commandBuffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &m_timeline;
+
+	{
+		std::unique_lock<std::mutex> queue_lock;
+		if (m_queueMutex) queue_lock = std::unique_lock<std::mutex>(*m_queueMutex);
+		if (vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit effects!");
+		}
+	}
+
+	return {m_timeline, value, stages};
+}
+
+std::array<float, 16> ComputeEffects::yuvToRgbMatrix(YuvMatrix matrix, YuvRange range) {
+	const float kr = matrix == YuvMatrix::Bt709 ? 0.2126f : 0.299f;
+	const float kb = matrix == YuvMatrix::Bt709 ? 0.0722f : 0.114f;
+	const float kg = 1.0f - kr - kb;
+
+	// Y' = ys * y + yo in 0..1, and U' = cs * u + co (likewise V') in -0.5..0.5
+	const bool limited = range == YuvRange::Limited;
+	const float ys = limited ? 255.0f / 219.0f : 1.0f;
+	const float yo = limited ? -16.0f / 219.0f : 0.0f;
+	const float cs = limited ? 255.0f / 224.0f : 1.0f;
+	const float co = limited ? -128.0f / 224.0f : -128.0f / 255.0f;
+
+	const float rv = 2.0f * (1.0f - kr);
+	const float gu = -2.0f * kb * (1.0f - kb) / kg;
+	const float gv = -2.0f * kr * (1.0f - kr) / kg;
+	const float bu = 2.0f * (1.0f - kb);
+
+	// Column-major, as GLSL expects; columns are the y, u, v and constant terms
+	return {
+		ys, ys, ys, 0.0f,
+		0.0f, gu * cs, bu * cs, 0.0f,
+		rv * cs, gv * cs, 0.0f, 0.0f,
+		yo + rv * co, yo + (gu + gv) * co, yo + bu * co, 1.0f,
+	};
+}
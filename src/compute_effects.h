@@ -0,0 +1,117 @@
+#pragma once
+
+#include "gpu_sync.h"
+#include "pipeline_registry.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+enum class YuvMatrix { Bt601, Bt709 };
+enum class YuvRange { Limited, Full }; // Limited is 16-235 luma and 16-240 chroma, as most video is
+enum class ResizeFilter { Bilinear, Lanczos };
+
+/// An image as the effect kernels see it. Images are always in VK_IMAGE_LAYOUT_GENERAL; outputs are moved there
+/// (discarding their contents) before being written. Inputs are sampled and outputs are storage images.
+struct EffectImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkExtent2D extent{};
+};
+
+/// Compute-shader color work on decoded frames: NV12/I420 to RGBA conversion, bilinear and Lanczos resizing and
+/// 3D LUT grading.
+///
+/// Variants of a kernel (the YUV layout, the resize filter) share one shader and are told apart by specialization
+/// constants, so each variant's pipeline is compiled with only its own code path.
+///
+/// Effects run on an async compute queue when the device has one, so they overlap compositing on the graphics
+/// queue. Each frame slot records its dispatches into its own command buffer; submit() sends them off and
+/// returns the timeline wait that the graphics submission using the results must include. Images shared with
+/// another queue family have to be created with VK_SHARING_MODE_CONCURRENT.
+class ComputeEffects {
+public:
+	static constexpr uint32_t GROUP_SIZE = 16; // local_size_x and local_size_y of every kernel
+
+	struct Shaders {
+		ShaderCode yuvToRgba; // Constant 0: planar (I420) rather than interleaved (NV12) chroma
+		ShaderCode resize;    // Constant 0: Lanczos rather than bilinear
+		ShaderCode applyLut;
+	};
+
+	/// `queueMutex` must be given if `queue` is also used elsewhere, and then has to be held around every other
+	/// submission to that queue. The kernels' pipelines come from `pipelines`, which must outlive the effects.
+	ComputeEffects(VkDevice device, PipelineRegistry& pipelines, uint32_t queueFamily, VkQueue queue, std::mutex* queueMutex,
+	               uint32_t framesInFlight, const Shaders& shaders);
+	~ComputeEffects();
+
+	ComputeEffects(const ComputeEffects&) = delete;
+	ComputeEffects& operator=(const ComputeEffects&) = delete;
+
+	/// Start recording the frame in `slot`. The work this slot submitted last time must be done, which it is once
+	/// the graphics frame that waited on it has finished.
+	void beginFrame(uint32_t slot);
+
+	void convertNv12(const EffectImage& luma, const EffectImage& chroma, const EffectImage& output, YuvMatrix matrix, YuvRange range);
+	void convertI420(const EffectImage& luma, const EffectImage& u, const EffectImage& v, const EffectImage& output,
+	                 YuvMatrix matrix, YuvRange range);
+
+	/// Scale `source` to the size of `output`.
+	void resize(const EffectImage& source, const EffectImage& output, ResizeFilter filter);
+
+	/// Grade `source` through `lut` (a 3D RGBA image of N×N×N entries), blended with the original by `strength`.
+	void applyLut(const EffectImage& source, const EffectImage& lut, const EffectImage& output, float strength);
+
+	/// Submit what was recorded since beginFrame(), after `inputs` (such as uploads) are done. Returns the wait for
+	/// a graphics submission reading the results in `stages`; it is empty if nothing was recorded.
+	TimelineWait submit(std::initializer_list<TimelineWait> inputs, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	/// Color matrix taking (y, u, v, 1) with components in 0..1 to (r, g, b, 1), including range expansion.
+	static std::array<float, 16> yuvToRgbMatrix(YuvMatrix matrix, YuvRange range);
+
+private:
+	enum Kernel { NV12_TO_RGBA, I420_TO_RGBA, RESIZE_BILINEAR, RESIZE_LANCZOS, APPLY_LUT, KERNEL_COUNT };
+
+	struct KernelPipeline {
+		VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE; // Owned by the pipeline registry
+		std::vector<VkDescriptorType> bindings; // Inputs in order, then the output
+	};
+
+	struct FrameSlot {
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPool> descriptorPools; // Grows when a frame needs more sets than one pool holds
+		size_t currentPool = 0;
+		bool recording = false;
+	};
+
+	VkDevice m_device;
+	VkQueue m_queue;
+	std::mutex* m_queueMutex;
+	VkSemaphore m_timeline = VK_NULL_HANDLE;
+	uint64_t m_lastValue = 0;
+	VkSampler m_linearSampler = VK_NULL_HANDLE;
+	std::array<KernelPipeline, KERNEL_COUNT> m_kernels;
+	std::vector<FrameSlot> m_frames;
+	uint32_t m_currentSlot = 0;
+
+	/// Create the layouts for `kernel` and request its pipeline from `code`, with `constants` as its specialization
+	/// constants 0, 1, ...
+	PipelineRegistry::Key createKernel(Kernel kernel, PipelineRegistry& pipelines, const ShaderCode& code,
+	                                   const std::vector<VkDescriptorType>& bindings, uint32_t pushConstantSize,
+	                                   const std::vector<uint32_t>& constants = {});
+	VkDescriptorPool createDescriptorPool();
+	VkDescriptorSet allocateSet(Kernel kernel);
+	VkCommandBuffer commandBuffer();
+
+	/// Bind `kernel` with `inputs` and then `output` as its bindings in order, and dispatch it over `output`, which
+	/// is first moved to GENERAL. A barrier after the dispatch makes the result visible to the next one.
+	void dispatch(Kernel kernel, std::initializer_list<const EffectImage*> inputs, const EffectImage& output,
+	              const void* pushConstants, uint32_t pushConstantSize);
+};
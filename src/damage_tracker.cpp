@@ -0,0 +1,115 @@
+#include "damage_tracker.h"
+
+#include <algorithm>
+
+namespace {
+
+DamageRect unite(const DamageRect& a, const DamageRect& b) {
+	return {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+}
+
+/// Overlapping or sharing an edge.
+bool touches(const DamageRect& a, const DamageRect& b) {
+	return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+} // namespace
+
+void DamageTracker::reset(uint32_t width, uint32_t height, uint32_t imageCount) {
+	m_width = width;
+	m_height = height;
+	m_frame = 0;
+	m_history.assign(MAX_AGE, {});
+	m_imageFrames.assign(imageCount, NEVER);
+	m_tileHashes.clear();
+	addAll();
+}
+
+void DamageTracker::add(DamageRect rect) {
+	merge(m_current, rect);
+}
+
+void DamageTracker::addAll() {
+	m_current.assign(1, window());
+}
+
+void DamageTracker::merge(std::vector<DamageRect>& rects, DamageRect rect) const {
+	rect = {std::max(rect.x0, 0), std::max(rect.y0, 0), std::min(rect.x1, int32_t(m_width)), std::min(rect.y1, int32_t(m_height))};
+	if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return;
+
+	// Swallow every rectangle the new one touches, and whatever the grown one then touches
+	for (size_t i = 0; i < rects.size();) {
+		if (touches(rects[i], rect)) {
+			rect = unite(rects[i], rect);
+			rects.erase(rects.begin() + ptrdiff_t(i));
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+	rects.push_back(rect);
+
+	while (rects.size() > MAX_RECTS) {
+		size_t best_a = 0, best_b = 1;
+		int64_t best_waste = INT64_MAX;
+		for (size_t a = 0; a < rects.size(); a++) {
+			for (size_t b = a + 1; b < rects.size(); b++) {
+				const int64_t waste = unite(rects[a], rects[b]).area() - rects[a].area() - rects[b].area();
+				if (waste < best_waste) {
+					best_waste = waste;
+					best_a = a;
+					best_b = b;
+				}
+			}
+		}
+		rects[best_a] = unite(rects[best_a], rects[best_b]);
+		rects.erase(rects.begin() + ptrdiff_t(best_b));
+	}
+
+	// Past three quarters of the window, separate passes cost more than they save
+	int64_t area = 0;
+	for (const DamageRect& r : rects) area += r.area();
+	if (area * 4 > window().area() * 3) rects.assign(1, window());
+}
+
+void DamageTracker::addTiles(const std::vector<uint64_t>& hashes) {
+	if (hashes.size() != m_tileHashes.size()) {
+		addAll();
+	} else {
+		// Runs of changed tiles along each row; runs in neighbouring rows merge as they touch
+		const uint32_t columns = tileColumns();
+		for (uint32_t row = 0; row < tileRows(); row++) {
+			const size_t base = size_t(row) * columns;
+			for (uint32_t column = 0; column < columns;) {
+				if (hashes[base + column] == m_tileHashes[base + column]) {
+					column++;
+					continue;
+				}
+				const uint32_t first = column;
+				while (column < columns && hashes[base + column] != m_tileHashes[base + column]) column++;
+				add({int32_t(first * TILE_SIZE), int32_t(row * TILE_SIZE), int32_t(column * TILE_SIZE), int32_t((row + 1) * TILE_SIZE)});
+			}
+		}
+	}
+	m_tileHashes = hashes;
+}
+
+const std::vector<DamageRect>& DamageTracker::takeFrame(uint32_t image) {
+	m_history[m_frame % MAX_AGE].swap(m_current);
+	m_current.clear();
+
+	m_result.clear();
+	const uint64_t last = m_imageFrames.at(image);
+	if (last == NEVER || m_frame - last > MAX_AGE) {
+		m_result.assign(1, window());
+	} else {
+		for (uint64_t frame = last + 1; frame <= m_frame; frame++) {
+			for (const DamageRect& rect : m_history[frame % MAX_AGE]) merge(m_result, rect);
+		}
+	}
+	m_full = m_result.size() == 1 && m_result[0].area() == window().area();
+
+	m_imageFrames[image] = m_frame;
+	m_frame++;
+	return m_result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// A rectangle of pixels [x0, x1) × [y0, y1).
+struct DamageRect {
+	int32_t x0;
+	int32_t y0;
+	int32_t x1;
+	int32_t y1;
+
+	int64_t area() const { return int64_t(x1 - x0) * (y1 - y0); }
+};
+
+/// Tracks which parts of a window have changed, so frames only redraw those and frames without changes are not drawn
+/// at all.
+///
+/// Damage is reported with add() by whatever knows it changed something (a new frame in the viewer), or found by
+/// addTiles() comparing the GUI's tile hashes with the previous frame's. It is kept as a few rectangles: touching
+/// ones are merged, and when there are too many the two whose union wastes least are.
+///
+/// Presentation cycles through several swap chain images, and an image being drawn again still shows what it held
+/// when it was last drawn. So each image remembers the frame it last showed, and redrawing it covers the damage of
+/// every frame since (its age); an image that was never drawn, or is older than the history kept, is redrawn whole.
+class DamageTracker {
+public:
+	static constexpr size_t MAX_RECTS = 8;       // Each costs every layer another scissored pass
+	static constexpr uint32_t MAX_AGE = 8;       // Frames of history kept; older images are redrawn whole
+	static constexpr uint32_t TILE_SIZE = 64;    // Pixels per side of the GUI's hashed tiles
+
+	/// Start over for a `width` × `height` window with `imageCount` swap chain images, all of them damaged.
+	void reset(uint32_t width, uint32_t height, uint32_t imageCount);
+
+	void add(DamageRect rect);
+	void addAll();
+
+	/// Compare the GUI's tile hashes (see GuiBatch::hashTiles()) with the previous frame's, damaging the tiles that
+	/// differ, and keep them for the next comparison.
+	void addTiles(const std::vector<uint64_t>& hashes);
+
+	/// Whether anything changed since the last frame was drawn.
+	bool pending() const { return !m_current.empty(); }
+
+	/// End the current frame and return what image `image` needs redrawn to show it: its age's worth of damage, or
+	/// the whole window. Empty if nothing changed since the image was last drawn.
+	const std::vector<DamageRect>& takeFrame(uint32_t image);
+
+	/// Whether the last takeFrame() covered the whole window, which can be drawn without keeping its old contents.
+	bool fullFrame() const { return m_full; }
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	uint32_t tileColumns() const { return (m_width + TILE_SIZE - 1) / TILE_SIZE; }
+	uint32_t tileRows() const { return (m_height + TILE_SIZE - 1) / TILE_SIZE; }
+
+private:
+	static constexpr uint64_t NEVER = UINT64_MAX;
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint64_t m_frame = 0;                         // Number of the frame being accumulated
+	std::vector<DamageRect> m_current;            // Its damage
+	std::vector<std::vector<DamageRect>> m_history; // Damage of frame f at [f % MAX_AGE]
+	std::vector<uint64_t> m_imageFrames;          // Frame each image last showed, or NEVER
+	std::vector<uint64_t> m_tileHashes;           // The GUI's, from the last addTiles()
+
+	std::vector<DamageRect> m_result; // Of takeFrame()
+	bool m_full = false;
+
+	DamageRect window() const { return {0, 0, int32_t(m_width), int32_t(m_height)}; }
+	/// Add `rect` (clamped to the window) to `rects`, merging as described above.
+	void merge(std::vector<DamageRect>& rects, DamageRect rect) const;
+};
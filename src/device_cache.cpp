@@ -0,0 +1,48 @@
+#include "device_cache.h"
+#include "hash.h"
+#include "paths.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+struct FileHeader {
+	char magic[4];     // "VDEV"
+	uint32_t version;
+	uint64_t checksum; // FNV-1a of the CachedDevice following this header
+};
+
+constexpr char FILE_MAGIC[4] = {'V', 'D', 'E', 'V'};
+constexpr uint32_t FILE_VERSION = 1;
+
+} // namespace
+
+bool loadCachedDevice(const std::string& path, CachedDevice& device) {
+	char file_data[sizeof(FileHeader) + sizeof(CachedDevice)];
+	std::ifstream file(path, std::ios::binary);
+	if (!file.read(file_data, sizeof(file_data)) || file.peek() != std::ifstream::traits_type::eof()) return false;
+
+	FileHeader header;
+	std::memcpy(&header, file_data, sizeof(header));
+	if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.version != FILE_VERSION
+		|| fnv1a64(file_data + sizeof(FileHeader), sizeof(CachedDevice)) != header.checksum) {
+		return false;
+	}
+
+	std::memcpy(&device, file_data + sizeof(FileHeader), sizeof(device));
+	return true;
+}
+
+bool saveCachedDevice(const std::string& path, const CachedDevice& device) {
+	char file_data[sizeof(FileHeader) + sizeof(CachedDevice)];
+	std::memcpy(file_data + sizeof(FileHeader), &device, sizeof(device));
+
+	FileHeader header;
+	std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	header.version = FILE_VERSION;
+	header.checksum = fnv1a64(file_data + sizeof(FileHeader), sizeof(CachedDevice));
+	std::memcpy(file_data, &header, sizeof(header));
+
+	return writeFileAtomically(path, file_data, sizeof(file_data));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+/// The GPU picked on a previous run, and its queue families, so the next start can skip checking every device's
+/// extensions, features and swap chain support. It identifies the device by UUID and driver version; the caller
+/// still has to check that the device is present and its queue families unchanged before trusting the rest.
+struct CachedDevice {
+	uint8_t deviceUUID[VK_UUID_SIZE];
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint32_t queueFamilyCount;
+	int32_t graphicsFamily; // Queue family indices, -1 for none
+	int32_t presentFamily;
+	int32_t transferFamily;
+	int32_t computeFamily;
+	uint32_t headless; // Picked for headless rendering, which asks less of a device
+};
+
+/// Read the device cached at `path`. Returns false if there is none, or it is damaged or from another version.
+bool loadCachedDevice(const std::string& path, CachedDevice& device);
+
+/// Write `device` to `path`. Returns false if that failed.
+bool saveCachedDevice(const std::string& path, const CachedDevice& device);
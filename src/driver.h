@@ -0,0 +1,91 @@
+#pragma once
+
+#include "gui_batch.h"
+
+#include <cstdint>
+#include <vector>
+
+/// A rectangle of pixels in a render target, with the origin at the top left.
+struct DriverRect {
+	int32_t x = 0;
+	int32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+/// What presenting to a window is tuned for, for backends that do.
+enum class PresentLatency : uint8_t {
+	Low,   // Show the newest frame as soon as possible, replacing any not shown yet (editing, scrubbing)
+	Paced, // Show every frame, each for at least one refresh, queued a frame ahead (playback)
+};
+
+/// The interface every rendering backend (Vulkan, the software rasterizer) provides.
+///
+/// A backend derives from Driver<Backend>, and its command list (what draws are recorded into) from
+/// DriverCommands<Commands>, implementing the functions named below with an `Impl` suffix. The interface dispatches
+/// to them statically: code drawing through it is written as templates over the command list, so a draw costs a
+/// direct, usually inlined call into the backend rather than a virtual one. Only one backend is used at a time, so
+/// nothing is lost by resolving it at compile time.
+///
+/// Setting up a backend differs too much between them to share (a window and device, or just a size), so that is
+/// left to each backend's constructor and accessors; the interface only covers what generic code calls.
+template <typename Backend>
+class Driver {
+public:
+	/// Create whatever the backend renders with. Throws std::runtime_error on failure.
+	void init() { backend().initImpl(); }
+	/// Release everything init() created. Everything created from the backend must be gone by then.
+	void cleanup() { backend().cleanupImpl(); }
+
+	static constexpr const char* name() { return Backend::NAME; }
+
+protected:
+	Driver() = default;
+	~Driver() = default;
+
+private:
+	Backend& backend() { return static_cast<Backend&>(*this); }
+};
+
+/// Draws recorded into one of a backend's command lists (one per thread recording). See Driver.
+template <typename Commands>
+class DriverCommands {
+public:
+	/// Limit the draws that follow to `rect`.
+	void setScissor(const DriverRect& rect) { commands().setScissorImpl(rect); }
+	/// Fill `rects` with the RGBA `color`, ignoring the scissor.
+	void clear(const std::vector<DriverRect>& rects, const float color[4]) { commands().clearImpl(rects, color); }
+
+	/// GUI quads: set the blend mode and the texture (see GuiBatch) of the draws that follow, and draw `quadCount`
+	/// quads of the frame's GUI vertices starting at `firstVertex`.
+	void bindGuiBlend(GuiBlend blend) { commands().bindGuiBlendImpl(blend); }
+	void bindGuiTexture(uint32_t texture) { commands().bindGuiTextureImpl(texture); }
+	void drawQuads(uint32_t firstVertex, uint32_t quadCount) { commands().drawQuadsImpl(firstVertex, quadCount); }
+
+protected:
+	DriverCommands() = default;
+	~DriverCommands() = default;
+
+private:
+	Commands& commands() { return static_cast<Commands&>(*this); }
+};
+
+/// Issue a GUI frame's `draws` (see GuiBatch::build()), once within each of `scissors`. Blend modes and textures
+/// are only bound when they change from the draw before, including across scissor rectangles.
+template <typename Commands>
+void drawGui(DriverCommands<Commands>& commands, const std::vector<GuiDraw>& draws, const std::vector<DriverRect>& scissors) {
+	bool bound = false;
+	GuiBlend blend = GuiBlend::Alpha;
+	uint32_t texture = 0;
+	for (const DriverRect& scissor : scissors) {
+		commands.setScissor(scissor);
+		for (const GuiDraw& draw : draws) {
+			if (!bound || draw.blend != blend) commands.bindGuiBlend(draw.blend);
+			if (!bound || draw.texture != texture) commands.bindGuiTexture(draw.texture);
+			bound = true;
+			blend = draw.blend;
+			texture = draw.texture;
+			commands.drawQuads(draw.firstVertex, draw.quadCount);
+		}
+	}
+}
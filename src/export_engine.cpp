@@ -0,0 +1,245 @@
+#include "export_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+/// Hands frames finished in any order to the sink in order. Whichever thread delivers the next frame to write
+/// also writes it, and any frames after it that are already waiting.
+class ReorderBuffer {
+public:
+	ReorderBuffer(int64_t first, size_t capacity, const ExportSink& sink) : m_next(first), m_capacity(capacity), m_sink(sink) {}
+
+	/// Wait until `frame` is within `capacity` of the next frame to write, then queue it. The next frame itself
+	/// never waits, so the worker rendering it always gets through. Returns false if the export was aborted.
+	bool push(int64_t frame, DecodedFrame& image) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_space.wait(lock, [&]() { return m_aborted || frame < m_next + static_cast<int64_t>(m_capacity); });
+		if (m_aborted) return false;
+		std::swap(m_waiting[frame], image); // The caller gets an old image back to render into
+		if (m_writing || frame != m_next) return true;
+
+		m_writing = true;
+		for (auto it = m_waiting.find(m_next); it != m_waiting.end(); it = m_waiting.find(m_next)) {
+			DecodedFrame ready = std::move(it->second);
+			m_waiting.erase(it);
+			lock.unlock();
+			m_sink(m_next, ready);
+			lock.lock();
+			m_next++;
+			m_space.notify_all();
+		}
+		m_writing = false;
+		return !m_aborted;
+	}
+
+	void abort() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_aborted = true;
+		m_space.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_space;
+	std::map<int64_t, DecodedFrame> m_waiting;
+	int64_t m_next;
+	size_t m_capacity;
+	const ExportSink& m_sink;
+	bool m_writing = false; // A thread is calling the sink
+	bool m_aborted = false;
+};
+
+struct WorkerQueue {
+	std::mutex mutex;
+	std::deque<ExportChunk> chunks; // Ascending; the owner takes the front, thieves the back
+};
+
+/// Resize `source` to `out`'s size by nearest-neighbour sampling.
+void stretchRgba8(const DecodedFrame& source, DecodedFrame& out) {
+	for (uint32_t y = 0; y < out.height; y++) {
+		const uint8_t* in_row = source.pixels.data() + size_t(uint64_t(y) * source.height / out.height) * source.stride;
+		auto* out_row = reinterpret_cast<uint32_t*>(out.pixels.data() + y * out.stride);
+		for (uint32_t x = 0; x < out.width; x++) {
+			std::memcpy(&out_row[x], in_row + size_t(uint64_t(x) * source.width / out.width) * 4, 4);
+		}
+	}
+}
+
+} // namespace
+
+std::vector<ExportChunk> splitTimeline(const Timeline& timeline, int64_t first, int64_t end, int64_t chunkFrames) {
+	chunkFrames = std::max<int64_t>(chunkFrames, 1);
+
+	std::vector<int64_t> boundaries;
+	for (const TrackTimeline& track : timeline.tracks()) {
+		for (int64_t frame : track.starts()) {
+			if (frame > first && frame < end) boundaries.push_back(frame);
+		}
+		for (int64_t frame : track.ends()) {
+			if (frame > first && frame < end) boundaries.push_back(frame);
+		}
+	}
+	std::sort(boundaries.begin(), boundaries.end());
+	boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+	std::vector<ExportChunk> chunks;
+	for (int64_t start = first; start < end;) {
+		const int64_t target = start + chunkFrames;
+		const int64_t limit = start + 2 * chunkFrames;
+
+		// The first boundary at or past the target, or else the last one past half of it, or else just the limit
+		int64_t cut = limit;
+		auto after = std::lower_bound(boundaries.begin(), boundaries.end(), target);
+		if (after != boundaries.end() && *after <= limit) {
+			cut = *after;
+		} else if (after != boundaries.begin() && *(after - 1) > start + chunkFrames / 2) {
+			cut = *(after - 1);
+		}
+		cut = std::min(cut, end);
+
+		chunks.push_back({start, cut});
+		start = cut;
+	}
+	return chunks;
+}
+
+int64_t timelineEnd(const Timeline& timeline) {
+	int64_t end = 0;
+	for (const TrackTimeline& track : timeline.tracks()) {
+		for (size_t i = 0; i < track.size(); i++) {
+			const int64_t segment_end = track.ends()[i];
+			end = std::max(end, segment_end != std::numeric_limits<int64_t>::max() ? segment_end : track.starts()[i] + 1);
+		}
+	}
+	return end;
+}
+
+CpuExportRenderer::CpuExportRenderer(const Timeline& timeline, FrameDecoder decoder, uint32_t width, uint32_t height)
+	: m_timeline(timeline), m_decoder(std::move(decoder)), m_width(width), m_height(height), m_compositor(nullptr) {}
+
+void CpuExportRenderer::render(int64_t frame, DecodedFrame& out) {
+	out.width = m_width;
+	out.height = m_height;
+	out.stride = size_t(m_width) * 4;
+	out.format = PixelFormat::Rgba8;
+	out.pixels.resize(out.stride * m_height);
+	for (size_t i = 0; i < out.pixels.size(); i += 4) { // Opaque black
+		out.pixels[i] = out.pixels[i + 1] = out.pixels[i + 2] = 0;
+		out.pixels[i + 3] = 255;
+	}
+
+	m_timeline.activeAt(frame, m_active);
+	m_sources.resize(m_active.size());
+	m_layers.clear();
+	for (size_t i = 0; i < m_active.size(); i++) {
+		const ActiveSegment& active = m_active[i];
+		if (m_timeline.tracks()[active.track].kind() != TrackKind::Video) continue;
+
+		DecodedFrame decoded = m_decoder({active.resource, active.clipFrame});
+		if (decoded.format != PixelFormat::Rgba8) throw std::runtime_error("export sources must decode to RGBA8!");
+		DecodedFrame& layer = m_sources[i];
+		if (decoded.width == m_width && decoded.height == m_height) {
+			layer = std::move(decoded);
+		} else {
+			layer.width = m_width;
+			layer.height = m_height;
+			layer.stride = out.stride;
+			layer.format = PixelFormat::Rgba8;
+			layer.pixels.resize(out.pixels.size());
+			stretchRgba8(decoded, layer);
+		}
+		m_layers.push_back({layer.pixels.data(), layer.stride});
+	}
+	m_compositor.composite(out.image(), m_layers);
+}
+
+ExportStats exportTimeline(const Timeline& timeline, const ExportSettings& settings, const ExportRendererFactory& renderers,
+                           const ExportSink& sink) {
+	const auto start_time = std::chrono::steady_clock::now();
+	const int64_t end = settings.end >= 0 ? settings.end : timelineEnd(timeline);
+	size_t worker_count = settings.workers ? settings.workers : std::thread::hardware_concurrency();
+	if (worker_count == 0) worker_count = 1;
+
+	ExportStats stats;
+	if (end <= settings.first) return stats;
+	const std::vector<ExportChunk> chunks = splitTimeline(timeline, settings.first, end, settings.chunkFrames);
+	worker_count = std::min(worker_count, chunks.size());
+
+	// Dealing the chunks out round-robin keeps every queue ascending, which the reorder buffer relies on: an owner
+	// finishes each chunk before starting its next, so the chunk holding the next frame to write is always either
+	// being rendered or at the front of an idle queue
+	std::vector<WorkerQueue> queues(worker_count);
+	for (size_t i = 0; i < chunks.size(); i++) queues[i % worker_count].chunks.push_back(chunks[i]);
+
+	ReorderBuffer reorder(settings.first, settings.reorderFrames ? settings.reorderFrames : 4 * worker_count, sink);
+	std::atomic<size_t> steals{0};
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	auto take = [&](size_t worker, ExportChunk& chunk) {
+		{
+			std::lock_guard<std::mutex> lock(queues[worker].mutex);
+			if (!queues[worker].chunks.empty()) {
+				chunk = queues[worker].chunks.front();
+				queues[worker].chunks.pop_front();
+				return true;
+			}
+		}
+		for (size_t offset = 1; offset < worker_count; offset++) {
+			WorkerQueue& victim = queues[(worker + offset) % worker_count];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.chunks.empty()) {
+				chunk = victim.chunks.back();
+				victim.chunks.pop_back();
+				steals++;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto work = [&](size_t worker) {
+		try {
+			std::unique_ptr<ExportRenderer> renderer = renderers(worker);
+			DecodedFrame image;
+			ExportChunk chunk;
+			while (take(worker, chunk)) {
+				for (int64_t frame = chunk.first; frame < chunk.end; frame++) {
+					renderer->render(frame, image);
+					if (!reorder.push(frame, image)) return;
+				}
+			}
+		} catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) error = std::current_exception();
+			}
+			reorder.abort();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(worker_count - 1);
+	for (size_t i = 1; i < worker_count; i++) workers.emplace_back(work, i);
+	work(0);
+	for (auto& worker : workers) worker.join();
+	if (error) std::rethrow_exception(error);
+
+	stats.frames = end - settings.first;
+	stats.chunks = chunks.size();
+	stats.steals = steals;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	return stats;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "compositor.h"
+#include "frame_cache.h"
+#include "timeline.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// A range of timeline frames [first, end) rendered by one worker, in order.
+struct ExportChunk {
+	int64_t first;
+	int64_t end;
+};
+
+/// Cut [first, end) into chunks of about `chunkFrames`, preferring to cut where a segment starts or ends on any
+/// track, so a chunk's decoders start at a segment's beginning rather than seeking into it. A stretch without
+/// boundaries is cut anyway once a chunk reaches twice `chunkFrames`.
+std::vector<ExportChunk> splitTimeline(const Timeline& timeline, int64_t first, int64_t end, int64_t chunkFrames);
+
+/// The last frame any segment covers, plus one. Open-ended segments count only their first frame.
+int64_t timelineEnd(const Timeline& timeline);
+
+/// Renders timeline frames for export. Every worker gets its own, so implementations need no locking; one could
+/// own a headless Vulkan device, another composite on the CPU.
+class ExportRenderer {
+public:
+	virtual ~ExportRenderer() = default;
+	/// Render timeline frame `frame` into `out`, which may hold the previous frame's image to reuse.
+	virtual void render(int64_t frame, DecodedFrame& out) = 0;
+};
+
+using ExportRendererFactory = std::function<std::unique_ptr<ExportRenderer>(size_t worker)>;
+
+/// Receives the exported frames, strictly in order and never concurrently.
+using ExportSink = std::function<void(int64_t frame, const DecodedFrame& image)>;
+
+/// Composites the video tracks on the CPU: track 0 at the bottom, over opaque black, alpha-over. Decoded frames of
+/// another size than the output are stretched to it by nearest-neighbour sampling.
+class CpuExportRenderer : public ExportRenderer {
+public:
+	CpuExportRenderer(const Timeline& timeline, FrameDecoder decoder, uint32_t width, uint32_t height);
+
+	void render(int64_t frame, DecodedFrame& out) override;
+
+private:
+	const Timeline& m_timeline;
+	FrameDecoder m_decoder;
+	uint32_t m_width;
+	uint32_t m_height;
+	Compositor m_compositor; // Single-threaded; the export runs one renderer per worker thread
+	std::vector<ActiveSegment> m_active;
+	std::vector<DecodedFrame> m_sources;
+	std::vector<CompositeLayer> m_layers;
+};
+
+struct ExportSettings {
+	int64_t first = 0;
+	int64_t end = -1;         // Exclusive; -1 for timelineEnd()
+	size_t workers = 0;       // 0 for one per hardware thread
+	int64_t chunkFrames = 48;
+	size_t reorderFrames = 0; // Frames that may wait for earlier ones; 0 for four per worker
+};
+
+struct ExportStats {
+	int64_t frames = 0;
+	size_t chunks = 0;
+	size_t steals = 0; // Chunks a worker took from another's queue
+	double seconds = 0;
+
+	double framesPerSecond() const { return seconds > 0 ? double(frames) / seconds : 0.0; }
+};
+
+/// Render [settings.first, settings.end) of `timeline` on worker threads and hand the frames to `sink` in order.
+///
+/// The range is split with splitTimeline() and the chunks dealt out round-robin to per-worker queues; a worker
+/// that runs out takes the last chunk of another's queue (work stealing), so uneven chunks still keep every
+/// thread busy. Finished frames pass through a reorder buffer to the sink. A worker whose frame is too far ahead
+/// of the next one to write waits, which bounds the buffer to `reorderFrames`. The first exception thrown by a
+/// renderer or the sink stops the export and is rethrown here.
+ExportStats exportTimeline(const Timeline& timeline, const ExportSettings& settings, const ExportRendererFactory& renderers,
+                           const ExportSink& sink);
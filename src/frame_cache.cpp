@@ -0,0 +1,285 @@
+#include "frame_cache.h"
+
+#include "hash.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iomanip>
+
+size_t FrameKeyHash::operator()(const FrameKey& key) const {
+	return static_cast<size_t>(fnv1a64(&key.frame, sizeof(key.frame), fnv1a64(&key.resource, sizeof(key.resource))));
+}
+
+DecodedFrame downscaleRgba8(const DecodedFrame& source, uint32_t width, uint32_t height) {
+	DecodedFrame frame;
+	frame.width = width;
+	frame.height = height;
+	frame.stride = size_t(width) * 4;
+	frame.pixels.resize(frame.stride * height);
+
+	auto span = [](uint32_t i, uint32_t from, uint32_t to) {
+		const uint32_t first = static_cast<uint32_t>(uint64_t(i) * from / to);
+		const uint32_t end = static_cast<uint32_t>(uint64_t(i + 1) * from / to);
+		return std::make_pair(first, std::max(end, first + 1));
+	};
+
+	for (uint32_t y = 0; y < height; y++) {
+		const auto [row_first, row_end] = span(y, source.height, height);
+		uint8_t* out = frame.pixels.data() + y * frame.stride;
+		for (uint32_t x = 0; x < width; x++, out += 4) {
+			const auto [column_first, column_end] = span(x, source.width, width);
+			uint32_t sums[4] = {};
+			for (uint32_t sy = row_first; sy < row_end; sy++) {
+				const uint8_t* in = source.pixels.data() + sy * source.stride + size_t(column_first) * 4;
+				for (uint32_t sx = column_first; sx < column_end; sx++, in += 4) {
+					for (int c = 0; c < 4; c++) sums[c] += in[c];
+				}
+			}
+			const uint32_t count = (column_end - column_first) * (row_end - row_first);
+			for (int c = 0; c < 4; c++) out[c] = static_cast<uint8_t>((sums[c] + count / 2) / count);
+		}
+	}
+	return frame;
+}
+
+double FrameCacheStats::hitRate() const {
+	const uint64_t lookups = hits + misses + waits;
+	return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+}
+
+void FrameCacheStats::print(std::ostream& out) const {
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(1);
+	out << "frame cache: resident=" << bytesResident / (1024.0 * 1024.0) << "MiB in " << framesResident << " frames"
+	    << " pinned=" << framesPinned
+	    << " hit rate=" << 100.0 * hitRate() << "% (hits=" << hits << " misses=" << misses << " waits=" << waits << ")"
+	    << " prefetched=" << prefetched << " (used " << prefetchHits << ")"
+	    << " evictions=" << evictions << "\n";
+	out.flags(flags);
+}
+
+FrameCache::Handle& FrameCache::Handle::operator=(Handle&& other) noexcept {
+	if (this != &other) {
+		reset();
+		m_cache = other.m_cache;
+		m_entry = other.m_entry;
+		other.m_cache = nullptr;
+	}
+	return *this;
+}
+
+void FrameCache::Handle::reset() {
+	if (m_cache) m_cache->unpin(m_entry);
+	m_cache = nullptr;
+	m_entry = nullptr;
+}
+
+const DecodedFrame& FrameCache::Handle::frame() const {
+	return m_entry->frame; // Pinned frames are not modified, so no lock is needed
+}
+
+const FrameKey& FrameCache::Handle::key() const {
+	return m_entry->key;
+}
+
+FrameCache::FrameCache(FrameDecoder decoder, size_t budgetBytes, ThreadPool& pool, size_t prefetchJobs)
+	: m_decoder(std::move(decoder)), m_pool(pool), m_prefetchJobs(prefetchJobs), m_budget(budgetBytes) {}
+
+FrameCache::~FrameCache() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_prefetchQueue.clear();
+	m_changed.wait(lock, [this]() { return m_runningPrefetchJobs == 0; });
+}
+
+FrameCache::Handle FrameCache::get(const FrameKey& key) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto found = m_index.find(key);
+	if (found != m_index.end() && found->second->state == State::Loading) {
+		m_stats.waits++;
+		m_changed.wait(lock, [&]() {
+			found = m_index.find(key);
+			return found == m_index.end() || found->second->state == State::Ready;
+		});
+		if (found != m_index.end()) {
+			if (found->second->prefetched) {
+				found->second->prefetched = false;
+				m_stats.prefetchHits++;
+			}
+			return pin(found->second);
+		}
+		// The other decode failed; try again here, which surfaces the error to this caller too
+	} else if (found != m_index.end()) {
+		m_stats.hits++;
+		if (found->second->prefetched) {
+			found->second->prefetched = false;
+			m_stats.prefetchHits++;
+		}
+		return pin(found->second);
+	} else {
+		m_stats.misses++;
+	}
+
+	auto it = m_entries.emplace(m_entries.begin());
+	it->key = key;
+	m_index.emplace(key, it);
+	it->pins = 1; // Held for the returned handle, so the frame cannot be evicted before it is handed out
+	m_stats.framesPinned++;
+	load(lock, it);
+	return Handle(this, &*it);
+}
+
+FrameCache::Handle FrameCache::find(const FrameKey& key) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto found = m_index.find(key);
+	if (found == m_index.end() || found->second->state != State::Ready) return {};
+	m_stats.hits++;
+	return pin(found->second);
+}
+
+void FrameCache::prefetch(std::vector<FrameKey> keys) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_prefetchQueue.assign(keys.begin(), keys.end());
+	while (m_runningPrefetchJobs < m_prefetchJobs && m_runningPrefetchJobs < m_prefetchQueue.size()) {
+		m_runningPrefetchJobs++;
+		m_pool.submit([this]() { prefetchJob(); });
+	}
+}
+
+void FrameCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		if (it->pins > 0 || it->state != State::Ready) {
+			++it;
+			continue;
+		}
+		m_stats.bytesResident -= it->frame.byteSize();
+		m_stats.framesResident--;
+		m_index.erase(it->key);
+		it = m_entries.erase(it);
+	}
+}
+
+void FrameCache::setBudget(size_t budgetBytes) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budget = budgetBytes;
+	evict();
+}
+
+size_t FrameCache::budget() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_budget;
+}
+
+FrameCacheStats FrameCache::stats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void FrameCache::resetStats() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	FrameCacheStats fresh;
+	fresh.bytesResident = m_stats.bytesResident;
+	fresh.framesResident = m_stats.framesResident;
+	fresh.framesPinned = m_stats.framesPinned;
+	m_stats = fresh;
+}
+
+FrameCache::Handle FrameCache::pin(EntryList::iterator it) {
+	if (it->pins++ == 0) m_stats.framesPinned++;
+	m_entries.splice(m_entries.begin(), m_entries, it);
+	return Handle(this, &*it);
+}
+
+void FrameCache::unpin(Entry* entry) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (--entry->pins == 0) {
+		m_stats.framesPinned--;
+		evict(); // It may have been held over the budget
+	}
+}
+
+void FrameCache::load(std::unique_lock<std::mutex>& lock, EntryList::iterator it) {
+	// Loading entries are never evicted or cleared, so the entry stays put while unlocked
+	lock.unlock();
+	DecodedFrame frame;
+	try {
+		frame = m_decoder(it->key);
+	} catch (...) {
+		lock.lock();
+		if (it->pins > 0) m_stats.framesPinned--;
+		m_index.erase(it->key);
+		m_entries.erase(it);
+		m_changed.notify_all();
+		throw;
+	}
+	lock.lock();
+
+	it->frame = std::move(frame);
+	it->state = State::Ready;
+	m_stats.bytesResident += it->frame.byteSize();
+	m_stats.framesResident++;
+	evict();
+	m_changed.notify_all();
+}
+
+void FrameCache::evict() {
+	auto it = m_entries.end();
+	while (m_stats.bytesResident > m_budget && it != m_entries.begin()) {
+		--it;
+		if (it->pins > 0 || it->state != State::Ready) continue;
+
+		m_stats.bytesResident -= it->frame.byteSize();
+		m_stats.framesResident--;
+		m_stats.evictions++;
+		m_index.erase(it->key);
+		it = m_entries.erase(it);
+	}
+}
+
+void FrameCache::prefetchJob() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_prefetchQueue.empty()) {
+		const FrameKey key = m_prefetchQueue.front();
+		m_prefetchQueue.pop_front();
+		if (m_index.count(key)) continue;
+
+		auto it = m_entries.emplace(m_entries.begin());
+		it->key = key;
+		it->prefetched = true;
+		m_index.emplace(key, it);
+		try {
+			load(lock, it);
+			m_stats.prefetched++;
+		} catch (...) {
+			// Dropped; a lookup of the frame decodes it again and sees the error itself
+		}
+	}
+	m_runningPrefetchJobs--;
+	m_changed.notify_all();
+}
+
+void PlayheadPrefetcher::update(int64_t frame) {
+	if (m_started && frame != m_lastFrame) m_direction = frame > m_lastFrame ? 1 : -1;
+	m_started = true;
+	m_lastFrame = frame;
+
+	// Everything playing anywhere in the window, then the keys nearest the playhead first
+	const int64_t first = m_direction > 0 ? frame + 1 : frame - m_lookahead;
+	const int64_t last = m_direction > 0 ? frame + 1 + m_lookahead : frame;
+	m_segments.clear();
+	m_timeline.overlapping(first, last, m_segments);
+
+	m_keys.clear();
+	for (int64_t step = 1; step <= m_lookahead; step++) {
+		const int64_t at = frame + step * m_direction;
+		for (const ActiveSegment& active : m_segments) {
+			const TrackTimeline& track = m_timeline.tracks()[active.track];
+			if (track.kind() != TrackKind::Video) continue;
+			const int64_t start = track.starts()[active.segment];
+			if (at < start || at >= track.ends()[active.segment]) continue;
+			m_keys.push_back({active.resource, track.clipFrames()[active.segment] + (at - start)});
+		}
+	}
+	m_cache.prefetch(m_keys);
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "compositor.h"
+#include "timeline.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+/// A frame of a resource, identified by its frame number within the resource (Segment::clipFrame and onwards).
+struct FrameKey {
+	uint32_t resource;
+	int64_t frame;
+
+	bool operator==(const FrameKey& other) const { return resource == other.resource && frame == other.frame; }
+};
+
+struct FrameKeyHash {
+	size_t operator()(const FrameKey& key) const;
+};
+
+struct DecodedFrame {
+	std::vector<uint8_t> pixels;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t stride = 0;
+	PixelFormat format = PixelFormat::Rgba8;
+
+	CpuImage image() { return {pixels.data(), width, height, stride, format}; }
+	size_t byteSize() const { return pixels.size(); }
+};
+
+/// Average `source` (RGBA8) down to width × height, each output pixel covering a block of input pixels.
+DecodedFrame downscaleRgba8(const DecodedFrame& source, uint32_t width, uint32_t height);
+
+/// Decodes one frame; called on whichever thread needs it, possibly several at once. Throws on failure.
+using FrameDecoder = std::function<DecodedFrame(const FrameKey& key)>;
+
+struct FrameCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;       // Lookups that decoded the frame themselves
+	uint64_t waits = 0;        // Lookups that found the frame being decoded by another thread and waited for it
+	uint64_t prefetched = 0;   // Frames decoded ahead of the playhead
+	uint64_t prefetchHits = 0; // Prefetched frames that were then looked up, counted once each
+	uint64_t evictions = 0;
+	size_t bytesResident = 0;
+	size_t framesResident = 0;
+	size_t framesPinned = 0;
+
+	/// Share of lookups that did not have to wait for a decode.
+	double hitRate() const;
+	void print(std::ostream& out) const;
+};
+
+/// Decoded frames kept within a memory budget, so scrubbing over frames already seen does not decode them again.
+///
+/// Frames are evicted least recently used first. A frame is pinned for as long as a Handle to it exists, which is
+/// how the renderer keeps what it is drawing; pinned frames are never evicted, even if that means going over the
+/// budget for a while. prefetch() decodes frames ahead on the thread pool; a lookup of a frame still being
+/// prefetched waits for that decode rather than starting its own.
+class FrameCache {
+	struct Entry;
+
+public:
+	static constexpr size_t DEFAULT_PREFETCH_JOBS = 2;
+
+	/// A pinned frame, which stays cached until the handle is destroyed or reset.
+	class Handle {
+	public:
+		Handle() = default;
+		Handle(Handle&& other) noexcept : m_cache(other.m_cache), m_entry(other.m_entry) { other.m_cache = nullptr; }
+		Handle& operator=(Handle&& other) noexcept;
+		~Handle() { reset(); }
+
+		void reset();
+		explicit operator bool() const { return m_cache != nullptr; }
+		const DecodedFrame& frame() const;
+		const FrameKey& key() const;
+
+	private:
+		friend class FrameCache;
+		Handle(FrameCache* cache, Entry* entry) : m_cache(cache), m_entry(entry) {}
+
+		FrameCache* m_cache = nullptr;
+		Entry* m_entry = nullptr;
+	};
+
+	FrameCache(FrameDecoder decoder, size_t budgetBytes, ThreadPool& pool, size_t prefetchJobs = DEFAULT_PREFETCH_JOBS);
+	/// Waits for running prefetches. All handles must be gone.
+	~FrameCache();
+
+	FrameCache(const FrameCache&) = delete;
+	FrameCache& operator=(const FrameCache&) = delete;
+
+	/// The frame for `key`, decoding it on this thread if it is neither cached nor being prefetched. Rethrows
+	/// the decoder's exceptions.
+	Handle get(const FrameKey& key);
+	/// The frame for `key` if it is cached, without waiting or decoding.
+	Handle find(const FrameKey& key);
+
+	/// Decode `keys` in order in the background, replacing whatever was still queued from an earlier call.
+	/// Frames already cached are skipped; decode failures are ignored.
+	void prefetch(std::vector<FrameKey> keys);
+
+	/// Drop every frame that is not pinned.
+	void clear();
+
+	void setBudget(size_t budgetBytes);
+	size_t budget() const;
+	FrameCacheStats stats() const;
+	void resetStats();
+
+private:
+	enum class State { Loading, Ready };
+
+	struct Entry {
+		FrameKey key;
+		State state = State::Loading;
+		bool prefetched = false;
+		uint32_t pins = 0;
+		DecodedFrame frame;
+	};
+	using EntryList = std::list<Entry>; // Most recently used first; nodes never move in memory
+
+	FrameDecoder m_decoder;
+	ThreadPool& m_pool;
+	size_t m_prefetchJobs;
+
+	mutable std::mutex m_mutex; // Guards everything below
+	std::condition_variable m_changed; // Signalled when a load finishes (or fails) and when a prefetch job ends
+	EntryList m_entries;
+	std::unordered_map<FrameKey, EntryList::iterator, FrameKeyHash> m_index;
+	size_t m_budget;
+	std::deque<FrameKey> m_prefetchQueue;
+	size_t m_runningPrefetchJobs = 0;
+	FrameCacheStats m_stats;
+
+	/// Pin `it`, mark it most recently used and hand it out. Called with m_mutex held.
+	Handle pin(EntryList::iterator it);
+	void unpin(Entry* entry);
+	/// Decode into the Loading entry `it` with m_mutex unlocked. On failure the entry is removed and the exception
+	/// rethrown.
+	void load(std::unique_lock<std::mutex>& lock, EntryList::iterator it);
+	/// Evict unpinned, loaded frames from the cold end until within budget. Called with m_mutex held.
+	void evict();
+	void prefetchJob();
+};
+
+/// Turns playhead movement into prefetches: a window of frames ahead of the playhead, in the direction it last
+/// moved, for every segment the timeline plays there.
+class PlayheadPrefetcher {
+public:
+	static constexpr int64_t DEFAULT_LOOKAHEAD = 24;
+
+	PlayheadPrefetcher(FrameCache& cache, const Timeline& timeline, int64_t lookahead = DEFAULT_LOOKAHEAD)
+		: m_cache(cache), m_timeline(timeline), m_lookahead(lookahead) {}
+
+	/// The playhead is now at `frame`. Cheap enough to call every time it moves.
+	void update(int64_t frame);
+
+private:
+	FrameCache& m_cache;
+	const Timeline& m_timeline;
+	int64_t m_lookahead;
+	int64_t m_lastFrame = 0;
+	int64_t m_direction = 1; // +1 playing or scrubbing forwards, -1 backwards
+	bool m_started = false;
+	std::vector<ActiveSegment> m_segments; // Scratch, kept to reuse its capacity
+	std::vector<FrameKey> m_keys;
+};
@@ -0,0 +1,82 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+void FrameTimeHistogram::record(double milliseconds) {
+	size_t bucket = milliseconds <= 0.0 ? 0 : static_cast<size_t>(milliseconds / BUCKET_MS);
+	m_buckets[std::min(bucket, BUCKET_COUNT)]++;
+	m_count++;
+	m_sum += milliseconds;
+	m_max = std::max(m_max, milliseconds);
+}
+
+void FrameTimeHistogram::reset() {
+	*this = FrameTimeHistogram{};
+}
+
+double FrameTimeHistogram::percentile(double p) const {
+	if (m_count == 0) return 0.0;
+
+	const double target = p / 100.0 * static_cast<double>(m_count);
+	size_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++) {
+		seen += m_buckets[i];
+		if (static_cast<double>(seen) >= target) return (static_cast<double>(i) + 1.0) * BUCKET_MS; // Upper edge
+	}
+	return m_max; // In the overflow bucket
+}
+
+size_t FrameTimeHistogram::countAbove(double milliseconds) const {
+	size_t first = static_cast<size_t>(milliseconds / BUCKET_MS);
+	size_t total = 0;
+	for (size_t i = std::min(first, BUCKET_COUNT); i <= BUCKET_COUNT; i++) total += m_buckets[i];
+	return total;
+}
+
+void FrameTimeHistogram::print(std::ostream& out, const char* label) const {
+	const double budget_60 = 1000.0 / 60.0;
+	const double over = m_count ? 100.0 * static_cast<double>(countAbove(budget_60)) / static_cast<double>(m_count) : 0.0;
+
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(2)
+	    << label << ": n=" << m_count
+	    << " mean=" << mean() << "ms"
+	    << " p50=" << percentile(50) << "ms"
+	    << " p95=" << percentile(95) << "ms"
+	    << " p99=" << percentile(99) << "ms"
+	    << " max=" << m_max << "ms"
+	    << " over16.7ms=" << over << "%\n";
+	out.flags(flags);
+}
+
+double StartupReport::elapsed() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void StartupReport::add(const char* name, double start, double milliseconds) {
+	m_phases.push_back({name, start, milliseconds});
+}
+
+void StartupReport::mark(const char* name) {
+	const double now = elapsed();
+	add(name, m_lastMark, now - m_lastMark);
+	m_lastMark = now;
+}
+
+void StartupReport::print(std::ostream& out) const {
+	std::vector<Phase> phases = m_phases;
+	std::stable_sort(phases.begin(), phases.end(), [](const Phase& a, const Phase& b) { return a.start < b.start; });
+
+	double end = 0.0;
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(2) << "startup:\n";
+	for (const Phase& phase : phases) {
+		out << "  " << std::left << std::setw(28) << phase.name << std::right
+		    << " at " << std::setw(8) << phase.start << "ms"
+		    << " took " << std::setw(8) << phase.milliseconds << "ms\n";
+		end = std::max(end, phase.start + phase.milliseconds);
+	}
+	out << "  total " << end << "ms\n";
+	out.flags(flags);
+}
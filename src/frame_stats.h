@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/// A fixed-size histogram of durations in milliseconds. Recording is a couple of additions, so it can sit in
+/// the frame loop permanently.
+class FrameTimeHistogram {
+public:
+	void record(double milliseconds);
+	void reset();
+
+	size_t count() const { return m_count; }
+	double mean() const { return m_count ? m_sum / static_cast<double>(m_count) : 0.0; }
+	double max() const { return m_max; }
+
+	/// Approximate `p`th percentile (0..100), accurate to one bucket.
+	double percentile(double p) const;
+
+	/// Number of samples longer than `milliseconds`.
+	size_t countAbove(double milliseconds) const;
+
+	/// One summary line: mean, p50/p95/p99, max and the share of samples over a 60 fps frame budget.
+	void print(std::ostream& out, const char* label) const;
+
+private:
+	static constexpr double BUCKET_MS = 0.25;
+	static constexpr size_t BUCKET_COUNT = 200; // Up to 50 ms; the extra last bucket collects everything above
+
+	std::array<uint32_t, BUCKET_COUNT + 1> m_buckets{};
+	size_t m_count = 0;
+	double m_sum = 0.0;
+	double m_max = 0.0;
+};
+
+/// When each phase of startup ran, in milliseconds since the report was created, for a report once the first frame
+/// is out. Phases may overlap, as the driver initializes on its own thread.
+class StartupReport {
+public:
+	StartupReport() : m_start(std::chrono::steady_clock::now()) {}
+
+	/// Milliseconds since the report was created.
+	double elapsed() const;
+
+	/// Record a phase that began at `start` (as given by elapsed()) and took `milliseconds`.
+	void add(const char* name, double start, double milliseconds);
+
+	/// Record a phase that ran from the end of the last one marked until now.
+	void mark(const char* name);
+
+	/// One line per phase in the order they began, then the total.
+	void print(std::ostream& out) const;
+
+private:
+	struct Phase {
+		const char* name;
+		double start;
+		double milliseconds;
+	};
+
+	std::chrono::steady_clock::time_point m_start;
+	std::vector<Phase> m_phases;
+	double m_lastMark = 0.0;
+};
@@ -0,0 +1,341 @@
+#include "gpu_memory.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+
+bool isPowerOfTwo(uint64_t value) {
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+unsigned log2(uint64_t value) {
+	unsigned result = 0;
+	while (value >>= 1) result++;
+	return result;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+BuddyAllocator::BuddyAllocator(uint64_t capacity, uint64_t minBlock)
+	: m_capacity(capacity), m_minShift(log2(minBlock)), m_orderCount(log2(capacity / minBlock) + 1), m_freeBytes(capacity) {
+	if (!isPowerOfTwo(capacity) || !isPowerOfTwo(minBlock) || capacity < minBlock) {
+		throw std::invalid_argument("buddy allocator sizes must be powers of two");
+	}
+
+	const size_t leaf_count = static_cast<size_t>(capacity >> m_minShift);
+	m_freeHeads.assign(m_orderCount, NIL);
+	m_next.assign(leaf_count, NIL);
+	m_prev.assign(leaf_count, NIL);
+	m_state.assign(leaf_count, NONE);
+	pushFree(0, m_orderCount - 1); // One free block covering everything
+}
+
+uint64_t BuddyAllocator::blockSize(uint64_t size) const {
+	uint64_t block = uint64_t(1) << m_minShift;
+	while (block < size) block <<= 1;
+	return block;
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t size) {
+	const unsigned order = log2(blockSize(size) >> m_minShift);
+	if (order >= m_orderCount) return INVALID;
+
+	// Smallest free block that is big enough, split down to the requested order
+	unsigned found = order;
+	while (found < m_orderCount && m_freeHeads[found] == NIL) found++;
+	if (found == m_orderCount) return INVALID;
+
+	const uint32_t leaf = m_freeHeads[found];
+	removeFree(leaf, found);
+	while (found > order) {
+		found--;
+		pushFree(leaf + (uint32_t(1) << found), found); // The upper half stays free
+	}
+
+	m_state[leaf] = static_cast<uint8_t>(order);
+	m_freeBytes -= uint64_t(1) << (order + m_minShift);
+	return uint64_t(leaf) << m_minShift;
+}
+
+void BuddyAllocator::free(uint64_t offset) {
+	uint32_t leaf = static_cast<uint32_t>(offset >> m_minShift);
+	unsigned order = m_state[leaf];
+	m_state[leaf] = NONE;
+	m_freeBytes += uint64_t(1) << (order + m_minShift);
+
+	// Merge with the buddy for as long as it is free as a whole
+	while (order + 1 < m_orderCount) {
+		const uint32_t buddy = leaf ^ (uint32_t(1) << order);
+		if (m_state[buddy] != (FREE_BIT | order)) break;
+		removeFree(buddy, order);
+		leaf = std::min(leaf, buddy);
+		order++;
+	}
+	pushFree(leaf, order);
+}
+
+uint64_t BuddyAllocator::largestFree() const {
+	for (unsigned order = m_orderCount; order-- > 0;) {
+		if (m_freeHeads[order] != NIL) return uint64_t(1) << (order + m_minShift);
+	}
+	return 0;
+}
+
+void BuddyAllocator::pushFree(uint32_t leaf, unsigned order) {
+	m_state[leaf] = static_cast<uint8_t>(FREE_BIT | order);
+	m_prev[leaf] = NIL;
+	m_next[leaf] = m_freeHeads[order];
+	if (m_freeHeads[order] != NIL) m_prev[m_freeHeads[order]] = leaf;
+	m_freeHeads[order] = leaf;
+}
+
+void BuddyAllocator::removeFree(uint32_t leaf, unsigned order) {
+	if (m_prev[leaf] != NIL) {
+		m_next[m_prev[leaf]] = m_next[leaf];
+	} else {
+		m_freeHeads[order] = m_next[leaf];
+	}
+	if (m_next[leaf] != NIL) m_prev[m_next[leaf]] = m_prev[leaf];
+	m_state[leaf] = NONE;
+}
+
+FrameRing::FrameRing(uint64_t capacity, uint32_t framesInFlight)
+	: m_capacity(capacity), m_frameEnds(framesInFlight, 0) {}
+
+void FrameRing::beginFrame(uint32_t slot) {
+	if (m_currentSlot != UINT32_MAX) m_frameEnds[m_currentSlot] = m_head;
+
+	// Frames complete in submission order, so everything up to the end of this slot's last frame is done
+	release(m_frameEnds[slot]);
+	m_currentSlot = slot;
+}
+
+void FrameRing::release(uint64_t position) {
+	m_tail = std::max(m_tail, position);
+}
+
+uint64_t FrameRing::allocate(uint64_t size, uint64_t alignment) {
+	uint64_t base = m_head - m_head % m_capacity; // Start of the current lap around the ring
+	uint64_t offset = alignUp(m_head - base, alignment);
+	if (offset + size > m_capacity) { // Does not fit before the end; continue at the start of the next lap
+		base += m_capacity;
+		offset = 0;
+	}
+
+	const uint64_t end = base + offset + size;
+	if (size > m_capacity || end - m_tail > m_capacity) return INVALID;
+	m_head = end;
+	return offset;
+}
+
+bool VulkanMemorySource::allocate(uint32_t memoryType, VkDeviceSize size, bool hostVisible, DeviceBlock& block) {
+	VkMemoryAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = size;
+	alloc_info.memoryTypeIndex = memoryType;
+
+	if (vkAllocateMemory(m_device, &alloc_info, nullptr, &block.memory) != VK_SUCCESS) return false;
+
+	block.mapped = nullptr;
+	if (hostVisible && vkMapMemory(m_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+		vkFreeMemory(m_device, block.memory, nullptr);
+		return false;
+	}
+	return true;
+}
+
+void VulkanMemorySource::free(const DeviceBlock& block) {
+	vkFreeMemory(m_device, block.memory, nullptr); // Implicitly unmaps
+}
+
+double HeapStats::fragmentation() const {
+	const VkDeviceSize free_bytes = blockBytes - reservedBytes;
+	return free_bytes ? 1.0 - static_cast<double>(largestFree) / static_cast<double>(free_bytes) : 0.0;
+}
+
+GpuMemory::GpuMemory(const VkPhysicalDeviceMemoryProperties& properties, DeviceMemorySource& source, VkDeviceSize blockSize)
+	: m_properties(properties), m_source(source), m_blockSize(blockSize), m_pools(properties.memoryTypeCount * 2) {
+	if (!isPowerOfTwo(blockSize) || blockSize < MIN_ALLOCATION) {
+		throw std::invalid_argument("memory block size must be a power of two of at least one page");
+	}
+}
+
+GpuMemory::~GpuMemory() {
+	for (auto& pool : m_pools) {
+		for (auto& block : pool.blocks) {
+			if (block) m_source.free(block->memory);
+		}
+		for (auto& dedicated : pool.dedicated) {
+			m_source.free(dedicated.memory);
+		}
+	}
+}
+
+VkDeviceSize GpuMemory::blockSize(uint32_t heap) const {
+	VkDeviceSize size = m_blockSize;
+	while (size > MIN_ALLOCATION && size > m_properties.memoryHeaps[heap].size / 8) size >>= 1;
+	return size;
+}
+
+uint32_t GpuMemory::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required) const {
+	for (uint32_t i = 0; i < m_properties.memoryTypeCount; i++) {
+		if ((typeBits & (1u << i)) && (m_properties.memoryTypes[i].propertyFlags & required) == required) {
+			return i;
+		}
+	}
+	throw std::runtime_error("failed to find a suitable memory type!");
+}
+
+bool GpuMemory::isHostVisible(uint32_t memoryType) const {
+	return (m_properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+GpuAllocation GpuMemory::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, ResourceLayout layout) {
+	const uint32_t memory_type = findMemoryType(requirements.memoryTypeBits, required);
+	const bool host_visible = isHostVisible(memory_type);
+	const uint32_t pool_index = memory_type * 2 + (layout == ResourceLayout::Optimal ? 1 : 0);
+	const VkDeviceSize block_size = blockSize(m_properties.memoryTypes[memory_type].heapIndex);
+
+	// Buddy blocks are aligned to their size, so asking for at least `alignment` bytes also aligns the offset
+	const VkDeviceSize size = std::max({requirements.size, requirements.alignment, MIN_ALLOCATION});
+
+	GpuAllocation allocation;
+	allocation.size = requirements.size;
+	allocation.memoryType = memory_type;
+	allocation.pool = pool_index;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Pool& pool = m_pools[pool_index];
+
+	if (size > block_size / 2) { // Too big to share a block usefully
+		DeviceBlock block;
+		if (!m_source.allocate(memory_type, requirements.size, host_visible, block)) {
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		pool.dedicated.push_back({block, requirements.size});
+		pool.usedBytes += requirements.size;
+		pool.allocationCount++;
+
+		allocation.memory = block.memory;
+		allocation.mapped = block.mapped;
+		allocation.block = GpuAllocation::DEDICATED;
+		return allocation;
+	}
+
+	uint32_t block_index = 0;
+	VkDeviceSize offset = BuddyAllocator::INVALID;
+	for (; block_index < pool.blocks.size(); block_index++) {
+		if (pool.blocks[block_index]) {
+			offset = pool.blocks[block_index]->buddy.allocate(size);
+			if (offset != BuddyAllocator::INVALID) break;
+		}
+	}
+
+	if (offset == BuddyAllocator::INVALID) { // Every block is full; grab a new one, reusing a released slot
+		DeviceBlock memory;
+		if (!m_source.allocate(memory_type, block_size, host_visible, memory)) {
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+
+		auto empty_slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+		block_index = static_cast<uint32_t>(empty_slot - pool.blocks.begin());
+		auto block = std::make_unique<Block>(Block{memory, BuddyAllocator(block_size, MIN_ALLOCATION)});
+		if (empty_slot == pool.blocks.end()) {
+			pool.blocks.push_back(std::move(block));
+		} else {
+			*empty_slot = std::move(block);
+		}
+		offset = pool.blocks[block_index]->buddy.allocate(size);
+	}
+
+	Block& block = *pool.blocks[block_index];
+	block.allocationCount++;
+	pool.usedBytes += requirements.size;
+	pool.allocationCount++;
+
+	allocation.memory = block.memory.memory;
+	allocation.offset = offset;
+	allocation.mapped = block.memory.mapped ? static_cast<char*>(block.memory.mapped) + offset : nullptr;
+	allocation.block = block_index;
+	return allocation;
+}
+
+void GpuMemory::free(const GpuAllocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Pool& pool = m_pools[allocation.pool];
+	pool.usedBytes -= allocation.size;
+	pool.allocationCount--;
+
+	if (allocation.block == GpuAllocation::DEDICATED) {
+		auto it = std::find_if(pool.dedicated.begin(), pool.dedicated.end(),
+		                       [&](const Dedicated& dedicated) { return dedicated.memory.memory == allocation.memory; });
+		m_source.free(it->memory);
+		pool.dedicated.erase(it);
+		return;
+	}
+
+	auto& block = pool.blocks[allocation.block];
+	block->buddy.free(allocation.offset);
+	block->allocationCount--;
+
+	if (block->allocationCount == 0) {
+		// Keep one empty block per pool around, so a pool that repeatedly drains and refills does not thrash
+		size_t live_blocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const auto& b) { return b != nullptr; });
+		if (live_blocks > 1) {
+			m_source.free(block->memory);
+			block.reset();
+		}
+	}
+}
+
+HeapStats GpuMemory::heapStats(uint32_t heap) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	HeapStats stats;
+
+	for (uint32_t i = 0; i < m_pools.size(); i++) {
+		if (heapOf(i) != heap) continue;
+		const Pool& pool = m_pools[i];
+
+		stats.usedBytes += pool.usedBytes;
+		stats.allocationCount += pool.allocationCount;
+		stats.dedicatedCount += static_cast<uint32_t>(pool.dedicated.size());
+		for (const auto& dedicated : pool.dedicated) { // Dedicated blocks are always fully used
+			stats.blockBytes += dedicated.size;
+			stats.reservedBytes += dedicated.size;
+		}
+		for (const auto& block : pool.blocks) {
+			if (!block) continue;
+			stats.blockBytes += block->buddy.capacity();
+			stats.reservedBytes += block->buddy.capacity() - block->buddy.freeBytes();
+			stats.largestFree = std::max(stats.largestFree, block->buddy.largestFree());
+			stats.blockCount++;
+		}
+	}
+	return stats;
+}
+
+void GpuMemory::print(std::ostream& out) const {
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(1);
+	for (uint32_t heap = 0; heap < heapCount(); heap++) {
+		const HeapStats stats = heapStats(heap);
+		if (stats.blockCount == 0 && stats.dedicatedCount == 0) continue;
+
+		const double mib = 1024.0 * 1024.0;
+		out << "heap " << heap << ": blocks=" << stats.blockCount << " (" << stats.blockBytes / mib << "MiB)"
+		    << " used=" << stats.usedBytes / mib << "MiB"
+		    << " reserved=" << stats.reservedBytes / mib << "MiB"
+		    << " allocations=" << stats.allocationCount
+		    << " dedicated=" << stats.dedicatedCount
+		    << " fragmentation=" << 100.0 * stats.fragmentation() << "%\n";
+	}
+	out.flags(flags);
+}
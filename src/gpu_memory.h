@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/// A binary buddy allocator over an abstract range [0, capacity). It only hands out offsets, so it knows nothing
+/// about Vulkan. Every block size is a power of two and every block is aligned to its own size.
+///
+/// Free lists are intrusive and indexed by the block's first leaf, so allocation, free and buddy merging are all
+/// O(log capacity) without any per-call heap allocation.
+class BuddyAllocator {
+public:
+	static constexpr uint64_t INVALID = UINT64_MAX;
+
+	/// `capacity` and `minBlock` must be powers of two, with capacity >= minBlock.
+	BuddyAllocator(uint64_t capacity, uint64_t minBlock);
+
+	/// Offset of a free block of at least `size` bytes, aligned to the block size, or INVALID if there is none.
+	uint64_t allocate(uint64_t size);
+
+	/// Return the block starting at `offset`, which must have come from allocate().
+	void free(uint64_t offset);
+
+	/// Size of the block that allocate() would use for `size` bytes.
+	uint64_t blockSize(uint64_t size) const;
+
+	uint64_t capacity() const { return m_capacity; }
+	uint64_t freeBytes() const { return m_freeBytes; }
+	uint64_t largestFree() const;
+	bool empty() const { return m_freeBytes == m_capacity; }
+
+private:
+	static constexpr uint32_t NIL = UINT32_MAX;
+	static constexpr uint8_t NONE = 0xff;     // Leaf is not the start of a free or allocated block
+	static constexpr uint8_t FREE_BIT = 0x80; // Set for free blocks; the low bits are the order
+
+	uint64_t m_capacity;
+	unsigned m_minShift;
+	unsigned m_orderCount;
+	uint64_t m_freeBytes;
+
+	std::vector<uint32_t> m_freeHeads; // Per order
+	std::vector<uint32_t> m_next;      // Per leaf, free list links
+	std::vector<uint32_t> m_prev;
+	std::vector<uint8_t> m_state;      // Per leaf
+
+	void pushFree(uint32_t leaf, unsigned order);
+	void removeFree(uint32_t leaf, unsigned order);
+};
+
+/// A linear ring allocator for transient per-frame data such as upload staging. Allocations are never freed one by
+/// one: when a frame slot comes around again (after its fence was waited on), everything allocated during that
+/// slot's previous frame becomes free at once. Like BuddyAllocator it only deals in offsets; the caller binds a
+/// persistently mapped buffer of `capacity` bytes behind it.
+class FrameRing {
+public:
+	static constexpr uint64_t INVALID = UINT64_MAX;
+
+	FrameRing(uint64_t capacity, uint32_t framesInFlight = 0);
+
+	/// Start recording the frame in `slot`, releasing what that slot's previous frame allocated.
+	void beginFrame(uint32_t slot);
+
+	/// Offset of `size` bytes aligned to `alignment` (a power of two), or INVALID if the ring is full.
+	/// Allocations never wrap around the end of the ring.
+	uint64_t allocate(uint64_t size, uint64_t alignment = 16);
+
+	/// For rings retired by something other than frame slots, such as a timeline semaphore: position() marks
+	/// the end of everything allocated so far, and release() frees everything up to such a mark.
+	uint64_t position() const { return m_head; }
+	void release(uint64_t position);
+
+	uint64_t capacity() const { return m_capacity; }
+	uint64_t usedBytes() const { return m_head - m_tail; }
+
+private:
+	uint64_t m_capacity;
+	uint64_t m_head = 0; // Total bytes ever allocated, including padding; offsets are these modulo capacity
+	uint64_t m_tail = 0; // Total bytes ever released
+	std::vector<uint64_t> m_frameEnds; // Per slot, m_head when the slot's last frame ended
+	uint32_t m_currentSlot = UINT32_MAX;
+};
+
+/// A block of device memory as handed out by a DeviceMemorySource.
+struct DeviceBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	void* mapped = nullptr; // Persistently mapped base address, for host visible memory types
+};
+
+/// Where GpuMemory gets its blocks from. The Vulkan implementation calls vkAllocateMemory; anything else (such as a
+/// mock that hands out fake handles) lets the sub-allocation logic be exercised without a GPU.
+class DeviceMemorySource {
+public:
+	virtual ~DeviceMemorySource() = default;
+
+	/// Allocate `size` bytes of `memoryType`, mapping them if `hostVisible`. Returns false when out of memory.
+	virtual bool allocate(uint32_t memoryType, VkDeviceSize size, bool hostVisible, DeviceBlock& block) = 0;
+	virtual void free(const DeviceBlock& block) = 0;
+};
+
+class VulkanMemorySource : public DeviceMemorySource {
+public:
+	explicit VulkanMemorySource(VkDevice device) : m_device(device) {}
+
+	bool allocate(uint32_t memoryType, VkDeviceSize size, bool hostVisible, DeviceBlock& block) override;
+	void free(const DeviceBlock& block) override;
+
+private:
+	VkDevice m_device;
+};
+
+/// Whether a resource uses linear (buffers, linear images) or optimal tiling. The two are kept in separate blocks
+/// so bufferImageGranularity never has to be considered.
+enum class ResourceLayout { Linear, Optimal };
+
+/// A sub-allocation handed out by GpuMemory. Bind resources with `memory` and `offset`.
+struct GpuAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;     // As requested
+	void* mapped = nullptr;    // Host pointer to `offset`, for host visible memory
+	uint32_t memoryType = 0;
+
+	// Where the allocation came from, for free()
+	uint32_t pool = 0;
+	uint32_t block = 0; // DEDICATED for allocations with a block of their own
+	static constexpr uint32_t DEDICATED = UINT32_MAX;
+};
+
+/// Usage of one memory heap.
+struct HeapStats {
+	VkDeviceSize blockBytes = 0;     // Allocated from the driver
+	VkDeviceSize usedBytes = 0;      // Requested by sub-allocations
+	VkDeviceSize reservedBytes = 0;  // Taken by sub-allocations after rounding up to buddy block sizes
+	VkDeviceSize largestFree = 0;    // Largest sub-allocation that fits without a new block
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t dedicatedCount = 0;
+
+	/// Share of free bytes in the heap's blocks that cannot be used for one allocation (0 = none, 1 = all).
+	double fragmentation() const;
+};
+
+/// Device memory for images and buffers, sub-allocated from large blocks.
+///
+/// Each memory type gets one pool for linear and one for optimal resources. A pool grabs blocks of blockSize()
+/// bytes as needed and carves them up with a BuddyAllocator; requests larger than half a block get a dedicated
+/// block instead. Empty blocks are returned to the driver, except for the last one in each pool. Host visible
+/// blocks are mapped once, for their whole lifetime. All methods are thread safe.
+class GpuMemory {
+public:
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = VkDeviceSize(64) << 20;
+	static constexpr VkDeviceSize MIN_ALLOCATION = 4096;
+
+	GpuMemory(const VkPhysicalDeviceMemoryProperties& properties, DeviceMemorySource& source,
+	          VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+	~GpuMemory();
+
+	GpuMemory(const GpuMemory&) = delete;
+	GpuMemory& operator=(const GpuMemory&) = delete;
+
+	/// Sub-allocate memory for a resource with the given requirements from the first memory type that has all of
+	/// the `required` properties. Throws if there is no such type or the device is out of memory.
+	GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, ResourceLayout layout);
+	void free(const GpuAllocation& allocation);
+
+	/// Blocks in `heap` will be at most this big; small heaps (such as BAR memory) get smaller blocks.
+	VkDeviceSize blockSize(uint32_t heap) const;
+
+	HeapStats heapStats(uint32_t heap) const;
+	uint32_t heapCount() const { return m_properties.memoryHeapCount; }
+
+	/// One line per heap in use: block and used bytes, allocation counts and fragmentation.
+	void print(std::ostream& out) const;
+
+private:
+	struct Block {
+		DeviceBlock memory;
+		BuddyAllocator buddy;
+		uint32_t allocationCount = 0;
+	};
+
+	struct Dedicated {
+		DeviceBlock memory;
+		VkDeviceSize size;
+	};
+
+	struct Pool {
+		std::vector<std::unique_ptr<Block>> blocks; // Null entries are released blocks, so indices stay stable
+		std::vector<Dedicated> dedicated;
+		VkDeviceSize usedBytes = 0;
+		uint32_t allocationCount = 0;
+	};
+
+	VkPhysicalDeviceMemoryProperties m_properties;
+	DeviceMemorySource& m_source;
+	VkDeviceSize m_blockSize;
+	std::vector<Pool> m_pools; // Indexed by memory type * 2 + layout
+	mutable std::mutex m_mutex;
+
+	uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required) const;
+	bool isHostVisible(uint32_t memoryType) const;
+	uint32_t heapOf(uint32_t pool) const { return m_properties.memoryTypes[pool / 2].heapIndex; }
+};
@@ -0,0 +1,141 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkQueue queue,
+                         uint32_t framesInFlight)
+	: m_device(device), m_frames(framesInFlight) {
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> families(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &family_count, families.data());
+	const uint32_t valid_bits = families.at(queueFamily).timestampValidBits;
+	if (valid_bits == 0) return; // Zones will be skipped
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_period = properties.limits.timestampPeriod;
+	m_validMask = valid_bits >= 64 ? UINT64_MAX : (uint64_t(1) << valid_bits) - 1;
+
+	VkQueryPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	pool_info.queryCount = framesInFlight * MAX_ZONES_PER_FRAME * 2;
+
+	if (vkCreateQueryPool(m_device, &pool_info, nullptr, &m_pool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	for (FrameSlot& frame : m_frames) frame.names = std::make_unique<const char*[]>(MAX_ZONES_PER_FRAME);
+	m_results.resize(size_t(MAX_ZONES_PER_FRAME) * 4);
+	calibrate(queueFamily, queue);
+}
+
+GpuProfiler::~GpuProfiler() {
+	if (m_pool != VK_NULL_HANDLE) vkDestroyQueryPool(m_device, m_pool, nullptr);
+}
+
+void GpuProfiler::calibrate(uint32_t queueFamily, VkQueue queue) {
+	VkCommandPoolCreateInfo command_pool_info{};
+	command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	command_pool_info.queueFamilyIndex = queueFamily;
+
+	VkCommandPool command_pool;
+	if (vkCreateCommandPool(m_device, &command_pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create calibration command pool!");
+	}
+
+	VkCommandBufferAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = command_pool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	vkAllocateCommandBuffers(m_device, &alloc_info, &cmd);
+
+	VkCommandBufferBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &begin_info);
+	vkCmdResetQueryPool(cmd, m_pool, 0, 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, 0);
+	vkEndCommandBuffer(cmd);
+
+	VkFenceCreateInfo fence_info{};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	vkCreateFence(m_device, &fence_info, nullptr, &fence);
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+
+	// Runs before anything else uses the queue, so it needs no lock
+	const uint64_t submitted = Profiler::now();
+	if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit timestamp calibration!");
+	}
+	vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX);
+	const uint64_t finished = Profiler::now();
+
+	uint64_t ticks = 0;
+	vkGetQueryPoolResults(m_device, m_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT);
+	m_calibrationTicks = ticks & m_validMask;
+	m_calibrationTime = submitted + (finished - submitted) / 2;
+
+	vkDestroyFence(m_device, fence, nullptr);
+	vkDestroyCommandPool(m_device, command_pool, nullptr);
+}
+
+void GpuProfiler::beginFrame(uint32_t slot) {
+	m_currentSlot = slot;
+	if (!supported()) return;
+
+	FrameSlot& frame = m_frames[slot];
+	const uint32_t zones = std::min(frame.zoneCount.exchange(0, std::memory_order_relaxed), MAX_ZONES_PER_FRAME);
+	if (zones == 0) return;
+
+	// Each query's value is followed by whether it is available; zones that never ran are skipped
+	const VkResult result = vkGetQueryPoolResults(m_device, m_pool, slot * MAX_ZONES_PER_FRAME * 2, zones * 2,
+	                                              m_results.size() * sizeof(uint64_t), m_results.data(), 2 * sizeof(uint64_t),
+	                                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	if (result != VK_SUCCESS && result != VK_NOT_READY) return;
+
+	for (uint32_t zone = 0; zone < zones; zone++) {
+		const uint64_t* begin = &m_results[size_t(zone) * 4];
+		const uint64_t* end = begin + 2;
+		if (begin[1] == 0 || end[1] == 0) continue;
+
+		// Ticks since calibration, wrapping at the valid bits
+		const double begin_ns = double((begin[0] - m_calibrationTicks) & m_validMask) * m_period;
+		const double end_ns = double((end[0] - m_calibrationTicks) & m_validMask) * m_period;
+		if (end_ns < begin_ns) continue;
+		Profiler::record({frame.names[zone], m_calibrationTime + uint64_t(begin_ns), m_calibrationTime + uint64_t(end_ns),
+		                  ProfileTrack::Gpu});
+	}
+}
+
+void GpuProfiler::recordReset(VkCommandBuffer cmd) {
+	if (!supported()) return;
+	vkCmdResetQueryPool(cmd, m_pool, m_currentSlot * MAX_ZONES_PER_FRAME * 2, MAX_ZONES_PER_FRAME * 2);
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer cmd, const char* name) {
+	if (!supported()) return UINT32_MAX;
+
+	FrameSlot& frame = m_frames[m_currentSlot];
+	const uint32_t zone = frame.zoneCount.fetch_add(1, std::memory_order_relaxed);
+	if (zone >= MAX_ZONES_PER_FRAME) return UINT32_MAX;
+
+	frame.names[zone] = name;
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, (m_currentSlot * MAX_ZONES_PER_FRAME + zone) * 2);
+	return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer cmd, uint32_t zone) {
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool, (m_currentSlot * MAX_ZONES_PER_FRAME + zone) * 2 + 1);
+}
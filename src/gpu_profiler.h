@@ -0,0 +1,91 @@
+#pragma once
+
+#include "profiler.h"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Times GPU work with timestamp queries and hands the results to Profiler on its GPU track.
+///
+/// Each frame slot has its own range of queries in one pool. A zone writes a timestamp where it begins and one
+/// where it ends; beginFrame() reads back what the slot's previous frame wrote (its fence has been waited on, so
+/// the results are ready without stalling) and records the zones. Zones may be opened from several threads
+/// recording secondary command buffers of the same frame: queries are handed out with an atomic counter, and zones
+/// past the slot's capacity are skipped.
+///
+/// GPU ticks are put on the CPU clock with one calibration at construction: a timestamp is written by a
+/// submission that is waited for, and taken as happening halfway through the wait. That is accurate to the
+/// submission's latency, and ignores drift between the clocks over a session.
+class GpuProfiler {
+public:
+	static constexpr uint32_t MAX_ZONES_PER_FRAME = 256;
+
+	/// Timestamps are written on `queue` of `queueFamily`. Does nothing if that family has no timestamp support.
+	GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkQueue queue, uint32_t framesInFlight);
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	bool supported() const { return m_pool != VK_NULL_HANDLE; }
+
+	/// Start the frame in `slot`, whose previous frame the GPU must be done with, recording that frame's zones.
+	void beginFrame(uint32_t slot);
+	/// Reset the frame's queries. Record at the start of its primary command buffer, before any zone.
+	void recordReset(VkCommandBuffer cmd);
+
+	/// Write a zone's first timestamp into `cmd`, returning the zone, or UINT32_MAX if it is not timed.
+	uint32_t beginZone(VkCommandBuffer cmd, const char* name);
+	/// Write the second timestamp of `zone` (from beginZone()) into `cmd`.
+	void endZone(VkCommandBuffer cmd, uint32_t zone);
+
+private:
+	VkDevice m_device;
+	VkQueryPool m_pool = VK_NULL_HANDLE;
+	uint64_t m_validMask = 0; // Of the timestamps' bits
+	double m_period = 1.0; // Nanoseconds per tick
+	uint64_t m_calibrationTicks = 0;
+	uint64_t m_calibrationTime = 0; // Profiler::now() at m_calibrationTicks
+
+	struct FrameSlot {
+		std::unique_ptr<const char*[]> names; // Of each zone
+		std::atomic<uint32_t> zoneCount{0};
+	};
+	std::vector<FrameSlot> m_frames;
+	uint32_t m_currentSlot = 0;
+	std::vector<uint64_t> m_results; // Readback scratch, two timestamps and two availability words per zone
+
+	void calibrate(uint32_t queueFamily, VkQueue queue);
+};
+
+/// Times the enclosing scope of the commands recorded into `cmd` on the GPU. Use VIPER_PROFILE_GPU_ZONE.
+class GpuProfileZone {
+public:
+	GpuProfileZone(GpuProfiler* profiler, VkCommandBuffer cmd, const char* name)
+		: m_profiler(profiler && Profiler::enabled() ? profiler : nullptr), m_cmd(cmd),
+		  m_zone(m_profiler ? m_profiler->beginZone(cmd, name) : UINT32_MAX) {}
+	~GpuProfileZone() {
+		if (m_zone != UINT32_MAX) m_profiler->endZone(m_cmd, m_zone);
+	}
+
+	GpuProfileZone(const GpuProfileZone&) = delete;
+	GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+	GpuProfiler* m_profiler;
+	VkCommandBuffer m_cmd;
+	uint32_t m_zone;
+};
+
+#if VIPER_PROFILER
+/// Time the commands recorded into `cmd` for the rest of the enclosing scope as `name`, with the GpuProfiler* `profiler`
+/// (which may be null).
+#define VIPER_PROFILE_GPU_ZONE(profiler, cmd, name) \
+	const GpuProfileZone VIPER_PROFILE_CONCAT(gpu_profile_zone_, __LINE__)(profiler, cmd, name)
+#else
+#define VIPER_PROFILE_GPU_ZONE(profiler, cmd, name) ((void) 0)
+#endif
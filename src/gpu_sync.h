@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+/// A wait on a timeline semaphore that a queue submission has to include: the work signalling `value` must be done
+/// before `stages` of the waiting submission run.
+struct TimelineWait {
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t value = 0; // 0 if there is nothing to wait for
+	VkPipelineStageFlags stages = 0;
+};
@@ -0,0 +1,287 @@
+#include "gui_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t PADDING = 1; // Between atlas images, so linear filtering does not bleed one into the next
+constexpr uint32_t WHITE_SIZE = 4;
+
+/// Decode the UTF-8 character at `i`, advancing past it. Malformed bytes decode as U+FFFD one at a time.
+uint32_t nextCodepoint(std::string_view text, size_t& i) {
+	const auto byte = [&](size_t at) { return static_cast<uint8_t>(text[at]); };
+	const uint8_t lead = byte(i++);
+	if (lead < 0x80) return lead;
+
+	size_t length;
+	uint32_t codepoint;
+	if ((lead & 0xe0) == 0xc0) {
+		length = 1;
+		codepoint = lead & 0x1f;
+	} else if ((lead & 0xf0) == 0xe0) {
+		length = 2;
+		codepoint = lead & 0x0f;
+	} else if ((lead & 0xf8) == 0xf0) {
+		length = 3;
+		codepoint = lead & 0x07;
+	} else {
+		return 0xfffd;
+	}
+
+	if (i + length > text.size()) return 0xfffd;
+	for (size_t k = 0; k < length; k++) {
+		if ((byte(i + k) & 0xc0) != 0x80) return 0xfffd;
+		codepoint = codepoint << 6 | (byte(i + k) & 0x3f);
+	}
+	i += length;
+	return codepoint;
+}
+
+} // namespace
+
+GuiAtlas::GuiAtlas(uint32_t size) : m_size(size), m_pixels(size_t(size) * size * 4, 0) {
+	if (size < WHITE_SIZE) throw std::runtime_error("GUI atlas is too small!");
+
+	// Solid shapes sample the middle of a white block, away from its filtered edges
+	const std::vector<uint8_t> white(WHITE_SIZE * WHITE_SIZE * 4, 255);
+	GuiRect uv;
+	add(WHITE_SIZE, WHITE_SIZE, white.data(), WHITE_SIZE * 4, uv);
+	m_whiteU = uv.x + uv.width / 2;
+	m_whiteV = uv.y + uv.height / 2;
+}
+
+bool GuiAtlas::allocate(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y, GuiRect& uv) {
+	if (width > m_size || height > m_size) return false;
+
+	if (m_cursorX + width > m_size) { // Close the shelf and open one below it
+		m_shelfY += m_shelfHeight + PADDING;
+		m_shelfHeight = 0;
+		m_cursorX = 0;
+	}
+	if (m_shelfY + height > m_size) return false;
+
+	x = m_cursorX;
+	y = m_shelfY;
+	m_cursorX += width + PADDING;
+	m_shelfHeight = std::max(m_shelfHeight, height);
+	m_version++;
+
+	const float scale = 1.0f / float(m_size);
+	uv = {float(x) * scale, float(y) * scale, float(width) * scale, float(height) * scale};
+	return true;
+}
+
+bool GuiAtlas::add(uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch, GuiRect& uv) {
+	uint32_t x, y;
+	if (!allocate(width, height, x, y, uv)) return false;
+	for (uint32_t row = 0; row < height; row++) {
+		std::memcpy(&m_pixels[(size_t(y + row) * m_size + x) * 4], pixels + row * rowPitch, size_t(width) * 4);
+	}
+	return true;
+}
+
+bool GuiAtlas::addMask(uint32_t width, uint32_t height, const uint8_t* mask, size_t rowPitch, GuiRect& uv) {
+	uint32_t x, y;
+	if (!allocate(width, height, x, y, uv)) return false;
+	for (uint32_t row = 0; row < height; row++) {
+		uint8_t* out = &m_pixels[(size_t(y + row) * m_size + x) * 4];
+		for (uint32_t column = 0; column < width; column++) {
+			out[4 * column] = 255;
+			out[4 * column + 1] = 255;
+			out[4 * column + 2] = 255;
+			out[4 * column + 3] = mask[row * rowPitch + column];
+		}
+	}
+	return true;
+}
+
+void GuiFont::add(uint32_t codepoint, const GuiGlyph& glyph) {
+	if (codepoint < m_ascii.size()) {
+		m_ascii[codepoint] = glyph;
+		m_hasAscii[codepoint] = true;
+	} else {
+		m_others[codepoint] = glyph;
+	}
+}
+
+const GuiGlyph* GuiFont::find(uint32_t codepoint) const {
+	if (codepoint < m_ascii.size()) return m_hasAscii[codepoint] ? &m_ascii[codepoint] : nullptr;
+	auto it = m_others.find(codepoint);
+	return it != m_others.end() ? &it->second : nullptr;
+}
+
+GuiBatch::GuiBatch(const GuiAtlas& atlas) : m_whiteU(atlas.whiteU()), m_whiteV(atlas.whiteV()) {
+	reset(0, 0);
+}
+
+void GuiBatch::reset(float width, float height) {
+	for (Bucket& b : m_buckets) b.vertices.clear();
+
+	// Keys rarely change from frame to frame, but drop the buckets if they pile up
+	if (m_buckets.size() > 256) {
+		m_buckets.clear();
+		m_bucketIndex.clear();
+	}
+	m_lastKey = UINT64_MAX;
+
+	m_layer = 0;
+	m_blend = GuiBlend::Alpha;
+	m_clips.assign(1, {0, 0, width, height});
+	m_quadCount = 0;
+}
+
+void GuiBatch::pushClip(const GuiRect& rect) {
+	const GuiRect& outer = m_clips.back();
+	const float x0 = std::max(rect.x, outer.x);
+	const float y0 = std::max(rect.y, outer.y);
+	const float x1 = std::min(rect.x + rect.width, outer.x + outer.width);
+	const float y1 = std::min(rect.y + rect.height, outer.y + outer.height);
+	m_clips.push_back({x0, y0, std::max(0.0f, x1 - x0), std::max(0.0f, y1 - y0)});
+}
+
+void GuiBatch::popClip() {
+	if (m_clips.size() > 1) m_clips.pop_back(); // The target's own rectangle stays
+}
+
+void GuiBatch::rect(const GuiRect& rect, uint32_t color) {
+	quad(ATLAS, rect, {m_whiteU, m_whiteV, 0, 0}, 0, color);
+}
+
+void GuiBatch::roundedRect(const GuiRect& rect, float radius, uint32_t color) {
+	radius = std::min(radius, std::min(rect.width, rect.height) / 2);
+	quad(ATLAS, rect, {m_whiteU, m_whiteV, 0, 0}, std::max(0.0f, radius), color);
+}
+
+void GuiBatch::image(const GuiRect& rect, uint32_t texture, const GuiRect& uv, uint32_t color) {
+	quad(texture, rect, uv, 0, color);
+}
+
+float GuiBatch::text(const GuiFont& font, float x, float baseline, std::string_view text, uint32_t color) {
+	for (size_t i = 0; i < text.size();) {
+		const GuiGlyph* glyph = font.find(nextCodepoint(text, i));
+		if (!glyph) continue;
+		if (glyph->width > 0) {
+			quad(font.texture, {x + glyph->offsetX, baseline + glyph->offsetY, glyph->width, glyph->height}, glyph->uv, 0, color);
+		}
+		x += glyph->advance;
+	}
+	return x;
+}
+
+GuiBatch::Bucket& GuiBatch::bucket(uint32_t texture) {
+	const uint64_t k = key(m_layer, m_blend, texture);
+	if (k == m_lastKey) return m_buckets[m_lastBucket];
+
+	auto it = m_bucketIndex.find(k);
+	if (it == m_bucketIndex.end()) {
+		it = m_bucketIndex.emplace(k, static_cast<uint32_t>(m_buckets.size())).first;
+		m_buckets.push_back({k, {}});
+	}
+	m_lastKey = k;
+	m_lastBucket = it->second;
+	return m_buckets[m_lastBucket];
+}
+
+void GuiBatch::quad(uint32_t texture, const GuiRect& rect, const GuiRect& uv, float radius, uint32_t color) {
+	const GuiRect& clip = m_clips.back();
+	const float x0 = std::max(rect.x, clip.x);
+	const float y0 = std::max(rect.y, clip.y);
+	const float x1 = std::min(rect.x + rect.width, clip.x + clip.width);
+	const float y1 = std::min(rect.y + rect.height, clip.y + clip.height);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	// Texture and local coordinates of the clipped corners, interpolated across the whole rectangle
+	const float half_width = rect.width / 2;
+	const float half_height = rect.height / 2;
+	const float centre_x = rect.x + half_width;
+	const float centre_y = rect.y + half_height;
+	const float u_scale = uv.width / rect.width;
+	const float v_scale = uv.height / rect.height;
+	const float u0 = uv.x + (x0 - rect.x) * u_scale;
+	const float u1 = uv.x + (x1 - rect.x) * u_scale;
+	const float v0 = uv.y + (y0 - rect.y) * v_scale;
+	const float v1 = uv.y + (y1 - rect.y) * v_scale;
+
+	std::vector<GuiVertex>& vertices = bucket(texture).vertices;
+	vertices.push_back({x0, y0, u0, v0, x0 - centre_x, y0 - centre_y, half_width, half_height, radius, color});
+	vertices.push_back({x1, y0, u1, v0, x1 - centre_x, y0 - centre_y, half_width, half_height, radius, color});
+	vertices.push_back({x1, y1, u1, v1, x1 - centre_x, y1 - centre_y, half_width, half_height, radius, color});
+	vertices.push_back({x0, y1, u0, v1, x0 - centre_x, y1 - centre_y, half_width, half_height, radius, color});
+	m_quadCount++;
+}
+
+void GuiBatch::sortBuckets() {
+	m_order.clear();
+	for (uint32_t i = 0; i < m_buckets.size(); i++) {
+		if (!m_buckets[i].vertices.empty()) m_order.push_back(i);
+	}
+	std::sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) { return m_buckets[a].key < m_buckets[b].key; });
+}
+
+void GuiBatch::hashTiles(uint32_t tileSize, uint32_t columns, uint32_t rows, std::vector<uint64_t>& hashes) {
+	hashes.assign(size_t(columns) * rows, 0);
+	const float scale = 1.0f / float(tileSize);
+
+	sortBuckets();
+	for (uint32_t index : m_order) {
+		const Bucket& b = m_buckets[index];
+		for (size_t q = 0; q < b.vertices.size(); q += 4) {
+			// Opposite corners hold everything that can differ between two quads
+			uint64_t words[2 * sizeof(GuiVertex) / sizeof(uint64_t)];
+			std::memcpy(words, &b.vertices[q], sizeof(GuiVertex));
+			std::memcpy(words + sizeof(GuiVertex) / sizeof(uint64_t), &b.vertices[q + 2], sizeof(GuiVertex));
+			uint64_t h = b.key;
+			for (uint64_t word : words) {
+				h = (h ^ word) * 0x9e3779b97f4a7c15ull;
+				h ^= h >> 29;
+			}
+
+			const GuiVertex& top_left = b.vertices[q];
+			const GuiVertex& bottom_right = b.vertices[q + 2];
+			const uint32_t column_end = std::min(columns, static_cast<uint32_t>(std::max(0.0f, std::ceil(bottom_right.x * scale))));
+			const uint32_t row_end = std::min(rows, static_cast<uint32_t>(std::max(0.0f, std::ceil(bottom_right.y * scale))));
+			for (uint32_t row = static_cast<uint32_t>(std::max(0.0f, top_left.y * scale)); row < row_end; row++) {
+				for (uint32_t column = static_cast<uint32_t>(std::max(0.0f, top_left.x * scale)); column < column_end; column++) {
+					uint64_t& tile = hashes[size_t(row) * columns + column];
+					tile = (tile ^ h) * 0x100000001b3ull;
+				}
+			}
+		}
+	}
+}
+
+const std::vector<GuiDraw>& GuiBatch::build(GuiVertex* out) {
+	sortBuckets();
+
+	m_draws.clear();
+	uint32_t first_vertex = 0;
+	for (uint32_t index : m_order) {
+		const Bucket& b = m_buckets[index];
+		std::memcpy(out + first_vertex, b.vertices.data(), b.vertices.size() * sizeof(GuiVertex));
+
+		const GuiBlend blend = static_cast<GuiBlend>((b.key >> 32) & 0xff);
+		const uint32_t texture = static_cast<uint32_t>(b.key);
+		uint32_t quads = static_cast<uint32_t>(b.vertices.size() / 4);
+		uint32_t vertex = first_vertex;
+
+		// The previous layer's draw continues if it has the same state; either way, no draw exceeds the index range
+		if (!m_draws.empty() && m_draws.back().blend == blend && m_draws.back().texture == texture) {
+			GuiDraw& last = m_draws.back();
+			const uint32_t merged = std::min(quads, MAX_QUADS_PER_DRAW - last.quadCount);
+			last.quadCount += merged;
+			quads -= merged;
+			vertex += 4 * merged;
+		}
+		while (quads > 0) {
+			const uint32_t count = std::min(quads, MAX_QUADS_PER_DRAW);
+			m_draws.push_back({blend, texture, vertex, count});
+			vertex += 4 * count;
+			quads -= count;
+		}
+		first_vertex += static_cast<uint32_t>(b.vertices.size());
+	}
+	return m_draws;
+}
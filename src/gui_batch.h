@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// An axis-aligned rectangle in pixels, with the origin at the top left. Also used for texture coordinates.
+struct GuiRect {
+	float x = 0;
+	float y = 0;
+	float width = 0;
+	float height = 0;
+};
+
+/// Pack a color as the GUI's vertices carry it: 8 bits per channel, red in the lowest byte (VK_FORMAT_R8G8B8A8_UNORM).
+constexpr uint32_t guiColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+	return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 | uint32_t(a) << 24;
+}
+
+/// One corner of a quad. Every shape is a textured quad; rounded corners are cut out in the fragment shader from
+/// the distance to the shape's edge, which the last three fields describe.
+struct GuiVertex {
+	float x, y;                  // Pixels
+	float u, v;                  // Texture coordinates
+	float localX, localY;        // Pixels from the centre of the shape
+	float halfWidth, halfHeight; // Of the shape
+	float radius;                // Of the corners; 0 for square shapes and glyphs
+	uint32_t color;              // Multiplies the texture, see guiColor()
+};
+
+enum class GuiBlend : uint8_t {
+	Alpha,    // Straight alpha over what is below
+	Additive, // Adds light, e.g. for highlights
+};
+
+/// A run of quads drawn with the same state: one draw call.
+struct GuiDraw {
+	GuiBlend blend;
+	uint32_t texture;
+	uint32_t firstVertex;
+	uint32_t quadCount;
+};
+
+/// The GUI's shared RGBA8 texture: glyphs, icons and a white block that solid shapes sample, so all of them can be
+/// drawn with one texture bound. Images are packed into shelves, left to right, one pixel apart.
+class GuiAtlas {
+public:
+	explicit GuiAtlas(uint32_t size = 1024);
+
+	/// Copy a `width` × `height` RGBA8 image (rows `rowPitch` bytes apart) into the atlas and set `uv` to where
+	/// it went. Returns false if it does not fit.
+	bool add(uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch, GuiRect& uv);
+	/// Like add(), for an 8-bit coverage mask such as a glyph; it is stored as white with the mask as alpha.
+	bool addMask(uint32_t width, uint32_t height, const uint8_t* mask, size_t rowPitch, GuiRect& uv);
+
+	uint32_t size() const { return m_size; }
+	const uint8_t* pixels() const { return m_pixels.data(); }
+	/// Bumped by every change, so renderers know when to upload the atlas again.
+	uint64_t version() const { return m_version; }
+
+	/// Texture coordinates of a white texel.
+	float whiteU() const { return m_whiteU; }
+	float whiteV() const { return m_whiteV; }
+
+private:
+	uint32_t m_size;
+	std::vector<uint8_t> m_pixels;
+	uint64_t m_version = 1;
+	float m_whiteU;
+	float m_whiteV;
+
+	// The open shelf: images go right of m_cursorX, and the shelf is as tall as its tallest image
+	uint32_t m_shelfY = 0;
+	uint32_t m_shelfHeight = 0;
+	uint32_t m_cursorX = 0;
+
+	/// Find room for a `width` × `height` image, returning its top left corner.
+	bool allocate(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y, GuiRect& uv);
+};
+
+/// Where a glyph's bitmap is and how it sits on the baseline.
+struct GuiGlyph {
+	GuiRect uv;
+	float offsetX = 0; // From the pen position on the baseline to the bitmap's top left
+	float offsetY = 0;
+	float width = 0;   // Of the bitmap, in pixels
+	float height = 0;
+	float advance = 0; // Pen movement to the next glyph
+};
+
+/// A bitmap font whose glyphs have been packed into a texture, usually the GUI atlas. Rasterizing glyphs is up to
+/// whoever fills the font in.
+class GuiFont {
+public:
+	uint32_t texture = 0;
+	float lineHeight = 0;
+
+	void add(uint32_t codepoint, const GuiGlyph& glyph);
+	/// The glyph for `codepoint`, or null if the font does not have it.
+	const GuiGlyph* find(uint32_t codepoint) const;
+
+private:
+	std::vector<GuiGlyph> m_ascii = std::vector<GuiGlyph>(128); // Direct lookup for the common case
+	std::vector<bool> m_hasAscii = std::vector<bool>(128);
+	std::unordered_map<uint32_t, GuiGlyph> m_others;
+};
+
+/// Builds a frame of 2D GUI geometry immediate-mode style, for as few draw calls as possible.
+///
+/// Shapes are appended to one bucket per (layer, blend, texture), so building a frame never sorts individual
+/// quads. build() writes the buckets out in order of layer, then blend, then texture, and merges neighbouring
+/// buckets that differ only by layer. Within a layer, shapes of different states may therefore be drawn in any
+/// order relative to each other: put what has to cover something else on a higher layer. With everything in the
+/// atlas, a whole frame is typically one draw call per layer that uses another texture or blend mode.
+///
+/// Clipping happens here, on the CPU, by cutting quads down to the clip rectangle; shapes outside it cost
+/// nothing, and clipping never splits a draw. Buckets keep their memory from frame to frame.
+class GuiBatch {
+public:
+	static constexpr uint32_t ATLAS = 0; // Texture id of the GUI atlas
+	static constexpr uint32_t MAX_QUADS_PER_DRAW = 16384; // Vertex indices within a draw fit in 16 bits
+
+	explicit GuiBatch(const GuiAtlas& atlas);
+
+	/// Start a new frame for a `width` × `height` target, which is also the outermost clip rectangle.
+	void reset(float width, float height);
+
+	void setLayer(uint16_t layer) { m_layer = layer; }
+	void setBlend(GuiBlend blend) { m_blend = blend; }
+
+	/// Clip everything until the matching popClip() to `rect`, within the current clip rectangle.
+	void pushClip(const GuiRect& rect);
+	void popClip();
+
+	void rect(const GuiRect& rect, uint32_t color);
+	void roundedRect(const GuiRect& rect, float radius, uint32_t color);
+	/// Draw the part `uv` of `texture` into `rect`, multiplied by `color`.
+	void image(const GuiRect& rect, uint32_t texture, const GuiRect& uv, uint32_t color = guiColor(255, 255, 255));
+	/// Draw UTF-8 `text` with its baseline starting at (`x`, `baseline`). Returns the pen's x position after it.
+	/// Characters the font lacks are skipped.
+	float text(const GuiFont& font, float x, float baseline, std::string_view text, uint32_t color);
+
+	size_t quadCount() const { return m_quadCount; }
+	size_t vertexCount() const { return 4 * m_quadCount; }
+
+	/// Hash what the frame draws in each `tileSize` pixel square of a `columns` × `rows` grid into `hashes`, for
+	/// finding what changed since the previous frame (see DamageTracker). A tile's hash covers every quad that
+	/// touches it, in drawing order.
+	void hashTiles(uint32_t tileSize, uint32_t columns, uint32_t rows, std::vector<uint64_t>& hashes);
+
+	/// Write the frame's vertices to `out` (room for vertexCount() of them), bucket by bucket, and return the
+	/// draws covering them in order. Quads are drawn as two triangles each, from the indices 0 1 2 2 3 0.
+	const std::vector<GuiDraw>& build(GuiVertex* out);
+
+private:
+	struct Bucket {
+		uint64_t key;
+		std::vector<GuiVertex> vertices;
+	};
+
+	float m_whiteU;
+	float m_whiteV;
+	uint16_t m_layer = 0;
+	GuiBlend m_blend = GuiBlend::Alpha;
+	std::vector<GuiRect> m_clips; // The current clip rectangle is the last one
+	size_t m_quadCount = 0;
+
+	std::vector<Bucket> m_buckets;
+	std::unordered_map<uint64_t, uint32_t> m_bucketIndex; // By key
+	uint64_t m_lastKey = UINT64_MAX; // Most shapes go to the same bucket as the one before
+	uint32_t m_lastBucket = 0;
+
+	std::vector<uint32_t> m_order; // Scratch for build()
+	std::vector<GuiDraw> m_draws;
+
+	static uint64_t key(uint16_t layer, GuiBlend blend, uint32_t texture) {
+		return uint64_t(layer) << 40 | uint64_t(blend) << 32 | texture;
+	}
+
+	/// Fill m_order with the non-empty buckets, by key.
+	void sortBuckets();
+	Bucket& bucket(uint32_t texture);
+	/// Clip `rect` to the current clip rectangle and append it, cutting `uv` down along with it.
+	void quad(uint32_t texture, const GuiRect& rect, const GuiRect& uv, float radius, uint32_t color);
+};
@@ -0,0 +1,279 @@
+#include "gui_renderer.h"
+#include "upload_queue.h"
+#include "vulkan_driver.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t SETS_PER_POOL = 64;
+constexpr size_t MIN_VERTEX_CAPACITY = 4 * 4096;
+
+} // namespace
+
+GuiRenderer::GuiRenderer(VkDevice device, GpuMemory& memory, UploadQueue& uploads, PipelineRegistry& pipelines,
+                         VkRenderPass renderPass, uint32_t framesInFlight, const Shaders& shaders, uint32_t atlasSize)
+	: m_device(device), m_memory(memory), m_uploads(uploads), m_atlas(atlasSize), m_frames(framesInFlight), m_textureSets(1) {
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_LINEAR;
+	sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.maxLod = 0.0f;
+
+	if (vkCreateSampler(m_device, &sampler_info, nullptr, &m_sampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI sampler!");
+	}
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo set_layout_info{};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = 1;
+	set_layout_info.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(m_device, &set_layout_info, nullptr, &m_setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI descriptor set layout!");
+	}
+
+	VkPushConstantRange push_constants{};
+	push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_constants.offset = 0;
+	push_constants.size = 2 * sizeof(float);
+
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &m_setLayout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_constants;
+
+	if (vkCreatePipelineLayout(m_device, &layout_info, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI pipeline layout!");
+	}
+
+	// The two pipelines differ only in their blending, and compile in parallel
+	GraphicsPipelineDesc desc;
+	desc.vertexShader = shaders.vertex;
+	desc.fragmentShader = shaders.fragment;
+	desc.layout = m_pipelineLayout;
+	desc.renderPass = renderPass;
+	desc.cullMode = VK_CULL_MODE_NONE;
+	desc.vertexBindings = {{0, sizeof(GuiVertex), VK_VERTEX_INPUT_RATE_VERTEX}};
+	desc.vertexAttributes = {
+		{0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GuiVertex, x)},
+		{1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GuiVertex, u)},
+		{2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GuiVertex, localX)},
+		{3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GuiVertex, halfWidth)},
+		{4, 0, VK_FORMAT_R32_SFLOAT, offsetof(GuiVertex, radius)},
+		{5, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(GuiVertex, color)},
+	};
+	const PipelineRegistry::Key alpha = pipelines.request(desc);
+	desc.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	const PipelineRegistry::Key additive = pipelines.request(desc);
+	m_pipelines[size_t(GuiBlend::Alpha)] = pipelines.get(alpha);
+	m_pipelines[size_t(GuiBlend::Additive)] = pipelines.get(additive);
+
+	// Every quad is drawn from the same six indices, offset by the draw's first vertex
+	const VkDeviceSize index_count = VkDeviceSize(6) * GuiBatch::MAX_QUADS_PER_DRAW;
+	createBuffer(index_count * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer, m_indexMemory);
+	auto* indices = static_cast<uint16_t*>(m_indexMemory.mapped);
+	for (uint32_t quad = 0; quad < GuiBatch::MAX_QUADS_PER_DRAW; quad++) {
+		const uint16_t first = static_cast<uint16_t>(4 * quad);
+		const uint16_t pattern[6] = {0, 1, 2, 2, 3, 0};
+		for (int i = 0; i < 6; i++) indices[6 * quad + i] = static_cast<uint16_t>(first + pattern[i]);
+	}
+
+	for (FrameSlot& frame : m_frames) {
+		createAtlasImage(frame);
+		frame.atlasSet = allocateSet(frame.atlasView);
+	}
+}
+
+GuiRenderer::~GuiRenderer() {
+	for (FrameSlot& frame : m_frames) {
+		if (frame.vertexBuffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(m_device, frame.vertexBuffer, nullptr);
+			m_memory.free(frame.vertexMemory);
+		}
+		vkDestroyImageView(m_device, frame.atlasView, nullptr);
+		vkDestroyImage(m_device, frame.atlasImage, nullptr);
+		m_memory.free(frame.atlasMemory);
+	}
+	vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
+	m_memory.free(m_indexMemory);
+	for (VkDescriptorPool pool : m_descriptorPools) vkDestroyDescriptorPool(m_device, pool, nullptr); // Frees the sets
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr); // The pipelines belong to the registry
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+	vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+void GuiRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, GpuAllocation& memory) {
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI buffer!");
+	}
+
+	VkMemoryRequirements mem_requirements;
+	vkGetBufferMemoryRequirements(m_device, buffer, &mem_requirements);
+	memory = m_memory.allocate(mem_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                           ResourceLayout::Linear);
+	vkBindBufferMemory(m_device, buffer, memory.memory, memory.offset);
+}
+
+void GuiRenderer::createAtlasImage(FrameSlot& frame) {
+	VkImageCreateInfo image_info{};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+	image_info.extent = {m_atlas.size(), m_atlas.size(), 1};
+	image_info.mipLevels = 1;
+	image_info.arrayLayers = 1;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_device, &image_info, nullptr, &frame.atlasImage) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI atlas image!");
+	}
+
+	VkMemoryRequirements mem_requirements;
+	vkGetImageMemoryRequirements(m_device, frame.atlasImage, &mem_requirements);
+	frame.atlasMemory = m_memory.allocate(mem_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceLayout::Optimal);
+	vkBindImageMemory(m_device, frame.atlasImage, frame.atlasMemory.memory, frame.atlasMemory.offset);
+
+	VkImageViewCreateInfo view_info{};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = frame.atlasImage;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+	view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+	if (vkCreateImageView(m_device, &view_info, nullptr, &frame.atlasView) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create GUI atlas image view!");
+	}
+}
+
+VkDescriptorSet GuiRenderer::allocateSet(VkImageView view) {
+	if (m_descriptorPools.empty() || m_setsInPool == SETS_PER_POOL) {
+		VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SETS_PER_POOL};
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = SETS_PER_POOL;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create GUI descriptor pool!");
+		}
+		m_descriptorPools.push_back(pool);
+		m_setsInPool = 0;
+	}
+
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = m_descriptorPools.back();
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &m_setLayout;
+
+	VkDescriptorSet set;
+	if (vkAllocateDescriptorSets(m_device, &alloc_info, &set) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate GUI descriptor set!");
+	}
+	m_setsInPool++;
+
+	VkDescriptorImageInfo image_info{};
+	image_info.sampler = m_sampler;
+	image_info.imageView = view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = set;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &image_info;
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	return set;
+}
+
+uint32_t GuiRenderer::addTexture(VkImageView view) {
+	m_textureSets.push_back(allocateSet(view));
+	return static_cast<uint32_t>(m_textureSets.size() - 1);
+}
+
+void GuiRenderer::beginFrame(uint32_t slot) {
+	m_currentSlot = slot;
+	FrameSlot& frame = m_frames[slot];
+	if (frame.atlasVersion == m_atlas.version()) return;
+
+	UploadQueue::ImageUpload upload{};
+	upload.image = frame.atlasImage;
+	upload.extent = {m_atlas.size(), m_atlas.size()};
+	upload.bytesPerPixel = 4;
+	upload.pixels = m_atlas.pixels();
+	upload.rowPitch = size_t(m_atlas.size()) * 4;
+	m_uploads.upload(upload); // The frame's submission waits for it through the upload queue's acquires
+	frame.atlasVersion = m_atlas.version();
+}
+
+void GuiRenderer::record(VkCommandBuffer cmd, GuiBatch& batch, VkExtent2D extent, const std::vector<DriverRect>& scissors) {
+	FrameSlot& frame = m_frames[m_currentSlot];
+	const size_t vertex_count = batch.vertexCount();
+	m_lastQuadCount = batch.quadCount();
+	m_lastDrawCount = 0;
+	if (vertex_count == 0) return;
+
+	// The GPU is done with this slot's previous frame, so its buffer can be replaced right away
+	if (vertex_count > frame.vertexCapacity) {
+		if (frame.vertexBuffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(m_device, frame.vertexBuffer, nullptr);
+			m_memory.free(frame.vertexMemory);
+		}
+		frame.vertexCapacity = std::max({vertex_count, 2 * frame.vertexCapacity, MIN_VERTEX_CAPACITY});
+		createBuffer(frame.vertexCapacity * sizeof(GuiVertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, frame.vertexBuffer, frame.vertexMemory);
+	}
+
+	const std::vector<GuiDraw>& draws = batch.build(static_cast<GuiVertex*>(frame.vertexMemory.mapped));
+
+	VkViewport viewport{};
+	viewport.width = (float) extent.width;
+	viewport.height = (float) extent.height;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	const float scale[2] = {2.0f / float(extent.width), 2.0f / float(extent.height)};
+	vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(scale), scale);
+
+	const VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &frame.vertexBuffer, &offset);
+	vkCmdBindIndexBuffer(cmd, m_indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+	VulkanGuiBindings bindings;
+	bindings.layout = m_pipelineLayout;
+	bindings.pipelines = m_pipelines.data();
+	bindings.textureSets = m_textureSets.data();
+	bindings.atlasSet = frame.atlasSet;
+	VulkanCommands commands(cmd, &bindings);
+	drawGui(commands, draws, scissors);
+	m_lastDrawCount = static_cast<uint32_t>(draws.size() * scissors.size());
+}
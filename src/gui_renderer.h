@@ -0,0 +1,98 @@
+#pragma once
+
+#include "driver.h"
+#include "gpu_memory.h"
+#include "gui_batch.h"
+#include "pipeline_registry.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class UploadQueue;
+
+/// Draws GuiBatch frames with Vulkan.
+///
+/// Each frame slot has a persistently mapped, host-visible vertex buffer that the batch is built straight into;
+/// it only grows, when a frame needs more room than any before. Quads share one static index buffer. A draw is
+/// one vkCmdDrawIndexed, issued through the Vulkan driver's command list by drawGui(), which only binds pipelines
+/// and textures when they change from the draw before.
+///
+/// The GUI atlas lives in one image per frame slot, so a changed atlas can be uploaded into a slot's copy as soon
+/// as the slot comes around again, without waiting for frames that still sample the other copies.
+class GuiRenderer {
+public:
+	struct Shaders {
+		ShaderCode vertex;
+		ShaderCode fragment;
+	};
+
+	/// Pipelines are compiled by `pipelines` for subpass 0 of `renderPass`.
+	GuiRenderer(VkDevice device, GpuMemory& memory, UploadQueue& uploads, PipelineRegistry& pipelines, VkRenderPass renderPass,
+	            uint32_t framesInFlight, const Shaders& shaders, uint32_t atlasSize = 1024);
+	~GuiRenderer();
+
+	GuiRenderer(const GuiRenderer&) = delete;
+	GuiRenderer& operator=(const GuiRenderer&) = delete;
+
+	/// Glyphs and icons go here; changes are uploaded by beginFrame().
+	GuiAtlas& atlas() { return m_atlas; }
+
+	/// Make `view` (an RGBA image in SHADER_READ_ONLY_OPTIMAL, such as a thumbnail atlas) drawable with
+	/// GuiBatch::image(), returning its texture id. The view must outlive the renderer.
+	uint32_t addTexture(VkImageView view);
+
+	/// Start recording the frame in `slot`, whose previous frame the GPU must be done with. Uploads the atlas if it
+	/// changed, so call this before the upload queue's acquires are recorded.
+	void beginFrame(uint32_t slot);
+
+	/// Build `batch` into the frame's vertex buffer and draw it over the `extent` sized target, once within each of
+	/// `scissors` (the parts of the target being redrawn). Called once per frame, inside the render pass; fits in a
+	/// LayerRecorder.
+	void record(VkCommandBuffer cmd, GuiBatch& batch, VkExtent2D extent, const std::vector<DriverRect>& scissors);
+
+	/// Draw calls (counting every scissor rectangle) and quads of the last recorded frame.
+	uint32_t lastDrawCount() const { return m_lastDrawCount; }
+	size_t lastQuadCount() const { return m_lastQuadCount; }
+
+private:
+	struct FrameSlot {
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		GpuAllocation vertexMemory; // Persistently mapped
+		size_t vertexCapacity = 0;
+
+		VkImage atlasImage = VK_NULL_HANDLE;
+		GpuAllocation atlasMemory;
+		VkImageView atlasView = VK_NULL_HANDLE;
+		VkDescriptorSet atlasSet = VK_NULL_HANDLE;
+		uint64_t atlasVersion = 0; // Of the atlas contents in the image; 0 before the first upload
+	};
+
+	VkDevice m_device;
+	GpuMemory& m_memory;
+	UploadQueue& m_uploads;
+	GuiAtlas m_atlas;
+
+	VkSampler m_sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, 2> m_pipelines{}; // By GuiBlend
+	std::vector<VkDescriptorPool> m_descriptorPools; // Grows when textures need more sets than one pool holds
+	uint32_t m_setsInPool = 0; // Allocated from the last pool
+
+	VkBuffer m_indexBuffer = VK_NULL_HANDLE;
+	GpuAllocation m_indexMemory;
+
+	std::vector<FrameSlot> m_frames;
+	uint32_t m_currentSlot = 0;
+	std::vector<VkDescriptorSet> m_textureSets; // By texture id; entry 0 is the atlas, which is per slot
+
+	uint32_t m_lastDrawCount = 0;
+	size_t m_lastQuadCount = 0;
+
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, GpuAllocation& memory);
+	void createAtlasImage(FrameSlot& frame);
+	VkDescriptorSet allocateSet(VkImageView view);
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+
+/// 64-bit FNV-1a. Cheap and good enough for short keys and for combining a handful of values; `seed` lets
+/// several pieces of data be hashed as one.
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = FNV1A_OFFSET_BASIS) {
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+inline uint64_t fnv1a64(std::string_view text, uint64_t seed = FNV1A_OFFSET_BASIS) {
+	return fnv1a64(text.data(), text.size(), seed);
+}
@@ -1,640 +1,1211 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "compute_effects.h"
+#include "damage_tracker.h"
+#include "frame_stats.h"
+#include "gpu_memory.h"
+#include "gpu_profiler.h"
+#include "gui_renderer.h"
+#include "parallel_recorder.h"
+#include "paths.h"
+#include "pipeline_cache.h"
+#include "pipeline_registry.h"
+#include "present_scheduler.h"
+#include "profiler.h"
+#include "shaders.h"
+#include "thread_pool.h"
+#include "software_driver.h"
+#include "upload_queue.h"
+#include "vulkan_driver.h"
+
 #include <iostream>
 #include <vector>
-#include <set>
 #include <algorithm>
-#include <optional>
 #include <stdexcept>
 #include <fstream>
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-const std::vector<const char*> validationLayers = {
-	"VK_LAYER_KHRONOS_validation"
-};
+// How many frames the CPU may record ahead of the GPU. Each has its own command pool and sync objects.
+const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
 
-const std::vector<const char*> requiredDeviceExtensions = {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
+// Number of offscreen render targets used in headless mode; one per frame in flight.
+const uint32_t OFFSCREEN_IMAGE_COUNT = MAX_FRAMES_IN_FLIGHT;
+
+// How long the window sleeps between checks for background changes (such as finished proxies) while nothing animates.
+const double IDLE_WAKEUP_SECONDS = 0.25;
+
+const VkClearColorValue BACKGROUND_COLOR = {{0.1f, 0.1f, 0.1f, 1.0f}};
+
+/// Lay out a frame's GUI. Until gui.h has components, a status bar along the bottom stands in for them.
+void buildGui(GuiBatch& batch, float width, float height) {
+	const float bar_height = 28.0f;
+
+	batch.reset(width, height);
+	batch.rect({0, height - bar_height, width, bar_height}, guiColor(32, 32, 36));
+	batch.setLayer(1);
+	batch.roundedRect({8, height - bar_height + 6, 160, bar_height - 12}, 8, guiColor(70, 70, 80));
+}
+
+/// Write tightly packed RGBA `pixels` to the binary PPM file `path`, dropping the alpha channel.
+void writePpm(const std::string& path, const uint8_t* pixels, uint32_t width, uint32_t height) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open output file!");
+	}
+
+	file << "P6\n" << width << ' ' << height << "\n255\n";
+	const size_t pixel_count = (size_t) width * height;
+	for (size_t i = 0; i < pixel_count; i++) {
+		file.write(reinterpret_cast<const char*>(pixels + i * 4), 3);
+	}
+}
 
-#ifdef NDEBUG
-const bool enableValidationLayers = false;
-#else
-const bool enableValidationLayers = true;
-#endif
 
 class TriangleApplication {
 public:
+	/// When `headless` is true no window, surface or swap chain is created; frames are rendered into
+	/// offscreen images and read back to `<outputPrefix>NNNN.ppm` files instead.
+	explicit TriangleApplication(bool headless = false, uint32_t frameCount = 1, std::string outputPrefix = "frame_")
+		: m_headless(headless), m_frameCount(frameCount), m_outputPrefix(std::move(outputPrefix)) {}
+
 	void run() {
-		initWindow();
+		if (!m_headless) initWindow();
 		initVulkan();
-		mainLoop();
+		if (m_headless) {
+			renderOffscreen();
+		} else {
+			mainLoop();
+		}
 		cleanup();
-		createGraphicsPipeline();
+	}
+
+	/// Start playing as soon as the window is up, at `frameRateNumerator` / `frameRateDenominator` frames per second.
+	void playOnStart(uint32_t frameRateNumerator, uint32_t frameRateDenominator) {
+		m_scheduler.setFrameRate(frameRateNumerator, frameRateDenominator);
+		m_playOnStart = true;
 	}
 
 private:
-	GLFWwindow* m_window;
-	VkInstance m_instance;
-	VkSurfaceKHR m_surface;
-	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
-	VkDevice m_device;
-	VkQueue m_graphicsQueue;
-	VkQueue m_presentQueue;
+	bool m_headless;
+	uint32_t m_frameCount;
+	std::string m_outputPrefix;
+
+	StartupReport m_startup; // Printed once the first frame is out
+	bool m_firstFrameOut = false;
 
-	// Swap chain
-	VkSwapchainKHR m_swapChain;
+	GLFWwindow* m_window = nullptr;
+	std::unique_ptr<VulkanDriver> m_driver; // Instance, device, queues and swap chain
+	VkDevice m_device; // The driver's, which nearly everything uses
+	VkQueue m_graphicsQueue;
+	std::mutex m_graphicsQueueMutex; // Held around graphics submissions while uploads or compute may share the queue
+	std::mutex m_transferQueueMutex; // Held around submissions to the transfer queue when m_transferQueueShared
+	std::unique_ptr<UploadQueue> m_uploadQueue;
+	std::unique_ptr<ComputeEffects> m_effects;
+	std::unique_ptr<GuiRenderer> m_gui;
+	std::unique_ptr<GuiBatch> m_guiBatch; // Rebuilt every frame
+
+	// Device memory for images and buffers, sub-allocated from large blocks
+	std::unique_ptr<VulkanMemorySource> m_memorySource;
+	std::unique_ptr<GpuMemory> m_gpuMemory;
+
+	// Swap chain images (owned by the driver)
 	std::vector<VkImage> m_swapChainImages;
 	std::vector<VkImageView> m_swapChainImageViews;
 	VkFormat m_swapChainImageFormat;
 	VkExtent2D m_swapChainExtent;
 
+	// Offscreen render targets (headless mode). The images are exposed through `m_swapChainImages` so the
+	// rest of the renderer does not need to know whether it draws to a window or not.
+	std::vector<GpuAllocation> m_offscreenImageMemory;
+
 	// Render pipeline
+	VkRenderPass m_renderPass; // Clears the image, for frames that redraw all of it
+	VkRenderPass m_renderPassLoad = VK_NULL_HANDLE; // Keeps the image's contents, for partial redraws (not headless)
 	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_graphicsPipeline;
+	std::unique_ptr<ThreadPool> m_threadPool;
+	std::unique_ptr<PipelineCache> m_pipelineCache;
+	std::unique_ptr<PipelineRegistry> m_pipelineRegistry;
+	std::vector<VkFramebuffer> m_swapChainFramebuffers;
+
+	/// A swap chain replaced on resize, with what was made for its images. They may still be presenting, so they
+	/// are destroyed only once the frames drawn into them, and one after, have finished; see recreateSwapChain().
+	struct RetiredSwapChain {
+		VkSwapchainKHR swapChain;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkFramebuffer> framebuffers;
+		uint64_t frame; // m_frameNumber when it was replaced
+	};
+
+	std::vector<RetiredSwapChain> m_retiredSwapChains;
+	bool m_swapChainStale = false; // Resized, out of date or of the wrong latency, so replaced before the next frame
+	PresentLatency m_swapChainLatency = PresentLatency::Low; // What the swap chain was made for
+	bool m_minimized = false; // Nothing to draw into until the window is restored
+
+	/// Everything one frame in flight needs, so recording frame N + 1 never touches what the GPU uses for frame N.
+	struct FrameResources {
+		VkCommandPool commandPool; // Reset as a whole each time the frame slot comes around
+		VkCommandBuffer commandBuffer;
+		VkSemaphore imageAvailable; // Signalled when the acquired swap chain image may be drawn to
+		VkSemaphore renderFinished; // Signalled when drawing is done and the image may be presented
+		VkFence inFlight; // Signalled when the GPU has finished the frame's commands
+
+		// Headless mode only: where the rendered image is copied, and which frame number it holds (-1 for none)
+		VkBuffer readbackBuffer = VK_NULL_HANDLE;
+		GpuAllocation readbackMemory; // Persistently mapped
+		int64_t pendingOutput = -1;
+	};
+
+	std::vector<FrameResources> m_frames;
+	uint32_t m_currentFrame = 0;
+	uint64_t m_frameNumber = 0; // Frames submitted
+	std::unique_ptr<ParallelRecorder> m_recorder; // Per-thread, per-frame pools for secondary command buffers
+	std::unique_ptr<GpuProfiler> m_gpuProfiler; // Null unless the profiler is recording
+	std::vector<LayerRecorder> m_layers; // Recorded each frame in this order, i.e. back to front
+	std::vector<VkFence> m_imagesInFlight; // Fence of the frame currently using each swap chain image, if any
+
+	// What changed since each swap chain image was last drawn. Frames redraw only the damaged rectangles, which every
+	// layer draws with one scissored pass per rectangle, and nothing is drawn while nothing changes.
+	DamageTracker m_damage;
+	std::vector<uint64_t> m_guiTiles;
+	std::vector<DriverRect> m_frameScissors; // The current frame's rectangles
+	bool m_framePartial = false; // Whether the frame keeps the image's previous contents outside them
+	bool m_drewLast = false; // The last turn of the main loop drew a frame
+
+	// When frames are drawn and how they are presented: at the timeline's frame rate while playing, as soon as
+	// possible otherwise. The arrow keys scrub the playhead and space plays.
+	PresentScheduler m_scheduler;
+	bool m_playOnStart = false;
+
+	// Frame timing: the interval between frames, time spent recording and submitting, and time blocked on the
+	// GPU. With the CPU and GPU overlapped, fence waits stay near zero unless the GPU is the bottleneck.
+	FrameTimeHistogram m_frameTimes;
+	FrameTimeHistogram m_cpuTimes;
+	FrameTimeHistogram m_fenceWaitTimes;
+	std::chrono::steady_clock::time_point m_lastFrameStart;
 
 	void initWindow() {
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // Tell GLFW not to load OpenGL (as it does by default)
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // Prevent resizing windows, as it requires special care
 
 		m_window = glfwCreateWindow(WIDTH, HEIGHT, "Triangle", nullptr, nullptr);
+		m_startup.mark("window");
 	}
 
-	void initVulkan() {
-		createInstance();
-		createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-		createSwapChain();
-		createImageViews();
+	/// Initialize the driver on another thread, as loading the Vulkan driver and creating the instance and device is
+	/// most of the time to start. Meanwhile the window is up and kept responsive, and the worker threads start.
+	void initDriver() {
+		VIPER_PROFILE_ZONE("initDriver");
+		// Headless renders pick a device by other rules, so they have their own cache
+		m_driver = std::make_unique<VulkanDriver>(m_window, joinPath(cacheDirectory(), m_headless ? "device_headless.bin" : "device.bin"));
+		const double driver_start = m_startup.elapsed();
+		std::future<void> driver_init = std::async(std::launch::async, [this] {
+			if (Profiler::enabled()) Profiler::setThreadName("driver init");
+			m_driver->init();
+		});
+
+		m_threadPool = std::make_unique<ThreadPool>();
+		m_startup.mark("thread pool");
+
+		while (driver_init.wait_for(std::chrono::milliseconds(2)) != std::future_status::ready) {
+			if (!m_headless) glfwPollEvents();
+		}
+		driver_init.get(); // Rethrows what init() threw
+		m_startup.mark("wait for driver");
+
+		const VulkanInitTimes& times = m_driver->initTimes();
+		double step_start = driver_start;
+		const std::pair<const char*, double> steps[] = {
+			{"driver: instance", times.instance},
+			{"driver: surface", times.surface},
+			{times.cachedDevice ? "driver: cached device" : "driver: pick device", times.physicalDevice},
+			{"driver: logical device", times.device},
+		};
+		for (const auto& [name, milliseconds] : steps) {
+			m_startup.add(name, step_start, milliseconds);
+			step_start += milliseconds;
+		}
 	}
 
-	/// Create the Vulkan instance.
-	void createInstance() {
-		if (enableValidationLayers && !checkValidationLayerSupport()) {
-			throw std::runtime_error("validation layers requested, but not available!");
+	void initVulkan() {
+		VIPER_PROFILE_ZONE("initVulkan");
+		initDriver();
+		m_device = m_driver->device();
+		m_graphicsQueue = m_driver->graphicsQueue();
+		if (Profiler::enabled()) {
+			m_gpuProfiler = std::make_unique<GpuProfiler>(m_device, m_driver->physicalDevice(), m_driver->queueFamilies().graphicsFamily.value(),
+			                                              m_graphicsQueue, MAX_FRAMES_IN_FLIGHT);
 		}
-
-		VkApplicationInfo app_info{};
-		app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-		app_info.pApplicationName = "Triangle";
-		app_info.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
-		app_info.pEngineName = "No Engine";
-		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.apiVersion = VK_API_VERSION_1_0;
-
-		VkInstanceCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-		createInfo.pApplicationInfo = &app_info;
-
-		uint32_t glfw_extension_count = 0;
-		const char** glfw_extensions;
-
-		glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-
-		createInfo.enabledExtensionCount = glfw_extension_count;
-		createInfo.ppEnabledExtensionNames = glfw_extensions;
-
-		if (enableValidationLayers) { // Basically a runtime safety feature ...
-			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-			createInfo.ppEnabledLayerNames = validationLayers.data();
+		createGpuMemory();
+		createUploadQueue();
+		if (m_headless) {
+			createOffscreenTargets();
 		} else {
-			createInfo.enabledLayerCount = 0;
+			createSwapChain(framebufferSize());
 		}
+		createImageViews();
+		m_renderPass = createRenderPass(false);
+		if (!m_headless) m_renderPassLoad = createRenderPass(true);
+		createPipelineRegistry();
+		createGraphicsPipeline();
+		createComputeEffects();
+		createGui();
+		createFramebuffers();
+		createFrameResources();
+		m_startup.mark("renderer");
+	}
 
-		uint32_t extension_count = 0;
-		vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
-		std::vector<VkExtensionProperties> extensions(extension_count);
-		vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data()); // Retrieve a list of supported extensions
+	/// Note the first frame in the startup report, and print it.
+	void firstFrameOut() {
+		if (m_firstFrameOut) return;
+		m_firstFrameOut = true;
+		m_startup.mark("first frame");
+		m_startup.print(std::cout);
+	}
 
-		std::cout << "available extensions:\n";
-		for (const auto& extension : extensions) {
-			std::cout << '\t' << extension.extensionName << '\n';
-		}
+	/// Create the device memory arena everything else allocates from.
+	void createGpuMemory() {
+		VIPER_PROFILE_ZONE("createGpuMemory");
+		VkPhysicalDeviceMemoryProperties mem_properties;
+		vkGetPhysicalDeviceMemoryProperties(m_driver->physicalDevice(), &mem_properties);
+		m_memorySource = std::make_unique<VulkanMemorySource>(m_device);
+		m_gpuMemory = std::make_unique<GpuMemory>(mem_properties, *m_memorySource);
+	}
 
-		if (vkCreateInstance(&createInfo, nullptr, &m_instance) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create Vulkan m_instance!");
+	/// Create the upload queue for streaming frames to the GPU, on the transfer family if there is one and on the
+	/// graphics queue otherwise.
+	void createUploadQueue() {
+		VIPER_PROFILE_ZONE("createUploadQueue");
+		const VulkanQueueFamilies& indices = m_driver->queueFamilies();
+		const uint32_t graphics_family = indices.graphicsFamily.value();
+
+		if (indices.transferFamily.has_value()) {
+			m_uploadQueue = std::make_unique<UploadQueue>(m_device, m_driver->physicalDevice(), *m_gpuMemory, indices.transferFamily.value(),
+			                                              m_driver->transferQueue(), graphics_family,
+			                                              m_driver->transferQueueShared() ? &m_transferQueueMutex : nullptr);
+		} else {
+			m_uploadQueue = std::make_unique<UploadQueue>(m_device, m_driver->physicalDevice(), *m_gpuMemory, graphics_family,
+			                                              m_graphicsQueue, graphics_family, &m_graphicsQueueMutex);
 		}
 	}
 
-	void createSurface() {
-		if (glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create window surface!");
-		}
+	VkExtent2D framebufferSize() const {
+		int width, height;
+		glfwGetFramebufferSize(m_window, &width, &height);
+		return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
 	}
 
-	bool checkValidationLayerSupport() {
-		uint32_t layer_count;
-		vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+	/// Create the driver's swap chain, `extent` in size if the surface leaves it to us, and draw into its images.
+	/// Returns the swap chain it replaced, if any (see VulkanDriver::createSwapChain()).
+	VkSwapchainKHR createSwapChain(VkExtent2D extent) {
+		m_swapChainLatency = m_scheduler.latency();
+		const VkSwapchainKHR old_swap_chain = m_driver->createSwapChain(extent, m_swapChainLatency);
+		m_swapChainImages = m_driver->swapChainImages();
+		m_swapChainImageFormat = m_driver->swapChainFormat();
+		m_swapChainExtent = m_driver->swapChainExtent();
+
+		// The images hold nothing yet
+		m_damage.reset(m_swapChainExtent.width, m_swapChainExtent.height, static_cast<uint32_t>(m_swapChainImages.size()));
+		return old_swap_chain;
+	}
 
-		std::vector<VkLayerProperties> available_layers(layer_count);
-		vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+	/// Replace the swap chain with one of the window's new size, without waiting for the GPU: the old one is handed
+	/// over to the new and retired with its image views and framebuffers, which frames in flight may still use.
+	/// Everything that does not depend on the size is kept; the format stays the same, so render passes and
+	/// pipelines (whose viewport and scissor are dynamic) work as they are. Returns false, leaving the swap chain
+	/// stale, while the window is minimized.
+	bool recreateSwapChain() {
+		VIPER_PROFILE_ZONE("recreateSwapChain");
+		const VkExtent2D extent = framebufferSize();
+		m_minimized = extent.width == 0 || extent.height == 0;
+		if (m_minimized) return false;
+
+		RetiredSwapChain retired{VK_NULL_HANDLE, std::move(m_swapChainImageViews), std::move(m_swapChainFramebuffers), m_frameNumber};
+		retired.swapChain = createSwapChain(extent);
+		m_retiredSwapChains.push_back(std::move(retired));
+		createImageViews();
+		createFramebuffers();
+		m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE); // The frame fences still guard the old ones
+		m_swapChainStale = false;
+		return true;
+	}
 
-		for (const char* layer_name : validationLayers) {
-			bool layer_found = false;
+	/// Destroy the retired swap chains no frame uses any more. Frames finish in order, and the current frame slot's
+	/// fence was just waited for, so every frame up to m_frameNumber - MAX_FRAMES_IN_FLIGHT has finished. A retired
+	/// swap chain is kept until one frame past its last has too, as presenting its last image follows that frame.
+	void destroyRetiredSwapChains(bool all = false) {
+		auto unused = [&](const RetiredSwapChain& retired) { return all || m_frameNumber >= retired.frame + MAX_FRAMES_IN_FLIGHT; };
+		for (RetiredSwapChain& retired : m_retiredSwapChains) {
+			if (!unused(retired)) continue;
+			for (auto framebuffer : retired.framebuffers) vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+			for (auto image_view : retired.imageViews) vkDestroyImageView(m_device, image_view, nullptr);
+			vkDestroySwapchainKHR(m_device, retired.swapChain, nullptr); // Destroys its images
+		}
+		m_retiredSwapChains.erase(std::remove_if(m_retiredSwapChains.begin(), m_retiredSwapChains.end(), unused), m_retiredSwapChains.end());
+	}
 
-			for (const auto& layerProperties : available_layers) {
-				if (strcmp(layer_name, layerProperties.layerName) == 0) {
-					layer_found = true;
-					break;
-				}
+	/// Create the offscreen images that stand in for swap chain images in headless mode.
+	void createOffscreenTargets() {
+		VIPER_PROFILE_ZONE("createOffscreenTargets");
+		m_swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM; // Tightly packed RGBA makes readback trivial
+		m_swapChainExtent = {WIDTH, HEIGHT};
+
+		m_swapChainImages.resize(OFFSCREEN_IMAGE_COUNT);
+		m_offscreenImageMemory.resize(OFFSCREEN_IMAGE_COUNT);
+
+		for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+			VkImageCreateInfo image_info{};
+			image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_info.imageType = VK_IMAGE_TYPE_2D;
+			image_info.format = m_swapChainImageFormat;
+			image_info.extent = {m_swapChainExtent.width, m_swapChainExtent.height, 1};
+			image_info.mipLevels = 1;
+			image_info.arrayLayers = 1;
+			image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			if (vkCreateImage(m_device, &image_info, nullptr, &m_swapChainImages[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create offscreen image!");
 			}
 
-			if (!layer_found) return false;
+			VkMemoryRequirements mem_requirements;
+			vkGetImageMemoryRequirements(m_device, m_swapChainImages[i], &mem_requirements);
+
+			m_offscreenImageMemory[i] = m_gpuMemory->allocate(mem_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceLayout::Optimal);
+			vkBindImageMemory(m_device, m_swapChainImages[i], m_offscreenImageMemory[i].memory, m_offscreenImageMemory[i].offset);
 		}
 
-		return true;
 	}
 
-	/// Select a GPU with Vulkan support to use for rendering.
-	void pickPhysicalDevice() {
-		uint32_t deviceCount = 0;
-		vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
+	/// Create a buffer and bind memory with the given properties from the GPU memory arena to it.
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& memory) {
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = size;
+		buffer_info.usage = usage;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		if (deviceCount == 0) {
-			throw std::runtime_error("failed to find GPUs with Vulkan support!");
+		if (vkCreateBuffer(m_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create buffer!");
 		}
 
-		std::vector<VkPhysicalDevice> devices(deviceCount);
-		vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
+		VkMemoryRequirements mem_requirements;
+		vkGetBufferMemoryRequirements(m_device, buffer, &mem_requirements);
 
-		for (const auto& dev : devices) {
-			if (isDeviceSuitable(dev)) {
-				m_physicalDevice = dev;
-				break;
+		memory = m_gpuMemory->allocate(mem_requirements, properties, ResourceLayout::Linear);
+		vkBindBufferMemory(m_device, buffer, memory.memory, memory.offset);
+	}
+
+	/// Render `m_frameCount` frames into the offscreen targets and write each one out as a binary PPM.
+	/// Frames are pipelined like on screen: while the GPU renders frame N, the CPU writes out frame N - 1.
+	void renderOffscreen() {
+		for (uint32_t frame = 0; frame < m_frameCount; frame++) {
+			VIPER_PROFILE_ZONE("renderOffscreen frame");
+			FrameResources& fr = m_frames[m_currentFrame];
+			auto frame_start = std::chrono::steady_clock::now();
+			waitForFrame(fr);
+			if (m_gpuProfiler) m_gpuProfiler->beginFrame(m_currentFrame);
+
+			if (fr.pendingOutput >= 0) { // This slot's previous frame is done; write it out before reusing the buffer
+				VIPER_PROFILE_ZONE("writeReadbackBuffer");
+				writeReadbackBuffer(fr, static_cast<uint32_t>(fr.pendingOutput));
 			}
-		}
 
-		if (m_physicalDevice == VK_NULL_HANDLE) {
-			throw std::runtime_error("failed to find a suitable GPU!");
-		}
-	}
+			vkResetFences(m_device, 1, &fr.inFlight);
+			vkResetCommandPool(m_device, fr.commandPool, 0);
+			m_recorder->beginFrame(m_currentFrame);
+			m_effects->beginFrame(m_currentFrame);
+			m_gui->beginFrame(m_currentFrame);
+			buildGui();
+			setFrameDamage({}); // Every offscreen frame is written out whole
+
+			// Offscreen images are paired with frame slots, so an image is never in use by another frame
+			const uint32_t image_index = m_currentFrame;
+			beginCommandBuffer(fr.commandBuffer);
+			TimelineWait uploads = recordFrame(fr.commandBuffer, image_index); // Leaves the image in TRANSFER_SRC_OPTIMAL
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = 0;
+			region.bufferRowLength = 0; // Tightly packed
+			region.bufferImageHeight = 0;
+			region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+			region.imageOffset = {0, 0, 0};
+			region.imageExtent = {m_swapChainExtent.width, m_swapChainExtent.height, 1};
+			vkCmdCopyImageToBuffer(fr.commandBuffer, m_swapChainImages[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, fr.readbackBuffer, 1, &region);
+
+			// Make the copy visible to the host, which reads the buffer once the frame's fence signals
+			VkBufferMemoryBarrier readback{};
+			readback.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			readback.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			readback.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			readback.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			readback.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			readback.buffer = fr.readbackBuffer;
+			readback.offset = 0;
+			readback.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(fr.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			                     0, nullptr, 1, &readback, 0, nullptr);
+
+			if (vkEndCommandBuffer(fr.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to record command buffer!");
+			}
 
-	/// Returns true if the given GPU has valid queue families and supports required device extensions and features for the swap chain.
-	bool isDeviceSuitable(VkPhysicalDevice dev) {
-		QueueFamilyIndices indices = findQueueFamilies(dev);
+			TimelineWait effects = m_effects->submit({uploads});
+			submitFrame(fr.commandBuffer, fr.inFlight, VK_NULL_HANDLE, VK_NULL_HANDLE, {uploads, effects});
+			fr.pendingOutput = frame;
+			firstFrameOut(); // Submitted, if it is the first
 
-		bool extensionsSupported = checkDeviceExtensionSupport(dev);
+			m_frameTimes.record(millisecondsSince(frame_start));
+			m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+			if (Profiler::enabled()) Profiler::collect();
+		}
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported) { // If the swap chain extension is supported ...
-			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(dev);
-			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+		// Drain the frames still in flight, oldest first
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			FrameResources& fr = m_frames[(m_currentFrame + i) % MAX_FRAMES_IN_FLIGHT];
+			if (fr.pendingOutput >= 0) {
+				waitForFrame(fr);
+				writeReadbackBuffer(fr, static_cast<uint32_t>(fr.pendingOutput));
+			}
 		}
 
-		return indices.isComplete() && extensionsSupported && swapChainAdequate;
+		printFrameStats();
 	}
 
-	/// Returns true if the given GPU supports the required extensions found in `requiredDeviceExtensions`.
-	bool checkDeviceExtensionSupport(VkPhysicalDevice dev) {
-		uint32_t extensionCount;
-		vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, nullptr);
-
-		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-		vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, availableExtensions.data());
+	/// Write the contents of a frame's readback buffer to a binary PPM file for the given frame number.
+	void writeReadbackBuffer(FrameResources& fr, uint32_t frame) {
+		fr.pendingOutput = -1;
 
-		std::set<std::string> requiredExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
-
-		for (const auto& extension : availableExtensions) {
-			requiredExtensions.erase(extension.extensionName);
-		}
+		const auto* pixels = static_cast<const uint8_t*>(fr.readbackMemory.mapped);
 
-		return requiredExtensions.empty();
+		char number[16];
+		snprintf(number, sizeof(number), "%04u", frame);
+		writePpm(m_outputPrefix + number + ".ppm", pixels, m_swapChainExtent.width, m_swapChainExtent.height);
 	}
 
-	struct QueueFamilyIndices {
-		std::optional<uint32_t> graphicsFamily;
-		std::optional<uint32_t> presentFamily;
-
-		bool isComplete() {
-			return graphicsFamily.has_value() && presentFamily.has_value();
-		}
-	};
+	void createImageViews() {
+		VIPER_PROFILE_ZONE("createImageViews");
+		m_swapChainImageViews.resize(m_swapChainImages.size());
 
-	/// Returns the queue families for graphics and rendering in a QueueFamilyIndices struct.
-	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice dev) {
-		QueueFamilyIndices indices;
+		for (size_t i = 0; i < m_swapChainImages.size(); i++) {
+			VkImageViewCreateInfo create_info{};
+			create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			create_info.image = m_swapChainImages[i];
 
-		uint32_t queue_family_count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_family_count, nullptr);
+			create_info.viewType = VK_IMAGE_VIEW_TYPE_2D; // How do we treat images?
+			create_info.format = m_swapChainImageFormat;
 
-		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
-		vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_family_count, queue_families.data());
+			create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
-		int i = 0;
-		for (const auto& queue_family : queue_families) {
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, m_surface, &presentSupport); // Does this GPU support rendering to surfaces for this queue family?
+			// What is the image's purpose, and which part of the image should be accessed?
+			create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			create_info.subresourceRange.baseMipLevel = 0;
+			create_info.subresourceRange.levelCount = 1;
+			create_info.subresourceRange.baseArrayLayer = 0;
+			create_info.subresourceRange.layerCount = 1;
 
-			if (presentSupport) {
-				indices.presentFamily = i;
+			if (vkCreateImageView(m_device, &create_info, nullptr, &m_swapChainImageViews[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create image views!");
 			}
+		}
+	}
 
-			if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphicsFamily = i;
-				break;
-			}
 
-			i++;
+	/// Create a render pass drawing into the swap chain (or offscreen) images. It clears them first, unless
+	/// `keepContents`: then only presented images may be drawn to, and they keep what they showed. Both kinds are
+	/// compatible, so framebuffers, pipelines and secondary command buffers work with either.
+	VkRenderPass createRenderPass(bool keepContents) {
+		VkAttachmentDescription color_attachment{};
+		color_attachment.format = m_swapChainImageFormat;
+		color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		color_attachment.loadOp = keepContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // Keep what we drew so it can be shown
+		color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		color_attachment.initialLayout = keepContents ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_UNDEFINED;
+		// Presented images go to the screen, offscreen ones get copied out
+		color_attachment.finalLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkAttachmentReference color_attachment_ref{};
+		color_attachment_ref.attachment = 0;
+		color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &color_attachment_ref;
+
+		// Wait for the image to be available before writing to it
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.srcAccessMask = 0;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		if (keepContents) dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT; // The load op reads after the layout transition
+
+		// Offscreen images are copied out right after the pass: the copy waits for the color writes and the final
+		// transition to TRANSFER_SRC_OPTIMAL
+		VkSubpassDependency readback{};
+		readback.srcSubpass = 0;
+		readback.dstSubpass = VK_SUBPASS_EXTERNAL;
+		readback.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		readback.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		readback.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		readback.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		const VkSubpassDependency dependencies[] = {dependency, readback};
+
+		VkRenderPassCreateInfo render_pass_info{};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		render_pass_info.attachmentCount = 1;
+		render_pass_info.pAttachments = &color_attachment;
+		render_pass_info.subpassCount = 1;
+		render_pass_info.pSubpasses = &subpass;
+		render_pass_info.dependencyCount = m_headless ? 2 : 1;
+		render_pass_info.pDependencies = dependencies;
+
+		VkRenderPass render_pass;
+		if (vkCreateRenderPass(m_device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create render pass!");
 		}
-
-		return indices;
+		return render_pass;
 	}
 
-	/// Create the logical device `m_device` to the physical GPU `m_physicalDevice`.
-	void createLogicalDevice() {
-		QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
+	/// Load the pipeline cache from the previous run and hand the pipeline registry the worker threads.
+	void createPipelineRegistry() {
+		VIPER_PROFILE_ZONE("createPipelineRegistry");
+		m_pipelineCache = std::make_unique<PipelineCache>(m_device, m_driver->physicalDevice(), joinPath(cacheDirectory(), "pipeline_cache.bin"));
+		m_pipelineRegistry = std::make_unique<PipelineRegistry>(m_device, m_pipelineCache->handle(), *m_threadPool);
+	}
 
-		// Turn queue family indexes into queue family creation infos ...
-		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-		std::set<uint32_t> unique_queue_families = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+	void createGraphicsPipeline() {
+		VIPER_PROFILE_ZONE("createGraphicsPipeline");
+		VkPipelineLayoutCreateInfo pipeline_layout_info{};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = 0; // Optional
+		pipeline_layout_info.pSetLayouts = nullptr; // Optional
+		pipeline_layout_info.pushConstantRangeCount = 0; // Optional
+		pipeline_layout_info.pPushConstantRanges = nullptr; // Optional
 
-		const float queue_priority = 1.0f;
-		for (uint32_t queue_family : unique_queue_families) {
-			VkDeviceQueueCreateInfo queue_create_info{};
-			queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queue_create_info.queueFamilyIndex = queue_family;
-			queue_create_info.queueCount = 1;
-			queue_create_info.pQueuePriorities = &queue_priority;
-			queue_create_infos.push_back(queue_create_info);
+		if (vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
 		}
 
-		VkPhysicalDeviceFeatures device_features{}; // Use default values
-
-		// Now we complete the information about the logical device we're creating ...
-		VkDeviceCreateInfo create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-		create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
-		create_info.pQueueCreateInfos = queue_create_infos.data();
-
-		// Enable device extensions
-		create_info.enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size());
-		create_info.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+		// Alpha blending (SRC_ALPHA, ONE_MINUS_SRC_ALPHA) is the description's default
+		GraphicsPipelineDesc desc;
+		desc.vertexShader = embeddedShader(SHADER_VERT_SPV);
+		desc.fragmentShader = embeddedShader(SHADER_FRAG_SPV);
+		desc.layout = m_pipelineLayout;
+		desc.renderPass = m_renderPass;
 
-		create_info.pEnabledFeatures = &device_features;
+		// Compiles on the registry's workers; effect pipelines requested alongside it compile in parallel
+		PipelineRegistry::Key key = m_pipelineRegistry->request(desc);
+		m_graphicsPipeline = m_pipelineRegistry->get(key);
+	}
 
-		if (enableValidationLayers) { // Keeping support for older implementations of Vulkan
-			create_info.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-			create_info.ppEnabledLayerNames = validationLayers.data();
+	/// Create the compute effect stage (YUV conversion, resizing, LUTs), on the async compute queue if there is one.
+	void createComputeEffects() {
+		VIPER_PROFILE_ZONE("createComputeEffects");
+		ComputeEffects::Shaders shaders;
+		shaders.yuvToRgba = embeddedShader(YUV_TO_RGBA_COMP_SPV);
+		shaders.resize = embeddedShader(RESIZE_COMP_SPV);
+		shaders.applyLut = embeddedShader(APPLY_LUT_COMP_SPV);
+
+		const VulkanQueueFamilies& indices = m_driver->queueFamilies();
+		if (indices.computeFamily.has_value()) {
+			m_effects = std::make_unique<ComputeEffects>(m_device, *m_pipelineRegistry, indices.computeFamily.value(),
+			                                             m_driver->computeQueue(),
+			                                             m_driver->transferQueueShared() ? &m_transferQueueMutex : nullptr,
+			                                             MAX_FRAMES_IN_FLIGHT, shaders);
 		} else {
-			create_info.enabledLayerCount = 0;
+			m_effects = std::make_unique<ComputeEffects>(m_device, *m_pipelineRegistry, indices.graphicsFamily.value(), m_graphicsQueue,
+			                                             &m_graphicsQueueMutex, MAX_FRAMES_IN_FLIGHT, shaders);
 		}
+	}
 
-		if (vkCreateDevice(m_physicalDevice, &create_info, nullptr, &m_device) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create logical device!");
-		}
+	void createGui() {
+		VIPER_PROFILE_ZONE("createGui");
+		GuiRenderer::Shaders shaders;
+		shaders.vertex = embeddedShader(GUI_VERT_SPV);
+		shaders.fragment = embeddedShader(GUI_FRAG_SPV);
 
-		vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
-		vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_presentQueue);
+		m_gui = std::make_unique<GuiRenderer>(m_device, *m_gpuMemory, *m_uploadQueue, *m_pipelineRegistry, m_renderPass,
+		                                      MAX_FRAMES_IN_FLIGHT, shaders);
+		m_guiBatch = std::make_unique<GuiBatch>(m_gui->atlas());
 	}
 
-	struct SwapChainSupportDetails {
-		VkSurfaceCapabilitiesKHR capabilities;
-		std::vector<VkSurfaceFormatKHR> formats;
-		std::vector<VkPresentModeKHR> presentModes;
-	};
+	/// Lay out this frame's GUI.
+	void buildGui() {
+		::buildGui(*m_guiBatch, (float) m_swapChainExtent.width, (float) m_swapChainExtent.height);
+	}
 
-	/// Get capabilities, formats, and present mode support from the device for a swap chain.
-	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice dev) {
-		SwapChainSupportDetails details;
+	void createFramebuffers() {
+		VIPER_PROFILE_ZONE("createFramebuffers");
+		m_swapChainFramebuffers.resize(m_swapChainImageViews.size());
+
+		for (size_t i = 0; i < m_swapChainImageViews.size(); i++) {
+			VkFramebufferCreateInfo framebuffer_info{};
+			framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebuffer_info.renderPass = m_renderPass;
+			framebuffer_info.attachmentCount = 1;
+			framebuffer_info.pAttachments = &m_swapChainImageViews[i];
+			framebuffer_info.width = m_swapChainExtent.width;
+			framebuffer_info.height = m_swapChainExtent.height;
+			framebuffer_info.layers = 1;
+
+			if (vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &m_swapChainFramebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create framebuffer!");
+			}
+		}
+	}
 
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev, m_surface, &details.capabilities);
+	/// Create a command pool, command buffer and sync objects for each frame in flight.
+	void createFrameResources() {
+		VIPER_PROFILE_ZONE("createFrameResources");
+		const VulkanQueueFamilies& indices = m_driver->queueFamilies();
+		m_frames.resize(MAX_FRAMES_IN_FLIGHT);
+		m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
+
+		for (auto& frame : m_frames) {
+			VkCommandPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Buffers are re-recorded every frame
+			pool_info.queueFamilyIndex = indices.graphicsFamily.value();
+
+			if (vkCreateCommandPool(m_device, &pool_info, nullptr, &frame.commandPool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create command pool!");
+			}
 
-		uint32_t formatCount;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(dev, m_surface, &formatCount, nullptr);
+			VkCommandBufferAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = frame.commandPool;
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = 1;
 
-		if (formatCount != 0) {
-			details.formats.resize(formatCount);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(dev, m_surface, &formatCount, details.formats.data());
-		}
+			if (vkAllocateCommandBuffers(m_device, &alloc_info, &frame.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate command buffer!");
+			}
 
-		uint32_t presentModeCount;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(dev, m_surface, &presentModeCount, nullptr);
+			VkSemaphoreCreateInfo semaphore_info{};
+			semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		if (presentModeCount != 0) {
-			details.presentModes.resize(presentModeCount);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(dev, m_surface, &presentModeCount, details.presentModes.data());
-		}
+			VkFenceCreateInfo fence_info{};
+			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; // The first wait on each frame must not block
 
-		return details;
-	}
+			if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &frame.imageAvailable) != VK_SUCCESS
+				|| vkCreateSemaphore(m_device, &semaphore_info, nullptr, &frame.renderFinished) != VK_SUCCESS
+				|| vkCreateFence(m_device, &fence_info, nullptr, &frame.inFlight) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create frame synchronization objects!");
+			}
 
-	/// Select best available swap chain surface format.
-	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
-		for (const auto& available_format : availableFormats) {
-			// We would always prefer 32-bit SRGB pixels, in the SRGB non-linear color space if it is available.
-			if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-				return available_format;
+			if (m_headless) { // Each frame in flight reads back into its own buffer
+				createBuffer((VkDeviceSize) m_swapChainExtent.width * m_swapChainExtent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				             frame.readbackBuffer, frame.readbackMemory);
 			}
 		}
 
-		return availableFormats[0]; // Choose first format available.
+		m_recorder = std::make_unique<ParallelRecorder>(m_device, indices.graphicsFamily.value(), *m_threadPool, MAX_FRAMES_IN_FLIGHT);
+
+		// Partial redraws load the image, so first clear what is about to be drawn over
+		m_layers.push_back([this](VkCommandBuffer cmd) {
+			if (m_framePartial) VulkanCommands(cmd).clear(m_frameScissors, BACKGROUND_COLOR.float32); // Else the render pass did
+		});
+
+		// The scene is a single layer for now: the triangle
+		m_layers.push_back([this](VkCommandBuffer cmd) {
+			VIPER_PROFILE_GPU_ZONE(m_gpuProfiler.get(), cmd, "scene");
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+
+			VkViewport viewport{};
+			viewport.x = 0.0f;
+			viewport.y = 0.0f;
+			viewport.width = (float) m_swapChainExtent.width;
+			viewport.height = (float) m_swapChainExtent.height;
+			viewport.minDepth = 0.0f;
+			viewport.maxDepth = 1.0f;
+			vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+			VulkanCommands commands(cmd);
+			for (const DriverRect& scissor : m_frameScissors) {
+				commands.setScissor(scissor);
+				vkCmdDraw(cmd, 3, 1, 0, 0); // The triangle's vertices are generated in the vertex shader
+			}
+		});
+
+		// The GUI goes on top
+		m_layers.push_back([this](VkCommandBuffer cmd) {
+			VIPER_PROFILE_GPU_ZONE(m_gpuProfiler.get(), cmd, "gui");
+			m_gui->record(cmd, *m_guiBatch, m_swapChainExtent, m_frameScissors);
+		});
 	}
 
-	/// Select best swap chain method for displaying images from the queue.
-	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-		for (const auto& available_present_mode : availablePresentModes) {
-			if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) { // Choose triple-buffering when it is available
-				return available_present_mode;
-			}
-		}
-		return VK_PRESENT_MODE_FIFO_KHR; // Double-buffering is always available. (Commonly known as Vsync in video games)
+	static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 	}
 
-	/// Select resolution of the swap chain images.
-	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
-		if (capabilities.currentExtent.width != UINT32_MAX) {
-			return capabilities.currentExtent;
-		} else {
-			VkExtent2D actual_extent = {WIDTH, HEIGHT};
+	/// Block until the GPU has finished the last submission of `frame`, recording how long that took.
+	void waitForFrame(FrameResources& frame) {
+		VIPER_PROFILE_ZONE("waitForFrame");
+		auto wait_start = std::chrono::steady_clock::now();
+		vkWaitForFences(m_device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+		m_fenceWaitTimes.record(millisecondsSince(wait_start));
+	}
 
-			actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-			actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+	void beginCommandBuffer(VkCommandBuffer cmd) {
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-			return actual_extent;
+		if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
 		}
+		if (m_gpuProfiler) m_gpuProfiler->recordReset(cmd); // Before any zone of the frame
 	}
 
-	void createSwapChain() {
-		SwapChainSupportDetails swap_chain_support = querySwapChainSupport(m_physicalDevice);
-
-		// Of the swap chain's supported modes and formats, we will choose the best options for the three:
-		VkSurfaceFormatKHR surface_format = chooseSwapSurfaceFormat(swap_chain_support.formats);
-		VkPresentModeKHR present_mode = chooseSwapPresentMode(swap_chain_support.presentModes);
-		VkExtent2D extent = chooseSwapExtent(swap_chain_support.capabilities);
-
-		// Assign some member variables ...
-		m_swapChainImageFormat = surface_format.format;
-		m_swapChainExtent = extent;
-
-		// Request at least one more than the minimum images for the swap chain
-		uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-
-		// Make sure we don't exceed the maximum, either ...
-		if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
-			image_count = swap_chain_support.capabilities.maxImageCount;
+	/// Record the render pass drawing one frame into the image `imageIndex`. The frame slot's recorder pools
+	/// must have been reset with beginFrame(). Returns the uploads the frame's submission has to wait for.
+	TimelineWait recordFrame(VkCommandBuffer cmd, uint32_t imageIndex) {
+		VIPER_PROFILE_ZONE("recordFrame");
+		VIPER_PROFILE_GPU_ZONE(m_gpuProfiler.get(), cmd, "frame");
+		TimelineWait uploads = m_uploadQueue->recordAcquires(cmd); // Barriers cannot go inside the render pass
+
+		VkClearValue clear_color{};
+		clear_color.color = BACKGROUND_COLOR;
+
+		// Partial redraws only touch the bounds of the damage, which lets tiling GPUs skip the rest of the image
+		const VkRenderPass render_pass = m_framePartial ? m_renderPassLoad : m_renderPass;
+		VkRect2D render_area = {{0, 0}, m_swapChainExtent};
+		if (m_framePartial) {
+			int32_t x0 = INT32_MAX, y0 = INT32_MAX, x1 = 0, y1 = 0;
+			for (const DriverRect& rect : m_frameScissors) {
+				x0 = std::min(x0, rect.x);
+				y0 = std::min(y0, rect.y);
+				x1 = std::max(x1, rect.x + int32_t(rect.width));
+				y1 = std::max(y1, rect.y + int32_t(rect.height));
+			}
+			render_area = {{x0, y0}, {uint32_t(x1 - x0), uint32_t(y1 - y0)}};
 		}
 
-		VkSwapchainCreateInfoKHR create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		create_info.surface = m_surface;
-
-		// Details of the swap chain
-		create_info.minImageCount = image_count;
-		create_info.imageFormat = surface_format.format;
-		create_info.imageColorSpace = surface_format.colorSpace;
-		create_info.imageExtent = extent;
-		create_info.imageArrayLayers = 1;
-		create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-		// The swap chain needs to know which queue families will own the images ...
-		QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
-		uint32_t queue_family_indices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+		VkRenderPassBeginInfo render_pass_info{};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = render_pass;
+		render_pass_info.framebuffer = m_swapChainFramebuffers[imageIndex];
+		render_pass_info.renderArea = render_area;
+		render_pass_info.clearValueCount = 1;
+		render_pass_info.pClearValues = &clear_color;
+
+		// Layers are recorded into secondary buffers, in parallel when there are enough of them
+		vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBufferInheritanceInfo inheritance{};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = render_pass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = m_swapChainFramebuffers[imageIndex];
+		m_recorder->record(cmd, inheritance, m_layers);
+
+		vkCmdEndRenderPass(cmd);
+		return uploads;
+	}
 
-		if (indices.graphicsFamily != indices.presentFamily) {
-			create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT; // No ownership promises (simpler)
-			create_info.queueFamilyIndexCount = 2; // How many queue families will share the images?
-			create_info.pQueueFamilyIndices = queue_family_indices; // Which queue families will share them?
-		} else {
-			create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE; // Explicit ownership (higher performance)
-			create_info.queueFamilyIndexCount = 0; // Optional
-			create_info.pQueueFamilyIndices = nullptr; // Optional
+	/// Record and submit one frame, then present it. Only blocks when the frame slot about to be reused is
+	/// still executing on the GPU, which is what keeps up to MAX_FRAMES_IN_FLIGHT frames overlapped. Returns false,
+	/// drawing nothing, if the swap chain went out of date; it is then stale, and replaced before the next try.
+	bool drawFrame() {
+		VIPER_PROFILE_ZONE("drawFrame");
+		FrameResources& frame = m_frames[m_currentFrame];
+		waitForFrame(frame);
+		destroyRetiredSwapChains();
+		if (m_gpuProfiler) m_gpuProfiler->beginFrame(m_currentFrame);
+		auto cpu_start = std::chrono::steady_clock::now();
+
+		const VkSwapchainKHR swap_chain = m_driver->swapChain();
+		uint32_t image_index;
+		VkResult result;
+		{
+			VIPER_PROFILE_ZONE("acquire");
+			result = vkAcquireNextImageKHR(m_device, swap_chain, UINT64_MAX, frame.imageAvailable, VK_NULL_HANDLE, &image_index);
+		}
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) { // Nothing was acquired or signalled, so the frame slot is as it was
+			m_swapChainStale = true;
+			return false;
+		}
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("failed to acquire swap chain image!");
 		}
 
-		// Some miscellaneous swap chain creation information.
-		create_info.preTransform = swap_chain_support.capabilities.currentTransform;
-		create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		create_info.presentMode = present_mode;
-		create_info.clipped = VK_TRUE;
-		create_info.oldSwapchain = VK_NULL_HANDLE;
+		// The image may still be in use by an older frame if there are more images than frames in flight
+		if (m_imagesInFlight[image_index] != VK_NULL_HANDLE) {
+			vkWaitForFences(m_device, 1, &m_imagesInFlight[image_index], VK_TRUE, UINT64_MAX);
+		}
+		m_imagesInFlight[image_index] = frame.inFlight;
+
+		vkResetFences(m_device, 1, &frame.inFlight);
+		vkResetCommandPool(m_device, frame.commandPool, 0);
+		m_recorder->beginFrame(m_currentFrame);
+		m_effects->beginFrame(m_currentFrame);
+		m_gui->beginFrame(m_currentFrame); // The GUI was built by the main loop, to find its damage
+		setFrameDamage(m_damage.takeFrame(image_index));
+
+		beginCommandBuffer(frame.commandBuffer);
+		TimelineWait uploads = recordFrame(frame.commandBuffer, image_index);
+		if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
 
-		if (vkCreateSwapchainKHR(m_device, &create_info, nullptr, &m_swapChain) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create the swap chain!");
+		TimelineWait effects = m_effects->submit({uploads}); // Runs alongside the frame's graphics work
+		submitFrame(frame.commandBuffer, frame.inFlight, frame.imageAvailable, frame.renderFinished, {uploads, effects});
+
+		VkPresentInfoKHR present_info{};
+		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		present_info.waitSemaphoreCount = 1;
+		present_info.pWaitSemaphores = &frame.renderFinished;
+		present_info.swapchainCount = 1;
+		present_info.pSwapchains = &swap_chain;
+		present_info.pImageIndices = &image_index;
+
+		{
+			VIPER_PROFILE_ZONE("present");
+			std::lock_guard<std::mutex> lock(m_graphicsQueueMutex); // The present queue is usually the graphics queue
+			result = vkQueuePresentKHR(m_driver->presentQueue(), &present_info);
+		}
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+			m_swapChainStale = true; // Still shown (if suboptimal), but the next frame gets a new swap chain
+		} else if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to present swap chain image!");
 		}
 
-		// Obtain references to the swap chain images
-		vkGetSwapchainImagesKHR(m_device, m_swapChain, &image_count, nullptr);
-		m_swapChainImages.resize(image_count);
-		vkGetSwapchainImagesKHR(m_device, m_swapChain, &image_count, m_swapChainImages.data());
+		m_cpuTimes.record(millisecondsSince(cpu_start));
+		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		m_frameNumber++;
+		return true;
 	}
 
-	void createImageViews() {
-		m_swapChainImageViews.resize(m_swapChainImages.size());
-
-		for (size_t i = 0; i < m_swapChainImages.size(); i++) {
-			VkImageViewCreateInfo create_info{};
-			create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			create_info.image = m_swapChainImages[i];
-
-			create_info.viewType = VK_IMAGE_VIEW_TYPE_2D; // How do we treat images?
-			create_info.format = m_swapChainImageFormat;
+	/// Submit a frame's command buffer to the graphics queue. It waits for `imageAvailable` (if not null) before
+	/// writing color and for the work behind `timelines` (uploads, effects) before their first use, and signals
+	/// `renderFinished` (if not null) and `fence`.
+	void submitFrame(VkCommandBuffer cmd, VkFence fence, VkSemaphore imageAvailable, VkSemaphore renderFinished,
+	                 std::initializer_list<TimelineWait> timelines) {
+		VIPER_PROFILE_ZONE("submitFrame");
+		const size_t max_waits = 4;
+		VkSemaphore wait_semaphores[max_waits];
+		VkPipelineStageFlags wait_stages[max_waits];
+		uint64_t wait_values[max_waits]; // Binary semaphores ignore theirs
+		uint32_t wait_count = 0;
+
+		if (imageAvailable != VK_NULL_HANDLE) {
+			wait_semaphores[wait_count] = imageAvailable;
+			wait_stages[wait_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // Only writing color must wait
+			wait_values[wait_count++] = 0;
+		}
+		for (const TimelineWait& timeline : timelines) {
+			if (timeline.value == 0) continue;
+			if (wait_count == max_waits) throw std::logic_error("too many semaphores to wait for!");
+			wait_semaphores[wait_count] = timeline.semaphore;
+			wait_stages[wait_count] = timeline.stages;
+			wait_values[wait_count++] = timeline.value;
+		}
 
-			create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		VkTimelineSemaphoreSubmitInfo timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_info.waitSemaphoreValueCount = wait_count;
+		timeline_info.pWaitSemaphoreValues = wait_values;
+
+		VkSubmitInfo submit_info{};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.pNext = &timeline_info;
+		submit_info.waitSemaphoreCount = wait_count;
+		submit_info.pWaitSemaphores = wait_semaphores;
+		submit_info.pWaitDstStageMask = wait_stages;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &cmd;
+		submit_info.signalSemaphoreCount = renderFinished != VK_NULL_HANDLE ? 1 : 0;
+		submit_info.pSignalSemaphores = &renderFinished;
+
+		std::lock_guard<std::mutex> lock(m_graphicsQueueMutex);
+		if (vkQueueSubmit(m_graphicsQueue, 1, &submit_info, fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit frame!");
+		}
+	}
 
-			// What is the image's purpose, and which part of the image should be accessed?
-			create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			create_info.subresourceRange.baseMipLevel = 0;
-			create_info.subresourceRange.levelCount = 1;
-			create_info.subresourceRange.baseArrayLayer = 0;
-			create_info.subresourceRange.layerCount = 1;
+	void printFrameStats() {
+		m_frameTimes.print(std::cout, "frame interval");
+		m_cpuTimes.print(std::cout, "cpu record+submit");
+		m_fenceWaitTimes.print(std::cout, "gpu fence wait");
+		m_scheduler.print(std::cout);
+		m_gpuMemory->print(std::cout);
+	}
 
-			if (vkCreateImageView(m_device, &create_info, nullptr, &m_swapChainImageViews[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to create image views!");
-			}
+	/// Set the rectangles the frame about to be recorded draws: `damage`, or the whole image if that is empty.
+	void setFrameDamage(const std::vector<DamageRect>& damage) {
+		m_frameScissors.clear();
+		for (const DamageRect& rect : damage) {
+			m_frameScissors.push_back({rect.x0, rect.y0, uint32_t(rect.x1 - rect.x0), uint32_t(rect.y1 - rect.y0)});
 		}
+		m_framePartial = !m_headless && !m_frameScissors.empty() && !m_damage.fullFrame();
+		if (m_frameScissors.empty() || !m_framePartial) m_frameScissors.assign(1, {0, 0, m_swapChainExtent.width, m_swapChainExtent.height});
 	}
 
-	/// Read a file from the file system given a filename, as a vector of bytes.
-	static std::vector<char> readFile(const std::string& filename) {
-		std::ifstream file(filename, std::ios::ate | std::ios::binary); // Read at the end (ate) in binary
+	/// Draw frames only when something changed: sleep in glfwWaitEventsTimeout() until an event, the next timeline
+	/// frame during playback, or the next check for background changes, then rebuild the GUI and compare it with the
+	/// last one. An idle editor draws nothing, and playback draws at the timeline's frame rate.
+	void mainLoop() {
+		glfwSetWindowUserPointer(m_window, this);
+		glfwSetWindowRefreshCallback(m_window, [](GLFWwindow* window) { // Exposed, or asked to redraw
+			static_cast<TriangleApplication*>(glfwGetWindowUserPointer(window))->m_damage.addAll();
+		});
+		// Some platforms do not return from event processing until the user lets go of the window's edge, so the
+		// frame for each new size is drawn right here rather than by the loop
+		glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int, int) {
+			auto* app = static_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+			app->m_swapChainStale = true;
+			app->updateFrame();
+		});
+		glfwSetKeyCallback(m_window, [](GLFWwindow* window, int key, int, int action, int) {
+			static_cast<TriangleApplication*>(glfwGetWindowUserPointer(window))->keyPressed(key, action);
+		});
+		if (m_playOnStart) m_scheduler.play(PresentScheduler::Clock::now());
 
-		if (!file.is_open()) {
-			throw std::runtime_error("failed to open file!");
+		while (!glfwWindowShouldClose(m_window)) {
+			const bool playing = m_scheduler.mode() == PreviewMode::Playback;
+			const double until_due = m_scheduler.secondsUntilDue(PresentScheduler::Clock::now(), IDLE_WAKEUP_SECONDS);
+			if (m_minimized) {
+				glfwWaitEvents(); // Until the window is restored
+			} else if (until_due == 0.0 || (m_damage.pending() && !playing)) {
+				glfwPollEvents();
+			} else {
+				glfwWaitEventsTimeout(until_due);
+			}
+			updateFrame();
 		}
 
-		size_t file_size = (size_t) file.tellg(); // Get file size using position currently at (end)
-		std::vector<char> buffer(file_size); // Resize our buffer
-		file.seekg(0); // Go to the beginning of the file
-		file.read(buffer.data(), file_size); // Read the data
-
-		file.close();
-		return buffer;
+		vkDeviceWaitIdle(m_device); // Nothing may be destroyed while the GPU still uses it
+		printFrameStats();
 	}
 
-	/// Construct a new Vulkan shader module from a byte vector.
-	VkShaderModule createShaderModule(const std::vector<char>& code) {
-		VkShaderModuleCreateInfo create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		create_info.codeSize = code.size();
-		create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-		
-		VkShaderModule shader_module;
-		if (vkCreateShaderModule(m_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create shader module!");
+	/// Space plays and stops, and holding an arrow key scrubs a frame at a time (until there is a timeline to drag).
+	void keyPressed(int key, int action) {
+		const auto now = PresentScheduler::Clock::now();
+		if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+			if (m_scheduler.mode() == PreviewMode::Playback) {
+				m_scheduler.stop(now);
+			} else {
+				m_scheduler.play(now);
+			}
+		} else if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) {
+			if (action == GLFW_RELEASE) {
+				m_scheduler.stop(now);
+			} else {
+				m_scheduler.scrub(std::max<int64_t>(m_scheduler.frameAt(now) + (key == GLFW_KEY_RIGHT ? 1 : -1), 0));
+			}
 		}
-		return shader_module;
 	}
 
-	void createGraphicsPipeline() {
-		auto vert_shader_code = readFile("../shaders/vert.spv");
-		auto frag_shader_code = readFile("../shaders/frag.spv");
-
-		VkShaderModule vert_shader_module = createShaderModule(vert_shader_code);
-		VkShaderModule frag_shader_module = createShaderModule(frag_shader_code);
-
-		VkPipelineShaderStageCreateInfo vert_shader_stage_info{}; // Vertex shader module info
-		vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vert_shader_stage_info.module = vert_shader_module;
-		vert_shader_stage_info.pName = "main";
-
-		VkPipelineShaderStageCreateInfo frag_shader_stage_info{}; // Frag shader module info
-		frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		frag_shader_stage_info.module = frag_shader_module;
-		frag_shader_stage_info.pName = "main";
-
-		VkPipelineShaderStageCreateInfo shaderStages[] = {vert_shader_stage_info, frag_shader_stage_info};
-
-		// Describes the format of the vertex data that will be passed to the vertex shader
-		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertex_input_info.vertexBindingDescriptionCount = 0;
-		vertex_input_info.pVertexBindingDescriptions = nullptr; // Optional
-		vertex_input_info.vertexAttributeDescriptionCount = 0;
-		vertex_input_info.pVertexAttributeDescriptions = nullptr; // Optional
-
-		// What kind of geometry should be drawn from vertices
-		VkPipelineInputAssemblyStateCreateInfo input_asm{};
-		input_asm.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		input_asm.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; // For the type of primitive restart
-		input_asm.primitiveRestartEnable = VK_FALSE; // Disabled because we only draw triangles
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float) m_swapChainExtent.width;
-		viewport.height = (float) m_swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.offset = {0, 0};
-		scissor.extent = m_swapChainExtent;
-
-		VkPipelineViewportStateCreateInfo viewport_state{};
-		viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewport_state.viewportCount = 1;
-		viewport_state.pViewports = &viewport;
-		viewport_state.scissorCount = 1;
-		viewport_state.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE; // If true, it discards any output from reaching frame buffer
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL; // Determines how fragments are generated for geometry
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; // Type of culling
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-		rasterizer.depthBiasClamp = 0.0f; // Optional
-		rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-		// TODO: multisampling
-		/*
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisampling.minSampleShading = 1.0f; // Optional
-		multisampling.pSampleMask = nullptr; // Optional
-		multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-		multisampling.alphaToOneEnable = VK_FALSE; // Optional
-		*/
-
-		// TODO: depth buffering
-
-		// Alpha blending
-		VkPipelineColorBlendAttachmentState color_blend_attachment{};
-		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		color_blend_attachment.blendEnable = VK_TRUE;
-		color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA; // Optional
-		color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Optional
-		color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-		color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-		color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-		color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-		VkPipelineColorBlendStateCreateInfo color_blending{};
-		color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		color_blending.logicOpEnable = VK_FALSE;
-		color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
-		color_blending.attachmentCount = 1;
-		color_blending.pAttachments = &color_blend_attachment;
-		color_blending.blendConstants[0] = 0.0f; // Optional
-		color_blending.blendConstants[1] = 0.0f; // Optional
-		color_blending.blendConstants[2] = 0.0f; // Optional
-		color_blending.blendConstants[3] = 0.0f; // Optional
-
-		VkPipelineLayoutCreateInfo pipeline_layout_info{};
-		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipeline_layout_info.setLayoutCount = 0; // Optional
-		pipeline_layout_info.pSetLayouts = nullptr; // Optional
-		pipeline_layout_info.pushConstantRangeCount = 0; // Optional
-		pipeline_layout_info.pPushConstantRanges = nullptr; // Optional
-
-		if (vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout!");
+	/// One turn of the main loop: replace the swap chain if it is stale, rebuild the GUI, and draw a frame if anything
+	/// changed. During playback, frames are only drawn when the next timeline frame is due, and other changes wait
+	/// for it.
+	void updateFrame() {
+		const auto now = PresentScheduler::Clock::now();
+		if (m_scheduler.latency() != m_swapChainLatency) m_swapChainStale = true;
+		if (m_swapChainStale && !recreateSwapChain()) {
+			m_drewLast = false;
+			return;
 		}
-
-		vkDestroyShaderModule(m_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(m_device, vert_shader_module, nullptr);
-	}
-
-	void mainLoop() {
-		while (!glfwWindowShouldClose(m_window)) {
-			glfwPollEvents();
+		if (m_scheduler.mode() == PreviewMode::Playback && !m_scheduler.frameDue(now)) return;
+
+		const int64_t timeline_frame = m_scheduler.frameAt(now);
+		if (m_scheduler.frameDue(now)) m_damage.addAll(); // Until there is a viewer, the whole window stands in for it
+		{
+			VIPER_PROFILE_ZONE("buildGui");
+			buildGui();
+			m_guiBatch->hashTiles(DamageTracker::TILE_SIZE, m_damage.tileColumns(), m_damage.tileRows(), m_guiTiles);
+			m_damage.addTiles(m_guiTiles);
 		}
+		if (!m_damage.pending() || !drawFrame()) {
+			m_drewLast = false;
+			return;
+		}
+		m_scheduler.presented(timeline_frame, PresentScheduler::Clock::now());
+		firstFrameOut(); // Queued for presentation, if it is the first
+		if (Profiler::enabled()) Profiler::collect();
+
+		// Intervals only mean something between frames drawn back to back
+		auto frame_end = std::chrono::steady_clock::now();
+		if (m_drewLast) m_frameTimes.record(std::chrono::duration<double, std::milli>(frame_end - m_lastFrameStart).count());
+		m_lastFrameStart = frame_end;
+		m_drewLast = true;
 	}
 
 	void cleanup() {
 		// Vulkan cleanup
+		for (auto& frame : m_frames) {
+			vkDestroySemaphore(m_device, frame.imageAvailable, nullptr);
+			vkDestroySemaphore(m_device, frame.renderFinished, nullptr);
+			vkDestroyFence(m_device, frame.inFlight, nullptr);
+			vkDestroyCommandPool(m_device, frame.commandPool, nullptr); // Frees its command buffer too
+			if (frame.readbackBuffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(m_device, frame.readbackBuffer, nullptr);
+				m_gpuMemory->free(frame.readbackMemory);
+			}
+		}
+		m_recorder.reset();
+		m_gpuProfiler.reset();
+		m_effects.reset(); // Waits for outstanding effects
+		m_gui.reset();
+		destroyRetiredSwapChains(true);
+		for (auto framebuffer : m_swapChainFramebuffers) {
+			vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+		}
+		m_pipelineRegistry.reset(); // Destroys all pipelines
+		if (!m_pipelineCache->save()) {
+			std::cerr << "failed to save the pipeline cache" << std::endl; // Not fatal, the next start is just slower
+		}
+		m_pipelineCache.reset();
+		m_threadPool.reset();
 		vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+		vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+		if (m_renderPassLoad != VK_NULL_HANDLE) vkDestroyRenderPass(m_device, m_renderPassLoad, nullptr);
 		for (auto image_view : m_swapChainImageViews) { // Destroy image views
 			vkDestroyImageView(m_device, image_view, nullptr);
 		} // (Images are destroyed automatically by destroying the swap chain)
-		vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
-		vkDestroyDevice(m_device, nullptr);
-		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-		vkDestroyInstance(m_instance, nullptr);
+		if (m_headless) { // ... except offscreen images, which we own
+			for (size_t i = 0; i < m_swapChainImages.size(); i++) {
+				vkDestroyImage(m_device, m_swapChainImages[i], nullptr);
+				m_gpuMemory->free(m_offscreenImageMemory[i]);
+			}
+		}
+		m_uploadQueue.reset(); // Waits for outstanding uploads
+		m_gpuMemory.reset(); // Returns the remaining blocks to the driver
+		m_memorySource.reset();
+		m_driver->cleanup(); // Swap chain, device, surface and instance
+		m_driver.reset();
 
 		// GLFW cleanup
-		glfwDestroyWindow(m_window);
-		glfwTerminate();
+		if (!m_headless) {
+			glfwDestroyWindow(m_window);
+			glfwTerminate();
+		}
 	}
 };
 
-int main() {
-	TriangleApplication app;
+/// Render `frameCount` frames of the GUI with the software driver, needing no GPU, and write each one out like
+/// headless mode does. The scene's shaders only run on the GPU, so only the GUI is drawn.
+void renderSoftware(uint32_t frameCount, const std::string& outputPrefix) {
+	SoftwareDriver driver(WIDTH, HEIGHT);
+	driver.init();
+	GuiAtlas atlas;
+	GuiBatch batch(atlas);
+	std::vector<GuiVertex> vertices;
+	const std::vector<DriverRect> whole = {{0, 0, WIDTH, HEIGHT}};
+
+	FrameTimeHistogram frame_times;
+	for (uint32_t frame = 0; frame < frameCount; frame++) {
+		const auto start = std::chrono::steady_clock::now();
+		VIPER_PROFILE_ZONE("renderSoftware frame");
+		buildGui(batch, (float) WIDTH, (float) HEIGHT);
+		vertices.resize(batch.vertexCount());
+		const std::vector<GuiDraw>& draws = batch.build(vertices.data());
+		driver.updateAtlas(atlas);
+
+		SoftwareCommands commands = driver.commands(vertices.data());
+		commands.clear(whole, BACKGROUND_COLOR.float32);
+		drawGui(commands, draws, whole);
+		frame_times.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		char number[16];
+		snprintf(number, sizeof(number), "%04u", frame);
+		writePpm(outputPrefix + number + ".ppm", driver.pixels(), driver.width(), driver.height());
+		if (Profiler::enabled()) Profiler::collect();
+	}
+
+	frame_times.print(std::cout, "software frame");
+	driver.cleanup();
+}
+
+int main(int argc, char** argv) {
+	bool headless = false;
+	bool software = false;
+	uint32_t frame_count = 1;
+	std::string output_prefix = "frame_";
+	std::string trace_path; // Empty unless profiling
+	uint32_t play_numerator = 0; // Frame rate to play at from the start, if any
+	uint32_t play_denominator = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--software") {
+			software = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			frame_count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--output" && i + 1 < argc) {
+			output_prefix = argv[++i];
+		} else if (arg == "--trace" && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (arg == "--play" && i + 1 < argc) { // Frames per second, such as 24 or 30000/1001
+			char* slash;
+			play_numerator = static_cast<uint32_t>(std::strtoul(argv[++i], &slash, 10));
+			play_denominator = *slash == '/' ? static_cast<uint32_t>(std::strtoul(slash + 1, nullptr, 10)) : 1;
+		} else {
+			std::cerr << "usage: " << argv[0] << " [--headless | --software [--frames N] [--output PREFIX]] [--play FPS] [--trace FILE]"
+			          << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!trace_path.empty()) {
+		if (VIPER_PROFILER) {
+			Profiler::start(); // Before initialization, so startup is traced too
+		} else {
+			std::cerr << "--trace: the profiler is compiled out of this build (configure with -DVIPER_PROFILE_RELEASE=ON)" << std::endl;
+		}
+	}
 
 	try {
-		app.run();
+		if (software) {
+			renderSoftware(frame_count, output_prefix);
+		} else {
+			TriangleApplication app(headless, frame_count, output_prefix);
+			if (play_numerator != 0 && play_denominator != 0) app.playOnStart(play_numerator, play_denominator);
+			app.run();
+		}
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
 
+	if (Profiler::enabled()) {
+		Profiler::stop();
+		if (!Profiler::writeChromeTrace(trace_path)) {
+			std::cerr << "failed to write trace to " << trace_path << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (Profiler::droppedEvents() > 0) std::cerr << Profiler::droppedEvents() << " profiler events were dropped" << std::endl;
+	}
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,99 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open file '" + path + "'!");
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	m_file = file;
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0) return; // Empty files cannot be mapped, but are valid
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		unmap();
+		throw std::runtime_error("failed to map file '" + path + "'!");
+	}
+	m_mapping = mapping;
+	m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		unmap();
+		throw std::runtime_error("failed to map file '" + path + "'!");
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("failed to open file '" + path + "'!");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("failed to stat file '" + path + "'!");
+	}
+	m_size = static_cast<size_t>(st.st_size);
+
+	if (m_size != 0) { // Empty files cannot be mapped, but are valid
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("failed to map file '" + path + "'!");
+		}
+		madvise(data, m_size, MADV_SEQUENTIAL); // We read front to back; let the kernel read ahead aggressively
+		m_data = static_cast<const char*>(data);
+	}
+	close(fd); // The mapping keeps its own reference to the file
+#endif
+}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		unmap();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+		m_file = std::exchange(other.m_file, nullptr);
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+void MappedFile::unmap() {
+#ifdef _WIN32
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file) CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
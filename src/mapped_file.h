@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/// A read-only memory mapping of a whole file. The contents stay valid for as long as the object lives.
+class MappedFile {
+public:
+	MappedFile() = default;
+	/// Map `path` into memory. Throws std::runtime_error if the file cannot be opened or mapped.
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	std::string_view view() const { return {m_data, m_size}; }
+
+private:
+	void unmap();
+
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,403 @@
+#include "overview_cache.h"
+
+#include "audio_engine.h"
+#include "paths.h"
+#include "project.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A sidecar: this header, `levelCount` SidecarLevels, then each level's data at its offset. Little-endian as
+// written by this machine, and mapped as is.
+struct SidecarHeader {
+	char magic[4];       // "VWPK" for waveforms, "VTHB" for thumbnails
+	uint32_t version;
+	uint32_t levelCount;
+	uint32_t sampleRate; // Waveforms
+	uint32_t width;      // Thumbnails
+	uint32_t height;
+	int64_t frameCount;
+};
+
+struct SidecarLevel {
+	int64_t framesPer;
+	uint64_t count;
+	uint64_t offset;
+};
+
+constexpr char WAVEFORM_MAGIC[4] = {'V', 'W', 'P', 'K'};
+constexpr char THUMBNAIL_MAGIC[4] = {'V', 'T', 'H', 'B'};
+constexpr uint32_t SIDECAR_VERSION = 1;
+constexpr size_t AUDIO_CHUNK_PEAKS = 256; // Peaks' worth of audio decoded at a time
+
+/// Check the header and level table of a mapped sidecar against the file's size. Throws if they do not fit.
+std::vector<SidecarLevel> readLevels(const MappedFile& file, const char (&magic)[4], size_t itemSize, SidecarHeader& header) {
+	if (file.size() < sizeof(header)) throw std::runtime_error("sidecar is truncated!");
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != SIDECAR_VERSION) {
+		throw std::runtime_error("not a sidecar of this version!");
+	}
+	if (header.levelCount == 0 || header.levelCount > 64 || sizeof(header) + header.levelCount * sizeof(SidecarLevel) > file.size()) {
+		throw std::runtime_error("sidecar level table is damaged!");
+	}
+
+	std::vector<SidecarLevel> levels(header.levelCount);
+	std::memcpy(levels.data(), file.data() + sizeof(header), levels.size() * sizeof(SidecarLevel));
+	for (const SidecarLevel& level : levels) {
+		if (level.framesPer <= 0 || level.offset > file.size() || level.count > (file.size() - level.offset) / itemSize) {
+			throw std::runtime_error("sidecar level is out of bounds!");
+		}
+	}
+	return levels;
+}
+
+/// The sizes of the levels of a pyramid whose level 0 has `count` items, each level half the one below.
+std::vector<uint64_t> pyramidCounts(uint64_t count) {
+	std::vector<uint64_t> counts = {count};
+	while (counts.back() > 1) counts.push_back((counts.back() + 1) / 2);
+	return counts;
+}
+
+int16_t quantize(float sample, bool roundUp) {
+	const float scaled = std::clamp(sample, -1.0f, 1.0f) * 32767.0f;
+	return static_cast<int16_t>(roundUp ? std::ceil(scaled) : std::floor(scaled));
+}
+
+} // namespace
+
+WaveformPeaks::WaveformPeaks(const std::string& path) : m_file(path) {
+	SidecarHeader header;
+	for (const SidecarLevel& level : readLevels(m_file, WAVEFORM_MAGIC, 2 * sizeof(Peak), header)) {
+		m_levels.push_back({level.framesPer, size_t(level.count), reinterpret_cast<const Peak*>(m_file.data() + level.offset)});
+	}
+	m_sampleRate = header.sampleRate;
+	m_frameCount = header.frameCount;
+}
+
+uint32_t WaveformPeaks::levelFor(double framesPerColumn) const {
+	uint32_t level = 0;
+	while (level + 1 < m_levels.size() && double(m_levels[level + 1].framesPer) <= framesPerColumn) level++;
+	return level;
+}
+
+void WaveformPeaks::columns(int64_t first, int64_t end, size_t columns, Peak* out) const {
+	std::fill(out, out + 2 * columns, Peak{0, 0});
+	if (columns == 0 || end <= first) return;
+
+	const int64_t length = end - first;
+	const Level& level = m_levels[levelFor(double(length) / double(columns))];
+	for (size_t c = 0; c < columns; c++) {
+		const int64_t column_first = std::max<int64_t>(first + length * int64_t(c) / int64_t(columns), 0);
+		const int64_t column_end = std::max(first + length * int64_t(c + 1) / int64_t(columns), column_first + 1);
+		const size_t peak_first = size_t(column_first / level.framesPer);
+		const size_t peak_end = std::min(size_t((column_end + level.framesPer - 1) / level.framesPer), level.count);
+		if (peak_first >= peak_end) continue;
+
+		Peak left = level.peaks[2 * peak_first];
+		Peak right = level.peaks[2 * peak_first + 1];
+		for (size_t i = peak_first + 1; i < peak_end; i++) {
+			left = {std::min(left.min, level.peaks[2 * i].min), std::max(left.max, level.peaks[2 * i].max)};
+			right = {std::min(right.min, level.peaks[2 * i + 1].min), std::max(right.max, level.peaks[2 * i + 1].max)};
+		}
+		out[2 * c] = left;
+		out[2 * c + 1] = right;
+	}
+}
+
+ThumbnailStrip::ThumbnailStrip(const std::string& path) : m_file(path) {
+	SidecarHeader header;
+	std::memcpy(&header, m_file.data(), std::min(m_file.size(), sizeof(header)));
+	const size_t thumbnail_size = size_t(header.width) * header.height * 4;
+	if (m_file.size() < sizeof(header) || thumbnail_size == 0) throw std::runtime_error("thumbnail sidecar is damaged!");
+
+	for (const SidecarLevel& level : readLevels(m_file, THUMBNAIL_MAGIC, thumbnail_size, header)) {
+		m_levels.push_back({level.framesPer, size_t(level.count), reinterpret_cast<const uint8_t*>(m_file.data() + level.offset)});
+	}
+	m_width = header.width;
+	m_height = header.height;
+	m_frameCount = header.frameCount;
+}
+
+const uint8_t* ThumbnailStrip::thumbnail(uint32_t level, int64_t frame) const {
+	const Level& l = m_levels[level];
+	if (l.count == 0) return nullptr;
+	const size_t index = size_t(std::clamp<int64_t>(frame / l.framesPer, 0, int64_t(l.count) - 1));
+	return l.pixels + index * thumbnailSize();
+}
+
+uint32_t ThumbnailStrip::levelFor(double framesPerTile) const {
+	uint32_t level = 0;
+	while (level + 1 < m_levels.size() && double(m_levels[level + 1].framesPer) <= framesPerTile) level++;
+	return level;
+}
+
+OverviewCache::OverviewCache(FrameDecoder video, AudioDecoder& audio, std::string directory, OverviewSettings settings)
+	: m_video(std::move(video)), m_audio(audio), m_directory(std::move(directory)), m_settings(settings) {
+	std::error_code ec;
+	fs::create_directories(m_directory, ec);
+	m_builder = std::thread([this]() { builderLoop(); });
+}
+
+OverviewCache::~OverviewCache() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_buildQueue.clear();
+	}
+	m_cancel = true;
+	m_queued.notify_all();
+	m_builder.join();
+}
+
+std::string OverviewCache::defaultDirectory() {
+	return joinPath(cacheDirectory(), "overviews");
+}
+
+void OverviewCache::update(const ResourceRegistry& registry, const Project& project) {
+	enum : uint8_t { USED_BY_AUDIO = 1, USED_BY_VIDEO = 2 };
+	std::vector<uint8_t> uses(project.resources.size(), 0);
+	for (const Track& track : project.tracks) {
+		for (const Segment& segment : track.segments) {
+			if (segment.resource < uses.size()) uses[segment.resource] |= track.kind == TrackKind::Audio ? USED_BY_AUDIO : USED_BY_VIDEO;
+		}
+	}
+
+	std::vector<ResourceInfo> resources(std::min(registry.size(), uses.size()));
+	for (size_t i = 0; i < resources.size(); i++) resources[i] = registry.info(i);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_resourceWaveforms.assign(resources.size(), {});
+	m_resourceThumbnails.assign(resources.size(), {});
+	for (size_t i = 0; i < resources.size(); i++) {
+		const MediaInfo& media = resources[i].media;
+		if (resources[i].status != ResourceStatus::Ready) continue;
+
+		char name[64];
+		if (uses[i] & USED_BY_AUDIO) {
+			std::snprintf(name, sizeof(name), "%016" PRIx64 "_%u.peaks", media.contentHash, m_settings.framesPerPeak);
+			m_resourceWaveforms[i] = joinPath(m_directory, name);
+			request(m_resourceWaveforms[i], Kind::Waveform, static_cast<uint32_t>(i));
+		}
+		if ((uses[i] & USED_BY_VIDEO) && media.frameCount > 0 && media.width > 0 && media.height > 0) {
+			const uint32_t height = std::max(1u, m_settings.thumbnailHeight);
+			const uint32_t width = std::max(1u, static_cast<uint32_t>(double(media.width) * height / media.height + 0.5));
+			std::snprintf(name, sizeof(name), "%016" PRIx64 "_%up_%u.thumbs", media.contentHash, height, m_settings.framesPerThumbnail);
+			m_resourceThumbnails[i] = joinPath(m_directory, name);
+			request(m_resourceThumbnails[i], Kind::Thumbnails, static_cast<uint32_t>(i), media.frameCount, width, height);
+		}
+	}
+	m_queued.notify_all();
+}
+
+void OverviewCache::request(const std::string& path, Kind kind, uint32_t resource, int64_t frameCount, uint32_t width, uint32_t height) {
+	auto [it, inserted] = m_sidecars.try_emplace(path);
+	it->second.sourceResource = resource; // Resource indices change when another project is opened
+	if (!inserted) return;
+
+	it->second.kind = kind;
+	it->second.frameCount = frameCount;
+	it->second.width = width;
+	it->second.height = height;
+
+	if (!open(path, it->second)) { // Built earlier, possibly for another project, unless this fails
+		it->second.queued = true;
+		m_buildQueue.push_back(path);
+	}
+}
+
+bool OverviewCache::open(const std::string& path, Sidecar& sidecar) {
+	std::error_code ec;
+	if (!fs::is_regular_file(path, ec)) return false;
+	try {
+		if (sidecar.kind == Kind::Waveform) sidecar.waveform = std::make_shared<WaveformPeaks>(path);
+		else sidecar.thumbnails = std::make_shared<ThumbnailStrip>(path);
+		return true;
+	} catch (const std::exception&) { // Damaged or from another version: build it again
+		return false;
+	}
+}
+
+std::shared_ptr<const WaveformPeaks> OverviewCache::waveform(uint32_t resource) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (resource >= m_resourceWaveforms.size() || m_resourceWaveforms[resource].empty()) return nullptr;
+	return m_sidecars.at(m_resourceWaveforms[resource]).waveform;
+}
+
+std::shared_ptr<const ThumbnailStrip> OverviewCache::thumbnails(uint32_t resource) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (resource >= m_resourceThumbnails.size() || m_resourceThumbnails[resource].empty()) return nullptr;
+	return m_sidecars.at(m_resourceThumbnails[resource]).thumbnails;
+}
+
+size_t OverviewCache::pending() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t count = 0;
+	for (const auto& entry : m_sidecars) count += entry.second.queued;
+	return count;
+}
+
+void OverviewCache::builderLoop() {
+	for (;;) {
+		std::string path;
+		Sidecar sidecar;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this]() { return m_stopping || !m_buildQueue.empty(); });
+			if (m_stopping) return;
+			path = std::move(m_buildQueue.front());
+			m_buildQueue.pop_front();
+			sidecar = m_sidecars.at(path);
+		}
+
+		try {
+			if (sidecar.kind == Kind::Waveform) buildWaveform(path, sidecar);
+			else buildThumbnails(path, sidecar);
+			open(path, sidecar);
+		} catch (const std::exception&) { // Undecodable or cancelled; the timeline draws the clip without one
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Sidecar& entry = m_sidecars.at(path);
+		entry.queued = false;
+		entry.waveform = sidecar.waveform;
+		entry.thumbnails = sidecar.thumbnails;
+	}
+}
+
+void OverviewCache::buildWaveform(const std::string& path, const Sidecar& sidecar) {
+	const uint32_t sample_rate = m_audio.sampleRate(sidecar.sourceResource);
+	if (sample_rate == 0) throw std::runtime_error("resource has no audio!");
+
+	// Level 0 straight from the decoder, a chunk of whole peaks at a time
+	const size_t frames_per_peak = std::max(1u, m_settings.framesPerPeak);
+	const size_t chunk_frames = frames_per_peak * AUDIO_CHUNK_PEAKS;
+	std::vector<float> samples(2 * chunk_frames);
+	std::vector<Peak> level_zero;
+	int64_t frame_count = 0;
+	for (;;) {
+		if (m_cancel) throw std::runtime_error("waveform build cancelled");
+		const size_t decoded = std::min(chunk_frames, m_audio.decode(sidecar.sourceResource, frame_count, samples.data(), chunk_frames));
+		for (size_t first = 0; first < decoded; first += frames_per_peak) {
+			const size_t end = std::min(first + frames_per_peak, decoded);
+			float low[2] = {samples[2 * first], samples[2 * first + 1]};
+			float high[2] = {low[0], low[1]};
+			for (size_t i = first + 1; i < end; i++) {
+				for (int c = 0; c < 2; c++) {
+					low[c] = std::min(low[c], samples[2 * i + c]);
+					high[c] = std::max(high[c], samples[2 * i + c]);
+				}
+			}
+			for (int c = 0; c < 2; c++) level_zero.push_back({quantize(low[c], false), quantize(high[c], true)});
+		}
+		frame_count += int64_t(decoded);
+		if (decoded < chunk_frames) break;
+	}
+
+	const std::vector<uint64_t> counts = pyramidCounts(level_zero.size() / 2);
+	SidecarHeader header = {};
+	std::memcpy(header.magic, WAVEFORM_MAGIC, sizeof(header.magic));
+	header.version = SIDECAR_VERSION;
+	header.levelCount = static_cast<uint32_t>(counts.size());
+	header.sampleRate = sample_rate;
+	header.frameCount = frame_count;
+
+	std::vector<SidecarLevel> levels(counts.size());
+	uint64_t offset = sizeof(header) + levels.size() * sizeof(SidecarLevel);
+	for (size_t l = 0; l < levels.size(); l++) {
+		levels[l] = {int64_t(frames_per_peak) << l, counts[l], offset};
+		offset += counts[l] * 2 * sizeof(Peak);
+	}
+
+	std::vector<char> file(offset);
+	std::memcpy(file.data(), &header, sizeof(header));
+	std::memcpy(file.data() + sizeof(header), levels.data(), levels.size() * sizeof(SidecarLevel));
+	auto* peaks = reinterpret_cast<Peak*>(file.data() + levels[0].offset);
+	std::copy(level_zero.begin(), level_zero.end(), peaks);
+
+	// Each level above merges pairs of the one below; an odd last peak is carried up alone
+	for (size_t l = 1; l < levels.size(); l++) {
+		const Peak* below = reinterpret_cast<const Peak*>(file.data() + levels[l - 1].offset);
+		auto* level = reinterpret_cast<Peak*>(file.data() + levels[l].offset);
+		for (uint64_t i = 0; i < counts[l]; i++) {
+			for (int c = 0; c < 2; c++) {
+				Peak merged = below[4 * i + c];
+				if (2 * i + 1 < counts[l - 1]) {
+					const Peak& other = below[4 * i + 2 + c];
+					merged = {std::min(merged.min, other.min), std::max(merged.max, other.max)};
+				}
+				level[2 * i + c] = merged;
+			}
+		}
+	}
+
+	if (!writeFileAtomically(path, file.data(), file.size())) throw std::runtime_error("failed to write waveform sidecar!");
+}
+
+void OverviewCache::buildThumbnails(const std::string& path, const Sidecar& sidecar) {
+	const int64_t frames_per = std::max(1u, m_settings.framesPerThumbnail);
+	const std::vector<uint64_t> counts = pyramidCounts(uint64_t((sidecar.frameCount + frames_per - 1) / frames_per));
+	const size_t thumbnail_size = size_t(sidecar.width) * sidecar.height * 4;
+
+	SidecarHeader header = {};
+	std::memcpy(header.magic, THUMBNAIL_MAGIC, sizeof(header.magic));
+	header.version = SIDECAR_VERSION;
+	header.levelCount = static_cast<uint32_t>(counts.size());
+	header.width = sidecar.width;
+	header.height = sidecar.height;
+	header.frameCount = sidecar.frameCount;
+
+	std::vector<SidecarLevel> levels(counts.size());
+	uint64_t offset = sizeof(header) + levels.size() * sizeof(SidecarLevel);
+	for (size_t l = 0; l < levels.size(); l++) {
+		levels[l] = {frames_per << l, counts[l], offset};
+		offset += counts[l] * thumbnail_size;
+	}
+
+	// Thumbnails are too many to hold, so level 0 streams to the file and the levels above are copied back out of
+	// it: thumbnail i of level l is thumbnail i << l of level 0
+	const std::string temp_path = path + ".part";
+	try {
+		std::fstream file(temp_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) throw std::runtime_error("failed to create '" + temp_path + "'!");
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(SidecarLevel)));
+
+		for (uint64_t i = 0; i < counts[0]; i++) {
+			if (m_cancel) throw std::runtime_error("thumbnail build cancelled");
+			const DecodedFrame frame = m_video({sidecar.sourceResource, int64_t(i) * frames_per});
+			if (frame.format != PixelFormat::Rgba8) throw std::runtime_error("thumbnail sources must decode to RGBA8!");
+			const DecodedFrame thumbnail = downscaleRgba8(frame, sidecar.width, sidecar.height);
+			file.write(reinterpret_cast<const char*>(thumbnail.pixels.data()), static_cast<std::streamsize>(thumbnail_size));
+		}
+
+		std::vector<char> thumbnail(thumbnail_size);
+		for (size_t l = 1; l < levels.size(); l++) {
+			for (uint64_t i = 0; i < counts[l]; i++) {
+				file.seekg(static_cast<std::streamoff>(levels[0].offset + (i << l) * thumbnail_size));
+				file.read(thumbnail.data(), static_cast<std::streamsize>(thumbnail_size));
+				file.seekp(static_cast<std::streamoff>(levels[l].offset + i * thumbnail_size));
+				file.write(thumbnail.data(), static_cast<std::streamsize>(thumbnail_size));
+			}
+		}
+
+		file.close();
+		if (file.fail()) throw std::runtime_error("failed to write thumbnail sidecar!");
+		fs::rename(temp_path, path);
+	} catch (...) {
+		std::error_code ec;
+		fs::remove(temp_path, ec);
+		throw;
+	}
+}
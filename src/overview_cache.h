@@ -0,0 +1,182 @@
+#pragma once
+
+#include "frame_cache.h"
+#include "mapped_file.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class AudioDecoder;
+class ResourceRegistry;
+struct Project;
+
+/// The lowest and highest sample of one channel over a run of frames, at 16 bits (full scale is ±32767).
+struct Peak {
+	int16_t min;
+	int16_t max;
+};
+
+/// A memory-mapped waveform sidecar: min/max peaks of a stereo audio resource at a pyramid of resolutions.
+///
+/// Level 0 has one peak per channel for every framesPerPeak(0) audio frames; each level above merges pairs of
+/// the one below, up to a single peak for the whole resource. Peaks are stored per level as [index][channel].
+class WaveformPeaks {
+public:
+	/// Map the sidecar at `path`. Throws std::runtime_error if it is missing, damaged or of another version.
+	explicit WaveformPeaks(const std::string& path);
+
+	uint32_t sampleRate() const { return m_sampleRate; }
+	int64_t frameCount() const { return m_frameCount; }
+	uint32_t levelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+	int64_t framesPerPeak(uint32_t level) const { return m_levels[level].framesPer; }
+	size_t peakCount(uint32_t level) const { return m_levels[level].count; }
+	/// Level `level`'s peaks, two (left, right) per index.
+	const Peak* peaks(uint32_t level) const { return m_levels[level].peaks; }
+
+	/// The coarsest level whose peaks are no wider than `framesPerColumn`.
+	uint32_t levelFor(double framesPerColumn) const;
+
+	/// Reduce audio frames [first, end) to `columns` left/right peak pairs in `out` (2 * columns of them), as a
+	/// waveform drawn `columns` pixels wide. Reads a couple of peaks per column from the level levelFor() picks,
+	/// so the cost depends on the width drawn, not on the length of the range.
+	void columns(int64_t first, int64_t end, size_t columns, Peak* out) const;
+
+private:
+	struct Level {
+		int64_t framesPer;
+		size_t count;
+		const Peak* peaks;
+	};
+
+	MappedFile m_file;
+	uint32_t m_sampleRate = 0;
+	int64_t m_frameCount = 0;
+	std::vector<Level> m_levels;
+};
+
+/// A memory-mapped thumbnail sidecar: small RGBA8 pictures of a video resource at a pyramid of spacings.
+///
+/// Level 0 has one thumbnail every framesPerThumbnail(0) frames; each level above keeps every other thumbnail of
+/// the one below. A level's thumbnails are stored one after another, which makes the level an atlas: a single
+/// image width() pixels wide and thumbnailCount(level) × height() tall that can be uploaded in one go.
+class ThumbnailStrip {
+public:
+	/// Map the sidecar at `path`. Throws std::runtime_error if it is missing, damaged or of another version.
+	explicit ThumbnailStrip(const std::string& path);
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	size_t thumbnailSize() const { return size_t(m_width) * m_height * 4; }
+	int64_t frameCount() const { return m_frameCount; }
+	uint32_t levelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+	int64_t framesPerThumbnail(uint32_t level) const { return m_levels[level].framesPer; }
+	size_t thumbnailCount(uint32_t level) const { return m_levels[level].count; }
+
+	/// Level `level`'s atlas.
+	const uint8_t* atlas(uint32_t level) const { return m_levels[level].pixels; }
+	/// The thumbnail showing `frame` (the last one at or before it) at `level`.
+	const uint8_t* thumbnail(uint32_t level, int64_t frame) const;
+
+	/// The coarsest level with a thumbnail at least every `framesPerTile` frames.
+	uint32_t levelFor(double framesPerTile) const;
+
+private:
+	struct Level {
+		int64_t framesPer;
+		size_t count;
+		const uint8_t* pixels;
+	};
+
+	MappedFile m_file;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	int64_t m_frameCount = 0;
+	std::vector<Level> m_levels;
+};
+
+struct OverviewSettings {
+	uint32_t framesPerPeak = 256;       // Audio frames per level 0 peak
+	uint32_t framesPerThumbnail = 30;   // Video frames between level 0 thumbnails
+	uint32_t thumbnailHeight = 54;      // The width follows the video's aspect ratio
+};
+
+/// Waveforms for a project's audio resources and thumbnail strips for its video resources, built in the
+/// background and kept as sidecar files for the timeline to draw from.
+///
+/// update() looks at which resources the project's audio and video tracks use, and queues a sidecar for each
+/// that has none yet. Sidecars live in the cache directory named after the resource's content hash, like proxies,
+/// so they survive moves and are shared between projects. They are written to a temporary file and renamed into
+/// place when complete. One thread builds them one at a time: waveforms by streaming the audio through the
+/// decoder, thumbnail strips by decoding one frame per level 0 thumbnail.
+class OverviewCache {
+public:
+	/// `audio` is only called from the cache's own thread, so it must not be shared with an AudioEngine.
+	OverviewCache(FrameDecoder video, AudioDecoder& audio, std::string directory = defaultDirectory(), OverviewSettings settings = {});
+	/// Abandons the running build and whatever is queued.
+	~OverviewCache();
+
+	OverviewCache(const OverviewCache&) = delete;
+	OverviewCache& operator=(const OverviewCache&) = delete;
+
+	/// Queue sidecars for what `project` uses, from what `registry` has probed so far. Call again as probes finish.
+	void update(const ResourceRegistry& registry, const Project& project);
+
+	/// The waveform of project resource `resource`, or null while it is being built (or cannot be).
+	std::shared_ptr<const WaveformPeaks> waveform(uint32_t resource) const;
+	/// The thumbnail strip of project resource `resource`, or null while it is being built (or cannot be).
+	std::shared_ptr<const ThumbnailStrip> thumbnails(uint32_t resource) const;
+	/// Sidecars queued or being built.
+	size_t pending() const;
+
+	/// "overviews" in the cache directory.
+	static std::string defaultDirectory();
+
+private:
+	enum class Kind { Waveform, Thumbnails };
+
+	struct Sidecar {
+		Kind kind;
+		uint32_t sourceResource; // A resource with this content, for the decoders
+		int64_t frameCount;      // Of the video; audio is read until it ends
+		uint32_t width;          // Thumbnail size
+		uint32_t height;
+		bool queued = false;     // Waiting for or being built; a build that fails leaves no sidecar
+		std::shared_ptr<const WaveformPeaks> waveform;
+		std::shared_ptr<const ThumbnailStrip> thumbnails;
+	};
+
+	FrameDecoder m_video;
+	AudioDecoder& m_audio;
+	std::string m_directory;
+	OverviewSettings m_settings;
+
+	mutable std::mutex m_mutex; // Guards everything below
+	std::condition_variable m_queued;
+	std::unordered_map<std::string, Sidecar> m_sidecars; // By path
+	std::vector<std::string> m_resourceWaveforms;        // Sidecar path per project resource; empty if none
+	std::vector<std::string> m_resourceThumbnails;
+	std::deque<std::string> m_buildQueue;
+	bool m_stopping = false;
+
+	std::atomic<bool> m_cancel{false}; // Abandon the running build
+	std::thread m_builder;
+
+	/// Find or queue the sidecar at `path`. Called with m_mutex held.
+	void request(const std::string& path, Kind kind, uint32_t resource, int64_t frameCount = 0, uint32_t width = 0, uint32_t height = 0);
+	/// Map the finished sidecar at `path` into `sidecar`. Returns false if it is not there or unusable.
+	static bool open(const std::string& path, Sidecar& sidecar);
+
+	void builderLoop();
+	/// Write the sidecar at `path`, throwing on failure. Called without m_mutex held.
+	void buildWaveform(const std::string& path, const Sidecar& sidecar);
+	void buildThumbnails(const std::string& path, const Sidecar& sidecar);
+};
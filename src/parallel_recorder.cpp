@@ -0,0 +1,131 @@
+#include "parallel_recorder.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+// A single layer has nothing to overlap with. From two on, the GUI layer (by far the longest to record)
+// overlaps the others, which is what the app's three layers need.
+const size_t MIN_PARALLEL_LAYERS = 2;
+
+ParallelRecorder::ParallelRecorder(VkDevice device, uint32_t queueFamily, ThreadPool& pool, uint32_t framesInFlight)
+	: m_device(device), m_threads(pool), m_threadSlots(static_cast<uint32_t>(pool.size()) + 1) {
+	m_pools.resize(static_cast<size_t>(framesInFlight) * m_threadSlots);
+
+	for (auto& state : m_pools) {
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Buffers only live for one frame
+		pool_info.queueFamilyIndex = queueFamily;
+
+		if (vkCreateCommandPool(m_device, &pool_info, nullptr, &state.pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
+}
+
+ParallelRecorder::~ParallelRecorder() {
+	for (auto& state : m_pools) {
+		vkDestroyCommandPool(m_device, state.pool, nullptr); // Frees its command buffers too
+	}
+}
+
+void ParallelRecorder::beginFrame(uint32_t frameSlot) {
+	m_currentFrame = frameSlot;
+	for (uint32_t t = 0; t < m_threadSlots; t++) {
+		ThreadPoolState& state = m_pools[static_cast<size_t>(frameSlot) * m_threadSlots + t];
+		if (state.used == 0) continue; // Nothing recorded from this pool last time
+		vkResetCommandPool(m_device, state.pool, 0);
+		state.used = 0;
+	}
+}
+
+VkCommandBuffer ParallelRecorder::recordLayer(const VkCommandBufferInheritanceInfo& inheritance, const LayerRecorder& layer) {
+	VIPER_PROFILE_ZONE("recordLayer");
+
+	// Workers use their own pool; the calling thread uses the extra last one
+	size_t thread = ThreadPool::workerIndex();
+	if (thread == ThreadPool::NOT_A_WORKER || thread >= m_threadSlots - 1) thread = m_threadSlots - 1;
+	ThreadPoolState& state = m_pools[static_cast<size_t>(m_currentFrame) * m_threadSlots + thread];
+
+	if (state.used == state.buffers.size()) {
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = state.pool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		alloc_info.commandBufferCount = 1;
+
+		VkCommandBuffer buffer;
+		if (vkAllocateCommandBuffers(m_device, &alloc_info, &buffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+		state.buffers.push_back(buffer);
+	}
+	VkCommandBuffer cmd = state.buffers[state.used++];
+
+	VkCommandBufferBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	begin_info.pInheritanceInfo = &inheritance;
+
+	if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording secondary command buffer!");
+	}
+	layer(cmd);
+	if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record secondary command buffer!");
+	}
+	return cmd;
+}
+
+void ParallelRecorder::record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, const std::vector<LayerRecorder>& layers) {
+	if (layers.empty()) return;
+	m_recorded.resize(layers.size());
+
+	if (layers.size() < MIN_PARALLEL_LAYERS || m_threads.size() == 0) {
+		for (size_t i = 0; i < layers.size(); i++) {
+			m_recorded[i] = recordLayer(inheritance, layers[i]);
+		}
+	} else {
+		// Deal layers out in contiguous runs, one per thread, so each thread touches only its own pool. The
+		// calling thread records the last run itself rather than idling.
+		const size_t runs = std::min<size_t>(m_threadSlots, layers.size());
+		auto record_run = [this, &inheritance, &layers, runs](size_t run) {
+			const size_t first = layers.size() * run / runs;
+			const size_t last = layers.size() * (run + 1) / runs;
+			for (size_t i = first; i < last; i++) {
+				m_recorded[i] = recordLayer(inheritance, layers[i]);
+			}
+		};
+
+		std::vector<std::future<void>> jobs;
+		jobs.reserve(runs - 1);
+		std::exception_ptr caller_error;
+		try {
+			for (size_t run = 0; run + 1 < runs; run++) {
+				jobs.push_back(m_threads.submit([&record_run, run]() { record_run(run); }));
+			}
+			record_run(runs - 1);
+		} catch (...) {
+			caller_error = std::current_exception();
+		}
+
+		// Every job references `inheritance`, `layers` and `record_run`, so all must finish before anything is rethrown
+		std::exception_ptr error;
+		for (auto& job : jobs) {
+			try {
+				job.get();
+			} catch (...) {
+				if (!error) error = std::current_exception();
+			}
+		}
+		if (!error) error = caller_error; // Report the error of the earliest failing run
+		if (error) std::rethrow_exception(error);
+	}
+
+	// Composite order is the layer order, not completion order
+	vkCmdExecuteCommands(primary, static_cast<uint32_t>(m_recorded.size()), m_recorded.data());
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+/// Records one secondary command buffer's worth of commands, e.g. one composited layer or effect pass.
+using LayerRecorder = std::function<void(VkCommandBuffer)>;
+
+/// Records the layers of a frame in parallel into secondary command buffers.
+///
+/// Every (frame in flight, thread) pair owns a command pool, so workers never share a pool and never lock.
+/// At the start of a frame the slot's pools are reset as a whole, which recycles their command buffers
+/// without freeing them. The secondary buffers are then executed from the primary buffer in layer order,
+/// regardless of which thread finished first.
+class ParallelRecorder {
+public:
+	ParallelRecorder(VkDevice device, uint32_t queueFamily, ThreadPool& pool, uint32_t framesInFlight);
+	~ParallelRecorder();
+
+	ParallelRecorder(const ParallelRecorder&) = delete;
+	ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+	/// Reset the pools of `frameSlot`. The GPU must be done with that slot's previous frame.
+	void beginFrame(uint32_t frameSlot);
+
+	/// Record `layers` into secondary buffers that continue the render pass described by `inheritance`, then
+	/// execute them into `primary` in order. The render pass must have been begun with
+	/// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Must not be called from one of the pool's own workers.
+	void record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, const std::vector<LayerRecorder>& layers);
+
+private:
+	struct ThreadPoolState {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers; // Allocated once, reused after each pool reset
+		size_t used = 0;
+	};
+
+	VkDevice m_device;
+	ThreadPool& m_threads;
+	uint32_t m_threadSlots; // Worker threads plus the calling thread
+	uint32_t m_currentFrame = 0;
+	std::vector<ThreadPoolState> m_pools; // [frame slot * m_threadSlots + thread]
+	std::vector<VkCommandBuffer> m_recorded;
+
+	VkCommandBuffer recordLayer(const VkCommandBufferInheritanceInfo& inheritance, const LayerRecorder& layer);
+};
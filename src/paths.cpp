@@ -0,0 +1,54 @@
+#include "paths.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+namespace {
+
+std::string findCacheDirectory() {
+	std::filesystem::path dir;
+#ifdef _WIN32
+	if (const char* local = std::getenv("LOCALAPPDATA")) dir = std::filesystem::path(local) / "Viper" / "cache";
+#else
+	if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) dir = std::filesystem::path(xdg) / "viper";
+	else if (const char* home = std::getenv("HOME")) dir = std::filesystem::path(home) / ".cache" / "viper";
+#endif
+	if (dir.empty()) return ".";
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	return ec ? std::string(".") : dir.string();
+}
+
+} // namespace
+
+const std::string& cacheDirectory() {
+	static const std::string dir = findCacheDirectory();
+	return dir;
+}
+
+std::string joinPath(const std::string& directory, const std::string& name) {
+	return (std::filesystem::path(directory) / name).string();
+}
+
+bool writeFileAtomically(const std::string& path, const void* data, size_t size) {
+	const std::string temp_path = path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		if (!file.good()) {
+			file.close();
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp_path, path, ec);
+	if (ec) std::remove(temp_path.c_str());
+	return !ec;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// The per-user directory Viper keeps caches in (pipeline caches, media indices, proxies, ...), created on
+/// first use: $XDG_CACHE_HOME/viper, ~/.cache/viper or %LOCALAPPDATA%\Viper\cache. Falls back to the working
+/// directory when none of those can be determined.
+const std::string& cacheDirectory();
+
+/// Join a directory and a file name with the platform's separator.
+std::string joinPath(const std::string& directory, const std::string& name);
+
+/// Write `size` bytes to `path` by writing a temporary file next to it and renaming it into place, so readers
+/// never see a partially written file. Returns false on failure, leaving any previous file intact.
+bool writeFileAtomically(const std::string& path, const void* data, size_t size);
@@ -0,0 +1,101 @@
+#include "pipeline_cache.h"
+#include "hash.h"
+#include "paths.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Our own wrapper around the driver's blob, so truncated or corrupted files never reach the driver
+struct FileHeader {
+	char magic[4];     // "VPLC"
+	uint32_t version;
+	uint64_t dataSize; // Size of the driver blob following this header
+	uint64_t checksum; // FNV-1a of the driver blob
+};
+
+constexpr char FILE_MAGIC[4] = {'V', 'P', 'L', 'C'};
+constexpr uint32_t FILE_VERSION = 1;
+
+// Layout of VkPipelineCacheHeaderVersionOne, the header every driver blob starts with
+struct VulkanCacheHeader {
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+} // namespace
+
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, std::string path)
+	: m_device(device), m_path(std::move(path)) {
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+	std::vector<char> blob;
+	std::ifstream file(m_path, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		const size_t file_size = static_cast<size_t>(file.tellg());
+		if (file_size > sizeof(FileHeader)) {
+			FileHeader header;
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 && header.version == FILE_VERSION
+				&& header.dataSize == file_size - sizeof(FileHeader)) {
+				blob.resize(header.dataSize);
+				file.read(blob.data(), static_cast<std::streamsize>(blob.size()));
+				if (!file.good() || fnv1a64(blob.data(), blob.size()) != header.checksum || !isCompatible(blob.data(), blob.size())) {
+					blob.clear();
+				}
+			}
+		}
+	}
+
+	VkPipelineCacheCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	create_info.initialDataSize = blob.size();
+	create_info.pInitialData = blob.empty() ? nullptr : blob.data();
+
+	if (vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+	m_loadedFromDisk = !blob.empty();
+}
+
+PipelineCache::~PipelineCache() {
+	vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+bool PipelineCache::isCompatible(const char* data, size_t size) const {
+	if (size < sizeof(VulkanCacheHeader)) return false;
+
+	VulkanCacheHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	return header.headerSize >= sizeof(VulkanCacheHeader)
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == m_properties.vendorID
+		&& header.deviceID == m_properties.deviceID
+		&& std::memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::save() const {
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(m_device, m_cache, &data_size, nullptr) != VK_SUCCESS) return false;
+
+	std::vector<char> file(sizeof(FileHeader) + data_size);
+	if (vkGetPipelineCacheData(m_device, m_cache, &data_size, file.data() + sizeof(FileHeader)) != VK_SUCCESS) return false;
+	file.resize(sizeof(FileHeader) + data_size); // The cache cannot shrink, but be exact anyway
+
+	FileHeader header;
+	std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	header.version = FILE_VERSION;
+	header.dataSize = data_size;
+	header.checksum = fnv1a64(file.data() + sizeof(FileHeader), data_size);
+	std::memcpy(file.data(), &header, sizeof(header));
+
+	return writeFileAtomically(m_path, file.data(), file.size());
+}
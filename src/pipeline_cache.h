@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+/// A VkPipelineCache that persists across runs.
+///
+/// The blob on disk is wrapped in a small header with a checksum, and the Vulkan cache header inside it is checked
+/// against the current device (vendor, device id and pipeline cache UUID) before being handed to the driver.
+/// Blobs from another GPU or driver version, or damaged ones, are ignored and the cache starts out empty.
+class PipelineCache {
+public:
+	PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, std::string path);
+	~PipelineCache();
+
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	VkPipelineCache handle() const { return m_cache; }
+
+	/// True if valid data from a previous run was loaded.
+	bool loadedFromDisk() const { return m_loadedFromDisk; }
+
+	/// Write the cache's current contents to disk. Returns false if that failed; the cache stays usable.
+	bool save() const;
+
+private:
+	VkDevice m_device;
+	VkPipelineCache m_cache = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_properties;
+	std::string m_path;
+	bool m_loadedFromDisk = false;
+
+	bool isCompatible(const char* data, size_t size) const;
+};
@@ -0,0 +1,280 @@
+#include "pipeline_registry.h"
+#include "hash.h"
+#include "thread_pool.h"
+
+#include <stdexcept>
+
+VkShaderModule createShaderModule(VkDevice device, const std::vector<char>& code) {
+	VkShaderModuleCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.codeSize = code.size();
+	create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shader_module;
+	if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create shader module!");
+	}
+	return shader_module;
+}
+
+namespace {
+
+VkPipeline compileGraphicsPipeline(VkDevice device, VkPipelineCache cache, const GraphicsPipelineDesc& desc) {
+	VkShaderModule vert_shader_module = createShaderModule(device, *desc.vertexShader);
+	VkShaderModule frag_shader_module = createShaderModule(device, *desc.fragmentShader);
+
+	VkPipelineShaderStageCreateInfo vert_shader_stage_info{}; // Vertex shader module info
+	vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vert_shader_stage_info.module = vert_shader_module;
+	vert_shader_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo frag_shader_stage_info{}; // Frag shader module info
+	frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	frag_shader_stage_info.module = frag_shader_module;
+	frag_shader_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
+
+	// Describes the format of the vertex data that will be passed to the vertex shader
+	VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+	vertex_input_info.pVertexBindingDescriptions = desc.vertexBindings.data();
+	vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+	vertex_input_info.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+	// What kind of geometry should be drawn from vertices
+	VkPipelineInputAssemblyStateCreateInfo input_asm{};
+	input_asm.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_asm.topology = desc.topology;
+	input_asm.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are set when recording, so one pipeline serves every target size
+	VkPipelineViewportStateCreateInfo viewport_state{};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state.viewportCount = 1;
+	viewport_state.scissorCount = 1;
+
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic_state{};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount = 2;
+	dynamic_state.pDynamicStates = dynamic_states;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE; // If true, it discards any output from reaching frame buffer
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL; // Determines how fragments are generated for geometry
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode; // Type of culling
+	rasterizer.frontFace = desc.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	// TODO: multisampling
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// TODO: depth buffering
+
+	// Alpha blending
+	VkPipelineColorBlendAttachmentState color_blend_attachment{};
+	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	color_blend_attachment.blendEnable = desc.blendEnable ? VK_TRUE : VK_FALSE;
+	color_blend_attachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+	color_blend_attachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+	color_blend_attachment.colorBlendOp = desc.colorBlendOp;
+	// Coverage accumulates as sa + da * (1 - sa) whatever the color blend, as in the CPU compositor
+	color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo color_blending{};
+	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending.logicOpEnable = VK_FALSE;
+	color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
+	color_blending.attachmentCount = 1;
+	color_blending.pAttachments = &color_blend_attachment;
+
+	VkGraphicsPipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = 2;
+	pipeline_info.pStages = shader_stages;
+	pipeline_info.pVertexInputState = &vertex_input_info;
+	pipeline_info.pInputAssemblyState = &input_asm;
+	pipeline_info.pViewportState = &viewport_state;
+	pipeline_info.pRasterizationState = &rasterizer;
+	pipeline_info.pMultisampleState = &multisampling;
+	pipeline_info.pColorBlendState = &color_blending;
+	pipeline_info.pDynamicState = &dynamic_state;
+	pipeline_info.layout = desc.layout;
+	pipeline_info.renderPass = desc.renderPass;
+	pipeline_info.subpass = desc.subpass;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &pipeline_info, nullptr, &pipeline);
+
+	// Modules are only needed while the pipeline is created
+	vkDestroyShaderModule(device, frag_shader_module, nullptr);
+	vkDestroyShaderModule(device, vert_shader_module, nullptr);
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	return pipeline;
+}
+
+VkPipeline compileComputePipeline(VkDevice device, VkPipelineCache cache, const ComputePipelineDesc& desc) {
+	VkShaderModule module = createShaderModule(device, *desc.shader);
+
+	std::vector<VkSpecializationMapEntry> constant_entries(desc.constants.size());
+	for (uint32_t i = 0; i < desc.constants.size(); i++) constant_entries[i] = {i, i * uint32_t(sizeof(uint32_t)), sizeof(uint32_t)};
+
+	VkSpecializationInfo specialization{};
+	specialization.mapEntryCount = static_cast<uint32_t>(constant_entries.size());
+	specialization.pMapEntries = constant_entries.data();
+	specialization.dataSize = desc.constants.size() * sizeof(uint32_t);
+	specialization.pData = desc.constants.data();
+
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.stage.pSpecializationInfo = desc.constants.empty() ? nullptr : &specialization;
+	pipeline_info.layout = desc.layout;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(device, cache, 1, &pipeline_info, nullptr, &pipeline);
+	vkDestroyShaderModule(device, module, nullptr); // Not needed once the pipeline exists
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+	return pipeline;
+}
+
+// Leads every description's bytes, so a graphics and a compute description never compare equal
+enum class PipelineKind : uint8_t { Graphics, Compute };
+
+template<typename T>
+void appendValue(std::string& out, const T& value) {
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/// Append `count` followed by the bytes of `data`, so neighbouring variable-length fields cannot run into each other.
+void appendSized(std::string& out, const void* data, size_t size, size_t count) {
+	appendValue(out, static_cast<uint64_t>(count));
+	out.append(static_cast<const char*>(data), size);
+}
+
+} // namespace
+
+std::string GraphicsPipelineDesc::bytes() const {
+	std::string out;
+	appendValue(out, PipelineKind::Graphics);
+	appendSized(out, vertexShader->data(), vertexShader->size(), vertexShader->size());
+	appendSized(out, fragmentShader->data(), fragmentShader->size(), fragmentShader->size());
+	appendValue(out, layout);
+	appendValue(out, renderPass);
+	appendValue(out, subpass);
+	// Both descriptions are plain 32-bit fields without padding
+	appendSized(out, vertexBindings.data(), vertexBindings.size() * sizeof(VkVertexInputBindingDescription), vertexBindings.size());
+	appendSized(out, vertexAttributes.data(), vertexAttributes.size() * sizeof(VkVertexInputAttributeDescription), vertexAttributes.size());
+	appendValue(out, topology);
+	appendValue(out, cullMode);
+	appendValue(out, frontFace);
+	appendValue(out, blendEnable);
+	appendValue(out, srcColorBlendFactor);
+	appendValue(out, dstColorBlendFactor);
+	appendValue(out, colorBlendOp);
+	return out;
+}
+
+uint64_t GraphicsPipelineDesc::hash() const {
+	return fnv1a64(bytes());
+}
+
+std::string ComputePipelineDesc::bytes() const {
+	std::string out;
+	appendValue(out, PipelineKind::Compute);
+	appendSized(out, shader->data(), shader->size(), shader->size());
+	appendValue(out, layout);
+	appendSized(out, constants.data(), constants.size() * sizeof(uint32_t), constants.size());
+	return out;
+}
+
+uint64_t ComputePipelineDesc::hash() const {
+	return fnv1a64(bytes());
+}
+
+PipelineRegistry::PipelineRegistry(VkDevice device, VkPipelineCache cache, ThreadPool& pool)
+	: m_device(device), m_cache(cache), m_pool(pool) {}
+
+PipelineRegistry::~PipelineRegistry() {
+	for (auto& entry : m_pipelines) {
+		try {
+			vkDestroyPipeline(m_device, entry.pipeline.get(), nullptr);
+		} catch (const std::exception&) {
+			// Compilation failed, so there is nothing to destroy
+		}
+	}
+}
+
+PipelineRegistry::Key PipelineRegistry::request(const GraphicsPipelineDesc& desc) {
+	VkDevice device = m_device;
+	VkPipelineCache cache = m_cache;
+	return request(desc.bytes(), [device, cache, desc]() { return compileGraphicsPipeline(device, cache, desc); });
+}
+
+PipelineRegistry::Key PipelineRegistry::request(const ComputePipelineDesc& desc) {
+	VkDevice device = m_device;
+	VkPipelineCache cache = m_cache;
+	return request(desc.bytes(), [device, cache, desc]() { return compileComputePipeline(device, cache, desc); });
+}
+
+PipelineRegistry::Key PipelineRegistry::request(std::string description, std::function<VkPipeline()> compile) {
+	const uint64_t hash = fnv1a64(description);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto [first, last] = m_index.equal_range(hash);
+	for (auto it = first; it != last; ++it) {
+		if (m_pipelines[it->second].description == description) return it->second;
+	}
+
+	const Key key = m_pipelines.size();
+	m_pipelines.push_back({std::move(description), m_pool.submit(std::move(compile)).share()});
+	m_index.emplace(hash, key);
+	return key;
+}
+
+VkPipeline PipelineRegistry::get(Key key) {
+	std::shared_future<VkPipeline> pipeline;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (key >= m_pipelines.size()) {
+			throw std::runtime_error("requested an unknown pipeline!");
+		}
+		pipeline = m_pipelines[key].pipeline;
+	}
+	return pipeline.get(); // Wait outside the lock so other threads can keep requesting
+}
+
+void PipelineRegistry::waitIdle() {
+	std::vector<std::shared_future<VkPipeline>> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& entry : m_pipelines) pending.push_back(entry.pipeline);
+	}
+	for (auto& pipeline : pending) pipeline.wait();
+}
+
+size_t PipelineRegistry::size() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pipelines.size();
+}
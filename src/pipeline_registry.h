@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+/// SPIR-V code shared between pipeline descriptions and the workers compiling them.
+using ShaderCode = std::shared_ptr<const std::vector<char>>;
+
+/// Construct a new Vulkan shader module from SPIR-V code.
+VkShaderModule createShaderModule(VkDevice device, const std::vector<char>& code);
+
+/// Everything that distinguishes one graphics pipeline from another. Viewport and scissor are dynamic state,
+/// so pipelines do not depend on the size of what they render to.
+struct GraphicsPipelineDesc {
+	ShaderCode vertexShader;
+	ShaderCode fragmentShader;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	// Empty when the vertex shader makes up its own vertices
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	bool blendEnable = true;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+
+	/// The shader code and all state above as one byte string: two descriptions make the same pipeline exactly
+	/// when these are equal.
+	std::string bytes() const;
+	/// Hash of bytes().
+	uint64_t hash() const;
+};
+
+/// Everything that distinguishes one compute pipeline from another.
+struct ComputePipelineDesc {
+	ShaderCode shader;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	// Specialization constants 0, 1, ... in order. Every constant is 32 bits, which covers the bool, int and float
+	// constants GLSL has.
+	std::vector<uint32_t> constants;
+
+	/// As GraphicsPipelineDesc::bytes(), and never equal to a graphics description's.
+	std::string bytes() const;
+	uint64_t hash() const;
+};
+
+/// Owns every pipeline the renderer uses, found by the hash of its description and told apart by the whole of it,
+/// so a hash collision never hands out the wrong pipeline.
+///
+/// Requesting a pipeline queues its compilation on the thread pool and returns at once, so all pipelines
+/// needed at startup can be requested up front and compile in parallel. Compilation goes through a shared
+/// VkPipelineCache (which is internally synchronized), so warm starts mostly skip the driver's compiler.
+class PipelineRegistry {
+public:
+	using Key = uint64_t; // Identifies a requested pipeline in this registry
+
+	PipelineRegistry(VkDevice device, VkPipelineCache cache, ThreadPool& pool);
+	/// Waits for outstanding compilations, then destroys all pipelines.
+	~PipelineRegistry();
+
+	PipelineRegistry(const PipelineRegistry&) = delete;
+	PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+	/// Start compiling the pipeline for `desc` unless it is already known. Never blocks.
+	Key request(const GraphicsPipelineDesc& desc);
+	Key request(const ComputePipelineDesc& desc);
+
+	/// The pipeline for `key`, waiting for it to finish compiling if needed.
+	/// Throws std::runtime_error if the key is unknown or compilation failed.
+	VkPipeline get(Key key);
+
+	/// Block until every requested pipeline has been compiled.
+	void waitIdle();
+
+	size_t size() const;
+
+private:
+	VkDevice m_device;
+	VkPipelineCache m_cache;
+	ThreadPool& m_pool;
+
+	struct Entry {
+		std::string description; // The description's bytes()
+		std::shared_future<VkPipeline> pipeline;
+	};
+
+	mutable std::mutex m_mutex;
+	std::vector<Entry> m_pipelines; // Indexed by Key
+	std::unordered_multimap<uint64_t, Key> m_index; // Description hash to the keys of every description with it
+
+	/// The key of `description`, queueing `compile` on the thread pool if it is new.
+	Key request(std::string description, std::function<VkPipeline()> compile);
+};
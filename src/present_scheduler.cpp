@@ -0,0 +1,88 @@
+#include "present_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+constexpr int64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+} // namespace
+
+void PresentScheduler::setFrameRate(uint32_t frameRateNumerator, uint32_t frameRateDenominator, Clock::time_point now) {
+	if (frameRateNumerator == 0 || frameRateDenominator == 0) return;
+	if (m_mode == PreviewMode::Playback) { // Carry on from where playback is, at the new rate
+		m_playStartFrame = frameAt(now);
+		m_playStart = now;
+	}
+	m_frameRateNumerator = frameRateNumerator;
+	m_frameRateDenominator = frameRateDenominator;
+}
+
+void PresentScheduler::play(Clock::time_point now) {
+	m_mode = PreviewMode::Playback;
+	m_playStart = now;
+	m_playStartFrame = m_playhead;
+	m_playedAny = false;
+}
+
+void PresentScheduler::stop(Clock::time_point now) {
+	m_playhead = frameAt(now);
+	m_mode = PreviewMode::Editing;
+}
+
+void PresentScheduler::scrub(int64_t frame) {
+	m_playhead = frame;
+	m_mode = PreviewMode::Scrubbing;
+}
+
+// Both conversions split the time into whole seconds and the rest, so they are exact and cannot overflow in any
+// playback shorter than centuries: frameAt(dueTime(f)) is f.
+
+int64_t PresentScheduler::frameAt(Clock::time_point now) const {
+	if (m_mode != PreviewMode::Playback) return m_playhead;
+	if (now <= m_playStart) return m_playStartFrame;
+
+	const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_playStart).count();
+	const int64_t seconds = elapsed / NANOSECONDS_PER_SECOND;
+	const int64_t rest = elapsed % NANOSECONDS_PER_SECOND;
+	const int64_t ticks = seconds * m_frameRateNumerator + rest * m_frameRateNumerator / NANOSECONDS_PER_SECOND; // Of 1/numerator s
+	return m_playStartFrame + ticks / m_frameRateDenominator;
+}
+
+PresentScheduler::Clock::time_point PresentScheduler::dueTime(int64_t frame) const {
+	const int64_t ticks = std::max<int64_t>(frame - m_playStartFrame, 0) * m_frameRateDenominator;
+	const int64_t seconds = ticks / m_frameRateNumerator;
+	const int64_t rest = ticks % m_frameRateNumerator;
+	const int64_t nanoseconds = seconds * NANOSECONDS_PER_SECOND
+	                            + (rest * NANOSECONDS_PER_SECOND + m_frameRateNumerator - 1) / m_frameRateNumerator; // Rounded up
+	return m_playStart + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(nanoseconds));
+}
+
+double PresentScheduler::secondsUntilDue(Clock::time_point now, double idle) const {
+	if (frameDue(now)) return 0.0;
+	if (m_mode != PreviewMode::Playback) return idle;
+	return std::max(std::chrono::duration<double>(dueTime(frameAt(now) + 1) - now).count(), 0.0);
+}
+
+void PresentScheduler::presented(int64_t frame, Clock::time_point now) {
+	if (m_mode == PreviewMode::Playback) {
+		if (!m_playedAny || frame != m_presentedFrame) {
+			if (m_playedAny && frame > m_presentedFrame + 1) m_stats.dropped += uint64_t(frame - m_presentedFrame - 1);
+			m_stats.lateness.record(std::chrono::duration<double, std::milli>(now - dueTime(frame)).count());
+		}
+		m_stats.presented++;
+		m_playedAny = true;
+	}
+	m_presentedFrame = frame;
+}
+
+void PresentScheduler::print(std::ostream& out) const {
+	if (m_stats.presented == 0) return;
+	auto flags = out.flags();
+	out << std::fixed << std::setprecision(3)
+	    << "playback at " << frameRate() << " fps: presented=" << m_stats.presented
+	    << " dropped=" << m_stats.dropped << "\n";
+	out.flags(flags);
+	m_stats.lateness.print(out, "playback lateness");
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "driver.h"
+#include "frame_stats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/// What the preview is doing, which decides when its frames are drawn and how they are presented.
+enum class PreviewMode : uint8_t {
+	Editing,   // Frames are drawn when something changes (see DamageTracker)
+	Scrubbing, // The playhead is being dragged: each frame is drawn and shown as soon as it can be
+	Playback,  // Frames are drawn at the timeline's frame rate, each shown once
+};
+
+/// Paces the preview's frames and picks how they are presented.
+///
+/// During playback, the timeline frame to show is found from the time since playback started, and a frame is only
+/// drawn when the next timeline frame is due, whatever the display's refresh rate: a 24 fps project on a 60 Hz
+/// display draws 24 frames a second, not 60. Frames are presented in FIFO order so each is shown. While scrubbing
+/// or editing, the newest frame should be shown as soon as possible instead, so latency() asks for low latency
+/// presentation then.
+///
+/// Presenting is accounted against the timeline during playback: a frame that was due but never presented is
+/// dropped, and how late each was queued after it was due is recorded. Refreshes that repeat a frame beyond its
+/// share of the timeline are not counted, as when a frame reaches the screen is not known without present timing.
+/// Time is passed in, so the scheduler can be driven by a simulated clock.
+class PresentScheduler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	/// Counts since statistics were last reset, all during playback.
+	struct Stats {
+		uint64_t presented = 0;
+		uint64_t dropped = 0;    // Due, but never presented
+		FrameTimeHistogram lateness; // Milliseconds from when each frame was due until it was queued for presentation
+	};
+
+	/// Pace playback to `frameRateNumerator` / `frameRateDenominator` timeline frames per second (such as 24/1 or
+	/// 30000/1001). Playback in progress carries on from the frame due at `now`.
+	void setFrameRate(uint32_t frameRateNumerator, uint32_t frameRateDenominator, Clock::time_point now = Clock::now());
+	double frameRate() const { return double(m_frameRateNumerator) / m_frameRateDenominator; }
+
+	PreviewMode mode() const { return m_mode; }
+	PresentLatency latency() const { return m_mode == PreviewMode::Playback ? PresentLatency::Paced : PresentLatency::Low; }
+
+	/// Start playing at `now`, from the playhead.
+	void play(Clock::time_point now);
+	/// Stop playing or scrubbing, leaving the playhead at the frame showing at `now`.
+	void stop(Clock::time_point now);
+	/// Move the playhead to `frame`, scrubbing until stop(). Stops playback.
+	void scrub(int64_t frame);
+
+	/// The timeline frame to show at `now`: the one due then during playback, the playhead otherwise.
+	int64_t frameAt(Clock::time_point now) const;
+	/// When timeline `frame` is due to be shown during playback.
+	Clock::time_point dueTime(int64_t frame) const;
+
+	/// Whether the frame to show at `now` has not been presented yet.
+	bool frameDue(Clock::time_point now) const { return frameAt(now) != m_presentedFrame; }
+	/// How long the main loop may sleep at `now` before a frame is due: until the next one during playback, and up to
+	/// `idle` seconds otherwise. Zero if a frame is due already.
+	double secondsUntilDue(Clock::time_point now, double idle) const;
+
+	/// Note that timeline frame `frame` was queued for presentation at `now`.
+	void presented(int64_t frame, Clock::time_point now);
+
+	const Stats& stats() const { return m_stats; }
+	void resetStats() { m_stats = Stats{}; }
+	/// One line of counts, then the lateness histogram. Nothing if nothing was played.
+	void print(std::ostream& out) const;
+
+private:
+	uint32_t m_frameRateNumerator = 30;
+	uint32_t m_frameRateDenominator = 1;
+	PreviewMode m_mode = PreviewMode::Editing;
+	int64_t m_playhead = 0;
+	Clock::time_point m_playStart; // When playback reached m_playStartFrame
+	int64_t m_playStartFrame = 0;
+	int64_t m_presentedFrame = -1; // Timeline frame last presented, -1 for none
+	bool m_playedAny = false; // A frame was presented since playback started
+	Stats m_stats;
+};
@@ -0,0 +1,158 @@
+#include "profiler.h"
+#include "spsc_ring.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Profiler::s_recording{false};
+
+namespace {
+
+struct ThreadBuffer {
+	SpscRing<ProfileEvent> ring{Profiler::RING_CAPACITY}; // Produced by its thread, consumed by collect()
+	std::atomic<uint64_t> dropped{0};
+	uint32_t id = 0;
+	std::string name; // Guarded by the trace's mutex
+};
+
+struct CollectedEvent {
+	ProfileEvent event;
+	uint32_t thread;
+};
+
+struct Trace {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threads; // Kept after their threads exit, as their events may not be collected yet
+	std::vector<CollectedEvent> events;
+	uint64_t dropped = 0;
+};
+
+Trace& trace() {
+	static Trace instance; // Constructed on first use, so zones in static initializers are safe
+	return instance;
+}
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+ThreadBuffer& threadBuffer() {
+	if (t_buffer == nullptr) {
+		Trace& t = trace();
+		std::lock_guard<std::mutex> lock(t.mutex);
+		auto buffer = std::make_unique<ThreadBuffer>();
+		buffer->id = static_cast<uint32_t>(t.threads.size());
+		if (ThreadPool::workerIndex() != ThreadPool::NOT_A_WORKER) {
+			buffer->name = "worker " + std::to_string(ThreadPool::workerIndex());
+		} else {
+			buffer->name = buffer->id == 0 ? "main" : "thread " + std::to_string(buffer->id);
+		}
+		t_buffer = buffer.get();
+		t.threads.push_back(std::move(buffer));
+	}
+	return *t_buffer;
+}
+
+/// Write `text` as a JSON string.
+void writeJsonString(std::FILE* file, const char* text) {
+	std::fputc('"', file);
+	for (const char* c = text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') std::fputc('\\', file);
+		if (static_cast<unsigned char>(*c) >= 0x20) std::fputc(*c, file);
+	}
+	std::fputc('"', file);
+}
+
+} // namespace
+
+void Profiler::start() {
+	threadBuffer(); // So the starting thread, normally the main one, gets the first id
+	s_recording.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::stop() {
+	s_recording.store(false, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::record(const ProfileEvent& event) {
+	ThreadBuffer& buffer = threadBuffer();
+	ProfileEvent* slot = buffer.ring.back();
+	if (slot == nullptr) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	*slot = event;
+	buffer.ring.push();
+}
+
+void Profiler::setThreadName(const std::string& name) {
+	ThreadBuffer& buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(trace().mutex);
+	buffer.name = name;
+}
+
+void Profiler::collect() {
+	Trace& t = trace();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : t.threads) {
+		while (const ProfileEvent* event = buffer->ring.front()) {
+			if (t.events.size() < MAX_EVENTS) {
+				t.events.push_back({*event, buffer->id});
+			} else {
+				t.dropped++;
+			}
+			buffer->ring.pop();
+		}
+		t.dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+	}
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+	collect();
+
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (file == nullptr) return false;
+
+	Trace& t = trace();
+	std::lock_guard<std::mutex> lock(t.mutex);
+
+	// Times are written relative to the earliest event, in the microseconds the format uses
+	uint64_t origin = UINT64_MAX;
+	for (const CollectedEvent& e : t.events) origin = std::min(origin, e.event.start);
+
+	std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n", file);
+	std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}", file);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : t.threads) {
+		std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->id);
+		writeJsonString(file, buffer->name.c_str());
+		std::fputs("}}", file);
+	}
+	for (const CollectedEvent& e : t.events) {
+		const bool gpu = e.event.track == ProfileTrack::Gpu;
+		std::fputs(",\n{\"name\":", file);
+		writeJsonString(file, e.event.name);
+		std::fprintf(file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", gpu ? 2 : 1, gpu ? 0 : e.thread,
+		             double(e.event.start - origin) / 1000.0, double(e.event.end - e.event.start) / 1000.0);
+	}
+	std::fputs("\n]}\n", file);
+
+	const bool ok = std::ferror(file) == 0;
+	return std::fclose(file) == 0 && ok;
+}
+
+uint64_t Profiler::droppedEvents() {
+	Trace& t = trace();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	uint64_t dropped = t.dropped;
+	for (const std::unique_ptr<ThreadBuffer>& buffer : t.threads) dropped += buffer->dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// The profiler is compiled into debug builds, and into release builds configured with -DVIPER_PROFILE_RELEASE=ON.
+// Otherwise every VIPER_PROFILE_* macro expands to nothing and Profiler::enabled() is a constant false, so the
+// instrumentation costs nothing at all. Where it is compiled in, it still records nothing until Profiler::start().
+#if !defined(NDEBUG) || defined(VIPER_PROFILER_IN_RELEASE)
+#define VIPER_PROFILER 1
+#else
+#define VIPER_PROFILER 0
+#endif
+
+/// Where an event happened: on the thread that recorded it, or on the GPU.
+enum class ProfileTrack : uint8_t { Cpu, Gpu };
+
+/// A finished zone. `name` must be a string literal (or otherwise live until the trace is written).
+struct ProfileEvent {
+	const char* name = nullptr;
+	uint64_t start = 0; // Nanoseconds on Profiler::now()'s clock
+	uint64_t end = 0;
+	ProfileTrack track = ProfileTrack::Cpu;
+};
+
+/// Collects timed zones from every thread and writes them out as a Chrome trace (chrome://tracing, Perfetto).
+///
+/// Each thread records into its own lock-free ring (an SpscRing with the recording thread as producer), so
+/// recording a zone is two clock reads and a push; it never locks or allocates after the thread's first event.
+/// collect() drains the rings, and must be called regularly (the main loop does so every frame) or full rings drop
+/// events, which are counted.
+class Profiler {
+public:
+	static constexpr size_t RING_CAPACITY = 16384;      // Events per thread between collect() calls
+	static constexpr size_t MAX_EVENTS = size_t(1) << 22; // Collected events kept for the trace; later ones are dropped
+
+	/// Whether zones are being recorded: compiled in and started.
+	static bool enabled() {
+#if VIPER_PROFILER
+		return s_recording.load(std::memory_order_relaxed);
+#else
+		return false;
+#endif
+	}
+
+	/// Start or stop recording. Events already collected are kept.
+	static void start();
+	static void stop();
+
+	/// The clock zones are timed with: steady, in nanoseconds.
+	static uint64_t now();
+
+	/// Record an event on the calling thread's ring.
+	static void record(const ProfileEvent& event);
+
+	/// Name the calling thread in traces. Pool workers and the first thread to record are named automatically.
+	static void setThreadName(const std::string& name);
+
+	/// Move every thread's recorded events into the trace. Call from one thread at a time.
+	static void collect();
+
+	/// Collect, then write everything collected as Chrome trace JSON to `path`. Returns false if it cannot be written.
+	static bool writeChromeTrace(const std::string& path);
+
+	/// Events lost to full rings or the MAX_EVENTS limit.
+	static uint64_t droppedEvents();
+
+private:
+	static std::atomic<bool> s_recording;
+};
+
+/// Times the enclosing scope on the calling thread. Use VIPER_PROFILE_ZONE rather than naming one directly.
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : m_name(name), m_start(Profiler::enabled() ? Profiler::now() : 0) {}
+	~ProfileZone() {
+		if (m_start != 0) Profiler::record({m_name, m_start, Profiler::now(), ProfileTrack::Cpu});
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* m_name;
+	uint64_t m_start; // 0 if the profiler was not recording when the zone began
+};
+
+#define VIPER_PROFILE_CONCAT_INNER(a, b) a##b
+#define VIPER_PROFILE_CONCAT(a, b) VIPER_PROFILE_CONCAT_INNER(a, b)
+
+#if VIPER_PROFILER
+/// Time the rest of the enclosing scope as `name`, a string literal.
+#define VIPER_PROFILE_ZONE(name) const ProfileZone VIPER_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#else
+#define VIPER_PROFILE_ZONE(name) ((void) 0)
+#endif
@@ -0,0 +1,498 @@
+#include "project.h"
+#include "mapped_file.h"
+#include "hash.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+enum class TokenKind : uint8_t {
+	Identifier,
+	String,
+	Number,
+	LBracket,
+	RBracket,
+	LParen,
+	RParen,
+	Comma,
+	Equals,
+	Newline,
+	End,
+};
+
+/// A token is a view into the source text; nothing is copied while tokenizing.
+struct Token {
+	TokenKind kind;
+	std::string_view text; // For strings, the contents between the quotes (still escaped). Always points into the source.
+	uint32_t line;
+};
+
+const char* tokenKindName(TokenKind kind) {
+	switch (kind) {
+	case TokenKind::Identifier: return "identifier";
+	case TokenKind::String: return "string";
+	case TokenKind::Number: return "number";
+	case TokenKind::LBracket: return "'['";
+	case TokenKind::RBracket: return "']'";
+	case TokenKind::LParen: return "'('";
+	case TokenKind::RParen: return "')'";
+	case TokenKind::Comma: return "','";
+	case TokenKind::Equals: return "'='";
+	case TokenKind::Newline: return "end of line";
+	case TokenKind::End: return "end of file";
+	}
+	return "token";
+}
+
+// Character classes, looked up through a table so the tokenizer's inner loops stay branch-light
+enum CharClass : uint8_t {
+	CC_OTHER = 0,
+	CC_BLANK = 1 << 0,       // Spaces, tabs and carriage returns
+	CC_DIGIT = 1 << 1,
+	CC_IDENT_START = 1 << 2, // Letters and '_'
+	CC_IDENT = 1 << 3,       // Anything that may continue an identifier
+	CC_NUMBER = 1 << 4,      // Anything that may continue a number
+};
+
+struct CharClassTable {
+	uint8_t classes[256] = {};
+
+	constexpr CharClassTable() {
+		classes[static_cast<uint8_t>(' ')] = CC_BLANK;
+		classes[static_cast<uint8_t>('\t')] = CC_BLANK;
+		classes[static_cast<uint8_t>('\r')] = CC_BLANK;
+		for (int c = '0'; c <= '9'; c++) classes[c] = CC_DIGIT | CC_IDENT | CC_NUMBER;
+		for (int c = 'a'; c <= 'z'; c++) classes[c] = CC_IDENT_START | CC_IDENT;
+		for (int c = 'A'; c <= 'Z'; c++) classes[c] = CC_IDENT_START | CC_IDENT;
+		classes[static_cast<uint8_t>('_')] = CC_IDENT_START | CC_IDENT;
+		classes[static_cast<uint8_t>('-')] = CC_IDENT;
+		classes[static_cast<uint8_t>('.')] = CC_IDENT | CC_NUMBER;
+	}
+};
+
+constexpr CharClassTable CHAR_CLASSES;
+
+inline bool hasClass(char c, uint8_t cls) {
+	return (CHAR_CLASSES.classes[static_cast<uint8_t>(c)] & cls) != 0;
+}
+
+class Lexer {
+public:
+	Lexer(std::string_view source, const std::string& sourceName)
+		: m_cur(source.data()), m_end(source.data() + source.size()), m_name(sourceName) {}
+
+	Token next() {
+		// Skip blanks and comments, but not newlines: they terminate entries
+		for (;;) {
+			while (m_cur < m_end && hasClass(*m_cur, CC_BLANK)) m_cur++;
+			if (m_cur < m_end && *m_cur == '#') {
+				while (m_cur < m_end && *m_cur != '\n') m_cur++;
+				continue;
+			}
+			break;
+		}
+
+		if (m_cur >= m_end) return {TokenKind::End, {m_end, 0}, m_line};
+
+		const char* start = m_cur++;
+		switch (*start) {
+		case '\n': return {TokenKind::Newline, {start, 1}, m_line++};
+		case '[': return {TokenKind::LBracket, {start, 1}, m_line};
+		case ']': return {TokenKind::RBracket, {start, 1}, m_line};
+		case '(': return {TokenKind::LParen, {start, 1}, m_line};
+		case ')': return {TokenKind::RParen, {start, 1}, m_line};
+		case ',': return {TokenKind::Comma, {start, 1}, m_line};
+		case '=': return {TokenKind::Equals, {start, 1}, m_line};
+		case '"': {
+			while (m_cur < m_end && *m_cur != '"') {
+				if (*m_cur == '\\') m_cur++; // Skip the escaped character
+				else if (*m_cur == '\n') error("unterminated string");
+				m_cur++;
+			}
+			if (m_cur >= m_end) error("unterminated string");
+			m_cur++; // Closing quote
+			return {TokenKind::String, {start + 1, static_cast<size_t>(m_cur - start - 2)}, m_line};
+		}
+		default:
+			break;
+		}
+
+		if (hasClass(*start, CC_DIGIT) || ((*start == '-' || *start == '+') && m_cur < m_end && hasClass(*m_cur, CC_DIGIT))) {
+			while (m_cur < m_end && hasClass(*m_cur, CC_NUMBER)) m_cur++;
+			return {TokenKind::Number, {start, static_cast<size_t>(m_cur - start)}, m_line};
+		}
+
+		if (hasClass(*start, CC_IDENT_START)) {
+			while (m_cur < m_end && hasClass(*m_cur, CC_IDENT)) m_cur++;
+			return {TokenKind::Identifier, {start, static_cast<size_t>(m_cur - start)}, m_line};
+		}
+
+		error(std::string("unexpected character '") + *start + "'");
+	}
+
+	// Token-free scanning used for the fixed shape of segment entries, which make up the bulk of large projects.
+	// None of these cross a newline.
+
+	void expectChar(char c) {
+		skipBlanks();
+		if (m_cur >= m_end || *m_cur != c) error(std::string("expected '") + c + "'");
+		m_cur++;
+	}
+
+	bool acceptChar(char c) {
+		skipBlanks();
+		if (m_cur >= m_end || *m_cur != c) return false;
+		m_cur++;
+		return true;
+	}
+
+	std::string_view identifier() {
+		skipBlanks();
+		const char* start = m_cur;
+		if (m_cur >= m_end || !hasClass(*m_cur, CC_IDENT_START)) error("expected identifier");
+		while (m_cur < m_end && hasClass(*m_cur, CC_IDENT)) m_cur++;
+		return {start, static_cast<size_t>(m_cur - start)};
+	}
+
+	int64_t integer() {
+		skipBlanks();
+		bool negative = false;
+		if (m_cur < m_end && (*m_cur == '-' || *m_cur == '+')) negative = *m_cur++ == '-';
+		if (m_cur >= m_end || !hasClass(*m_cur, CC_DIGIT)) error("expected an integer");
+
+		int64_t value = 0;
+		while (m_cur < m_end && hasClass(*m_cur, CC_DIGIT)) {
+			const int64_t digit = *m_cur++ - '0';
+			if (value > (INT64_MAX - digit) / 10) error("integer out of range");
+			value = value * 10 + digit;
+		}
+		if (m_cur < m_end && hasClass(*m_cur, CC_NUMBER)) error("expected an integer");
+		return negative ? -value : value;
+	}
+
+	[[noreturn]] void error(const std::string& message) const {
+		throw std::runtime_error(m_name + ":" + std::to_string(m_line) + ": " + message);
+	}
+
+private:
+	void skipBlanks() {
+		while (m_cur < m_end && hasClass(*m_cur, CC_BLANK)) m_cur++;
+	}
+
+	const char* m_cur;
+	const char* m_end;
+	const std::string& m_name;
+	uint32_t m_line = 1;
+};
+
+/// Undo backslash escapes in the contents of a string token. Only allocates for the result.
+std::string unescape(std::string_view text) {
+	std::string out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '\\' && i + 1 < text.size()) {
+			i++;
+			switch (text[i]) {
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			default: out += text[i]; break; // \" and \\ .
+			}
+		} else {
+			out += text[i];
+		}
+	}
+	return out;
+}
+
+/// Maps resource ids to resource indices. Keys are views into the source text. Open addressing over a flat
+/// array keeps lookups (one per segment) free of allocations and pointer chasing.
+class ResourceIdTable {
+public:
+	/// Returns false if `key` was already present.
+	bool insert(std::string_view key, uint32_t value) {
+		if ((m_count + 1) * 2 > m_slots.size()) grow();
+		Slot& slot = probe(key);
+		if (slot.key.data() != nullptr) return false;
+		slot = {key, value};
+		m_count++;
+		return true;
+	}
+
+	/// Returns nullptr if `key` is not present.
+	const uint32_t* find(std::string_view key) const {
+		if (m_slots.empty()) return nullptr;
+		const Slot& slot = const_cast<ResourceIdTable*>(this)->probe(key);
+		return slot.key.data() != nullptr ? &slot.value : nullptr;
+	}
+
+private:
+	struct Slot {
+		std::string_view key; // data() == nullptr marks an empty slot
+		uint32_t value;
+	};
+
+	std::vector<Slot> m_slots;
+	size_t m_count = 0;
+
+	Slot& probe(std::string_view key) {
+		const size_t mask = m_slots.size() - 1;
+		size_t i = fnv1a64(key) & mask; // Ids are short, so FNV-1a is plenty
+		while (m_slots[i].key.data() != nullptr && m_slots[i].key != key) {
+			i = (i + 1) & mask;
+		}
+		return m_slots[i];
+	}
+
+	void grow() {
+		std::vector<Slot> old = std::move(m_slots);
+		m_slots.assign(old.empty() ? 64 : old.size() * 2, Slot{});
+		for (const Slot& slot : old) {
+			if (slot.key.data() != nullptr) probe(slot.key) = slot;
+		}
+	}
+};
+
+enum class Section {
+	None,
+	Settings,
+	Resources,
+	Tracks,
+};
+
+class Parser {
+public:
+	Parser(std::string_view source, const std::string& sourceName) : m_source(source), m_lexer(source, sourceName) {
+		advance();
+	}
+
+	Project parse() {
+		Project project;
+		Section section = Section::None;
+		m_boundaries.clear();
+
+		for (;;) {
+			if (m_tok.kind == TokenKind::End) break;
+			if (m_tok.kind == TokenKind::Newline) {
+				advance();
+				continue;
+			}
+
+			if (m_tok.kind == TokenKind::LBracket) { // Section header
+				const uint64_t offset = offsetOf(m_tok);
+				advance();
+				Token name = expect(TokenKind::Identifier);
+				expect(TokenKind::RBracket);
+				if (name.text == "Settings") section = Section::Settings;
+				else if (name.text == "Resources") section = Section::Resources;
+				else if (name.text == "Tracks") section = Section::Tracks;
+				else error("unknown section '" + std::string(name.text) + "'");
+				m_boundaries.push_back({section, 0, offset});
+				endOfEntry();
+				continue;
+			}
+
+			if (section == Section::Tracks) {
+				m_boundaries.push_back({Section::Tracks, project.tracks.size() + 1, offsetOf(m_tok)});
+			}
+			Token key = expect(TokenKind::Identifier);
+			expect(TokenKind::Equals);
+
+			switch (section) {
+			case Section::None: error("entry outside of a section");
+			case Section::Settings: parseSetting(project, key); break;
+			case Section::Resources: parseResource(project, key); break;
+			case Section::Tracks: parseTrack(project, key); break;
+			}
+			endOfEntry();
+		}
+
+		recordLayout(project);
+		return project;
+	}
+
+private:
+	/// Where a section header (`track == 0`) or a track entry (`track == index + 1`) starts in the source.
+	struct Boundary {
+		Section section;
+		size_t track;
+		uint64_t offset;
+	};
+
+	std::string_view m_source;
+	Lexer m_lexer;
+	std::vector<Boundary> m_boundaries;
+	Token m_tok{};
+	ResourceIdTable m_resourceIds;
+
+	void advance() {
+		m_tok = m_lexer.next();
+	}
+
+	Token expect(TokenKind kind) {
+		if (m_tok.kind != kind) {
+			error(std::string("expected ") + tokenKindName(kind) + ", found " + tokenKindName(m_tok.kind));
+		}
+		Token tok = m_tok;
+		advance();
+		return tok;
+	}
+
+	uint64_t offsetOf(const Token& tok) const {
+		return static_cast<uint64_t>(tok.text.data() - m_source.data());
+	}
+
+	/// Turn the recorded boundaries into spans that tile the source, so unchanged parts can be copied on save.
+	void recordLayout(Project& project) const {
+		SourceLayout& layout = project.layout;
+		layout = SourceLayout{};
+		layout.fileSize = m_source.size();
+		layout.valid = true;
+
+		Section previous = Section::None;
+		for (size_t i = 0; i < m_boundaries.size(); i++) {
+			const Boundary& b = m_boundaries[i];
+			const uint64_t end = i + 1 < m_boundaries.size() ? m_boundaries[i + 1].offset : m_source.size();
+			const SourceSpan span{b.offset, end - b.offset};
+
+			if (b.track != 0) {
+				project.tracks[b.track - 1].source = span;
+				continue;
+			}
+
+			// Only files with each section at most once, in the canonical order, can be patched
+			if (b.section <= previous) layout.valid = false;
+			previous = b.section;
+			switch (b.section) {
+			case Section::Settings: layout.settings = span; break;
+			case Section::Resources: layout.resources = span; break;
+			case Section::Tracks: layout.tracksHeader = span; break;
+			case Section::None: break;
+			}
+		}
+		layout.prefix = {0, m_boundaries.empty() ? m_source.size() : m_boundaries.front().offset};
+
+		project.settingsDirty = false;
+		project.resourcesDirty = false;
+		for (auto& track : project.tracks) track.dirty = false;
+	}
+
+	void endOfEntry() {
+		if (m_tok.kind != TokenKind::End) expect(TokenKind::Newline);
+	}
+
+	void skipNewlines() {
+		while (m_tok.kind == TokenKind::Newline) advance();
+	}
+
+	[[noreturn]] void error(const std::string& message) const {
+		m_lexer.error(message);
+	}
+
+	void parseSetting(Project& project, const Token& key) {
+		std::string value;
+		switch (m_tok.kind) {
+		case TokenKind::String: value = unescape(m_tok.text); break;
+		case TokenKind::Number:
+		case TokenKind::Identifier: value = std::string(m_tok.text); break;
+		default: error(std::string("expected a setting value, found ") + tokenKindName(m_tok.kind));
+		}
+		advance();
+		project.settings.push_back({std::string(key.text), std::move(value)});
+	}
+
+	void parseResource(Project& project, const Token& key) {
+		Token type = expect(TokenKind::Identifier);
+		if (type.text != "Resource") {
+			error("expected Resource(...), found '" + std::string(type.text) + "'");
+		}
+		expect(TokenKind::LParen);
+		Token path = expect(TokenKind::String);
+		expect(TokenKind::RParen);
+
+		if (!m_resourceIds.insert(key.text, static_cast<uint32_t>(project.resources.size()))) {
+			error("duplicate resource id '" + std::string(key.text) + "'");
+		}
+		project.resources.push_back({std::string(key.text), unescape(path.text)});
+	}
+
+	void parseTrack(Project& project, const Token& key) {
+		Track track;
+		track.name = std::string(key.text);
+		// Empty tracks have no segments to tell their kind, so fall back on the name
+		track.kind = key.text.rfind("audio", 0) == 0 ? TrackKind::Audio : TrackKind::Video;
+
+		expect(TokenKind::LBracket);
+		skipNewlines();
+		while (m_tok.kind != TokenKind::RBracket) {
+			Token type = expect(TokenKind::Identifier);
+			TrackKind kind;
+			if (type.text == "VideoSegment") kind = TrackKind::Video;
+			else if (type.text == "AudioSegment") kind = TrackKind::Audio;
+			else error("expected VideoSegment(...) or AudioSegment(...), found '" + std::string(type.text) + "'");
+
+			if (track.segments.empty()) {
+				track.kind = kind;
+			} else if (track.kind != kind) {
+				error("track '" + track.name + "' mixes video and audio segments");
+			}
+
+			// The lookahead token is the opening parenthesis, so the lexer sits right at the arguments
+			if (m_tok.kind != TokenKind::LParen) expect(TokenKind::LParen);
+			std::string_view id = m_lexer.identifier();
+			const uint32_t* resource = m_resourceIds.find(id);
+			if (resource == nullptr) {
+				error("unknown resource '" + std::string(id) + "'");
+			}
+
+			Segment segment;
+			segment.resource = *resource;
+			m_lexer.expectChar(',');
+			segment.trackFrame = m_lexer.integer();
+			m_lexer.expectChar(',');
+			segment.clipFrame = m_lexer.integer();
+			segment.length = Segment::UNTIL_NEXT;
+			if (m_lexer.acceptChar(',')) { // Optional explicit length
+				segment.length = m_lexer.integer();
+				if (segment.length < 0) error("segment length must not be negative");
+			}
+			m_lexer.expectChar(')');
+			advance();
+			track.segments.push_back(segment);
+
+			if (m_tok.kind == TokenKind::Comma) advance();
+			skipNewlines();
+		}
+		expect(TokenKind::RBracket);
+
+		project.tracks.push_back(std::move(track));
+	}
+};
+
+} // namespace
+
+std::string_view Project::setting(std::string_view key, std::string_view fallback) const {
+	for (const auto& s : settings) {
+		if (s.key == key) return s.value;
+	}
+	return fallback;
+}
+
+int64_t Project::findResource(std::string_view id) const {
+	for (size_t i = 0; i < resources.size(); i++) {
+		if (resources[i].id == id) return static_cast<int64_t>(i);
+	}
+	return -1;
+}
+
+Project parseProject(std::string_view text, const std::string& sourceName) {
+	Parser parser(text, sourceName);
+	return parser.parse();
+}
+
+Project loadProject(const std::string& path) {
+	MappedFile file(path);
+	Project project = parseProject(file.view(), path);
+	project.path = path;
+	return project;
+}
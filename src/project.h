@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/// The kind of media a track holds, determined by the segments listed in it.
+enum class TrackKind : uint8_t {
+	Video,
+	Audio,
+};
+
+/// A piece of a resource placed on a track. Segments are plain values stored contiguously per track.
+struct Segment {
+	uint32_t resource;   // Index into Project::resources
+	int64_t trackFrame;  // Frame on the track where the segment starts
+	int64_t clipFrame;   // Frame in the resource the segment starts playing from
+	int64_t length;      // Length in frames, or -1 to last until the next segment on the track
+
+	static constexpr int64_t UNTIL_NEXT = -1;
+};
+
+/// A byte range of the file a project was loaded from.
+struct SourceSpan {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+struct Track {
+	std::string name;
+	TrackKind kind;
+	std::vector<Segment> segments;
+
+	SourceSpan source; // The entry's bytes in the loaded file, including trailing comments and blank lines
+	bool dirty = true; // Set when the track is edited; new tracks have no source and are always written out
+};
+
+/// A `Resource("path")` entry of the [Resources] section.
+struct Resource {
+	std::string id;
+	std::string path;
+};
+
+/// A `key=value` entry of the [Settings] section. Values are kept in their textual form (strings unquoted).
+struct Setting {
+	std::string key;
+	std::string value;
+};
+
+/// Where the parts of a project live in the file it was loaded from. The spans tile the file in order
+/// (prefix, [Settings], [Resources], the [Tracks] header, then each track entry), so parts that did not change
+/// can be copied verbatim when saving.
+struct SourceLayout {
+	bool valid = false; // False for files with repeated or out-of-order sections; those are rewritten in full
+	uint64_t fileSize = 0;
+	SourceSpan prefix;       // Comments before the first section
+	SourceSpan settings;     // Whole [Settings] section, header included
+	SourceSpan resources;    // Whole [Resources] section, header included
+	SourceSpan tracksHeader; // The [Tracks] header up to the first track entry
+};
+
+/// The in-memory form of a ".viper" project file.
+///
+/// Editors must set the dirty flag of whatever they change (`settingsDirty`, `resourcesDirty` or a track's
+/// `dirty`) so saveProject() knows what to rewrite. Tracks refer to resources by id, so renaming or reordering
+/// resources also requires marking the tracks that use them.
+struct Project {
+	std::string path; // Where the project was loaded from, if anywhere
+	std::vector<Setting> settings;
+	std::vector<Resource> resources;
+	std::vector<Track> tracks;
+
+	SourceLayout layout;
+	bool settingsDirty = true;
+	bool resourcesDirty = true;
+
+	/// Returns the value of the setting `key`, or `fallback` when it is not set.
+	std::string_view setting(std::string_view key, std::string_view fallback = {}) const;
+	/// Returns the index of the resource with the given id, or -1 when there is none.
+	int64_t findResource(std::string_view id) const;
+};
+
+/// Parse a project from its text. `sourceName` is only used in error messages.
+/// Throws std::runtime_error with the offending line on malformed input.
+Project parseProject(std::string_view text, const std::string& sourceName = "<memory>");
+
+/// Memory-map and parse the project file at `path`.
+Project loadProject(const std::string& path);
+
+/// Write `project` to `path` (its own path when empty) through a temporary file that atomically replaces the
+/// old one. When saving over the file the project was loaded from, only dirty parts are serialized and the
+/// rest is copied byte for byte from the previous file. Afterwards the project's layout describes the new file
+/// and nothing is dirty. Throws std::runtime_error on I/O failure, leaving the old file untouched.
+void saveProject(Project& project, const std::string& path = {});
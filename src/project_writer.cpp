@@ -0,0 +1,307 @@
+#include "project.h"
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void appendQuoted(std::string& out, const std::string& text) {
+	out += '"';
+	for (char c : text) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\t': out += "\\t"; break;
+		default: out += c; break;
+		}
+	}
+	out += '"';
+}
+
+/// Setting values are stored unquoted, so quote anything that would not read back as a number or identifier.
+void appendSettingValue(std::string& out, const std::string& value) {
+	bool bare = !value.empty();
+	for (char c : value) {
+		const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' || c == '+';
+		if (!ok) {
+			bare = false;
+			break;
+		}
+	}
+	if (bare && (value[0] == '-' || value[0] == '+' || value[0] == '.')) bare = false; // Ambiguous starts
+	if (bare) {
+		out += value;
+	} else {
+		appendQuoted(out, value);
+	}
+}
+
+void writeSettings(std::string& out, const Project& project) {
+	if (project.settings.empty()) return;
+	out += "[Settings]\n";
+	for (const auto& setting : project.settings) {
+		out += setting.key;
+		out += '=';
+		appendSettingValue(out, setting.value);
+		out += '\n';
+	}
+	out += '\n';
+}
+
+void writeResources(std::string& out, const Project& project) {
+	if (project.resources.empty()) return;
+	out += "[Resources]\n";
+	for (const auto& resource : project.resources) {
+		out += resource.id;
+		out += "=Resource(";
+		appendQuoted(out, resource.path);
+		out += ")\n";
+	}
+	out += '\n';
+}
+
+void writeTrack(std::string& out, const Project& project, const Track& track) {
+	const char* type = track.kind == TrackKind::Audio ? "AudioSegment(" : "VideoSegment(";
+	out += track.name;
+	out += "=[\n";
+	for (const auto& segment : track.segments) {
+		out += "    ";
+		out += type;
+		out += project.resources.at(segment.resource).id;
+		out += ", ";
+		out += std::to_string(segment.trackFrame);
+		out += ", ";
+		out += std::to_string(segment.clipFrame);
+		if (segment.length != Segment::UNTIL_NEXT) {
+			out += ", ";
+			out += std::to_string(segment.length);
+		}
+		out += "),\n";
+	}
+	out += "]\n";
+}
+
+/// The new file as a list of pieces, each either copied from the old file or freshly serialized.
+struct SavePlan {
+	struct Piece {
+		bool copy;         // Copy `span` of the old file, or write text[textOffset, textOffset + size)
+		SourceSpan span;
+		size_t textOffset;
+	};
+
+	std::vector<Piece> pieces;
+	std::string text; // All serialized parts, back to back
+
+	/// Append a copy of `span`, merging with the previous piece when it continues it.
+	void copy(SourceSpan span) {
+		if (span.size == 0) return;
+		if (!pieces.empty() && pieces.back().copy && pieces.back().span.offset + pieces.back().span.size == span.offset) {
+			pieces.back().span.size += span.size;
+			return;
+		}
+		pieces.push_back({true, span, 0});
+	}
+
+	/// Append whatever has been serialized into `text` since `textStart`.
+	void write(size_t textStart) {
+		const uint64_t size = text.size() - textStart;
+		if (size == 0) return;
+		if (!pieces.empty() && !pieces.back().copy && pieces.back().textOffset + pieces.back().span.size == textStart) {
+			pieces.back().span.size += size;
+			return;
+		}
+		pieces.push_back({false, {0, size}, textStart});
+	}
+};
+
+#ifdef _WIN32
+using NativeFile = HANDLE;
+
+NativeFile createFile(const std::string& path) {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	return file == INVALID_HANDLE_VALUE ? nullptr : file;
+}
+
+bool writeAll(NativeFile file, const char* data, uint64_t size) {
+	while (size > 0) {
+		DWORD chunk = size > (1u << 30) ? (1u << 30) : static_cast<DWORD>(size);
+		DWORD written = 0;
+		if (!WriteFile(file, data, chunk, &written, nullptr)) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool finishFile(NativeFile file) {
+	bool ok = FlushFileBuffers(file) != 0;
+	return CloseHandle(file) != 0 && ok;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+#else
+using NativeFile = int;
+
+NativeFile createFile(const std::string& path) {
+	return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+bool writeAll(NativeFile fd, const char* data, uint64_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) return false;
+		data += written;
+		size -= static_cast<uint64_t>(written);
+	}
+	return true;
+}
+
+bool finishFile(NativeFile fd) {
+	bool ok = fsync(fd) == 0;
+	return close(fd) == 0 && ok;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+	return rename(from.c_str(), to.c_str()) == 0; // Atomic on POSIX file systems
+}
+#endif
+
+/// Copy a span of the old file into `out`. On Linux this happens in the kernel (and is a cheap extent clone
+/// on file systems that support reflinks), so unchanged parts are never touched from user space.
+bool copySpan(NativeFile out, const MappedFile& old, [[maybe_unused]] const std::string& oldPath, SourceSpan span) {
+#if defined(__linux__)
+	int in = open(oldPath.c_str(), O_RDONLY);
+	if (in >= 0) {
+		loff_t offset = static_cast<loff_t>(span.offset);
+		uint64_t remaining = span.size;
+		while (remaining > 0) {
+			ssize_t copied = copy_file_range(in, &offset, out, nullptr, remaining, 0);
+			if (copied <= 0) break;
+			remaining -= static_cast<uint64_t>(copied);
+		}
+		close(in);
+		if (remaining == 0) return true;
+		span.offset += span.size - remaining; // Fall back to plain writes for whatever is left
+		span.size = remaining;
+	}
+#endif
+	return writeAll(out, old.data() + span.offset, span.size);
+}
+
+} // namespace
+
+void saveProject(Project& project, const std::string& path) {
+	const std::string target = path.empty() ? project.path : path;
+	if (target.empty()) {
+		throw std::runtime_error("failed to save project: no path given!");
+	}
+
+	// Unchanged parts can only be reused when overwriting the file the layout describes, as it was loaded
+	MappedFile old;
+	bool incremental = project.layout.valid && target == project.path;
+	if (incremental) {
+		try {
+			old = MappedFile(target);
+			incremental = old.size() == project.layout.fileSize;
+		} catch (const std::runtime_error&) {
+			incremental = false;
+		}
+	}
+
+	SavePlan plan;
+	std::vector<SourceSpan> new_track_spans(project.tracks.size());
+	SourceLayout new_layout;
+	new_layout.valid = true;
+	uint64_t out_offset = 0;
+	bool at_line_start = true;
+
+	// Emit one part: copy it when it is clean and was in the old file, serialize it otherwise
+	auto emit = [&](bool dirty, SourceSpan oldSpan, auto serialize) {
+		SourceSpan span{out_offset, 0};
+		if (incremental && !dirty) {
+			if (oldSpan.size != 0 && !at_line_start) { // A part moved up from the end of the old file, say
+				const size_t start = plan.text.size();
+				plan.text += '\n';
+				plan.write(start);
+				span.size = 1;
+			}
+			plan.copy(oldSpan);
+			span.size += oldSpan.size;
+			if (span.size != 0) at_line_start = old.data()[oldSpan.offset + oldSpan.size - 1] == '\n';
+		} else {
+			const size_t start = plan.text.size();
+			serialize(plan.text);
+			if (plan.text.size() != start && !at_line_start) { // e.g. the old file did not end in a newline
+				plan.text.insert(plan.text.begin() + static_cast<std::ptrdiff_t>(start), '\n');
+			}
+			plan.write(start);
+			span.size = plan.text.size() - start;
+			if (span.size != 0) at_line_start = plan.text.back() == '\n';
+		}
+		out_offset += span.size;
+		return span;
+	};
+
+	new_layout.prefix = emit(false, project.layout.prefix, [](std::string&) {});
+	new_layout.settings = emit(project.settingsDirty, project.layout.settings, [&](std::string& out) { writeSettings(out, project); });
+	new_layout.resources = emit(project.resourcesDirty, project.layout.resources, [&](std::string& out) { writeResources(out, project); });
+	const bool header_needed = !project.tracks.empty() && project.layout.tracksHeader.size == 0;
+	new_layout.tracksHeader = emit(header_needed, project.layout.tracksHeader, [&](std::string& out) {
+		if (!project.tracks.empty()) out += "[Tracks]\n";
+	});
+	for (size_t i = 0; i < project.tracks.size(); i++) {
+		const Track& track = project.tracks[i];
+		new_track_spans[i] = emit(track.dirty || track.source.size == 0, track.source, [&](std::string& out) { writeTrack(out, project, track); });
+	}
+	new_layout.fileSize = out_offset;
+
+	// Write everything to a temporary file next to the target, then swap it in
+	const std::string temp_path = target + ".tmp";
+	NativeFile out = createFile(temp_path);
+#ifdef _WIN32
+	if (out == nullptr) {
+#else
+	if (out < 0) {
+#endif
+		throw std::runtime_error("failed to create '" + temp_path + "'!");
+	}
+
+	bool ok = true;
+	for (const auto& piece : plan.pieces) {
+		ok = piece.copy ? copySpan(out, old, target, piece.span) : writeAll(out, plan.text.data() + piece.textOffset, piece.span.size);
+		if (!ok) break;
+	}
+	ok = finishFile(out) && ok;
+	old = MappedFile(); // Windows cannot replace a file that is still mapped
+
+	if (!ok || !replaceFile(temp_path, target)) {
+		std::remove(temp_path.c_str());
+		throw std::runtime_error("failed to save project to '" + target + "'!");
+	}
+
+	// The project now describes the file just written
+	project.path = target;
+	project.layout = new_layout;
+	project.settingsDirty = false;
+	project.resourcesDirty = false;
+	for (size_t i = 0; i < project.tracks.size(); i++) {
+		project.tracks[i].source = new_track_spans[i];
+		project.tracks[i].dirty = false;
+	}
+}
@@ -0,0 +1,231 @@
+#include "proxy_manager.h"
+
+#include "bounded_queue.h"
+#include "paths.h"
+#include "resource_registry.h"
+#include "y4m.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+ProxyManager::ProxyManager(FrameDecoder source, std::string directory, ProxySettings settings)
+	: m_source(std::move(source)), m_directory(std::move(directory)), m_settings(settings) {
+	std::error_code ec;
+	fs::create_directories(m_directory, ec);
+	for (fs::directory_iterator it(m_directory, ec), end; !ec && it != end; it.increment(ec)) {
+		if (it->path().extension() == ".y4m" && it->is_regular_file(ec)) m_diskUsage += it->file_size(ec);
+	}
+
+	m_builder = std::thread([this]() { builderLoop(); });
+}
+
+ProxyManager::~ProxyManager() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_buildQueue.clear();
+	}
+	m_cancel = true;
+	m_queued.notify_all();
+	m_builder.join();
+}
+
+std::string ProxyManager::defaultDirectory() {
+	return joinPath(cacheDirectory(), "proxies");
+}
+
+void ProxyManager::update(const ResourceRegistry& registry) {
+	std::vector<ResourceInfo> resources(registry.size());
+	for (size_t i = 0; i < resources.size(); i++) resources[i] = registry.info(i);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_resourceProxies.assign(resources.size(), {});
+	for (size_t i = 0; i < resources.size(); i++) {
+		const MediaInfo& media = resources[i].media;
+		if (resources[i].status != ResourceStatus::Ready || media.height <= m_settings.height || media.frameCount <= 0
+			|| media.frameRateNumerator == 0) {
+			continue;
+		}
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "%016" PRIx64 "_%up.y4m", media.contentHash, m_settings.height);
+		const std::string path = joinPath(m_directory, name);
+		m_resourceProxies[i] = path;
+
+		auto [it, inserted] = m_proxies.try_emplace(path);
+		Proxy& proxy = it->second;
+		proxy.sourceResource = static_cast<uint32_t>(i); // Resource indices change when another project is opened
+		if (!inserted) continue;
+
+		// Keep the aspect ratio, at even dimensions for 4:2:0
+		proxy.height = m_settings.height & ~1u;
+		proxy.width = std::max(2u, static_cast<uint32_t>(double(media.width) * proxy.height / media.height / 2.0 + 0.5) * 2);
+		proxy.frameRateNumerator = media.frameRateNumerator;
+		proxy.frameRateDenominator = media.frameRateDenominator;
+		proxy.status.path = path;
+		proxy.status.frameCount = media.frameCount;
+
+		std::error_code ec;
+		if (fs::is_regular_file(path, ec)) { // Built earlier, possibly for another project
+			proxy.status.state = ProxyState::Ready;
+			proxy.status.framesDone = media.frameCount;
+		} else {
+			proxy.status.state = ProxyState::Queued;
+			m_buildQueue.push_back(path);
+		}
+	}
+	m_queued.notify_all();
+}
+
+ProxyStatus ProxyManager::status(uint32_t resource) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (resource >= m_resourceProxies.size() || m_resourceProxies[resource].empty()) return {};
+	return m_proxies.at(m_resourceProxies[resource]).status;
+}
+
+uint64_t ProxyManager::diskUsage() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_diskUsage;
+}
+
+FrameDecoder ProxyManager::previewDecoder() {
+	return [this](const FrameKey& key) {
+		const std::shared_ptr<Y4mReader> reader = readerFor(key.resource);
+		if (reader && key.frame < reader->frameCount()) return reader->readFrame(key.frame);
+		return m_source(key);
+	};
+}
+
+std::shared_ptr<Y4mReader> ProxyManager::readerFor(uint32_t resource) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (resource >= m_resourceProxies.size() || m_resourceProxies[resource].empty()) return nullptr;
+	Proxy& proxy = m_proxies.at(m_resourceProxies[resource]);
+	if (proxy.status.state != ProxyState::Ready) return nullptr;
+
+	if (!proxy.reader) {
+		try {
+			proxy.reader = std::make_shared<Y4mReader>(proxy.status.path);
+		} catch (const std::exception& e) { // Deleted or damaged since; the source still works
+			proxy.status.state = ProxyState::Failed;
+			proxy.status.error = e.what();
+			return nullptr;
+		}
+	}
+	return proxy.reader;
+}
+
+void ProxyManager::builderLoop() {
+	for (;;) {
+		std::string path;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this]() { return m_stopping || !m_buildQueue.empty(); });
+			if (m_stopping) return;
+			path = std::move(m_buildQueue.front());
+			m_buildQueue.pop_front();
+			m_proxies.at(path).status.state = ProxyState::Building;
+		}
+
+		std::string error;
+		try {
+			build(path);
+		} catch (const std::exception& e) {
+			error = e.what();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ProxyStatus& status = m_proxies.at(path).status;
+		if (error.empty()) {
+			std::error_code ec;
+			const uint64_t size = fs::file_size(path, ec);
+			if (!ec) m_diskUsage += size;
+			status.state = ProxyState::Ready;
+		} else {
+			status.state = ProxyState::Failed;
+			status.error = std::move(error);
+		}
+	}
+}
+
+void ProxyManager::build(const std::string& path) {
+	Proxy proxy;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		proxy = m_proxies.at(path);
+	}
+
+	const std::string temp_path = path + ".part";
+	std::string error;
+	{
+		Y4mWriter writer(temp_path, proxy.width, proxy.height, proxy.frameRateNumerator, proxy.frameRateDenominator);
+		BoundedQueue<DecodedFrame> decoded(m_settings.queueDepth);
+		BoundedQueue<std::vector<uint8_t>> converted(m_settings.queueDepth);
+
+		// The first error stops every stage: both queues are closed and emptied, which releases anyone blocked on them
+		std::mutex error_mutex;
+		auto fail = [&](const std::string& what) {
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (error.empty()) error = what;
+			}
+			decoded.close(true);
+			converted.close(true);
+		};
+
+		std::thread decode_stage([&]() {
+			try {
+				for (int64_t frame = 0; frame < proxy.status.frameCount && !m_cancel; frame++) {
+					DecodedFrame decoded_frame = m_source({proxy.sourceResource, frame});
+					if (decoded_frame.format != PixelFormat::Rgba8) throw std::runtime_error("proxy sources must decode to RGBA8!");
+					if (!decoded.push(std::move(decoded_frame))) break;
+				}
+			} catch (const std::exception& e) {
+				fail(e.what());
+			}
+			decoded.close();
+		});
+
+		std::thread write_stage([&]() {
+			try {
+				std::vector<uint8_t> planes;
+				while (converted.pop(planes)) {
+					writer.writeFrame(planes);
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_proxies.at(path).status.framesDone++;
+				}
+				writer.finish();
+			} catch (const std::exception& e) {
+				fail(e.what());
+			}
+		});
+
+		try {
+			DecodedFrame frame;
+			while (decoded.pop(frame)) {
+				std::vector<uint8_t> planes;
+				rgbaToI420(downscaleRgba8(frame, proxy.width, proxy.height), planes);
+				if (!converted.push(std::move(planes))) break;
+			}
+		} catch (const std::exception& e) {
+			fail(e.what());
+		}
+		converted.close();
+
+		decode_stage.join();
+		write_stage.join();
+		if (error.empty() && m_cancel) error = "proxy build cancelled";
+	}
+
+	std::error_code ec;
+	if (error.empty()) fs::rename(temp_path, path, ec);
+	if (!error.empty() || ec) {
+		fs::remove(temp_path, ec);
+		throw std::runtime_error(error.empty() ? "failed to move proxy into place!" : error);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "frame_cache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ResourceRegistry;
+class Y4mReader;
+
+struct ProxySettings {
+	uint32_t height = 540;   // Sources taller than this get a proxy of this height
+	size_t queueDepth = 8;   // Frames buffered between pipeline stages
+};
+
+enum class ProxyState { None, Queued, Building, Ready, Failed };
+
+struct ProxyStatus {
+	ProxyState state = ProxyState::None;
+	int64_t framesDone = 0;
+	int64_t frameCount = 0;
+	std::string path;
+	std::string error;
+
+	double progress() const { return frameCount ? double(framesDone) / double(frameCount) : 0.0; }
+};
+
+/// Builds downscaled copies of a project's large media in the background, and serves them to the preview.
+///
+/// update() looks at what the resource registry found and queues a proxy for every resource taller than the proxy
+/// height. Proxies are YUV4MPEG2 files in the cache directory named after the source's content hash, so they
+/// survive the source being moved and are shared between projects. Each build streams frames through three
+/// stages on their own threads (decode, scale and convert, write) joined by bounded queues, so the slowest stage
+/// sets the pace and at most a few frames are in memory. Builds run one at a time; a half-built proxy is never
+/// used, because it is only renamed into place once complete.
+///
+/// previewDecoder() reads proxies for resources that have one and falls back to the source decoder otherwise;
+/// export keeps using the source decoder, so it always renders from the originals. Proxy frames are smaller than
+/// the source's, so whatever draws them must scale to its target.
+class ProxyManager {
+public:
+	ProxyManager(FrameDecoder source, std::string directory = defaultDirectory(), ProxySettings settings = {});
+	/// Abandons the running build and whatever is queued.
+	~ProxyManager();
+
+	ProxyManager(const ProxyManager&) = delete;
+	ProxyManager& operator=(const ProxyManager&) = delete;
+
+	/// Pick up resources the registry has probed since the last call (or since it opened another project).
+	void update(const ResourceRegistry& registry);
+
+	/// Status of the proxy for project resource `resource`; None if it needs none or is unknown.
+	ProxyStatus status(uint32_t resource) const;
+	/// Bytes taken up by finished proxies in the directory.
+	uint64_t diskUsage() const;
+
+	/// Decodes from proxies where they are ready, and from the source otherwise.
+	FrameDecoder previewDecoder();
+	/// Always decodes from the source.
+	const FrameDecoder& exportDecoder() const { return m_source; }
+
+	/// "proxies" in the cache directory.
+	static std::string defaultDirectory();
+
+private:
+	struct Proxy {
+		ProxyStatus status;
+		uint32_t sourceResource; // A resource with this content, for the source decoder
+		uint32_t width, height;
+		uint32_t frameRateNumerator, frameRateDenominator;
+		std::shared_ptr<Y4mReader> reader; // Opened on first use once Ready
+	};
+
+	FrameDecoder m_source;
+	std::string m_directory;
+	ProxySettings m_settings;
+
+	mutable std::mutex m_mutex; // Guards everything below
+	std::condition_variable m_queued;
+	std::unordered_map<std::string, Proxy> m_proxies; // By proxy path
+	std::vector<std::string> m_resourceProxies;       // Proxy path per project resource; empty if none
+	std::deque<std::string> m_buildQueue;
+	uint64_t m_diskUsage = 0;
+	bool m_stopping = false;
+
+	std::atomic<bool> m_cancel{false}; // Abandon the running build
+	std::thread m_builder;
+
+	void builderLoop();
+	/// Build the proxy at `path`, throwing on failure. Called without m_mutex held.
+	void build(const std::string& path);
+	std::shared_ptr<Y4mReader> readerFor(uint32_t resource);
+};
@@ -0,0 +1,347 @@
+#include "resource_registry.h"
+
+#include "hash.h"
+#include "paths.h"
+#include "thread_pool.h"
+#include "y4m.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint64_t HASH_CHUNK = 64 * 1024;
+
+// The index file: this header, then `recordCount` records of a length-prefixed path and the fields of
+// IndexRecord, all little-endian as written by this machine
+struct IndexHeader {
+	char magic[4]; // "VMIX"
+	uint32_t version;
+	uint64_t recordCount;
+	uint64_t dataSize;
+	uint64_t checksum; // FNV-1a of the records
+};
+
+constexpr char INDEX_MAGIC[4] = {'V', 'M', 'I', 'X'};
+constexpr uint32_t INDEX_VERSION = 1;
+
+std::string normalize(const fs::path& path) {
+	std::error_code ec;
+	fs::path absolute = fs::absolute(path, ec);
+	return (ec ? path : absolute).lexically_normal().string();
+}
+
+template<typename T>
+void append(std::vector<char>& out, const T& value) {
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+template<typename T>
+bool take(std::string_view& in, T& value) {
+	if (in.size() < sizeof(value)) return false;
+	std::memcpy(&value, in.data(), sizeof(value));
+	in.remove_prefix(sizeof(value));
+	return true;
+}
+
+} // namespace
+
+bool probeMedia(const std::string& path, MediaInfo& info) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) throw std::runtime_error("failed to open media file '" + path + "'!");
+
+	char buffer[1024];
+	file.read(buffer, sizeof(buffer));
+	Y4mFormat format;
+	if (!parseY4mHeader(std::string_view(buffer, static_cast<size_t>(file.gcount())), format)) return false;
+
+	const uint64_t frame_stride = Y4M_FRAME_HEADER_SIZE + format.frameSize();
+	info.width = format.width;
+	info.height = format.height;
+	info.frameRateNumerator = format.frameRateNumerator;
+	info.frameRateDenominator = format.frameRateDenominator;
+	info.frameCount = info.fileSize > format.headerSize ? static_cast<int64_t>((info.fileSize - format.headerSize) / frame_stride) : 0;
+	return true;
+}
+
+uint64_t hashMediaFile(const std::string& path, uint64_t fileSize) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) throw std::runtime_error("failed to open media file '" + path + "'!");
+
+	uint64_t h = fnv1a64(&fileSize, sizeof(fileSize));
+	std::vector<char> chunk(HASH_CHUNK);
+	auto hash_range = [&](uint64_t offset, uint64_t size) {
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(chunk.data(), static_cast<std::streamsize>(size));
+		if (static_cast<uint64_t>(file.gcount()) != size) throw std::runtime_error("failed to read media file '" + path + "'!");
+		h = fnv1a64(chunk.data(), size, h);
+	};
+
+	if (fileSize <= 3 * HASH_CHUNK) { // Small enough to hash whole
+		for (uint64_t offset = 0; offset < fileSize; offset += HASH_CHUNK) {
+			hash_range(offset, fileSize - offset < HASH_CHUNK ? fileSize - offset : HASH_CHUNK);
+		}
+	} else {
+		hash_range(0, HASH_CHUNK);
+		hash_range(fileSize / 2 - HASH_CHUNK / 2, HASH_CHUNK);
+		hash_range(fileSize - HASH_CHUNK, HASH_CHUNK);
+	}
+	return h;
+}
+
+ResourceRegistry::ResourceRegistry(ThreadPool& pool, std::string indexPath, MediaProbe probe)
+	: m_pool(pool), m_indexPath(std::move(indexPath)), m_probe(std::move(probe)) {
+	loadIndex();
+}
+
+ResourceRegistry::~ResourceRegistry() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_settled.wait(lock, [this]() { return m_running == 0; });
+}
+
+std::string ResourceRegistry::defaultIndexPath() {
+	return joinPath(cacheDirectory(), "media_index.bin");
+}
+
+void ResourceRegistry::open(const Project& project) {
+	std::error_code ec;
+	const std::string project_directory = project.path.empty() ? normalize(fs::current_path(ec))
+	                                                          : normalize(fs::path(project.path).parent_path());
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const uint64_t generation = ++m_generation;
+	m_stats = {};
+	m_resources.clear();
+	for (const Resource& resource : project.resources) {
+		ResourceInfo info;
+		info.id = resource.id;
+		info.path = resource.path;
+		m_resources.push_back(std::move(info));
+	}
+	m_pending = m_resources.size();
+	m_running += m_resources.size();
+
+	for (size_t i = 0; i < project.resources.size(); i++) {
+		m_pool.submit([this, generation, i, path = project.resources[i].path, project_directory]() {
+			probeJob(generation, i, path, project_directory);
+		});
+	}
+	m_settled.notify_all();
+}
+
+size_t ResourceRegistry::size() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_resources.size();
+}
+
+ResourceInfo ResourceRegistry::info(size_t index) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_resources.at(index);
+}
+
+bool ResourceRegistry::settled() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending == 0;
+}
+
+void ResourceRegistry::waitSettled() const {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_settled.wait(lock, [this]() { return m_pending == 0; });
+}
+
+ResourceRegistryStats ResourceRegistry::stats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+bool ResourceRegistry::save() {
+	std::vector<char> data;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_indexPath.empty() || !m_indexDirty) return true;
+
+		IndexHeader header{};
+		std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+		header.version = INDEX_VERSION;
+		header.recordCount = m_index.size();
+		data.resize(sizeof(header));
+		for (const auto& [path, record] : m_index) {
+			append(data, static_cast<uint32_t>(path.size()));
+			data.insert(data.end(), path.begin(), path.end());
+			append(data, record.modified);
+			append(data, record.media.frameCount);
+			append(data, record.media.frameRateNumerator);
+			append(data, record.media.frameRateDenominator);
+			append(data, record.media.width);
+			append(data, record.media.height);
+			append(data, record.media.fileSize);
+			append(data, record.media.contentHash);
+		}
+		header.dataSize = data.size() - sizeof(header);
+		header.checksum = fnv1a64(data.data() + sizeof(header), header.dataSize);
+		std::memcpy(data.data(), &header, sizeof(header));
+		m_indexDirty = false;
+	}
+
+	if (writeFileAtomically(m_indexPath, data.data(), data.size())) return true;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_indexDirty = true;
+	return false;
+}
+
+void ResourceRegistry::loadIndex() {
+	if (m_indexPath.empty()) return;
+	std::ifstream file(m_indexPath, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) return;
+
+	const size_t file_size = static_cast<size_t>(file.tellg());
+	if (file_size < sizeof(IndexHeader)) return;
+	std::vector<char> data(file_size);
+	file.seekg(0);
+	file.read(data.data(), static_cast<std::streamsize>(data.size()));
+	if (!file.good()) return;
+
+	// Anything wrong with the file and the index starts out empty; it is only a cache
+	IndexHeader header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION
+		|| header.dataSize != file_size - sizeof(header) || fnv1a64(data.data() + sizeof(header), header.dataSize) != header.checksum) {
+		return;
+	}
+
+	std::string_view in(data.data() + sizeof(header), header.dataSize);
+	for (uint64_t i = 0; i < header.recordCount; i++) {
+		uint32_t path_size;
+		if (!take(in, path_size) || in.size() < path_size) break;
+		std::string path(in.substr(0, path_size));
+		in.remove_prefix(path_size);
+
+		IndexRecord record;
+		if (!take(in, record.modified) || !take(in, record.media.frameCount) || !take(in, record.media.frameRateNumerator)
+			|| !take(in, record.media.frameRateDenominator) || !take(in, record.media.width) || !take(in, record.media.height)
+			|| !take(in, record.media.fileSize) || !take(in, record.media.contentHash)) {
+			break;
+		}
+		indexFile(path, record);
+	}
+	m_indexDirty = false;
+}
+
+void ResourceRegistry::indexFile(const std::string& path, const IndexRecord& record) {
+	auto [it, inserted] = m_index.insert_or_assign(path, record);
+	if (inserted) m_byName.emplace(fs::path(path).filename().string(), path);
+	m_indexDirty = true;
+}
+
+bool ResourceRegistry::examine(const std::string& path, MediaInfo& media, bool& fromIndex) {
+	std::error_code ec;
+	if (!fs::is_regular_file(path, ec)) return false;
+	const uint64_t size = fs::file_size(path, ec);
+	if (ec) return false;
+	const int64_t modified = static_cast<int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+	if (ec) return false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_index.find(path);
+		if (found != m_index.end() && found->second.modified == modified && found->second.media.fileSize == size) {
+			media = found->second.media;
+			fromIndex = true;
+			return true;
+		}
+	}
+
+	MediaInfo probed;
+	probed.fileSize = size;
+	probed.contentHash = hashMediaFile(path, size);
+	m_probe(path, probed);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	indexFile(path, {modified, probed});
+	media = probed;
+	fromIndex = false;
+	return true;
+}
+
+void ResourceRegistry::probeJob(uint64_t generation, size_t index, std::string path, std::string projectDirectory) {
+	const fs::path requested(path);
+	const std::string absolute = normalize(requested.is_absolute() ? requested : fs::path(projectDirectory) / requested);
+
+	ResourceStatus status = ResourceStatus::Missing;
+	std::string resolved;
+	std::string error;
+	MediaInfo media;
+	bool from_index = false;
+	bool relocated = false;
+
+	try {
+		if (examine(absolute, media, from_index)) {
+			status = ResourceStatus::Ready;
+			resolved = absolute;
+		} else {
+			// Next to the project first, then wherever the index has seen a file of that name
+			const std::string name = fs::path(absolute).filename().string();
+			const std::string beside_project = normalize(fs::path(projectDirectory) / name);
+			uint64_t expected_hash = 0;
+			std::vector<std::string> candidates;
+			if (beside_project != absolute) candidates.push_back(beside_project);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto known = m_index.find(absolute);
+				if (known != m_index.end()) expected_hash = known->second.media.contentHash;
+				auto [first, last] = m_byName.equal_range(name);
+				for (auto it = first; it != last; ++it) {
+					if (it->second != absolute && it->second != beside_project) candidates.push_back(it->second);
+				}
+			}
+
+			for (const std::string& candidate : candidates) {
+				MediaInfo candidate_media;
+				bool candidate_from_index = false;
+				try {
+					if (!examine(candidate, candidate_media, candidate_from_index)) continue;
+				} catch (const std::exception&) {
+					continue; // An unreadable candidate is no match
+				}
+				const bool matches = expected_hash != 0 ? candidate_media.contentHash == expected_hash : candidate == beside_project;
+				if (matches) {
+					status = ResourceStatus::Ready;
+					resolved = candidate;
+					media = candidate_media;
+					from_index = candidate_from_index;
+					relocated = true;
+					break;
+				}
+			}
+		}
+	} catch (const std::exception& e) {
+		status = ResourceStatus::Failed;
+		resolved = absolute;
+		error = e.what();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_running--;
+	if (generation == m_generation) {
+		ResourceInfo& info = m_resources[index];
+		info.status = status;
+		info.resolvedPath = std::move(resolved);
+		info.fromIndex = from_index;
+		info.media = media;
+		info.error = std::move(error);
+
+		if (status == ResourceStatus::Ready) (from_index ? m_stats.indexHits : m_stats.probed)++;
+		if (status == ResourceStatus::Missing) m_stats.missing++;
+		if (status == ResourceStatus::Failed) m_stats.failed++;
+		if (relocated) m_stats.relocated++;
+		m_pending--;
+	}
+	m_settled.notify_all();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "project.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+/// What probing a media file found out. Stream properties are zero when the file's format is not understood.
+struct MediaInfo {
+	int64_t frameCount = 0;
+	uint32_t frameRateNumerator = 0;
+	uint32_t frameRateDenominator = 1;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint64_t fileSize = 0;
+	uint64_t contentHash = 0; // See hashMediaFile()
+
+	double frameRate() const { return frameRateDenominator ? double(frameRateNumerator) / frameRateDenominator : 0.0; }
+	double durationSeconds() const { return frameRateNumerator ? double(frameCount) * frameRateDenominator / frameRateNumerator : 0.0; }
+};
+
+/// Fills in the stream properties of `info` for the file at `path`. Returns false if it does not understand the
+/// format; throws std::runtime_error if the file cannot be read.
+using MediaProbe = std::function<bool(const std::string& path, MediaInfo& info)>;
+
+/// The probe used when no other is given. Understands YUV4MPEG2 (.y4m) streams; other formats get only their size
+/// and content hash until a decoder library provides a probe.
+bool probeMedia(const std::string& path, MediaInfo& info);
+
+/// A fast fingerprint of a media file: its size and 64 KiB from each of its start, middle and end. Media files
+/// differ early (headers) and late (indices), so this tells them apart without reading gigabytes.
+uint64_t hashMediaFile(const std::string& path, uint64_t fileSize);
+
+enum class ResourceStatus {
+	Probing,
+	Ready,   // Found and probed
+	Missing, // Neither the path nor any fallback location has the file
+	Failed,  // Found but unreadable; see ResourceInfo::error
+};
+
+struct ResourceInfo {
+	std::string id;
+	std::string path;         // As written in the project
+	std::string resolvedPath; // Where the file was found, which may be a fallback location
+	ResourceStatus status = ResourceStatus::Probing;
+	bool fromIndex = false;   // Known from the metadata index, so nothing had to be probed
+	MediaInfo media;
+	std::string error;
+};
+
+struct ResourceRegistryStats {
+	size_t indexHits = 0;
+	size_t probed = 0;
+	size_t relocated = 0; // Found through the missing-file fallback
+	size_t missing = 0;
+	size_t failed = 0;
+};
+
+/// The media files a project uses and what is known about them.
+///
+/// open() returns at once; every resource is then located and probed on the thread pool. Results are kept in a
+/// metadata index on disk keyed by path, modification time and size, so reopening a project only stats its
+/// files. A resource missing from its path is looked for next to the project file, as design.md describes, and
+/// wherever the index last saw a file of the same name; a candidate is accepted if its content hash matches the
+/// one the index remembers for the original path (or by name alone, when there is none).
+class ResourceRegistry {
+public:
+	/// `indexPath` empty means no persistent index.
+	explicit ResourceRegistry(ThreadPool& pool, std::string indexPath = defaultIndexPath(), MediaProbe probe = probeMedia);
+	/// Waits for running probes. Does not save the index.
+	~ResourceRegistry();
+
+	ResourceRegistry(const ResourceRegistry&) = delete;
+	ResourceRegistry& operator=(const ResourceRegistry&) = delete;
+
+	/// Start locating and probing the resources of `project`, replacing the previous project's. Relative paths are
+	/// relative to the project file (or the working directory if it has none).
+	void open(const Project& project);
+
+	size_t size() const;
+	/// A snapshot of resource `index`, in the order of Project::resources.
+	ResourceInfo info(size_t index) const;
+	/// True once no resource is still being probed.
+	bool settled() const;
+	void waitSettled() const;
+	ResourceRegistryStats stats() const;
+
+	/// Write the index if it changed. Returns false if that failed.
+	bool save();
+
+	/// The index in the cache directory.
+	static std::string defaultIndexPath();
+
+private:
+	struct IndexRecord {
+		int64_t modified; // File time, in the file clock's ticks
+		MediaInfo media;
+	};
+
+	ThreadPool& m_pool;
+	std::string m_indexPath;
+	MediaProbe m_probe;
+
+	mutable std::mutex m_mutex; // Guards everything below
+	mutable std::condition_variable m_settled;
+	std::vector<ResourceInfo> m_resources;
+	uint64_t m_generation = 0; // Bumped by open(), so probes for a previous project are not applied
+	size_t m_pending = 0;      // Probes of the current generation still running
+	size_t m_running = 0;      // Probes of any generation still running
+	std::unordered_map<std::string, IndexRecord> m_index; // By absolute path
+	std::unordered_multimap<std::string, std::string> m_byName; // File name to absolute paths in m_index
+	bool m_indexDirty = false;
+	ResourceRegistryStats m_stats;
+
+	void loadIndex();
+	void indexFile(const std::string& path, const IndexRecord& record); // Called with m_mutex held
+
+	/// Locate and probe one resource. Runs on the pool without m_mutex held.
+	void probeJob(uint64_t generation, size_t index, std::string path, std::string projectDirectory);
+	/// Media info for the file at `path` if it exists, from the index when it is current. Returns false if the file
+	/// does not exist; throws if it cannot be read.
+	bool examine(const std::string& path, MediaInfo& media, bool& fromIndex);
+};
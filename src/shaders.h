@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pipeline_registry.h"
+
+// Generated at build time from shaders/ by viper_embed_shaders() (cmake/Modules/ViperShaders.cmake)
+#include "shaders/apply_lut_comp.h"
+#include "shaders/gui_frag.h"
+#include "shaders/gui_vert.h"
+#include "shaders/resize_comp.h"
+#include "shaders/shader_frag.h"
+#include "shaders/shader_vert.h"
+#include "shaders/yuv_to_rgba_comp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// The SPIR-V `words` of a shader embedded in the binary, as pipelines take it.
+template<size_t N>
+ShaderCode embeddedShader(const uint32_t (&words)[N]) {
+	const auto* bytes = reinterpret_cast<const char*>(words);
+	return std::make_shared<const std::vector<char>>(bytes, bytes + sizeof(words));
+}
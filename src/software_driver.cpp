@@ -0,0 +1,143 @@
+#include "software_driver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/// First pixel whose centre is at or right of `edge`; pixels are covered from there to the one before the end edge's.
+int32_t firstPixel(float edge) {
+	return static_cast<int32_t>(std::ceil(edge - 0.5f));
+}
+
+uint8_t toUnorm(float value) {
+	return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+} // namespace
+
+SoftwareDriver::SoftwareDriver(uint32_t width, uint32_t height) : m_width(width), m_height(height) {}
+
+void SoftwareDriver::initImpl() {
+	m_pixels.assign(size_t(m_width) * m_height * 4, 0);
+	m_textures.assign(1, {}); // The atlas, until updateAtlas()
+	m_atlasVersion = 0;
+}
+
+void SoftwareDriver::cleanupImpl() {
+	m_pixels = {};
+	m_textures = {};
+}
+
+void SoftwareDriver::updateAtlas(const GuiAtlas& atlas) {
+	if (atlas.version() == m_atlasVersion) return;
+	Texture& texture = m_textures[GuiBatch::ATLAS];
+	texture.width = atlas.size();
+	texture.height = atlas.size();
+	texture.pixels.assign(atlas.pixels(), atlas.pixels() + size_t(atlas.size()) * atlas.size() * 4);
+	m_atlasVersion = atlas.version();
+}
+
+uint32_t SoftwareDriver::addTexture(uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch) {
+	Texture texture;
+	texture.width = width;
+	texture.height = height;
+	texture.pixels.resize(size_t(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++) {
+		std::memcpy(&texture.pixels[size_t(y) * width * 4], pixels + y * rowPitch, size_t(width) * 4);
+	}
+	m_textures.push_back(std::move(texture));
+	return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+SoftwareCommands SoftwareDriver::commands(const GuiVertex* vertices) {
+	return SoftwareCommands(*this, vertices);
+}
+
+SoftwareCommands::SoftwareCommands(SoftwareDriver& driver, const GuiVertex* vertices)
+	: m_driver(driver), m_vertices(vertices), m_scissorX0(0), m_scissorY0(0), m_scissorX1(int32_t(driver.m_width)),
+	  m_scissorY1(int32_t(driver.m_height)) {}
+
+void SoftwareCommands::setScissorImpl(const DriverRect& rect) {
+	m_scissorX0 = std::clamp(rect.x, 0, int32_t(m_driver.m_width));
+	m_scissorY0 = std::clamp(rect.y, 0, int32_t(m_driver.m_height));
+	m_scissorX1 = std::clamp(rect.x + int32_t(rect.width), m_scissorX0, int32_t(m_driver.m_width));
+	m_scissorY1 = std::clamp(rect.y + int32_t(rect.height), m_scissorY0, int32_t(m_driver.m_height));
+}
+
+void SoftwareCommands::clearImpl(const std::vector<DriverRect>& rects, const float color[4]) {
+	const uint8_t texel[4] = {toUnorm(color[0]), toUnorm(color[1]), toUnorm(color[2]), toUnorm(color[3])};
+	const int32_t width = int32_t(m_driver.m_width);
+	const int32_t height = int32_t(m_driver.m_height);
+	for (const DriverRect& rect : rects) {
+		const int32_t x0 = std::clamp(rect.x, 0, width);
+		const int32_t x1 = std::clamp(rect.x + int32_t(rect.width), x0, width);
+		for (int32_t y = std::max(rect.y, 0); y < std::min(rect.y + int32_t(rect.height), height); y++) {
+			uint8_t* row = &m_driver.m_pixels[(size_t(y) * width + x0) * 4];
+			for (int32_t x = x0; x < x1; x++, row += 4) std::memcpy(row, texel, 4);
+		}
+	}
+}
+
+void SoftwareCommands::drawQuadsImpl(uint32_t firstVertex, uint32_t quadCount) {
+	for (uint32_t quad = 0; quad < quadCount; quad++) drawQuad(m_vertices + firstVertex + 4 * quad);
+}
+
+void SoftwareCommands::drawQuad(const GuiVertex* v) {
+	const GuiVertex& a = v[0];
+	const GuiVertex& b = v[2];
+	const int32_t x0 = std::max(firstPixel(a.x), m_scissorX0);
+	const int32_t y0 = std::max(firstPixel(a.y), m_scissorY0);
+	const int32_t x1 = std::min(firstPixel(b.x), m_scissorX1);
+	const int32_t y1 = std::min(firstPixel(b.y), m_scissorY1);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	const SoftwareDriver::Texture& texture = *m_texture;
+	const float color[4] = {float(a.color & 0xff) / 255.0f, float((a.color >> 8) & 0xff) / 255.0f,
+	                        float((a.color >> 16) & 0xff) / 255.0f, float(a.color >> 24) / 255.0f};
+
+	// Everything varies linearly across the quad, so it steps by a constant per pixel
+	const float du = (b.u - a.u) / (b.x - a.x);
+	const float dv = (b.v - a.v) / (b.y - a.y);
+	const float dlocal_x = (b.localX - a.localX) / (b.x - a.x);
+	const float dlocal_y = (b.localY - a.localY) / (b.y - a.y);
+	const float start_x = float(x0) + 0.5f - a.x;
+	const float inner_x = a.halfWidth - a.radius;
+	const float inner_y = a.halfHeight - a.radius;
+	const bool additive = m_blend == GuiBlend::Additive;
+
+	for (int32_t y = y0; y < y1; y++) {
+		const float offset_y = float(y) + 0.5f - a.y;
+		const float tex_v = a.v + offset_y * dv;
+		const float local_y = a.localY + offset_y * dlocal_y;
+		const uint32_t texel_y = std::min(static_cast<uint32_t>(std::max(tex_v * float(texture.height), 0.0f)), texture.height - 1);
+		const uint8_t* texture_row = &texture.pixels[size_t(texel_y) * texture.width * 4];
+		uint8_t* out = &m_driver.m_pixels[(size_t(y) * m_driver.m_width + x0) * 4];
+
+		for (int32_t x = x0; x < x1; x++, out += 4) {
+			const float offset_x = start_x + float(x - x0);
+			const float tex_u = a.u + offset_x * du;
+			const uint32_t texel_x = std::min(static_cast<uint32_t>(std::max(tex_u * float(texture.width), 0.0f)), texture.width - 1);
+			const uint8_t* texel = texture_row + size_t(texel_x) * 4;
+
+			float alpha = color[3] * float(texel[3]) / 255.0f;
+			if (a.radius > 0) { // As in gui.frag
+				const float corner_x = std::abs(a.localX + offset_x * dlocal_x) - inner_x;
+				const float corner_y = std::abs(local_y) - inner_y;
+				const float outside = std::hypot(std::max(corner_x, 0.0f), std::max(corner_y, 0.0f));
+				const float distance = outside + std::min(std::max(corner_x, corner_y), 0.0f) - a.radius;
+				alpha *= std::clamp(0.5f - distance, 0.0f, 1.0f);
+			}
+			if (alpha <= 0) continue;
+
+			// Like the GUI pipelines' blend state: straight alpha or additive color, coverage accumulating either way
+			for (int c = 0; c < 3; c++) {
+				const float source = color[c] * float(texel[c]) / 255.0f * alpha;
+				const float destination = float(out[c]) / 255.0f;
+				out[c] = toUnorm(source + destination * (additive ? 1.0f : 1.0f - alpha));
+			}
+			out[3] = toUnorm(alpha + float(out[3]) / 255.0f * (1.0f - alpha));
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "driver.h"
+#include "gui_batch.h"
+
+#include <cstdint>
+#include <vector>
+
+class SoftwareCommands;
+
+/// The CPU backend: rasterizes into an RGBA8 image in memory.
+///
+/// It needs no GPU at all, so the rendering stack above the driver can be run, tested and profiled on machines
+/// without one (such as CI runners), and its output compared with the Vulkan backend's headless frames. Only what
+/// the driver interface draws is supported: clears and GUI quads, shaded like the GUI shaders do (texture times
+/// color, rounded corners by signed distance) with nearest-texel sampling.
+class SoftwareDriver : public Driver<SoftwareDriver> {
+public:
+	static constexpr const char* NAME = "software";
+
+	SoftwareDriver(uint32_t width, uint32_t height);
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	/// The render target: RGBA, tightly packed rows, top first.
+	const uint8_t* pixels() const { return m_pixels.data(); }
+
+	/// Use `atlas` as GuiBatch::ATLAS, copying it again only if it changed since the last call.
+	void updateAtlas(const GuiAtlas& atlas);
+	/// Add an RGBA texture for GuiBatch::image(), returning its texture id.
+	uint32_t addTexture(uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch);
+
+	/// A command list drawing GUI quads from `vertices` (the output of GuiBatch::build()), which must outlive it.
+	SoftwareCommands commands(const GuiVertex* vertices);
+
+private:
+	friend class Driver<SoftwareDriver>;
+	friend class SoftwareCommands;
+
+	struct Texture {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> pixels; // RGBA
+	};
+
+	uint32_t m_width;
+	uint32_t m_height;
+	std::vector<uint8_t> m_pixels;
+	std::vector<Texture> m_textures; // By texture id; entry 0 is the atlas
+	uint64_t m_atlasVersion = 0;
+
+	void initImpl();
+	void cleanupImpl();
+};
+
+/// Draws straight into a SoftwareDriver's image. See DriverCommands.
+class SoftwareCommands : public DriverCommands<SoftwareCommands> {
+public:
+	SoftwareCommands(SoftwareDriver& driver, const GuiVertex* vertices);
+
+private:
+	friend class DriverCommands<SoftwareCommands>;
+
+	SoftwareDriver& m_driver;
+	const GuiVertex* m_vertices;
+	int32_t m_scissorX0, m_scissorY0, m_scissorX1, m_scissorY1; // Clamped to the image
+	GuiBlend m_blend = GuiBlend::Alpha;
+	const SoftwareDriver::Texture* m_texture = nullptr;
+
+	void setScissorImpl(const DriverRect& rect);
+	void clearImpl(const std::vector<DriverRect>& rects, const float color[4]);
+	void bindGuiBlendImpl(GuiBlend blend) { m_blend = blend; }
+	void bindGuiTextureImpl(uint32_t texture) { m_texture = &m_driver.m_textures.at(texture); }
+	void drawQuadsImpl(uint32_t firstVertex, uint32_t quadCount);
+
+	/// Rasterize the axis-aligned quad of vertices `v[0]` (top left) to `v[2]` (bottom right).
+	void drawQuad(const GuiVertex* v);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/// A lock-free ring of preallocated slots between exactly one producer thread and one consumer thread.
+///
+/// Slots are constructed once, up front, and then filled and read in place, so neither side ever allocates:
+/// the producer fills back() and publishes it with push(), and the consumer reads front() and hands it back with
+/// pop(). Each side keeps its own index on its own cache line, along with a cached copy of the other side's,
+/// so the two threads only touch each other's line when the ring looks full or empty.
+template<typename T>
+class SpscRing {
+public:
+	/// Capacity is rounded up to a power of two.
+	explicit SpscRing(size_t capacity) {
+		size_t slots = 1;
+		while (slots < capacity) slots *= 2;
+		m_slots = std::make_unique<T[]>(slots);
+		m_mask = slots - 1;
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	size_t capacity() const { return m_mask + 1; }
+	/// Slots in use. Exact only on the producer or consumer thread, and only as of the call.
+	size_t size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+	/// Producer: the next free slot, or null if the ring is full.
+	T* back() {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_producerHead > m_mask) {
+			m_producerHead = m_head.load(std::memory_order_acquire);
+			if (tail - m_producerHead > m_mask) return nullptr;
+		}
+		return &m_slots[tail & m_mask];
+	}
+	/// Producer: hand the slot from back() to the consumer.
+	void push() { m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/// Consumer: the oldest filled slot, or null if the ring is empty.
+	T* front() {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_consumerTail) {
+			m_consumerTail = m_tail.load(std::memory_order_acquire);
+			if (head == m_consumerTail) return nullptr;
+		}
+		return &m_slots[head & m_mask];
+	}
+	/// Consumer: give the slot from front() back to the producer.
+	void pop() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+	static constexpr size_t CACHE_LINE = 64;
+
+	std::unique_ptr<T[]> m_slots;
+	size_t m_mask = 0;
+
+	alignas(CACHE_LINE) std::atomic<size_t> m_tail{0}; // Written by the producer
+	size_t m_producerHead = 0;                         // The producer's last look at m_head
+	alignas(CACHE_LINE) std::atomic<size_t> m_head{0}; // Written by the consumer
+	size_t m_consumerTail = 0;                         // The consumer's last look at m_tail
+};
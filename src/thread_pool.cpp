@@ -0,0 +1,68 @@
+#include "thread_pool.h"
+
+namespace {
+
+thread_local size_t t_workerIndex = ThreadPool::NOT_A_WORKER;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 1; // The count is only a hint and may be unknown
+	}
+
+	m_workers.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; i++) {
+		m_workers.emplace_back([this, i]() { workerLoop(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_jobAvailable.notify_all();
+	for (auto& worker : m_workers) worker.join();
+}
+
+size_t ThreadPool::workerIndex() {
+	return t_workerIndex;
+}
+
+void ThreadPool::waitIdle() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return m_jobs.empty() && m_active == 0; });
+}
+
+void ThreadPool::enqueue(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop(size_t index) {
+	t_workerIndex = index;
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+			if (m_jobs.empty()) return; // Only reached when stopping
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_active++;
+		}
+
+		job(); // packaged_task captures exceptions, so this does not throw
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_active--;
+			if (m_jobs.empty() && m_active == 0) m_idle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// A fixed set of worker threads pulling jobs from a shared queue.
+class ThreadPool {
+public:
+	/// Start `threadCount` workers; zero means one per hardware thread.
+	explicit ThreadPool(size_t threadCount = 0);
+	/// Finishes all queued jobs, then joins the workers.
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const { return m_workers.size(); }
+
+	/// Index of the calling thread among the workers of whichever pool it belongs to, or NOT_A_WORKER.
+	/// Lets jobs use per-worker state (such as command pools) without locking.
+	static size_t workerIndex();
+	static constexpr size_t NOT_A_WORKER = static_cast<size_t>(-1);
+
+	/// Queue `job` and return a future for its result. Exceptions thrown by the job surface through the future.
+	template<typename F>
+	auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> future = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return future;
+	}
+
+	/// Block until every job queued so far has finished.
+	void waitIdle();
+
+private:
+	void enqueue(std::function<void()> job);
+	void workerLoop(size_t index);
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::condition_variable m_idle;
+	size_t m_active = 0;
+	bool m_stopping = false;
+};
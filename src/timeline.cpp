@@ -0,0 +1,101 @@
+#include "timeline.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+void TrackTimeline::assign(const Track& track) {
+	const size_t n = track.segments.size();
+	m_kind = track.kind;
+
+	// Sort a permutation rather than the segments, so each column is written exactly once
+	std::vector<uint32_t> order(n);
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return track.segments[a].trackFrame < track.segments[b].trackFrame;
+	});
+
+	m_start.resize(n);
+	m_end.resize(n);
+	m_clipFrame.resize(n);
+	m_resource.resize(n);
+	m_sourceIndex.resize(n);
+
+	for (size_t i = 0; i < n; i++) {
+		const Segment& segment = track.segments[order[i]];
+		m_start[i] = segment.trackFrame;
+		m_clipFrame[i] = segment.clipFrame;
+		m_resource[i] = segment.resource;
+		m_sourceIndex[i] = order[i];
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const Segment& segment = track.segments[order[i]];
+		if (segment.length != Segment::UNTIL_NEXT) {
+			m_end[i] = segment.trackFrame + segment.length;
+		} else if (i + 1 < n) {
+			m_end[i] = m_start[i + 1];
+		} else {
+			m_end[i] = std::numeric_limits<int64_t>::max(); // Open-ended: plays until its resource runs out
+		}
+	}
+
+	buildIndex();
+}
+
+void TrackTimeline::buildIndex() {
+	const int64_t n = static_cast<int64_t>(m_start.size());
+	m_maxEnd = m_end;
+	m_rootLevel = -1;
+	if (n == 0) return;
+
+	// Leaves (even indices) already hold their own end. Fill each level above from its two children; the
+	// rightmost path may point past the end of the array, so track the max end of the last real subtree.
+	int64_t last_i = 0;
+	int64_t last = 0;
+	for (int64_t i = 0; i < n; i += 2) {
+		last_i = i;
+		last = m_maxEnd[i];
+	}
+
+	int level = 1;
+	for (; (int64_t(1) << level) <= n; level++) {
+		const int64_t x = int64_t(1) << (level - 1);
+		const int64_t i0 = (x << 1) - 1;
+		const int64_t step = x << 2;
+		for (int64_t i = i0; i < n; i += step) {
+			const int64_t left = m_maxEnd[i - x];
+			const int64_t right = i + x < n ? m_maxEnd[i + x] : last;
+			m_maxEnd[i] = std::max({m_end[i], left, right});
+		}
+		last_i = (last_i >> level & 1) ? last_i - x : last_i + x;
+		if (last_i < n && m_maxEnd[last_i] > last) last = m_maxEnd[last_i];
+	}
+	m_rootLevel = level - 1;
+}
+
+Timeline::Timeline(const Project& project) {
+	m_tracks.resize(project.tracks.size());
+	for (size_t i = 0; i < project.tracks.size(); i++) {
+		m_tracks[i].assign(project.tracks[i]);
+	}
+}
+
+void Timeline::activeAt(int64_t frame, std::vector<ActiveSegment>& out) const {
+	out.clear();
+	overlapping(frame, frame + 1, out);
+}
+
+void Timeline::overlapping(int64_t first, int64_t last, std::vector<ActiveSegment>& out) const {
+	for (uint32_t t = 0; t < m_tracks.size(); t++) {
+		const TrackTimeline& track = m_tracks[t];
+		const int64_t* start = track.starts().data();
+		const int64_t* clip_frame = track.clipFrames().data();
+		const uint32_t* resource = track.resources().data();
+
+		track.forEachOverlapping(first, last, [&](uint32_t i) {
+			const int64_t at = std::max(first, start[i]);
+			out.push_back({t, i, resource[i], clip_frame[i] + (at - start[i])});
+		});
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "project.h"
+
+#include <cstdint>
+#include <vector>
+
+/// One track of the timeline, stored as a structure of arrays sorted by start frame.
+///
+/// On top of the columns sits an implicit interval tree: the sorted array is viewed as a balanced binary tree
+/// (node i is at level = number of trailing one bits of i) and `maxEnd()[i]` holds the largest end frame in the
+/// subtree rooted at i. Stabbing and range queries walk that tree, so they cost O(log n + hits) and touch
+/// nothing but a few contiguous arrays.
+class TrackTimeline {
+public:
+	/// Build the columns and index for `track`. Segments lasting "until next" end where the following segment
+	/// starts; the last such segment is open-ended.
+	void assign(const Track& track);
+
+	size_t size() const { return m_start.size(); }
+	TrackKind kind() const { return m_kind; }
+
+	// Columns, all indexed by position in start-frame order
+	const std::vector<int64_t>& starts() const { return m_start; }
+	const std::vector<int64_t>& ends() const { return m_end; } // Exclusive
+	const std::vector<int64_t>& clipFrames() const { return m_clipFrame; }
+	const std::vector<uint32_t>& resources() const { return m_resource; }
+	const std::vector<uint32_t>& sourceIndices() const { return m_sourceIndex; } // Index into Track::segments
+	const std::vector<int64_t>& maxEnd() const { return m_maxEnd; }
+
+	/// Call `f(i)` for every segment overlapping the frame range [first, last), in start-frame order.
+	template<typename F>
+	void forEachOverlapping(int64_t first, int64_t last, F&& f) const;
+
+	/// Call `f(i)` for every segment covering `frame`.
+	template<typename F>
+	void forEachActive(int64_t frame, F&& f) const {
+		forEachOverlapping(frame, frame + 1, f);
+	}
+
+private:
+	TrackKind m_kind = TrackKind::Video;
+	std::vector<int64_t> m_start;
+	std::vector<int64_t> m_end;
+	std::vector<int64_t> m_clipFrame;
+	std::vector<uint32_t> m_resource;
+	std::vector<uint32_t> m_sourceIndex;
+	std::vector<int64_t> m_maxEnd;
+	int m_rootLevel = -1;
+
+	void buildIndex();
+};
+
+/// A segment that is playing at some frame, with the frame of its resource to show at that moment.
+struct ActiveSegment {
+	uint32_t track;
+	uint32_t segment;   // Position within the TrackTimeline
+	uint32_t resource;
+	int64_t clipFrame;
+};
+
+/// The query-side model of a project's [Tracks] section.
+class Timeline {
+public:
+	Timeline() = default;
+	explicit Timeline(const Project& project);
+
+	const std::vector<TrackTimeline>& tracks() const { return m_tracks; }
+
+	/// Replace `out` with the segments playing at `frame`, ordered by track then start frame.
+	void activeAt(int64_t frame, std::vector<ActiveSegment>& out) const;
+
+	/// Append the segments overlapping [first, last) to `out`, ordered by track then start frame.
+	/// `clipFrame` is the resource frame at max(first, segment start).
+	void overlapping(int64_t first, int64_t last, std::vector<ActiveSegment>& out) const;
+
+private:
+	std::vector<TrackTimeline> m_tracks;
+};
+
+template<typename F>
+void TrackTimeline::forEachOverlapping(int64_t first, int64_t last, F&& f) const {
+	if (m_rootLevel < 0 || first >= last) return;
+
+	const int64_t n = static_cast<int64_t>(m_start.size());
+	const int64_t* start = m_start.data();
+	const int64_t* end = m_end.data();
+	const int64_t* max_end = m_maxEnd.data();
+
+	struct Node {
+		int64_t x;
+		int level;
+		bool leftDone;
+	};
+	Node stack[64];
+	int top = 0;
+	stack[top++] = {(int64_t(1) << m_rootLevel) - 1, m_rootLevel, false};
+
+	while (top > 0) {
+		const Node z = stack[--top];
+		if (z.level <= 3) { // Small subtree: a linear scan is cheaper than descending further
+			const int64_t i0 = z.x >> z.level << z.level;
+			int64_t i1 = i0 + (int64_t(1) << (z.level + 1)) - 1;
+			if (i1 > n) i1 = n;
+			for (int64_t i = i0; i < i1 && start[i] < last; i++) {
+				if (first < end[i]) f(static_cast<uint32_t>(i));
+			}
+		} else if (!z.leftDone) { // Visit the left subtree first, unless nothing in it reaches `first`
+			const int64_t y = z.x - (int64_t(1) << (z.level - 1));
+			stack[top++] = {z.x, z.level, true};
+			if (y >= n || max_end[y] > first) stack[top++] = {y, z.level - 1, false};
+		} else if (z.x < n && start[z.x] < last) { // Then this node and its right subtree
+			if (first < end[z.x]) f(static_cast<uint32_t>(z.x));
+			stack[top++] = {z.x + (int64_t(1) << (z.level - 1)), z.level - 1, false};
+		}
+	}
+}
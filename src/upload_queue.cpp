@@ -0,0 +1,284 @@
+#include "upload_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+UploadQueue::UploadQueue(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemory& memory, uint32_t transferFamily,
+                         VkQueue transferQueue, uint32_t graphicsFamily, std::mutex* queueMutex, VkDeviceSize stagingSize)
+	: m_device(device), m_memory(memory), m_transferFamily(transferFamily), m_graphicsFamily(graphicsFamily),
+	  m_queue(transferQueue), m_queueMutex(queueMutex), m_ring(stagingSize) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	// Offsets must be multiples of the texel size (4 covers the common formats) and ideally of the optimal alignment
+	m_copyAlignment = 16;
+	while (m_copyAlignment < properties.limits.optimalBufferCopyOffsetAlignment) m_copyAlignment <<= 1;
+
+	VkSemaphoreTypeCreateInfo type_info{};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphore_info{};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+
+	if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_timeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload timeline semaphore!");
+	}
+
+	VkCommandPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_info.queueFamilyIndex = m_transferFamily;
+
+	if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = stagingSize;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &buffer_info, nullptr, &m_stagingBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+
+	VkMemoryRequirements mem_requirements;
+	vkGetBufferMemoryRequirements(m_device, m_stagingBuffer, &mem_requirements);
+	m_stagingMemory = m_memory.allocate(mem_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                                    ResourceLayout::Linear);
+	vkBindBufferMemory(m_device, m_stagingBuffer, m_stagingMemory.memory, m_stagingMemory.offset);
+}
+
+UploadQueue::~UploadQueue() {
+	waitFor(m_lastValue);
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr); // Frees all command buffers
+	vkDestroyBuffer(m_device, m_stagingBuffer, nullptr);
+	m_memory.free(m_stagingMemory);
+	vkDestroySemaphore(m_device, m_timeline, nullptr);
+}
+
+bool UploadQueue::isComplete(uint64_t value) const {
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(m_device, m_timeline, &completed);
+	return completed >= value;
+}
+
+void UploadQueue::waitFor(uint64_t value) const {
+	VkSemaphoreWaitInfo wait_info{};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &m_timeline;
+	wait_info.pValues = &value;
+	vkWaitSemaphores(m_device, &wait_info, UINT64_MAX);
+}
+
+void UploadQueue::retire() {
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(m_device, m_timeline, &completed);
+
+	// Spans are released strictly in ring order, so one still being filled by another thread holds back later ones
+	while (!m_spans.empty()) {
+		const StagingSpan& span = m_spans.front();
+		if (!span.abandoned && (span.value == 0 || span.value > completed)) break;
+		m_ring.release(span.end);
+		m_spans.pop_front();
+	}
+
+	auto done = std::partition(m_inFlight.begin(), m_inFlight.end(), [&](const Submission& s) { return s.value > completed; });
+	for (auto it = done; it != m_inFlight.end(); ++it) m_freeCommandBuffers.push_back(it->cmd);
+	m_inFlight.erase(done, m_inFlight.end());
+}
+
+VkCommandBuffer UploadQueue::takeCommandBuffer() {
+	if (!m_freeCommandBuffers.empty()) {
+		VkCommandBuffer cmd = m_freeCommandBuffers.back();
+		m_freeCommandBuffers.pop_back();
+		vkResetCommandBuffer(cmd, 0);
+		return cmd;
+	}
+
+	VkCommandBufferAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = m_commandPool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	if (vkAllocateCommandBuffers(m_device, &alloc_info, &cmd) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate upload command buffer!");
+	}
+	return cmd;
+}
+
+uint64_t UploadQueue::upload(const ImageUpload& upload) {
+	const size_t row_bytes = static_cast<size_t>(upload.extent.width) * upload.bytesPerPixel;
+	const VkDeviceSize size = static_cast<VkDeviceSize>(row_bytes) * upload.extent.height;
+	if (size > m_ring.capacity()) {
+		throw std::runtime_error("upload is larger than the staging ring!");
+	}
+
+	// Reserve staging space, waiting for older uploads while the ring is full
+	StagingSpan* span = nullptr;
+	uint64_t offset = FrameRing::INVALID;
+	for (;;) {
+		uint64_t wait_value = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			retire();
+			offset = m_ring.allocate(size, m_copyAlignment);
+			if (offset != FrameRing::INVALID) {
+				m_spans.push_back({m_ring.position()});
+				span = &m_spans.back(); // Deque references stay valid while other spans come and go
+				break;
+			}
+			wait_value = m_spans.empty() ? 0 : m_spans.front().value;
+		}
+		if (wait_value != 0) {
+			waitFor(wait_value);
+		} else {
+			std::this_thread::yield(); // The oldest span is still being filled by another thread
+		}
+	}
+
+	// The copy into staging memory is the expensive part, so it happens without holding the lock
+	auto* dst = static_cast<char*>(m_stagingMemory.mapped) + offset;
+	const auto* src = static_cast<const char*>(upload.pixels);
+	if (upload.rowPitch == row_bytes) {
+		std::memcpy(dst, src, static_cast<size_t>(size));
+	} else {
+		for (uint32_t y = 0; y < upload.extent.height; y++) {
+			std::memcpy(dst + y * row_bytes, src + y * upload.rowPitch, row_bytes);
+		}
+	}
+
+	// If recording or submitting fails, nothing will ever copy out of the span, so it is abandoned rather than left
+	// unsubmitted, which would hold back every later span
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	try {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		cmd = takeCommandBuffer();
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(cmd, &begin_info);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED; // The old contents are discarded
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = upload.image;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.bufferRowLength = 0; // Tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		region.imageOffset = {0, 0, 0};
+		region.imageExtent = {upload.extent.width, upload.extent.height, 1};
+		vkCmdCopyBufferToImage(cmd, m_stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		// Transition to the final layout. With separate families this is the release half of the ownership transfer,
+		// and the graphics queue repeats it as the acquire half; its own synchronization comes from the semaphore wait.
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = upload.finalLayout;
+		const bool transfer_ownership = transfersOwnership() && !upload.concurrent;
+		if (transfer_ownership) {
+			barrier.srcQueueFamilyIndex = m_transferFamily;
+			barrier.dstQueueFamilyIndex = m_graphicsFamily;
+		}
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record upload command buffer!");
+		}
+
+		// Only taken once submitted, so nothing waits for a value that is never signalled
+		const uint64_t value = m_lastValue + 1;
+		submit(cmd, value);
+		m_lastValue = value;
+		span->value = value;
+		m_inFlight.push_back({cmd, value});
+		VkImage acquired_image = transfer_ownership ? upload.image : VK_NULL_HANDLE;
+		m_pendingAcquires.push_back({acquired_image, upload.finalLayout, upload.dstStage, upload.dstAccess, value});
+		return value;
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (span->value == 0) {
+			span->abandoned = true;
+			if (cmd != VK_NULL_HANDLE) m_freeCommandBuffers.push_back(cmd);
+		}
+		throw;
+	}
+}
+
+void UploadQueue::submit(VkCommandBuffer cmd, uint64_t value) {
+	VkTimelineSemaphoreSubmitInfo timeline_info{};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &value;
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &m_timeline;
+
+	std::unique_lock<std::mutex> queue_lock;
+	if (m_queueMutex) queue_lock = std::unique_lock<std::mutex>(*m_queueMutex);
+	if (vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload!");
+	}
+}
+
+TimelineWait UploadQueue::recordAcquires(VkCommandBuffer cmd) {
+	m_acquiring.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_acquiring.swap(m_pendingAcquires);
+	}
+
+	TimelineWait wait;
+	wait.semaphore = m_timeline;
+	m_barriers.clear();
+	for (const Acquire& acquire : m_acquiring) {
+		wait.value = std::max(wait.value, acquire.value);
+		wait.stages |= acquire.stage;
+		if (acquire.image == VK_NULL_HANDLE) continue; // No ownership transfer: the semaphore wait is all it takes
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = acquire.access;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = acquire.layout;
+		barrier.srcQueueFamilyIndex = m_transferFamily;
+		barrier.dstQueueFamilyIndex = m_graphicsFamily;
+		barrier.image = acquire.image;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		m_barriers.push_back(barrier);
+	}
+
+	// The barrier's first scope is the stages the semaphore wait blocks, which chains it after the release
+	if (!m_barriers.empty()) {
+		vkCmdPipelineBarrier(cmd, wait.stages, wait.stages, 0, 0, nullptr, 0, nullptr,
+		                     static_cast<uint32_t>(m_barriers.size()), m_barriers.data());
+	}
+	return wait;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "gpu_memory.h"
+#include "gpu_sync.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/// Streams pixel data (such as decoded video frames) into device-local images from any thread.
+///
+/// Pixels are copied into a persistently mapped staging ring and copied to the image on the transfer queue, a
+/// dedicated one if the device has it, so uploads overlap rendering instead of stalling it. Every upload signals
+/// a timeline semaphore. When the transfer queue belongs to another family than graphics, images are released
+/// from the transfer family after the copy and acquired by the graphics family in recordAcquires().
+///
+/// Staging space is retired by timeline value. An upload that does not fit waits for older uploads to finish,
+/// which blocks the uploading thread but never the render thread.
+class UploadQueue {
+public:
+	static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = VkDeviceSize(64) << 20; // Two 4K RGBA frames
+
+	struct ImageUpload {
+		VkImage image;
+		VkExtent2D extent;
+		uint32_t bytesPerPixel; // A power of two
+		const void* pixels;
+		size_t rowPitch; // Bytes between rows in `pixels`
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT; // Where graphics first uses the image
+		VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT;
+		bool concurrent = false; // The image uses VK_SHARING_MODE_CONCURRENT, so it needs no ownership transfer
+	};
+
+	/// `queueMutex` must be given if `transferQueue` is also used elsewhere (the device has no separate transfer
+	/// queue), and then has to be held around every other submission to that queue.
+	UploadQueue(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemory& memory, uint32_t transferFamily,
+	            VkQueue transferQueue, uint32_t graphicsFamily, std::mutex* queueMutex,
+	            VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+	~UploadQueue();
+
+	UploadQueue(const UploadQueue&) = delete;
+	UploadQueue& operator=(const UploadQueue&) = delete;
+
+	/// Copy `upload.pixels` to the whole of `upload.image` (one mip level, one layer), discarding its contents.
+	/// The image must not be in use by the GPU. Returns the timeline value signalled when the copy is done.
+	uint64_t upload(const ImageUpload& upload);
+
+	/// Record the ownership acquires for all uploads since the last call into a graphics command buffer, outside
+	/// a render pass, and return what its submission has to wait for. Only call this from the thread that records
+	/// graphics work.
+	TimelineWait recordAcquires(VkCommandBuffer cmd);
+
+	VkSemaphore semaphore() const { return m_timeline; }
+	bool isComplete(uint64_t value) const;
+	void waitFor(uint64_t value) const;
+
+	/// True if uploads run on their own queue family and need ownership transfers.
+	bool transfersOwnership() const { return m_transferFamily != m_graphicsFamily; }
+
+private:
+	struct Submission {
+		VkCommandBuffer cmd;
+		uint64_t value;
+	};
+
+	struct StagingSpan {
+		uint64_t end;       // Ring position after this upload's staging data
+		uint64_t value = 0; // Timeline value of its copy; 0 until submitted
+		bool abandoned = false; // Never submitted, as recording or submitting its copy failed
+	};
+
+	struct Acquire {
+		VkImage image;
+		VkImageLayout layout;
+		VkPipelineStageFlags stage;
+		VkAccessFlags access;
+		uint64_t value;
+	};
+
+	VkDevice m_device;
+	GpuMemory& m_memory;
+	uint32_t m_transferFamily;
+	uint32_t m_graphicsFamily;
+	VkQueue m_queue;
+	std::mutex* m_queueMutex;
+	VkDeviceSize m_copyAlignment;
+
+	VkSemaphore m_timeline = VK_NULL_HANDLE;
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+	GpuAllocation m_stagingMemory;
+
+	std::mutex m_mutex; // Guards everything below
+	FrameRing m_ring;
+	std::deque<StagingSpan> m_spans; // In ring order
+	std::vector<Submission> m_inFlight;
+	std::vector<VkCommandBuffer> m_freeCommandBuffers;
+	std::vector<Acquire> m_pendingAcquires;
+	uint64_t m_lastValue = 0;
+
+	// Scratch for recordAcquires(), kept to reuse their capacity
+	std::vector<Acquire> m_acquiring;
+	std::vector<VkImageMemoryBarrier> m_barriers;
+
+	/// Free staging space and command buffers of finished uploads. Called with m_mutex held.
+	void retire();
+	VkCommandBuffer takeCommandBuffer();
+	void submit(VkCommandBuffer cmd, uint64_t value);
+};
@@ -0,0 +1,585 @@
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "vulkan_driver.h"
+#include "device_cache.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const std::vector<const char*> validationLayers = {
+	"VK_LAYER_KHRONOS_validation"
+};
+
+const std::vector<const char*> requiredDeviceExtensions = {
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+};
+
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
+
+bool checkValidationLayerSupport() {
+	uint32_t layer_count;
+	vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+	std::vector<VkLayerProperties> available_layers(layer_count);
+	vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+	for (const char* layer_name : validationLayers) {
+		bool layer_found = false;
+
+		for (const auto& layerProperties : available_layers) {
+			if (strcmp(layer_name, layerProperties.layerName) == 0) {
+				layer_found = true;
+				break;
+			}
+		}
+
+		if (!layer_found) return false;
+	}
+
+	return true;
+}
+
+/// Returns true if the given GPU supports Vulkan 1.2 timeline semaphores, which the upload queue synchronizes with.
+bool supportsTimelineSemaphores(VkPhysicalDevice dev) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(dev, &properties);
+	if (properties.apiVersion < VK_API_VERSION_1_2) return false;
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+	timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &timeline_features;
+	vkGetPhysicalDeviceFeatures2(dev, &features);
+
+	return timeline_features.timelineSemaphore == VK_TRUE;
+}
+
+/// Returns true if the given GPU supports the required extensions found in `requiredDeviceExtensions`.
+bool checkDeviceExtensionSupport(VkPhysicalDevice dev) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionCount, availableExtensions.data());
+
+	std::set<std::string> requiredExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
+
+	for (const auto& extension : availableExtensions) {
+		requiredExtensions.erase(extension.extensionName);
+	}
+
+	return requiredExtensions.empty();
+}
+
+/// Select best available swap chain surface format.
+VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
+	for (const auto& available_format : availableFormats) {
+		// We would always prefer 32-bit SRGB pixels, in the SRGB non-linear color space if it is available.
+		if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+			return available_format;
+		}
+	}
+
+	return availableFormats[0]; // Choose first format available.
+}
+
+/// Select best swap chain method for displaying images from the queue. Paced presentation must show every frame,
+/// which only FIFO does. Low latency prefers mailbox, where a new frame replaces one still waiting to be shown.
+/// (Immediate presentation would be quicker still, but tears, which is worse for judging a picture.)
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, PresentLatency latency) {
+	if (latency == PresentLatency::Low) {
+		for (const auto& available_present_mode : availablePresentModes) {
+			if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) { // Choose triple-buffering when it is available
+				return available_present_mode;
+			}
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR; // Double-buffering is always available. (Commonly known as Vsync in video games)
+}
+
+/// Select how many swap chain images to ask for. Mailbox and paced FIFO want one more than the minimum: one to
+/// replace the waiting frame, or to queue a frame ahead while another is drawn. Low latency FIFO asks for the
+/// minimum, as every image more is a frame more that can wait in the queue before being shown.
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode, PresentLatency latency) {
+	uint32_t image_count = capabilities.minImageCount;
+	if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR || latency == PresentLatency::Paced) image_count++;
+
+	// Make sure we don't exceed the maximum, either ...
+	if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount) {
+		image_count = capabilities.maxImageCount;
+	}
+	return image_count;
+}
+
+/// Select resolution of the swap chain images.
+VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D preferredExtent) {
+	if (capabilities.currentExtent.width != UINT32_MAX) {
+		return capabilities.currentExtent;
+	} else {
+		VkExtent2D actual_extent = preferredExtent;
+
+		actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+		actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+		return actual_extent;
+	}
+}
+
+/// Convert queue family indices to and from their cached form.
+int32_t cachedFamily(const std::optional<uint32_t>& family) {
+	return family.has_value() ? static_cast<int32_t>(family.value()) : -1;
+}
+
+std::optional<uint32_t> uncachedFamily(int32_t family) {
+	return family >= 0 ? std::optional<uint32_t>(static_cast<uint32_t>(family)) : std::nullopt;
+}
+
+} // namespace
+
+VulkanDriver::VulkanDriver(GLFWwindow* window, std::string deviceCachePath)
+	: m_window(window), m_deviceCachePath(std::move(deviceCachePath)) {}
+
+void VulkanDriver::initImpl() {
+	VIPER_PROFILE_ZONE("VulkanDriver::init");
+	auto step_start = std::chrono::steady_clock::now();
+	auto step = [&step_start]() { // Milliseconds since the last step
+		const auto now = std::chrono::steady_clock::now();
+		const double milliseconds = std::chrono::duration<double, std::milli>(now - step_start).count();
+		step_start = now;
+		return milliseconds;
+	};
+
+	createInstance();
+	m_initTimes.instance = step();
+	if (!headless()) createSurface();
+	m_initTimes.surface = step();
+	pickPhysicalDevice();
+	m_initTimes.physicalDevice = step();
+	createLogicalDevice();
+	m_initTimes.device = step();
+}
+
+void VulkanDriver::cleanupImpl() {
+	if (m_swapChain != VK_NULL_HANDLE) vkDestroySwapchainKHR(m_device, m_swapChain, nullptr); // Destroys its images
+	vkDestroyDevice(m_device, nullptr);
+	if (m_surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	vkDestroyInstance(m_instance, nullptr);
+}
+
+/// Create the Vulkan instance.
+void VulkanDriver::createInstance() {
+	VIPER_PROFILE_ZONE("createInstance");
+	if (enableValidationLayers && !checkValidationLayerSupport()) {
+		throw std::runtime_error("validation layers requested, but not available!");
+	}
+
+	VkApplicationInfo app_info{};
+	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app_info.pApplicationName = "Triangle";
+	app_info.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
+	app_info.pEngineName = "No Engine";
+	app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+	app_info.apiVersion = VK_API_VERSION_1_2; // For timeline semaphores
+
+	VkInstanceCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	createInfo.pApplicationInfo = &app_info;
+
+	uint32_t glfw_extension_count = 0;
+	const char** glfw_extensions = nullptr;
+
+	if (!headless()) { // Headless rendering needs no surface extensions, and GLFW is never initialized
+		glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+	}
+
+	createInfo.enabledExtensionCount = glfw_extension_count;
+	createInfo.ppEnabledExtensionNames = glfw_extensions;
+
+	if (enableValidationLayers) { // Basically a runtime safety feature ...
+		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+		createInfo.ppEnabledLayerNames = validationLayers.data();
+	} else {
+		createInfo.enabledLayerCount = 0;
+	}
+
+	if (vkCreateInstance(&createInfo, nullptr, &m_instance) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create Vulkan m_instance!");
+	}
+}
+
+void VulkanDriver::createSurface() {
+	VIPER_PROFILE_ZONE("createSurface");
+	if (glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create window surface!");
+	}
+}
+
+/// Select a GPU with Vulkan support to use for rendering: the one picked last time if it is still there and
+/// unchanged, else the first suitable one.
+void VulkanDriver::pickPhysicalDevice() {
+	VIPER_PROFILE_ZONE("pickPhysicalDevice");
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
+
+	if (deviceCount == 0) {
+		throw std::runtime_error("failed to find GPUs with Vulkan support!");
+	}
+
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
+
+	m_initTimes.cachedDevice = pickCachedDevice(devices);
+	if (m_initTimes.cachedDevice) return;
+
+	for (const auto& dev : devices) {
+		SwapChainSupportDetails support;
+		if (isDeviceSuitable(dev, m_queueFamilies, support)) {
+			m_physicalDevice = dev;
+			if (!headless()) m_swapChainSupport = std::move(support);
+			break;
+		}
+	}
+
+	if (m_physicalDevice == VK_NULL_HANDLE) {
+		throw std::runtime_error("failed to find a suitable GPU!");
+	}
+	saveDeviceCache();
+}
+
+/// Pick the device in the device cache, if it is among `devices` with the same driver, and its queue families
+/// still look the same. A device that passed isDeviceSuitable() once needs nothing else checked.
+bool VulkanDriver::pickCachedDevice(const std::vector<VkPhysicalDevice>& devices) {
+	CachedDevice cached;
+	if (m_deviceCachePath.empty() || !loadCachedDevice(m_deviceCachePath, cached)) return false;
+	if (cached.headless != (headless() ? 1u : 0u)) return false;
+
+	for (VkPhysicalDevice dev : devices) {
+		VkPhysicalDeviceIDProperties id_properties{};
+		id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &id_properties;
+		vkGetPhysicalDeviceProperties2(dev, &properties);
+
+		if (std::memcmp(id_properties.deviceUUID, cached.deviceUUID, VK_UUID_SIZE) != 0
+			|| properties.properties.vendorID != cached.vendorID || properties.properties.deviceID != cached.deviceID
+			|| properties.properties.driverVersion != cached.driverVersion) {
+			continue;
+		}
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_family_count, nullptr);
+		if (queue_family_count != cached.queueFamilyCount) return false;
+
+		VulkanQueueFamilies families;
+		families.graphicsFamily = uncachedFamily(cached.graphicsFamily);
+		families.presentFamily = uncachedFamily(cached.presentFamily);
+		families.transferFamily = uncachedFamily(cached.transferFamily);
+		families.computeFamily = uncachedFamily(cached.computeFamily);
+		if (!families.graphicsFamily.has_value() || families.graphicsFamily.value() >= queue_family_count) return false;
+
+		if (!headless()) { // A new surface may be on another display, so check it can still be presented to
+			VkBool32 present_support = VK_FALSE;
+			if (!families.presentFamily.has_value() || families.presentFamily.value() >= queue_family_count) return false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(dev, families.presentFamily.value(), m_surface, &present_support);
+			if (!present_support) return false;
+		}
+
+		m_physicalDevice = dev;
+		m_queueFamilies = families;
+		return true;
+	}
+	return false;
+}
+
+/// Remember the device just picked for the next start. Failing to is not an error; that start is just slower.
+void VulkanDriver::saveDeviceCache() const {
+	if (m_deviceCachePath.empty()) return;
+
+	VkPhysicalDeviceIDProperties id_properties{};
+	id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &id_properties;
+	vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties);
+
+	CachedDevice cached{};
+	std::memcpy(cached.deviceUUID, id_properties.deviceUUID, VK_UUID_SIZE);
+	cached.vendorID = properties.properties.vendorID;
+	cached.deviceID = properties.properties.deviceID;
+	cached.driverVersion = properties.properties.driverVersion;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &cached.queueFamilyCount, nullptr);
+	cached.graphicsFamily = cachedFamily(m_queueFamilies.graphicsFamily);
+	cached.presentFamily = cachedFamily(m_queueFamilies.presentFamily);
+	cached.transferFamily = cachedFamily(m_queueFamilies.transferFamily);
+	cached.computeFamily = cachedFamily(m_queueFamilies.computeFamily);
+	cached.headless = headless() ? 1 : 0;
+
+	if (!saveCachedDevice(m_deviceCachePath, cached)) {
+		std::cerr << "failed to save the device cache" << std::endl;
+	}
+}
+
+/// Returns true if the given GPU has valid queue families and supports required device extensions and features for the swap chain.
+/// In headless mode only a graphics queue is required. Its queue families and, with a surface, swap chain support are
+/// returned in `families` and `support`.
+bool VulkanDriver::isDeviceSuitable(VkPhysicalDevice dev, VulkanQueueFamilies& families, SwapChainSupportDetails& support) const {
+	families = findQueueFamilies(dev);
+
+	if (!supportsTimelineSemaphores(dev)) return false;
+
+	if (headless()) {
+		return families.graphicsFamily.has_value();
+	}
+
+	bool extensionsSupported = checkDeviceExtensionSupport(dev);
+
+	bool swapChainAdequate = false;
+	if (extensionsSupported) { // If the swap chain extension is supported ...
+		support = querySwapChainSupport(dev);
+		swapChainAdequate = !support.formats.empty() && !support.presentModes.empty();
+	}
+
+	return families.isComplete() && extensionsSupported && swapChainAdequate;
+}
+
+/// Returns the queue families for graphics, presentation, transfers and async compute.
+/// Presenting from the graphics family is preferred, and a transfer-only family over one that can also compute.
+VulkanQueueFamilies VulkanDriver::findQueueFamilies(VkPhysicalDevice dev) const {
+	VulkanQueueFamilies indices;
+
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_family_count, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_family_count, queue_families.data());
+
+	for (uint32_t i = 0; i < queue_family_count; i++) {
+		const VkQueueFlags flags = queue_families[i].queueFlags;
+		const bool graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+
+		VkBool32 present_support = false;
+		if (m_surface != VK_NULL_HANDLE) { // There is nothing to present to in headless mode
+			vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, m_surface, &present_support); // Does this GPU support rendering to surfaces for this queue family?
+		}
+
+		if (graphics && !indices.graphicsFamily.has_value()) {
+			indices.graphicsFamily = i;
+		}
+		if (present_support && (!indices.presentFamily.has_value() || (graphics && indices.graphicsFamily == i))) {
+			indices.presentFamily = i;
+		}
+
+		// Graphics and compute queues implicitly support transfers too
+		if (!graphics && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			const bool dedicated = !(flags & VK_QUEUE_COMPUTE_BIT);
+			const bool have_dedicated = indices.transferFamily.has_value()
+				&& !(queue_families[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT);
+			if (!indices.transferFamily.has_value() || (dedicated && !have_dedicated)) {
+				indices.transferFamily = i;
+			}
+		}
+
+		if (!graphics && (flags & VK_QUEUE_COMPUTE_BIT) && !indices.computeFamily.has_value()) {
+			indices.computeFamily = i;
+		}
+	}
+
+	return indices;
+}
+
+/// Create the logical device `m_device` to the physical GPU `m_physicalDevice`.
+void VulkanDriver::createLogicalDevice() {
+	VIPER_PROFILE_ZONE("createLogicalDevice");
+	const VulkanQueueFamilies& indices = m_queueFamilies;
+
+	// Turn queue family indexes into queue family creation infos ...
+	std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
+	std::set<uint32_t> unique_queue_families = {indices.graphicsFamily.value()};
+	if (!headless()) unique_queue_families.insert(indices.presentFamily.value());
+	if (indices.transferFamily.has_value()) unique_queue_families.insert(indices.transferFamily.value());
+	if (indices.computeFamily.has_value()) unique_queue_families.insert(indices.computeFamily.value());
+
+	// Uploads and async compute can end up in the same family; give them a queue each if it has two
+	const bool shared_family = indices.computeFamily.has_value() && indices.computeFamily == indices.transferFamily;
+	uint32_t shared_family_queues = 1;
+	if (shared_family) {
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queue_family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queue_family_count, queue_families.data());
+		shared_family_queues = std::min(2u, queue_families[indices.computeFamily.value()].queueCount);
+	}
+	m_transferQueueShared = shared_family && shared_family_queues == 1;
+
+	const float queue_priorities[2] = {1.0f, 1.0f};
+	for (uint32_t queue_family : unique_queue_families) {
+		VkDeviceQueueCreateInfo queue_create_info{};
+		queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queue_create_info.queueFamilyIndex = queue_family;
+		queue_create_info.queueCount = shared_family && queue_family == indices.computeFamily ? shared_family_queues : 1;
+		queue_create_info.pQueuePriorities = queue_priorities;
+		queue_create_infos.push_back(queue_create_info);
+	}
+
+	VkPhysicalDeviceFeatures device_features{}; // Use default values
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+	timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timeline_features.timelineSemaphore = VK_TRUE;
+
+	// Now we complete the information about the logical device we're creating ...
+	VkDeviceCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	create_info.pNext = &timeline_features;
+	create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
+	create_info.pQueueCreateInfos = queue_create_infos.data();
+
+	// Enable device extensions (the swap chain is the only one, so headless devices need none)
+	if (headless()) {
+		create_info.enabledExtensionCount = 0;
+	} else {
+		create_info.enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size());
+		create_info.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+	}
+
+	create_info.pEnabledFeatures = &device_features;
+
+	if (enableValidationLayers) { // Keeping support for older implementations of Vulkan
+		create_info.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+		create_info.ppEnabledLayerNames = validationLayers.data();
+	} else {
+		create_info.enabledLayerCount = 0;
+	}
+
+	if (vkCreateDevice(m_physicalDevice, &create_info, nullptr, &m_device) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create logical device!");
+	}
+
+	vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
+	if (!headless()) {
+		vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_presentQueue);
+	}
+	if (indices.transferFamily.has_value()) {
+		vkGetDeviceQueue(m_device, indices.transferFamily.value(), 0, &m_transferQueue);
+	}
+	if (indices.computeFamily.has_value()) {
+		vkGetDeviceQueue(m_device, indices.computeFamily.value(), shared_family ? shared_family_queues - 1 : 0, &m_computeQueue);
+	}
+}
+
+/// Get capabilities, formats, and present mode support from the device for a swap chain.
+VulkanDriver::SwapChainSupportDetails VulkanDriver::querySwapChainSupport(VkPhysicalDevice dev) const {
+	SwapChainSupportDetails details;
+
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev, m_surface, &details.capabilities);
+
+	uint32_t formatCount;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(dev, m_surface, &formatCount, nullptr);
+
+	if (formatCount != 0) {
+		details.formats.resize(formatCount);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(dev, m_surface, &formatCount, details.formats.data());
+	}
+
+	uint32_t presentModeCount;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(dev, m_surface, &presentModeCount, nullptr);
+
+	if (presentModeCount != 0) {
+		details.presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(dev, m_surface, &presentModeCount, details.presentModes.data());
+	}
+
+	return details;
+}
+
+VkSwapchainKHR VulkanDriver::createSwapChain(VkExtent2D preferredExtent, PresentLatency latency) {
+	VIPER_PROFILE_ZONE("createSwapChain");
+	const VkSwapchainKHR old_swap_chain = m_swapChain;
+	SwapChainSupportDetails swap_chain_support;
+	if (old_swap_chain != VK_NULL_HANDLE) {
+		// Only the size changes, so only the capabilities need asking for again
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &swap_chain_support.capabilities);
+	} else {
+		// Picking the device just queried this, unless it came from the cache
+		swap_chain_support = m_swapChainSupport ? std::move(*m_swapChainSupport) : querySwapChainSupport(m_physicalDevice);
+		m_swapChainSupport.reset();
+		m_surfaceFormat = chooseSwapSurfaceFormat(swap_chain_support.formats);
+		m_presentModes = std::move(swap_chain_support.presentModes);
+	}
+
+	// Of the swap chain's supported modes and sizes, we will choose the best options for the latency asked for:
+	m_presentMode = chooseSwapPresentMode(m_presentModes, latency);
+	VkExtent2D extent = chooseSwapExtent(swap_chain_support.capabilities, preferredExtent);
+	m_swapChainExtent = extent;
+	uint32_t image_count = chooseSwapImageCount(swap_chain_support.capabilities, m_presentMode, latency);
+
+	VkSwapchainCreateInfoKHR create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	create_info.surface = m_surface;
+
+	// Details of the swap chain
+	create_info.minImageCount = image_count;
+	create_info.imageFormat = m_surfaceFormat.format;
+	create_info.imageColorSpace = m_surfaceFormat.colorSpace;
+	create_info.imageExtent = extent;
+	create_info.imageArrayLayers = 1;
+	create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+	// The swap chain needs to know which queue families will own the images ...
+	const VulkanQueueFamilies& indices = m_queueFamilies;
+	uint32_t queue_family_indices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+	if (indices.graphicsFamily != indices.presentFamily) {
+		create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT; // No ownership promises (simpler)
+		create_info.queueFamilyIndexCount = 2; // How many queue families will share the images?
+		create_info.pQueueFamilyIndices = queue_family_indices; // Which queue families will share them?
+	} else {
+		create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE; // Explicit ownership (higher performance)
+		create_info.queueFamilyIndexCount = 0; // Optional
+		create_info.pQueueFamilyIndices = nullptr; // Optional
+	}
+
+	// Some miscellaneous swap chain creation information.
+	create_info.preTransform = swap_chain_support.capabilities.currentTransform;
+	create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	create_info.presentMode = m_presentMode;
+	create_info.clipped = VK_TRUE;
+	create_info.oldSwapchain = old_swap_chain; // Lets the new one take over its resources
+
+	if (vkCreateSwapchainKHR(m_device, &create_info, nullptr, &m_swapChain) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the swap chain!");
+	}
+
+	// Obtain references to the swap chain images
+	vkGetSwapchainImagesKHR(m_device, m_swapChain, &image_count, nullptr);
+	m_swapChainImages.resize(image_count);
+	vkGetSwapchainImagesKHR(m_device, m_swapChain, &image_count, m_swapChainImages.data());
+	return old_swap_chain;
+}
+
+void VulkanCommands::clearImpl(const std::vector<DriverRect>& rects, const float color[4]) {
+	VkClearAttachment clear{};
+	clear.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	clear.colorAttachment = 0;
+	std::copy(color, color + 4, clear.clearValue.color.float32);
+
+	std::vector<VkClearRect> clear_rects(rects.size());
+	for (size_t i = 0; i < rects.size(); i++) clear_rects[i] = {{{rects[i].x, rects[i].y}, {rects[i].width, rects[i].height}}, 0, 1};
+	vkCmdClearAttachments(m_cmd, 1, &clear, static_cast<uint32_t>(clear_rects.size()), clear_rects.data());
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "driver.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct GLFWwindow;
+
+/// Queue families of a device.
+struct VulkanQueueFamilies {
+	std::optional<uint32_t> graphicsFamily;
+	std::optional<uint32_t> presentFamily;
+	std::optional<uint32_t> transferFamily; // A family without graphics for uploads, ideally a transfer-only DMA engine
+	std::optional<uint32_t> computeFamily; // A family with compute but no graphics, for async compute
+
+	bool isComplete() const {
+		return graphicsFamily.has_value() && presentFamily.has_value();
+	}
+};
+
+/// How long each step of VulkanDriver::init() took, in milliseconds.
+struct VulkanInitTimes {
+	double instance = 0.0;
+	double surface = 0.0;
+	double physicalDevice = 0.0;
+	double device = 0.0;
+	bool cachedDevice = false; // The physical device was picked from the device cache
+};
+
+/// The Vulkan backend: instance, surface, device, queues and swap chain.
+///
+/// Everything else (memory, pipelines, frames in flight) is built by the renderer on top of the device. Without a
+/// window the driver is headless: it creates no surface and no swap chain, and the device only needs a graphics
+/// queue.
+///
+/// init() touches nothing but the window's surface, so it may run on another thread than the one that created the
+/// window, while that one carries on.
+class VulkanDriver : public Driver<VulkanDriver> {
+public:
+	static constexpr const char* NAME = "vulkan";
+
+	/// Render to `window`, or headless if it is null. The window must outlive the driver. The physical device picked
+	/// is cached at `deviceCachePath` (see device_cache.h), unless it is empty.
+	explicit VulkanDriver(GLFWwindow* window, std::string deviceCachePath = {});
+
+	VulkanDriver(const VulkanDriver&) = delete;
+	VulkanDriver& operator=(const VulkanDriver&) = delete;
+
+	/// Create the swap chain, `preferredExtent` in size if the surface leaves the size to us, with the present mode
+	/// and image count that best suit `latency`. Not headless.
+	///
+	/// Called again, when the window was resized, the swap chain went out of date or the latency wanted changed, it
+	/// creates a new one and hands the current one over to it, which lets the presentation engine reuse its
+	/// resources and finish presenting its images. The format stays as it was, so render passes and pipelines made
+	/// for the old images work with the new. Returns the replaced swap chain (null the first time): it is retired,
+	/// and the caller destroys it once its images are no longer in use.
+	VkSwapchainKHR createSwapChain(VkExtent2D preferredExtent, PresentLatency latency = PresentLatency::Low);
+
+	bool headless() const { return m_window == nullptr; }
+	VkInstance instance() const { return m_instance; }
+	VkPhysicalDevice physicalDevice() const { return m_physicalDevice; }
+	VkDevice device() const { return m_device; }
+	const VulkanQueueFamilies& queueFamilies() const { return m_queueFamilies; }
+	VkQueue graphicsQueue() const { return m_graphicsQueue; }
+	VkQueue presentQueue() const { return m_presentQueue; }
+	VkQueue transferQueue() const { return m_transferQueue; } // Only if the device has a separate transfer family
+	VkQueue computeQueue() const { return m_computeQueue; } // Only if the device has async compute
+	/// Uploads and compute share one queue of a family that only has one.
+	bool transferQueueShared() const { return m_transferQueueShared; }
+
+	VkSwapchainKHR swapChain() const { return m_swapChain; }
+	const std::vector<VkImage>& swapChainImages() const { return m_swapChainImages; }
+	VkFormat swapChainFormat() const { return m_surfaceFormat.format; }
+	VkExtent2D swapChainExtent() const { return m_swapChainExtent; }
+	VkPresentModeKHR presentMode() const { return m_presentMode; }
+
+	const VulkanInitTimes& initTimes() const { return m_initTimes; }
+
+private:
+	friend class Driver<VulkanDriver>;
+
+	struct SwapChainSupportDetails {
+		VkSurfaceCapabilitiesKHR capabilities;
+		std::vector<VkSurfaceFormatKHR> formats;
+		std::vector<VkPresentModeKHR> presentModes;
+	};
+
+	GLFWwindow* m_window;
+	std::string m_deviceCachePath;
+	VulkanInitTimes m_initTimes;
+	VkInstance m_instance = VK_NULL_HANDLE;
+	VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+	VkDevice m_device = VK_NULL_HANDLE;
+	VulkanQueueFamilies m_queueFamilies;
+	VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+	VkQueue m_presentQueue = VK_NULL_HANDLE;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+	VkQueue m_computeQueue = VK_NULL_HANDLE;
+	bool m_transferQueueShared = false;
+
+	VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
+	std::vector<VkImage> m_swapChainImages;
+	VkSurfaceFormatKHR m_surfaceFormat{}; // Chosen for the first swap chain, and kept
+	std::vector<VkPresentModeKHR> m_presentModes; // Supported by the surface, to choose from each time
+	VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	VkExtent2D m_swapChainExtent{};
+	std::optional<SwapChainSupportDetails> m_swapChainSupport; // From picking the device, until the swap chain uses it
+
+	void initImpl();
+	void cleanupImpl();
+
+	void createInstance();
+	void createSurface();
+	void pickPhysicalDevice();
+	bool pickCachedDevice(const std::vector<VkPhysicalDevice>& devices);
+	void saveDeviceCache() const;
+	void createLogicalDevice();
+
+	bool isDeviceSuitable(VkPhysicalDevice dev, VulkanQueueFamilies& families, SwapChainSupportDetails& support) const;
+	VulkanQueueFamilies findQueueFamilies(VkPhysicalDevice dev) const;
+	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice dev) const;
+};
+
+/// What GUI draws bind, from the GUI renderer: its pipeline layout, pipelines by GuiBlend, and descriptor sets by
+/// texture id (with the atlas's, which changes with the frame slot, apart).
+struct VulkanGuiBindings {
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	const VkPipeline* pipelines = nullptr;
+	const VkDescriptorSet* textureSets = nullptr;
+	VkDescriptorSet atlasSet = VK_NULL_HANDLE;
+};
+
+/// A Vulkan command buffer as a driver command list. GUI draws also need the GUI renderer's `gui` bindings, and the
+/// GUI vertex and index buffers bound.
+class VulkanCommands : public DriverCommands<VulkanCommands> {
+public:
+	explicit VulkanCommands(VkCommandBuffer cmd, const VulkanGuiBindings* gui = nullptr) : m_cmd(cmd), m_gui(gui) {}
+
+	VkCommandBuffer handle() const { return m_cmd; }
+
+private:
+	friend class DriverCommands<VulkanCommands>;
+
+	VkCommandBuffer m_cmd;
+	const VulkanGuiBindings* m_gui;
+
+	void setScissorImpl(const DriverRect& rect) {
+		const VkRect2D scissor = {{rect.x, rect.y}, {rect.width, rect.height}};
+		vkCmdSetScissor(m_cmd, 0, 1, &scissor);
+	}
+
+	void clearImpl(const std::vector<DriverRect>& rects, const float color[4]);
+
+	void bindGuiBlendImpl(GuiBlend blend) {
+		vkCmdBindPipeline(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gui->pipelines[size_t(blend)]);
+	}
+
+	void bindGuiTextureImpl(uint32_t texture) {
+		const VkDescriptorSet set = texture == GuiBatch::ATLAS ? m_gui->atlasSet : m_gui->textureSets[texture];
+		vkCmdBindDescriptorSets(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gui->layout, 0, 1, &set, 0, nullptr);
+	}
+
+	void drawQuadsImpl(uint32_t firstVertex, uint32_t quadCount) {
+		vkCmdDrawIndexed(m_cmd, 6 * quadCount, 1, 0, static_cast<int32_t>(firstVertex), 0);
+	}
+};
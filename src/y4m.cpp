@@ -0,0 +1,169 @@
+#include "y4m.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+size_t Y4mFormat::frameSize() const {
+	const size_t luma = size_t(width) * height;
+	const size_t chroma_width = (size_t(width) + 1) / 2;
+	const size_t chroma_height = (size_t(height) + 1) / 2;
+	switch (chroma) {
+	case Y4mChroma::C420: return luma + 2 * chroma_width * chroma_height;
+	case Y4mChroma::C422: return luma + 2 * chroma_width * height;
+	case Y4mChroma::C444: return 3 * luma;
+	case Y4mChroma::Mono: return luma;
+	}
+	return 0;
+}
+
+bool parseY4mHeader(std::string_view data, Y4mFormat& format) {
+	const size_t line_end = data.find('\n');
+	if (data.substr(0, 10) != "YUV4MPEG2 " || line_end == std::string_view::npos) return false;
+
+	// Space-separated parameters, each a letter followed by its value: W1920 H1080 F30000:1001 C420jpeg ...
+	Y4mFormat parsed;
+	parsed.headerSize = line_end + 1;
+	std::string_view params = data.substr(10, line_end - 10);
+	while (!params.empty()) {
+		const size_t space = params.find(' ');
+		const std::string_view param = params.substr(0, space);
+		params = space == std::string_view::npos ? std::string_view() : params.substr(space + 1);
+		if (param.empty()) continue;
+
+		const std::string value(param.substr(1));
+		switch (param[0]) {
+		case 'W': parsed.width = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)); break;
+		case 'H': parsed.height = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)); break;
+		case 'F': {
+			char* colon = nullptr;
+			parsed.frameRateNumerator = static_cast<uint32_t>(std::strtoul(value.c_str(), &colon, 10));
+			if (*colon == ':') parsed.frameRateDenominator = static_cast<uint32_t>(std::strtoul(colon + 1, nullptr, 10));
+			break;
+		}
+		case 'C':
+			if (value.compare(0, 3, "420") == 0) parsed.chroma = Y4mChroma::C420;
+			else if (value == "422") parsed.chroma = Y4mChroma::C422;
+			else if (value == "444") parsed.chroma = Y4mChroma::C444;
+			else if (value == "mono") parsed.chroma = Y4mChroma::Mono;
+			else return false; // High bit depths and alpha
+			break;
+		case 'X':
+			if (value == "COLORRANGE=FULL") parsed.fullRange = true;
+			break;
+		default: break;
+		}
+	}
+
+	if (parsed.width == 0 || parsed.height == 0 || parsed.frameRateDenominator == 0) return false;
+	format = parsed;
+	return true;
+}
+
+Y4mReader::Y4mReader(const std::string& path) : m_file(path) {
+	if (!parseY4mHeader(m_file.view().substr(0, 1024), m_format) || m_format.chroma != Y4mChroma::C420) {
+		throw std::runtime_error("unsupported y4m stream in '" + path + "'!");
+	}
+	const size_t stride = Y4M_FRAME_HEADER_SIZE + m_format.frameSize();
+	m_frameCount = static_cast<int64_t>((m_file.size() - m_format.headerSize) / stride);
+}
+
+DecodedFrame Y4mReader::readFrame(int64_t index) const {
+	if (index < 0 || index >= m_frameCount) throw std::out_of_range("y4m frame out of range");
+
+	const size_t offset = m_format.headerSize + size_t(index) * (Y4M_FRAME_HEADER_SIZE + m_format.frameSize());
+	const char* frame_start = m_file.data() + offset;
+	if (std::string_view(frame_start, Y4M_FRAME_HEADER_SIZE) != "FRAME\n") {
+		throw std::runtime_error("failed to read y4m frame: frames with parameters are not supported!");
+	}
+
+	const uint32_t width = m_format.width;
+	const uint32_t height = m_format.height;
+	const uint32_t chroma_width = (width + 1) / 2;
+	const auto* y_plane = reinterpret_cast<const uint8_t*>(frame_start + Y4M_FRAME_HEADER_SIZE);
+	const uint8_t* u_plane = y_plane + size_t(width) * height;
+	const uint8_t* v_plane = u_plane + size_t(chroma_width) * ((height + 1) / 2);
+
+	// BT.601; video range is expanded to full range first
+	const float luma_scale = m_format.fullRange ? 1.0f : 255.0f / 219.0f;
+	const float luma_offset = m_format.fullRange ? 0.0f : 16.0f;
+	const float chroma_scale = m_format.fullRange ? 1.0f : 255.0f / 224.0f;
+
+	DecodedFrame frame;
+	frame.width = width;
+	frame.height = height;
+	frame.stride = size_t(width) * 4;
+	frame.format = PixelFormat::Rgba8;
+	frame.pixels.resize(frame.stride * height);
+	auto clamp_round = [](float value) { return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.0f, 255.0f)); };
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t* out = frame.pixels.data() + y * frame.stride;
+		for (uint32_t x = 0; x < width; x++, out += 4) {
+			const size_t chroma = size_t(y / 2) * chroma_width + x / 2;
+			const float luma = (y_plane[size_t(y) * width + x] - luma_offset) * luma_scale;
+			const float u = (u_plane[chroma] - 128.0f) * chroma_scale;
+			const float v = (v_plane[chroma] - 128.0f) * chroma_scale;
+			out[0] = clamp_round(luma + 1.402f * v);
+			out[1] = clamp_round(luma - 0.344136f * u - 0.714136f * v);
+			out[2] = clamp_round(luma + 1.772f * u);
+			out[3] = 255;
+		}
+	}
+	return frame;
+}
+
+Y4mWriter::Y4mWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t frameRateNumerator, uint32_t frameRateDenominator)
+	: m_file(path, std::ios::binary | std::ios::trunc) {
+	if (!m_file.is_open()) throw std::runtime_error("failed to create '" + path + "'!");
+
+	Y4mFormat format;
+	format.width = width;
+	format.height = height;
+	m_frameSize = format.frameSize();
+	m_file << "YUV4MPEG2 W" << width << " H" << height << " F" << frameRateNumerator << ':' << frameRateDenominator
+	       << " Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+}
+
+void Y4mWriter::writeFrame(const std::vector<uint8_t>& planes) {
+	if (planes.size() != m_frameSize) throw std::runtime_error("y4m frame has the wrong size!");
+	m_file.write("FRAME\n", Y4M_FRAME_HEADER_SIZE);
+	m_file.write(reinterpret_cast<const char*>(planes.data()), static_cast<std::streamsize>(planes.size()));
+	if (!m_file.good()) throw std::runtime_error("failed to write y4m frame!");
+}
+
+void Y4mWriter::finish() {
+	m_file.close();
+	if (m_file.fail()) throw std::runtime_error("failed to write y4m file!");
+}
+
+void rgbaToI420(const DecodedFrame& frame, std::vector<uint8_t>& planes) {
+	const uint32_t width = frame.width;
+	const uint32_t height = frame.height;
+	const uint32_t chroma_width = width / 2;
+	planes.resize(size_t(width) * height * 3 / 2);
+	uint8_t* y_plane = planes.data();
+	uint8_t* u_plane = y_plane + size_t(width) * height;
+	uint8_t* v_plane = u_plane + size_t(chroma_width) * (height / 2);
+
+	// 16.16 fixed point; the chroma rows sum four pixels, hence the two extra bits of shift
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t* in = frame.pixels.data() + y * frame.stride;
+		for (uint32_t x = 0; x < width; x++, in += 4) {
+			y_plane[size_t(y) * width + x] = static_cast<uint8_t>((19595 * in[0] + 38470 * in[1] + 7471 * in[2] + 32768) >> 16);
+		}
+	}
+	for (uint32_t y = 0; y < height / 2; y++) {
+		const uint8_t* top = frame.pixels.data() + (2 * y) * frame.stride;
+		const uint8_t* bottom = top + frame.stride;
+		for (uint32_t x = 0; x < chroma_width; x++, top += 8, bottom += 8) {
+			const int32_t r = top[0] + top[4] + bottom[0] + bottom[4];
+			const int32_t g = top[1] + top[5] + bottom[1] + bottom[5];
+			const int32_t b = top[2] + top[6] + bottom[2] + bottom[6];
+			const int32_t u = (-11059 * r - 21709 * g + 32768 * b + (512 << 16) + (1 << 17)) >> 18;
+			const int32_t v = (32768 * r - 27439 * g - 5329 * b + (512 << 16) + (1 << 17)) >> 18;
+			u_plane[size_t(y) * chroma_width + x] = static_cast<uint8_t>(std::clamp(u, 0, 255));
+			v_plane[size_t(y) * chroma_width + x] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+		}
+	}
+}
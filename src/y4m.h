@@ -0,0 +1,75 @@
+#pragma once
+
+#include "frame_cache.h"
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// YUV4MPEG2: a text header line, then every frame as a "FRAME" line followed by its raw planes. Viper writes
+// proxies in it because any frame can be found by offset and every tool can play it.
+
+enum class Y4mChroma { C420, C422, C444, Mono };
+
+struct Y4mFormat {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t frameRateNumerator = 0;
+	uint32_t frameRateDenominator = 0;
+	Y4mChroma chroma = Y4mChroma::C420;
+	bool fullRange = false; // XCOLORRANGE=FULL; otherwise video range (luma 16-235)
+	size_t headerSize = 0;  // Bytes up to and including the header's newline
+
+	/// Bytes of plane data per frame, without the FRAME line.
+	size_t frameSize() const;
+};
+
+/// Bytes of the line starting every frame, assuming frames carry no parameters of their own (encoders do not write
+/// any).
+constexpr size_t Y4M_FRAME_HEADER_SIZE = 6; // "FRAME\n"
+
+/// Parse the stream header at the start of `data`. Returns false if it is not a YUV4MPEG2 stream.
+bool parseY4mHeader(std::string_view data, Y4mFormat& format);
+
+/// Reads the frames of a 4:2:0 stream as RGBA8. Frames are located by offset in a memory mapping, so any frame can
+/// be read at any time, from several threads at once.
+class Y4mReader {
+public:
+	/// Throws std::runtime_error if the file cannot be mapped or is not a 4:2:0 YUV4MPEG2 stream.
+	explicit Y4mReader(const std::string& path);
+
+	const Y4mFormat& format() const { return m_format; }
+	int64_t frameCount() const { return m_frameCount; }
+
+	/// Throws std::out_of_range for frames past the end and std::runtime_error for malformed ones.
+	DecodedFrame readFrame(int64_t index) const;
+
+private:
+	MappedFile m_file;
+	Y4mFormat m_format;
+	int64_t m_frameCount = 0;
+};
+
+/// Writes a 4:2:0 full-range stream.
+class Y4mWriter {
+public:
+	/// Throws std::runtime_error if the file cannot be created.
+	Y4mWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t frameRateNumerator, uint32_t frameRateDenominator);
+
+	/// Append a frame of planes as produced by rgbaToI420(). Throws std::runtime_error on write errors.
+	void writeFrame(const std::vector<uint8_t>& planes);
+	/// Flush and close the file. Throws std::runtime_error if anything failed to reach it.
+	void finish();
+
+private:
+	std::ofstream m_file;
+	size_t m_frameSize;
+};
+
+/// Convert an RGBA8 frame with even dimensions to full-range BT.601 I420 planes (Y, then U, then V), averaging
+/// chroma over 2×2 blocks. Alpha is dropped.
+void rgbaToI420(const DecodedFrame& frame, std::vector<uint8_t>& planes);